@@ -0,0 +1,844 @@
+/*
+* The Sleuth Kit
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test the ext4 group, bitmap, extent tree, directory index and journal
+ * handling on a small file system that is built in memory */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk/fs/tsk_ext2fs.h"
+#include "tsk_test_img.h"
+
+#include <string>
+#include <vector>
+
+static TskTestImg s_img("ext4_apis.dd");
+
+/* 1 KiB blocks and 4 groups of 1024 blocks in one flex group.  Block 0 is
+ * the boot block, block 1 the superblock and block 2 the group
+ * descriptors. */
+#define EXT4_TEST_BSIZE     1024
+#define EXT4_TEST_BLOCKS    4096
+#define EXT4_TEST_BPG       1024
+#define EXT4_TEST_GROUPS    4
+#define EXT4_TEST_IPG       64
+#define EXT4_TEST_ISIZE     256
+#define EXT4_TEST_ITABLE_LEN (EXT4_TEST_IPG * EXT4_TEST_ISIZE / EXT4_TEST_BSIZE)
+
+/* The bitmaps and inode tables of all groups follow each other in group 0 */
+#define EXT4_TEST_BMAP(g)   (3 + (g))
+#define EXT4_TEST_IMAP(g)   (3 + EXT4_TEST_GROUPS + (g))
+#define EXT4_TEST_ITABLE(g) (3 + 2 * EXT4_TEST_GROUPS + \
+    (g) * EXT4_TEST_ITABLE_LEN)
+#define EXT4_TEST_META_END  EXT4_TEST_ITABLE(EXT4_TEST_GROUPS)
+
+/* The journal is inode 8 and its blocks follow each other in group 2 */
+#define EXT4_TEST_JINUM     8
+#define EXT4_TEST_JSTART    (2 * EXT4_TEST_BPG + 1)
+#define EXT4_TEST_JBLOCKS   64
+
+
+/* The journal is big endian */
+static void
+put_be32(std::vector<uint8_t> &a_buf, size_t a_off, uint32_t a_val)
+{
+    for (int i = 0; i < 4; i++)
+        a_buf[a_off + i] = (a_val >> (8 * (3 - i))) & 0xff;
+}
+
+class Ext4Image {
+public:
+    Ext4Image() : m_img((size_t) EXT4_TEST_BLOCKS * EXT4_TEST_BSIZE, 0) {
+        size_t sb = EXT4_TEST_BSIZE;
+
+        put_u32(m_img, sb + 0, EXT4_TEST_GROUPS * EXT4_TEST_IPG);
+        put_u32(m_img, sb + 4, EXT4_TEST_BLOCKS);
+        put_u32(m_img, sb + 20, 1);     // first data block
+        put_u32(m_img, sb + 32, EXT4_TEST_BPG);
+        put_u32(m_img, sb + 36, EXT4_TEST_BPG);
+        put_u32(m_img, sb + 40, EXT4_TEST_IPG);
+        put_u16(m_img, sb + 56, EXT2FS_FS_MAGIC);
+        put_u32(m_img, sb + 76, 1);     // dynamic revision
+        put_u32(m_img, sb + 84, 11);    // first inode
+        put_u16(m_img, sb + 88, EXT4_TEST_ISIZE);
+        put_u32(m_img, sb + 96, EXT2FS_FEATURE_INCOMPAT_FILETYPE |
+            EXT2FS_FEATURE_INCOMPAT_EXTENTS |
+            EXT2FS_FEATURE_INCOMPAT_FLEX_BG);
+        put_u32(m_img, sb + 100, EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM);
+        put_u16(m_img, sb + 254, 32);   // descriptor size
+        m_img[sb + 372] = 2;            // 4 groups per flex group
+
+        for (uint32_t g = 0; g < EXT4_TEST_GROUPS; g++) {
+            size_t gd = 2 * EXT4_TEST_BSIZE + g * 32;
+            put_u32(m_img, gd + 0, EXT4_TEST_BMAP(g));
+            put_u32(m_img, gd + 4, EXT4_TEST_IMAP(g));
+            put_u32(m_img, gd + 8, EXT4_TEST_ITABLE(g));
+        }
+
+        for (uint32_t blk = 1; blk < EXT4_TEST_META_END; blk++)
+            setBlockAlloc(blk);
+    }
+
+    /* Mark a block as allocated in the block bitmap of its group */
+    void setBlockAlloc(uint32_t a_blk) {
+        uint32_t g = (a_blk - 1) / EXT4_TEST_BPG;
+        uint32_t bit = (a_blk - 1) % EXT4_TEST_BPG;
+        m_img[(size_t) EXT4_TEST_BMAP(g) * EXT4_TEST_BSIZE + bit / 8] |=
+            1 << (bit % 8);
+    }
+
+    /* Set the flags and the count of never used inodes at the end of the
+     * inode table of a group */
+    void setGroupUnused(uint32_t a_grp, uint16_t a_flags, uint16_t a_unused) {
+        size_t gd = 2 * EXT4_TEST_BSIZE + a_grp * 32;
+        put_u16(m_img, gd + 18, a_flags);
+        put_u16(m_img, gd + 28, a_unused);
+    }
+
+    /* Mark an inode as allocated in the inode bitmap of its group */
+    void setInodeAlloc(uint32_t a_inum) {
+        uint32_t g = (a_inum - 1) / EXT4_TEST_IPG;
+        uint32_t bit = (a_inum - 1) % EXT4_TEST_IPG;
+        m_img[(size_t) EXT4_TEST_IMAP(g) * EXT4_TEST_BSIZE + bit / 8] |=
+            1 << (bit % 8);
+    }
+
+    /* Write an inode in the inode table, a regular file by default */
+    void setInode(uint32_t a_inum, uint32_t a_size,
+        uint16_t a_mode = 0x81a4) {
+        size_t off = inodeOffset(a_inum);
+        put_u16(m_img, off + 0, a_mode);
+        put_u32(m_img, off + 4, a_size);
+        put_u16(m_img, off + 26, 1);
+    }
+
+    void setInodeFlags(uint32_t a_inum, uint32_t a_flags) {
+        put_u32(m_img, inodeOffset(a_inum) + 32, a_flags);
+    }
+
+    /* Write an inode whose extent tree root in the inode has depth
+     * a_depth, and return the offset of its first entry */
+    size_t setExtentInode(uint32_t a_inum, uint32_t a_size,
+        uint16_t a_depth, uint16_t a_entries, uint16_t a_mode = 0x81a4) {
+        size_t off = inodeOffset(a_inum);
+
+        setInode(a_inum, a_size, a_mode);
+        setInodeFlags(a_inum, EXT2_IN_EXTENTS);
+        putExtentHeader(off + 40, a_entries, 4, a_depth);
+        return off + 40 + sizeof(ext2fs_extent_header);
+    }
+
+    /* Write an extent tree block with depth a_depth, and return the offset
+     * of its first entry */
+    size_t setExtentBlock(uint32_t a_blk, uint16_t a_depth,
+        uint16_t a_entries) {
+        size_t off = (size_t) a_blk * EXT4_TEST_BSIZE;
+
+        setBlockAlloc(a_blk);
+        putExtentHeader(off, a_entries,
+            (EXT4_TEST_BSIZE - sizeof(ext2fs_extent_header)) / 12,
+            a_depth);
+        return off + sizeof(ext2fs_extent_header);
+    }
+
+    /* Write an index entry that points to the tree block a_child and
+     * return the offset of the next entry */
+    size_t putExtentIdx(size_t a_off, uint32_t a_lblk, uint32_t a_child) {
+        put_u32(m_img, a_off, a_lblk);
+        put_u32(m_img, a_off + 4, a_child);
+        return a_off + sizeof(ext2fs_extent_idx);
+    }
+
+    /* Write a leaf entry and fill its blocks with their file block number,
+     * and return the offset of the next entry */
+    size_t putExtent(size_t a_off, uint32_t a_lblk, uint16_t a_len,
+        uint32_t a_start) {
+        put_u32(m_img, a_off, a_lblk);
+        put_u16(m_img, a_off + 4, a_len);
+        put_u32(m_img, a_off + 8, a_start);
+        for (uint32_t b = 0; b < a_len; b++) {
+            setBlockAlloc(a_start + b);
+            memset(&m_img[(size_t) (a_start + b) * EXT4_TEST_BSIZE],
+                (int) (a_lblk + b + 1), EXT4_TEST_BSIZE);
+        }
+        return a_off + sizeof(ext2fs_extent);
+    }
+
+    /* Add an empty journal in inode 8, with sequence a_seq at the start of
+     * the log */
+    void setJournal(uint32_t a_seq) {
+        size_t sb = EXT4_TEST_BSIZE;
+        size_t off = (size_t) EXT4_TEST_ITABLE(0) * EXT4_TEST_BSIZE +
+            (EXT4_TEST_JINUM - 1) * EXT4_TEST_ISIZE;
+        size_t jsb = jblkOffset(0);
+
+        put_u32(m_img, sb + 92, EXT2FS_FEATURE_COMPAT_HAS_JOURNAL);
+        put_u32(m_img, sb + 224, EXT4_TEST_JINUM);
+
+        put_u16(m_img, off + 0, 0x8180);
+        put_u32(m_img, off + 4, EXT4_TEST_JBLOCKS * EXT4_TEST_BSIZE);
+        put_u16(m_img, off + 26, 1);
+        put_u32(m_img, off + 28, EXT4_TEST_JBLOCKS * EXT4_TEST_BSIZE / 512);
+        put_u32(m_img, off + 32, EXT2_IN_EXTENTS);
+        put_u16(m_img, off + 40, 0xf30a);       // extent header
+        put_u16(m_img, off + 42, 1);
+        put_u16(m_img, off + 44, 4);
+        put_u16(m_img, off + 56, EXT4_TEST_JBLOCKS);
+        put_u32(m_img, off + 60, EXT4_TEST_JSTART);
+        for (uint32_t b = 0; b < EXT4_TEST_JBLOCKS; b++)
+            setBlockAlloc(EXT4_TEST_JSTART + b);
+
+        setJHead(0, EXT2_J_ETYPE_SB2, 0);
+        put_be32(m_img, jsb + 12, EXT4_TEST_BSIZE);
+        put_be32(m_img, jsb + 16, EXT4_TEST_JBLOCKS);
+        put_be32(m_img, jsb + 20, 1);   // first log block
+        put_be32(m_img, jsb + 24, a_seq);
+        put_be32(m_img, jsb + 28, 1);   // log start
+        put_be32(m_img, jsb + 40, JBD2_FEATURE_INCOMPAT_REVOKE);
+    }
+
+    /* Write a descriptor block with the tags of a_cnt file system blocks,
+     * which must follow it, and return the next journal block */
+    uint32_t addJDesc(uint32_t a_jblk, uint32_t a_seq,
+        const uint32_t * a_fs_blks, size_t a_cnt) {
+        size_t off = jblkOffset(a_jblk) + sizeof(ext2fs_journ_head);
+
+        setJHead(a_jblk, EXT2_J_ETYPE_DESC, a_seq);
+        for (size_t i = 0; i < a_cnt; i++) {
+            uint32_t flags = (i ? EXT2_J_DENTRY_SAMEID : 0);
+            size_t data = jblkOffset(a_jblk + 1 + (uint32_t) i);
+
+            if (i + 1 == a_cnt)
+                flags |= EXT2_J_DENTRY_LAST;
+            // the copy is filled with its block and sequence, except that
+            // a copy that would start with the journal magic is escaped
+            for (size_t b = 0; b < EXT4_TEST_BSIZE; b++)
+                m_img[data + b] = (uint8_t) (a_fs_blks[i] + a_seq + b);
+            if (a_fs_blks[i] & 1) {
+                put_be32(m_img, data, 0);
+                flags |= EXT2_J_DENTRY_ESC;
+            }
+            put_be32(m_img, off, a_fs_blks[i]);
+            put_be32(m_img, off + 4, flags);
+            off += 8 + (i ? 0 : 16);
+        }
+        return a_jblk + 1 + (uint32_t) a_cnt;
+    }
+
+    /* Write a revoke block for a_cnt file system blocks and return the
+     * next journal block */
+    uint32_t addJRevoke(uint32_t a_jblk, uint32_t a_seq,
+        const uint32_t * a_fs_blks, size_t a_cnt) {
+        size_t off = jblkOffset(a_jblk);
+
+        setJHead(a_jblk, EXT2_J_ETYPE_REV, a_seq);
+        put_be32(m_img, off + 12, (uint32_t) (16 + 4 * a_cnt));
+        for (size_t i = 0; i < a_cnt; i++)
+            put_be32(m_img, off + 16 + 4 * i, a_fs_blks[i]);
+        return a_jblk + 1;
+    }
+
+    /* Write a commit block and return the next journal block */
+    uint32_t addJCommit(uint32_t a_jblk, uint32_t a_seq) {
+        setJHead(a_jblk, EXT2_J_ETYPE_COM, a_seq);
+        return a_jblk + 1;
+    }
+
+    /* Index directories, with the hash of their names on unsigned chars
+     * if a_unsigned */
+    void setDirIndex(bool a_unsigned) {
+        size_t sb = EXT4_TEST_BSIZE;
+
+        put_u32(m_img, sb + 92, EXT2FS_FEATURE_COMPAT_DIR_INDEX);
+        put_u32(m_img, sb + 352, a_unsigned ? EXT2_FLAGS_UNSIGNED_HASH : 0);
+    }
+
+    /* Write block 0 of an indexed directory: '.', '..' and a root with a
+     * single level whose entries point to directory blocks 1 and 2, split
+     * at hash a_split */
+    void setDxRoot(uint32_t a_blk, uint32_t a_dir_inum, uint8_t a_version,
+        uint32_t a_split) {
+        size_t off = (size_t) a_blk * EXT4_TEST_BSIZE;
+
+        memset(&m_img[off], 0, EXT4_TEST_BSIZE);
+        putDirent(off, a_dir_inum, 12, ".", EXT2_DE_DIR);
+        putDirent(off + 12, 2, EXT4_TEST_BSIZE - 12, "..", EXT2_DE_DIR);
+        off += EXT2_DX_ROOT_INFO_OFF;
+        m_img[off + 4] = a_version;
+        m_img[off + 5] = sizeof(ext2fs_dx_root_info);
+        off += sizeof(ext2fs_dx_root_info);
+        put_u16(m_img, off, (EXT4_TEST_BSIZE - EXT2_DX_ROOT_INFO_OFF -
+                sizeof(ext2fs_dx_root_info)) / sizeof(ext2fs_dx_entry));
+        put_u16(m_img, off + 2, 2);
+        put_u32(m_img, off + 4, 1);
+        put_u32(m_img, off + 8, a_split);
+        put_u32(m_img, off + 12, 2);
+    }
+
+    /* Write a directory block with regular files a_names, which get the
+     * inodes from a_first_inum on */
+    void setDirLeaf(uint32_t a_blk, const std::vector<std::string> &a_names,
+        uint32_t a_first_inum) {
+        size_t off = (size_t) a_blk * EXT4_TEST_BSIZE;
+        size_t end = off + EXT4_TEST_BSIZE;
+
+        memset(&m_img[off], 0, EXT4_TEST_BSIZE);
+        if (a_names.empty())
+            put_u16(m_img, off + 4, EXT4_TEST_BSIZE);
+        for (size_t i = 0; i < a_names.size(); i++) {
+            uint16_t len = (uint16_t) ((8 + a_names[i].size() + 3) & ~3);
+            if (i + 1 == a_names.size())
+                len = (uint16_t) (end - off);
+            putDirent(off, a_first_inum + (uint32_t) i, len,
+                a_names[i].c_str(), EXT2_DE_REG);
+            off += len;
+        }
+    }
+
+    /* Write the image, cut after a_len bytes if not 0 */
+    int write(const TskTestImg & a_file, size_t a_len = 0) const {
+        return a_file.write(m_img, a_len);
+    }
+
+    std::vector<uint8_t> m_img;
+
+private:
+    size_t inodeOffset(uint32_t a_inum) const {
+        return (size_t) EXT4_TEST_ITABLE((a_inum - 1) / EXT4_TEST_IPG) *
+            EXT4_TEST_BSIZE +
+            (size_t) ((a_inum - 1) % EXT4_TEST_IPG) * EXT4_TEST_ISIZE;
+    }
+
+    void putDirent(size_t a_off, uint32_t a_inum, uint16_t a_rec_len,
+        const char *a_name, uint8_t a_type) {
+        put_u32(m_img, a_off, a_inum);
+        put_u16(m_img, a_off + 4, a_rec_len);
+        m_img[a_off + 6] = (uint8_t) strlen(a_name);
+        m_img[a_off + 7] = a_type;
+        memcpy(&m_img[a_off + 8], a_name, strlen(a_name));
+    }
+
+    void putExtentHeader(size_t a_off, uint16_t a_entries, uint16_t a_max,
+        uint16_t a_depth) {
+        put_u16(m_img, a_off, 0xf30a);
+        put_u16(m_img, a_off + 2, a_entries);
+        put_u16(m_img, a_off + 4, a_max);
+        put_u16(m_img, a_off + 6, a_depth);
+    }
+
+    size_t jblkOffset(uint32_t a_jblk) const {
+        return (size_t) (EXT4_TEST_JSTART + a_jblk) * EXT4_TEST_BSIZE;
+    }
+
+    void setJHead(uint32_t a_jblk, uint32_t a_type, uint32_t a_seq) {
+        size_t off = jblkOffset(a_jblk);
+        put_be32(m_img, off, EXT2_JMAGIC);
+        put_be32(m_img, off + 4, a_type);
+        put_be32(m_img, off + 8, a_seq);
+    }
+};
+
+
+/* Check the flags of the blocks of group 0 and that its descriptor is the
+ * one that is loaded afterwards (as blkstat reports it) */
+static int
+check_group0_flags(TSK_FS_INFO * a_fs, const char *a_name)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) a_fs;
+
+    for (uint32_t blk = 1; blk < 2 * EXT4_TEST_META_END; blk++) {
+        int exp = (blk < EXT4_TEST_META_END || blk == 100) ?
+            TSK_FS_BLOCK_FLAG_ALLOC : TSK_FS_BLOCK_FLAG_UNALLOC;
+        int flags;
+
+        // the superblock, the descriptors and the group's own metadata
+        if ((blk <= EXT4_TEST_BMAP(0)) || (blk == EXT4_TEST_IMAP(0))
+            || ((blk >= EXT4_TEST_ITABLE(0))
+                && (blk < EXT4_TEST_ITABLE(1))))
+            exp |= TSK_FS_BLOCK_FLAG_META;
+        else
+            exp |= TSK_FS_BLOCK_FLAG_CONT;
+
+        flags = a_fs->block_getflags(a_fs, blk);
+        if (flags != exp) {
+            fprintf(stderr, "%s: block %" PRIu32 " has flags 0x%x instead "
+                "of 0x%x\n", a_name, blk, flags, exp);
+            return 1;
+        }
+        if (ext2fs->grp_num != 0) {
+            fprintf(stderr, "%s: group %" PRI_EXT2GRP " is loaded after "
+                "block %" PRIu32 "\n", a_name, ext2fs->grp_num, blk);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The block bitmaps of the flex group are read in one I/O, which loads
+ * the descriptors of the other groups.  The descriptor of the group that
+ * was asked for must be loaded again, also when the image is cut after
+ * the first bitmap and the bitmaps end up being read one at a time. */
+static int
+test_ext4_bitmap_groups()
+{
+    Ext4Image ext4;
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    int retval;
+
+    ext4.setBlockAlloc(100);
+    ext4.setBlockAlloc(EXT4_TEST_BPG + 10);
+
+    if (ext4.write(s_img))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_EXT_DETECT, &img)) == NULL)
+        return 1;
+    retval = check_group0_flags(fs, "full image");
+    if ((retval == 0)
+        && (fs->block_getflags(fs, EXT4_TEST_BPG + 10) !=
+            (TSK_FS_BLOCK_FLAG_ALLOC | TSK_FS_BLOCK_FLAG_CONT))) {
+        fprintf(stderr, "full image: block in group 1 is not allocated\n");
+        retval = 1;
+    }
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    if (retval)
+        return 1;
+
+    if (ext4.write(s_img,
+            (size_t) (EXT4_TEST_BMAP(0) + 1) * EXT4_TEST_BSIZE))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_EXT_DETECT, &img)) == NULL)
+        return 1;
+    retval = check_group0_flags(fs, "truncated image");
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+/* What the inode walk saw */
+typedef struct {
+    std::vector<TSK_OFF_T> sizes;       // by inode number
+    std::vector<int> modes;
+} EXT4_TEST_INODES;
+
+static TSK_WALK_RET_ENUM
+inode_walk_cb(TSK_FS_FILE * a_file, void *a_ptr)
+{
+    EXT4_TEST_INODES *inodes = (EXT4_TEST_INODES *) a_ptr;
+
+    if (a_file->meta->addr < inodes->sizes.size()) {
+        inodes->sizes[a_file->meta->addr] = a_file->meta->size;
+        inodes->modes[a_file->meta->addr] = a_file->meta->mode;
+    }
+    return TSK_WALK_CONT;
+}
+
+/* Inodes past bg_itable_unused have never been used, so the inode walk
+ * and the lookup of a single inode must both report them as empty even
+ * if the inode table holds old data there. */
+static int
+test_ext4_itable_unused()
+{
+    Ext4Image ext4;
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    EXT4_TEST_INODES inodes;
+    TSK_INUM_T first = EXT4_TEST_IPG + 1;
+    TSK_INUM_T last = 2 * EXT4_TEST_IPG;
+    TSK_INUM_T used = first + 4;
+    TSK_INUM_T stale = first + 40;
+    int retval = 1;
+
+    ext4.setGroupUnused(1, EXT4_BG_INODE_ZEROED, EXT4_TEST_IPG - 32);
+    ext4.setInode((uint32_t) used, 777);
+    ext4.setInode((uint32_t) stale, 12345);
+
+    if (ext4.write(s_img))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_EXT_DETECT, &img)) == NULL)
+        return 1;
+
+    inodes.sizes.assign((size_t) last + 1, -1);
+    inodes.modes.assign((size_t) last + 1, -1);
+    if (tsk_fs_meta_walk(fs, first, last, (TSK_FS_META_FLAG_ENUM) 0,
+            inode_walk_cb, &inodes)) {
+        tsk_error_print(stderr);
+        goto end;
+    }
+
+    for (TSK_INUM_T inum = first; inum <= last; inum++) {
+        TSK_FS_FILE *file = tsk_fs_file_open_meta(fs, NULL, inum);
+        TSK_OFF_T exp = (inum == used) ? 777 : 0;
+
+        if (file == NULL) {
+            fprintf(stderr, "Error opening inode %" PRIuINUM ": ", inum);
+            tsk_error_print(stderr);
+            goto end;
+        }
+        if ((file->meta->size != exp) || (inodes.sizes[inum] != exp)
+            || (file->meta->mode != inodes.modes[inum])) {
+            fprintf(stderr, "inode %" PRIuINUM ": size %" PRIdOFF
+                " mode 0%o, inode walk size %" PRIdOFF " mode 0%o\n",
+                inum, file->meta->size, file->meta->mode,
+                inodes.sizes[inum], inodes.modes[inum]);
+            tsk_fs_file_close(file);
+            goto end;
+        }
+        tsk_fs_file_close(file);
+    }
+    retval = 0;
+
+  end:
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+/* A file whose extent tree has depth 2 has more than one tree block.  The
+ * tree blocks are the runs of the extent attribute in walk order, and the
+ * data of the file is in the order of the leaves. */
+static int
+test_ext4_extent_tree()
+{
+    Ext4Image ext4;
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    TSK_FS_FILE *file = NULL;
+    const TSK_FS_ATTR *attr;
+    const TSK_FS_ATTR_RUN *run;
+    const uint32_t inum = 12;
+    const uint32_t tree[] = { 1100, 1101, 1102 };
+    const uint32_t nblocks = 6;
+    std::vector<uint8_t> buf((size_t) nblocks * EXT4_TEST_BSIZE);
+    size_t off;
+    int retval = 1;
+
+    // the index block below the root points to two leaves, which map
+    // the file blocks out of order on disk
+    off = ext4.setExtentInode(inum, nblocks * EXT4_TEST_BSIZE, 2, 1);
+    ext4.putExtentIdx(off, 0, tree[0]);
+    off = ext4.setExtentBlock(tree[0], 1, 2);
+    off = ext4.putExtentIdx(off, 0, tree[1]);
+    ext4.putExtentIdx(off, 3, tree[2]);
+    off = ext4.setExtentBlock(tree[1], 0, 2);
+    off = ext4.putExtent(off, 0, 2, 1400);
+    ext4.putExtent(off, 2, 1, 1200);
+    off = ext4.setExtentBlock(tree[2], 0, 1);
+    ext4.putExtent(off, 3, 3, 1300);
+
+    if (ext4.write(s_img))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_EXT_DETECT, &img)) == NULL)
+        return 1;
+
+    if ((file = tsk_fs_file_open_meta(fs, NULL, inum)) == NULL) {
+        fprintf(stderr, "Error opening inode %" PRIu32 ": ", inum);
+        tsk_error_print(stderr);
+        goto end;
+    }
+    if (tsk_fs_file_read(file, 0, (char *) &buf[0], buf.size(),
+            TSK_FS_FILE_READ_FLAG_NONE) != (ssize_t) buf.size()) {
+        fprintf(stderr, "Error reading inode %" PRIu32 ": ", inum);
+        tsk_error_print(stderr);
+        goto end;
+    }
+    for (size_t i = 0; i < buf.size(); i++) {
+        if (buf[i] != (uint8_t) (i / EXT4_TEST_BSIZE + 1)) {
+            fprintf(stderr, "inode %" PRIu32 ": wrong data at offset %"
+                PRIuSIZE "\n", inum, i);
+            goto end;
+        }
+    }
+
+    if ((attr = tsk_fs_file_attr_get_type(file,
+                TSK_FS_ATTR_TYPE_UNIX_EXTENT, 0, 0)) == NULL) {
+        tsk_error_print(stderr);
+        goto end;
+    }
+    if (attr->size != 3 * EXT4_TEST_BSIZE) {
+        fprintf(stderr, "extent attribute has size %" PRIdOFF "\n",
+            attr->size);
+        goto end;
+    }
+    run = attr->nrd.run;
+    for (size_t i = 0; i < 3; i++, run = run->next) {
+        if ((run == NULL) || (run->offset != i) || (run->len != 1)
+            || (run->addr != tree[i])) {
+            fprintf(stderr, "extent attribute run %" PRIuSIZE
+                " is wrong\n", i);
+            goto end;
+        }
+    }
+    if (run != NULL) {
+        fprintf(stderr, "extent attribute has too many runs\n");
+        goto end;
+    }
+    retval = 0;
+
+  end:
+    tsk_fs_file_close(file);
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+/* Names and their hashes for each hash version, from "dx_hash -h <version>"
+ * of e2fsprogs' debugfs with the default seed.  The names with bytes above
+ * 0x7f hash differently on signed and unsigned chars, and the long one
+ * takes more than one round of each hash. */
+typedef struct {
+    const char *name;
+    uint32_t hash[2 * EXT2_DX_HASH_UNSIGNED];
+} EXT4_TEST_DX_HASH;
+
+static const EXT4_TEST_DX_HASH s_dx_hashes[] = {
+    {"lost+found", {0x5e2aba24, 0x591de422, 0x2dbf9e80,
+            0x5e2aba24, 0x591de422, 0x2dbf9e80}},
+    {"caf\xc3\xa9", {0x96ca5a2c, 0xfb9c5e5c, 0x105842ea,
+            0x6dde4230, 0x9d72aed6, 0x6621f032}},
+    {"\xc3\xa9t\xc3\xa9_2024_photos_from_the_summer_holiday.jpg",
+            {0x09b69390, 0xb86695fa, 0x1cdafdf0,
+            0x4ba57284, 0x7aa5a97e, 0x94e8ce5a}},
+};
+
+/* Names of an indexed directory are looked up by reading the root and the
+ * one leaf their hash falls in.  For each hash version, the directory has
+ * the names with a hash below 0x80000000 in its first leaf and the others
+ * in the second one, so a wrong hash finds the wrong leaf. */
+static int
+test_ext4_dir_index()
+{
+    const size_t nnames = sizeof(s_dx_hashes) / sizeof(s_dx_hashes[0]);
+    const uint32_t dir_inum = 12;
+    const uint32_t split = 0x80000000;
+
+    for (uint8_t version = 0; version < 2 * EXT2_DX_HASH_UNSIGNED;
+        version++) {
+        Ext4Image ext4;
+        TSK_IMG_INFO *img;
+        TSK_FS_INFO *fs;
+        std::vector<std::string> leaves[2];
+        size_t off;
+        int retval = 1;
+
+        for (size_t i = 0; i < nnames; i++)
+            leaves[s_dx_hashes[i].hash[version] >= split].push_back(
+                s_dx_hashes[i].name);
+
+        ext4.setDirIndex(version >= EXT2_DX_HASH_UNSIGNED);
+        off = ext4.setExtentInode(dir_inum, 3 * EXT4_TEST_BSIZE, 0, 1,
+            0x41ed);
+        ext4.putExtent(off, 0, 3, 1500);
+        ext4.setInodeFlags(dir_inum, EXT2_IN_EXTENTS | EXT2_IN_INDEX);
+        ext4.setInodeAlloc(dir_inum);
+        ext4.setDxRoot(1500, dir_inum,
+            version % EXT2_DX_HASH_UNSIGNED, split);
+        ext4.setDirLeaf(1501, leaves[0], 20);
+        ext4.setDirLeaf(1502, leaves[1], 30);
+
+        if (ext4.write(s_img))
+            return 1;
+        if ((fs = s_img.openFs(TSK_FS_TYPE_EXT_DETECT, &img)) == NULL)
+            return 1;
+
+        for (size_t i = 0; i < nnames; i++) {
+            const char *name = s_dx_hashes[i].name;
+            size_t leaf = (s_dx_hashes[i].hash[version] >= split);
+            uint32_t hash;
+            TSK_FS_DIR *dir;
+            size_t cnt;
+
+            if (ext2fs_dx_hash((EXT2FS_INFO *) fs, version, name, &hash)
+                || (hash != s_dx_hashes[i].hash[version])) {
+                fprintf(stderr, "hash version %d of %s is 0x%08" PRIx32
+                    " instead of 0x%08" PRIx32 "\n", version, name, hash,
+                    s_dx_hashes[i].hash[version]);
+                goto end;
+            }
+
+            // only the names of the leaf are read
+            if ((dir = ext2fs_dir_open_name(fs, dir_inum, name)) == NULL) {
+                fprintf(stderr, "hash version %d: %s is not found in the "
+                    "index\n", version, name);
+                goto end;
+            }
+            cnt = tsk_fs_dir_getsize(dir);
+            tsk_fs_dir_close(dir);
+            if (cnt != leaves[leaf].size()) {
+                fprintf(stderr, "hash version %d: lookup of %s returned %"
+                    PRIuSIZE " names\n", version, name, cnt);
+                goto end;
+            }
+        }
+        if (ext2fs_dir_open_name(fs, dir_inum, "not_there") != NULL) {
+            fprintf(stderr, "hash version %d: a missing name was found\n",
+                version);
+            goto end;
+        }
+        retval = 0;
+
+      end:
+        tsk_fs_close(fs);
+        tsk_img_close(img);
+        if (retval)
+            return 1;
+    }
+    return 0;
+}
+
+/* Expected copy of a file system block in the journal */
+typedef struct {
+    uint32_t fs_blk;
+    uint32_t seq;
+    uint32_t flags;
+} EXT4_TEST_JCOPY;
+
+/* Check the copies of a block and their contents */
+static int
+check_jcopies(TSK_FS_INFO * a_fs, uint32_t a_fs_blk,
+    const EXT4_TEST_JCOPY * a_exp, size_t a_exp_cnt)
+{
+    const EXT2FS_JBLK_COPY *copies;
+    size_t cnt;
+    std::vector<uint8_t> buf(EXT4_TEST_BSIZE);
+
+    if (ext2fs_jindex_find(a_fs, a_fs_blk, &copies, &cnt)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if (cnt != a_exp_cnt) {
+        fprintf(stderr, "block %" PRIu32 " has %" PRIuSIZE " copies\n",
+            a_fs_blk, cnt);
+        return 1;
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+        if ((copies[i].fs_blk != a_fs_blk)
+            || (copies[i].seq != a_exp[i].seq)
+            || (copies[i].flags != a_exp[i].flags)) {
+            fprintf(stderr, "block %" PRIu32 " copy %" PRIuSIZE
+                ": seq %" PRIu32 " flags 0x%" PRIx32 " instead of seq %"
+                PRIu32 " flags 0x%" PRIx32 "\n", a_fs_blk, i,
+                copies[i].seq, copies[i].flags, a_exp[i].seq,
+                a_exp[i].flags);
+            return 1;
+        }
+        if (ext2fs_jblk_copy_read(a_fs, &copies[i], (char *) &buf[0],
+                buf.size()) != (ssize_t) buf.size()) {
+            tsk_error_print(stderr);
+            return 1;
+        }
+        for (size_t b = (a_fs_blk & 1) ? 4 : 0; b < buf.size(); b++) {
+            if (buf[b] != (uint8_t) (a_fs_blk + copies[i].seq + b)) {
+                fprintf(stderr, "block %" PRIu32 " copy %" PRIuSIZE
+                    ": wrong data at offset %" PRIuSIZE "\n", a_fs_blk, i,
+                    b);
+                return 1;
+            }
+        }
+        if ((a_fs_blk & 1) && ((buf[0] != 0xc0) || (buf[1] != 0x3b)
+                || (buf[2] != 0x39) || (buf[3] != 0x98))) {
+            fprintf(stderr, "block %" PRIu32 " copy %" PRIuSIZE
+                ": escaped magic was not restored\n", a_fs_blk, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* A block that is revoked by a committed transaction must be reported as
+ * revoked in the older transactions only.  A revoke block without a commit
+ * block must be ignored. */
+static int
+test_ext4_journal_revoke()
+{
+    Ext4Image ext4;
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    const uint32_t blks10[] = { 500, 601 };
+    const uint32_t blks12[] = { 500 };
+    const uint32_t revoke11[] = { 500, 700 };
+    const uint32_t revoke13[] = { 601 };
+    const uint32_t valid = EXT2FS_JBLK_COPY_ALLOC | EXT2FS_JBLK_COPY_COMMIT;
+    const EXT4_TEST_JCOPY exp500[] = {
+        {500, 10, valid | EXT2FS_JBLK_COPY_REVOKED},
+        {500, 12, valid},
+    };
+    const EXT4_TEST_JCOPY exp601[] = {
+        {601, 10, valid | EXT2FS_JBLK_COPY_ESC},
+    };
+    uint32_t jblk = 1;
+    int retval = 1;
+
+    ext4.setJournal(10);
+    jblk = ext4.addJDesc(jblk, 10, blks10, 2);
+    jblk = ext4.addJCommit(jblk, 10);
+    jblk = ext4.addJRevoke(jblk, 11, revoke11, 2);
+    jblk = ext4.addJCommit(jblk, 11);
+    jblk = ext4.addJDesc(jblk, 12, blks12, 1);
+    jblk = ext4.addJCommit(jblk, 12);
+    jblk = ext4.addJRevoke(jblk, 13, revoke13, 1);
+
+    if (ext4.write(s_img))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_EXT_DETECT, &img)) == NULL)
+        return 1;
+
+    if (fs->journ_inum != EXT4_TEST_JINUM) {
+        fprintf(stderr, "journal inode is %" PRIuINUM "\n", fs->journ_inum);
+        goto end;
+    }
+    if (fs->jopen(fs, fs->journ_inum)) {
+        tsk_error_print(stderr);
+        goto end;
+    }
+    if (check_jcopies(fs, 500, exp500, 2)
+        || check_jcopies(fs, 601, exp601, 1)
+        || check_jcopies(fs, 700, NULL, 0))
+        goto end;
+
+    retval = 0;
+
+  end:
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    if (test_ext4_bitmap_groups()) {
+        fprintf(stderr, "ext4 bitmap group failure\n");
+        retval = 1;
+    }
+    else if (test_ext4_itable_unused()) {
+        fprintf(stderr, "ext4 unused inode table failure\n");
+        retval = 1;
+    }
+    else if (test_ext4_extent_tree()) {
+        fprintf(stderr, "ext4 extent tree failure\n");
+        retval = 1;
+    }
+    else if (test_ext4_dir_index()) {
+        fprintf(stderr, "ext4 directory index failure\n");
+        retval = 1;
+    }
+    else if (test_ext4_journal_revoke()) {
+        fprintf(stderr, "ext4 journal revoke failure\n");
+        retval = 1;
+    }
+
+
+    if (retval == 0)
+        printf("Tests Passed\n");
+    return retval;
+}
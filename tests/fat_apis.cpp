@@ -0,0 +1,282 @@
+/*
+* The Sleuth Kit
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test the decoding of the FAT of a FAT12 file system that is built in
+ * memory, with the entries read one at a time and from the table that is
+ * loaded when the file system is opened */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk/fs/tsk_fatfs.h"
+#include "tsk_test_img.h"
+
+#include <vector>
+
+static TskTestImg s_img("fat_apis.dd");
+
+/* 1.44 MB floppy layout */
+#define FAT_TEST_SSIZE      512
+#define FAT_TEST_SECTORS    2880
+#define FAT_TEST_SECTPERFAT 9
+#define FAT_TEST_NUMROOT    224
+#define FAT_TEST_FIRSTCLUST (1 + 2 * FAT_TEST_SECTPERFAT + \
+    FAT_TEST_NUMROOT * 32 / FAT_TEST_SSIZE)
+#define FAT_TEST_LASTCLUST  (1 + FAT_TEST_SECTORS - FAT_TEST_FIRSTCLUST)
+
+
+/* Value that is stored in a FAT entry */
+static uint16_t
+fat_test_stored(uint32_t a_clust)
+{
+    if (a_clust == 0)
+        return 0xff0;
+    else if (a_clust == 1)
+        return 0xfff;
+    else if (a_clust % 5 == 0)
+        return 0;
+    else if (a_clust % 7 == 0)
+        return 0xfff;
+    else if (a_clust % 11 == 0)
+        return 0xf00;           // past the last cluster
+    else if (a_clust % 13 == 0)
+        return 0xff7;
+    return (uint16_t) ((a_clust * 37) % (FAT_TEST_LASTCLUST - 1) + 2);
+}
+
+/* Value that TSK must report for a FAT entry */
+static TSK_DADDR_T
+fat_test_expected(uint32_t a_clust)
+{
+    uint16_t value = fat_test_stored(a_clust);
+
+    if ((value > FAT_TEST_LASTCLUST) && (value < 0xff7))
+        return 0;
+    return value;
+}
+
+/* Write the image, cut after a_len bytes if not 0 */
+static int
+write_fat12_image(size_t a_len)
+{
+    std::vector<uint8_t> img((size_t) FAT_TEST_SECTORS * FAT_TEST_SSIZE, 0);
+
+    img[0] = 0xeb;
+    img[1] = 0x3c;
+    img[2] = 0x90;
+    memcpy(&img[3], "MSDOS5.0", 8);
+    put_u16(img, 11, FAT_TEST_SSIZE);
+    img[13] = 1;                // sectors per cluster
+    put_u16(img, 14, 1);        // reserved sectors
+    img[16] = 2;                // number of FATs
+    put_u16(img, 17, FAT_TEST_NUMROOT);
+    put_u16(img, 19, FAT_TEST_SECTORS);
+    img[21] = 0xf0;
+    put_u16(img, 22, FAT_TEST_SECTPERFAT);
+    put_u16(img, 24, 18);
+    put_u16(img, 26, 2);
+    img[38] = 0x29;
+    memcpy(&img[43], "NO NAME    FAT12   ", 19);
+    img[510] = 0x55;
+    img[511] = 0xaa;
+
+    /* Two 12-bit entries are packed in each 3 bytes, the odd entry in the
+     * high 12 bits */
+    for (int fat = 0; fat < 2; fat++) {
+        size_t base = (size_t) (1 + fat * FAT_TEST_SECTPERFAT) *
+            FAT_TEST_SSIZE;
+        for (uint32_t clust = 0; clust <= FAT_TEST_LASTCLUST; clust++) {
+            size_t off = base + clust + (clust >> 1);
+            uint16_t value = fat_test_stored(clust);
+            if (clust & 1) {
+                img[off] = (img[off] & 0x0f) | ((value & 0x0f) << 4);
+                img[off + 1] = value >> 4;
+            }
+            else {
+                img[off] = value & 0xff;
+                img[off + 1] = (img[off + 1] & 0xf0) | (value >> 8);
+            }
+        }
+    }
+
+    return s_img.write(img, a_len);
+}
+
+/* Check the entries of clusters a_first to a_last with fatfs_getFAT() */
+static int
+check_entries(FATFS_INFO * a_fatfs, TSK_DADDR_T a_first, TSK_DADDR_T a_last,
+    const char *a_name)
+{
+    for (TSK_DADDR_T clust = a_first; clust <= a_last; clust++) {
+        TSK_DADDR_T value;
+
+        if (fatfs_getFAT(a_fatfs, clust, &value)) {
+            fprintf(stderr, "%s: error reading entry %" PRIuDADDR ": ",
+                a_name, clust);
+            tsk_error_print(stderr);
+            return 1;
+        }
+        if (value != fat_test_expected((uint32_t) clust)) {
+            fprintf(stderr, "%s: entry %" PRIuDADDR " is 0x%" PRIxDADDR
+                " instead of 0x%" PRIxDADDR "\n", a_name, clust, value,
+                fat_test_expected((uint32_t) clust));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* What the block walk saw */
+typedef struct {
+    size_t cnt;
+    int err;
+} FAT_TEST_WALK;
+
+static TSK_WALK_RET_ENUM
+block_walk_cb(const TSK_FS_BLOCK * a_block, void *a_ptr)
+{
+    FAT_TEST_WALK *walk = (FAT_TEST_WALK *) a_ptr;
+    TSK_DADDR_T clust;
+    int exp_alloc;
+
+    walk->cnt++;
+    if (a_block->addr < FAT_TEST_FIRSTCLUST)
+        return TSK_WALK_CONT;
+
+    clust = a_block->addr - FAT_TEST_FIRSTCLUST + 2;
+    exp_alloc = (fat_test_expected((uint32_t) clust) != 0);
+    if (((a_block->flags & TSK_FS_BLOCK_FLAG_ALLOC) != 0) != exp_alloc) {
+        fprintf(stderr, "sector %" PRIuDADDR " (cluster %" PRIuDADDR
+            ") has flags 0x%x\n", a_block->addr, clust, a_block->flags);
+        walk->err = 1;
+        return TSK_WALK_ERROR;
+    }
+    return TSK_WALK_CONT;
+}
+
+static int
+test_fat12_entries()
+{
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    FATFS_INFO *fatfs;
+    FAT_TEST_WALK walk;
+    TSK_DADDR_T table_cnt;
+    int cache_ret;
+    int retval = 1;
+
+    if (write_fat12_image(0))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_FAT12, &img)) == NULL)
+        return 1;
+    fatfs = (FATFS_INFO *) fs;
+
+    if (fatfs->lastclust != FAT_TEST_LASTCLUST) {
+        fprintf(stderr, "last cluster is %" PRIuDADDR "\n",
+            fatfs->lastclust);
+        goto end;
+    }
+
+    // the FAT is decoded at open
+    if ((fatfs->fat_table == NULL)
+        || (fatfs->fat_table_cnt != FAT_TEST_LASTCLUST + 1)) {
+        fprintf(stderr, "FAT table has %" PRIuDADDR " entries\n",
+            fatfs->fat_table_cnt);
+        goto end;
+    }
+    if (check_entries(fatfs, 0, FAT_TEST_LASTCLUST, "table"))
+        goto end;
+
+    // one entry at a time from the sector cache, including the entry that
+    // straddles the end of the first 4 KiB cache window
+    table_cnt = fatfs->fat_table_cnt;
+    fatfs->fat_table_cnt = 0;
+    cache_ret = check_entries(fatfs, 0, FAT_TEST_LASTCLUST, "cache");
+    fatfs->fat_table_cnt = table_cnt;
+    if (cache_ret)
+        goto end;
+
+    // the walk takes the allocation status from the table
+    memset(&walk, 0, sizeof(walk));
+    if (tsk_fs_block_walk(fs, fs->first_block, fs->last_block,
+            TSK_FS_BLOCK_WALK_FLAG_NONE, block_walk_cb, &walk)) {
+        if (walk.err == 0)
+            tsk_error_print(stderr);
+        goto end;
+    }
+    if (walk.cnt != FAT_TEST_SECTORS) {
+        fprintf(stderr, "block walk reported %" PRIuSIZE " sectors\n",
+            walk.cnt);
+        goto end;
+    }
+
+    retval = 0;
+
+  end:
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+/* The image ends inside of the FAT.  The table holds the entries that
+ * could be read and the others go through the cache, which fails. */
+static int
+test_fat12_truncated()
+{
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    FATFS_INFO *fatfs;
+    TSK_DADDR_T value;
+    size_t fat_bytes = 4 * FAT_TEST_SSIZE + 100;
+    int retval = 1;
+
+    if (write_fat12_image(FAT_TEST_SSIZE + fat_bytes))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_FAT12, &img)) == NULL)
+        return 1;
+    fatfs = (FATFS_INFO *) fs;
+
+    if ((fatfs->fat_table_cnt == 0)
+        || (fatfs->fat_table_cnt > fat_bytes * 2 / 3)) {
+        fprintf(stderr, "truncated FAT table has %" PRIuDADDR
+            " entries\n", fatfs->fat_table_cnt);
+        goto end;
+    }
+    if (check_entries(fatfs, 0, fatfs->fat_table_cnt - 1, "truncated"))
+        goto end;
+    if (fatfs_getFAT(fatfs, FAT_TEST_LASTCLUST, &value) == 0) {
+        fprintf(stderr, "read of the last entry did not fail\n");
+        goto end;
+    }
+    tsk_error_reset();
+
+    retval = 0;
+
+  end:
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    if (test_fat12_entries()) {
+        fprintf(stderr, "FAT12 entry failure\n");
+        retval = 1;
+    }
+    else if (test_fat12_truncated()) {
+        fprintf(stderr, "truncated FAT12 failure\n");
+        retval = 1;
+    }
+
+    if (retval == 0)
+        printf("Tests Passed\n");
+    return retval;
+}
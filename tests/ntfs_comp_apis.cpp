@@ -0,0 +1,402 @@
+/*
+* The Sleuth Kit
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test the NTFS decompression routines with known vectors: LZNT1 (the
+ * compression units of compressed files) and the XPRESS Huffman and LZX
+ * chunks of the files that are compressed by the Windows Overlay Filter */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk/fs/tsk_ntfs.h"
+
+#include <string>
+#include <vector>
+
+
+/* Fill a_buf with a_len bytes of words that are picked by an LCG
+ * (the vectors were compressed from the same data) */
+static void
+gen_words(unsigned char *a_buf, size_t a_len, uint32_t a_seed)
+{
+    static const char *words[8] = { "alpha ", "bravo ", "charlie ",
+        "delta ", "echo ", "foxtrot ", "golf ", "hotel "
+    };
+    uint32_t state = a_seed;
+    size_t i = 0;
+
+    while (i < a_len) {
+        state = (state * 1103515245u + 12345u) & 0x7fffffff;
+        for (const char *w = words[(state >> 16) & 7]; *w && i < a_len;
+            w++)
+            a_buf[i++] = (unsigned char) *w;
+    }
+}
+
+/* a_len bytes that repeat the first a_period bytes of gen_words() */
+static std::vector<unsigned char>
+gen_periodic(size_t a_len, size_t a_period, uint32_t a_seed)
+{
+    std::vector<unsigned char> period(a_period), data(a_len);
+
+    gen_words(&period[0], a_period, a_seed);
+    for (size_t i = 0; i < a_len; i++)
+        data[i] = period[i % a_period];
+    return data;
+}
+
+
+/*
+ * LZNT1
+ */
+
+/* Compressed sub-blocks of gen_periodic(4096, 300, 1) and
+ * gen_periodic(1000, 97, 3) */
+static const unsigned char s_lznt1_4k[434] = {
+    0xaf, 0xb1, 0x20, 0x67, 0x6f, 0x6c, 0x66, 0x20, 0x02, 0x40, 0x62, 0x72,
+    0x00, 0x61, 0x76, 0x6f, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x02, 0x61, 0x0a,
+    0x28, 0x63, 0x68, 0x61, 0x72, 0x6c, 0x69, 0x42, 0x65, 0x04, 0x34, 0x65,
+    0x63, 0x68, 0x6f, 0x03, 0xbc, 0x66, 0x00, 0x6f, 0x78, 0x74, 0x72, 0x6f,
+    0x74, 0x20, 0x68, 0xf0, 0x6f, 0x74, 0x65, 0x6c, 0x03, 0x2e, 0x02, 0x08,
+    0x03, 0x8e, 0x03, 0x2a, 0xff, 0x0f, 0x16, 0x07, 0xde, 0x05, 0xae, 0x03,
+    0x1d, 0x09, 0x05, 0x02, 0x1e, 0x09, 0x34, 0x05, 0x2a, 0xf0, 0x61, 0x6c,
+    0x70, 0x68, 0x04, 0x82, 0x0b, 0x18, 0x02, 0x31, 0x11, 0xb4, 0xff, 0x05,
+    0xa4, 0x03, 0x2e, 0x08, 0x3f, 0x02, 0x04, 0x0b, 0xc2, 0x08, 0x3e, 0x05,
+    0x0c, 0x0b, 0x26, 0xff, 0xff, 0x95, 0xff, 0x95, 0xff, 0x4a, 0xff, 0x4a,
+    0xff, 0x4a, 0xff, 0x4a, 0xff, 0x4a, 0xff, 0x4a, 0xff, 0xff, 0x4a, 0xff,
+    0x4a, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f,
+    0x25, 0xff, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25,
+    0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0xff, 0x7f, 0x25, 0x7f, 0x25, 0x7f,
+    0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0xff,
+    0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25, 0x7f, 0x25,
+    0x7f, 0x25, 0xbf, 0x12, 0xff, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf,
+    0x12, 0xbf, 0x12, 0xff, 0x11, 0xbf, 0x12, 0xbf, 0x12, 0xff, 0xbf, 0x12,
+    0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12,
+    0xbf, 0x12, 0xff, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf,
+    0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xff, 0xbf, 0x12, 0xbf, 0x12,
+    0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12,
+    0xff, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0x6f, 0x07, 0xbf, 0x12, 0xbf,
+    0x12, 0xbf, 0x12, 0xbf, 0x00, 0xff, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12,
+    0xbf, 0x12, 0xbf, 0x12, 0x4f, 0x0b, 0xbf, 0x12, 0xbf, 0x12, 0xff, 0xbf,
+    0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf,
+    0x12, 0xff, 0x11, 0xff, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12,
+    0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xff, 0xbf, 0x12, 0xbf,
+    0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf,
+    0x12, 0xff, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12,
+    0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xff, 0xbf, 0x12, 0xbf, 0x12, 0xbf,
+    0x12, 0xbf, 0x12, 0xbf, 0x12, 0x6f, 0x07, 0xbf, 0x12, 0xbf, 0x12, 0xff,
+    0xbf, 0x12, 0xbf, 0x00, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12,
+    0xbf, 0x12, 0x4f, 0x0b, 0xff, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf,
+    0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xff, 0xbf, 0x12,
+    0xff, 0x11, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12, 0xbf, 0x12,
+    0x83, 0x01,
+};
+
+static const unsigned char s_lznt1_1k[77] = {
+    0x4a, 0xb0, 0x40, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x20, 0x03, 0x50, 0x66,
+    0x00, 0x6f, 0x78, 0x74, 0x72, 0x6f, 0x74, 0x20, 0x61, 0x00, 0x6c, 0x70,
+    0x68, 0x61, 0x20, 0x67, 0x6f, 0x6c, 0x40, 0x66, 0x20, 0x65, 0x63, 0x68,
+    0x6f, 0x06, 0x5c, 0x68, 0xf0, 0x6f, 0x74, 0x65, 0x6c, 0x04, 0x74, 0x03,
+    0x2c, 0x05, 0x64, 0x02, 0x56, 0xe1, 0x05, 0x18, 0x62, 0x72, 0x61, 0x76,
+    0x07, 0x68, 0xff, 0xc1, 0x3f, 0x18, 0x1f, 0x3f, 0x18, 0x3f, 0x18, 0x3f,
+    0x18, 0x3f, 0x18, 0x38, 0x18,
+};
+
+/* "abcd" and a match of 100 bytes at offset 4 */
+static const unsigned char s_lznt1_run[] = {
+    0x06, 0xb0, 0x10, 0x61, 0x62, 0x63, 0x64, 0x61, 0x30
+};
+
+/* "a" and a match at offset 2, which is before the start of the data */
+static const unsigned char s_lznt1_bad_off[] = {
+    0x03, 0xb0, 0x02, 0x61, 0x00, 0x10
+};
+
+/* Expect ntfs_uncompress_buf() to fail */
+static int
+lznt1_fails(const unsigned char *a_in, size_t a_in_len, size_t a_out_size,
+    const char *a_name)
+{
+    std::vector<unsigned char> out(a_out_size);
+    size_t out_len;
+
+    if (ntfs_uncompress_buf(a_in, a_in_len, &out[0], a_out_size,
+            &out_len) == 0) {
+        fprintf(stderr, "LZNT1 %s: no error\n", a_name);
+        return 1;
+    }
+    tsk_error_reset();
+    return 0;
+}
+
+/* A compression unit with a compressed sub-block, a stored sub-block,
+ * a short compressed sub-block and the end of the data */
+static int
+test_lznt1_unit()
+{
+    const size_t unit_size = 16384;
+    std::vector<unsigned char> exp = gen_periodic(4096, 300, 1);
+    std::vector<unsigned char> raw(4096), last = gen_periodic(1000, 97, 3);
+    std::vector<unsigned char> unit, out(unit_size, 0xcc);
+    size_t out_len;
+
+    gen_words(&raw[0], raw.size(), 5);
+    exp.insert(exp.end(), raw.begin(), raw.end());
+    exp.insert(exp.end(), last.begin(), last.end());
+
+    unit.insert(unit.end(), s_lznt1_4k, s_lznt1_4k + sizeof(s_lznt1_4k));
+    unit.push_back(0xff);
+    unit.push_back(0x3f);
+    unit.insert(unit.end(), raw.begin(), raw.end());
+    unit.insert(unit.end(), s_lznt1_1k, s_lznt1_1k + sizeof(s_lznt1_1k));
+
+    // the unit ends with the data
+    if (ntfs_uncompress_buf(&unit[0], unit.size(), &out[0], unit_size,
+            &out_len)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if ((out_len != exp.size()) || memcmp(&out[0], &exp[0], out_len)) {
+        fprintf(stderr, "LZNT1 unit: wrong data (%" PRIuSIZE " bytes)\n",
+            out_len);
+        return 1;
+    }
+
+    // a 0 header fills the rest of the unit with 0s
+    unit.push_back(0);
+    unit.push_back(0);
+    memset(&out[0], 0xcc, unit_size);
+    if (ntfs_uncompress_buf(&unit[0], unit.size(), &out[0], unit_size,
+            &out_len)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if ((out_len != unit_size) || memcmp(&out[0], &exp[0], exp.size())) {
+        fprintf(stderr, "LZNT1 zero filled unit: wrong data\n");
+        return 1;
+    }
+    for (size_t i = exp.size(); i < unit_size; i++) {
+        if (out[i] != 0) {
+            fprintf(stderr, "LZNT1 zero filled unit: %" PRIuSIZE
+                " is not 0\n", i);
+            return 1;
+        }
+    }
+
+    // cut in the compressed and in the stored sub-block
+    if (lznt1_fails(&unit[0], sizeof(s_lznt1_4k) / 2, unit_size,
+            "cut in compressed sub-block")
+        || lznt1_fails(&unit[0], sizeof(s_lznt1_4k) + 2000, unit_size,
+            "cut in stored sub-block"))
+        return 1;
+
+    return 0;
+}
+
+/* Matches that end at and past the end of the buffer */
+static int
+test_lznt1_bounds()
+{
+    std::vector<unsigned char> exp = gen_periodic(4096, 300, 1);
+    std::vector<unsigned char> out(4096);
+    size_t out_len;
+
+    if (ntfs_uncompress_buf(s_lznt1_4k, sizeof(s_lznt1_4k), &out[0], 4096,
+            &out_len)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if ((out_len != 4096) || memcmp(&out[0], &exp[0], 4096)) {
+        fprintf(stderr, "LZNT1 4 KiB block: wrong data\n");
+        return 1;
+    }
+    if (lznt1_fails(s_lznt1_4k, sizeof(s_lznt1_4k), 4095,
+            "block larger than buffer"))
+        return 1;
+
+    if (ntfs_uncompress_buf(s_lznt1_run, sizeof(s_lznt1_run), &out[0],
+            4096, &out_len)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if (out_len != 104) {
+        fprintf(stderr, "LZNT1 run: wrong length %" PRIuSIZE "\n",
+            out_len);
+        return 1;
+    }
+    for (size_t i = 0; i < out_len; i++) {
+        if (out[i] != "abcd"[i % 4]) {
+            fprintf(stderr, "LZNT1 run: wrong data at %" PRIuSIZE "\n", i);
+            return 1;
+        }
+    }
+
+    if (lznt1_fails(s_lznt1_run, sizeof(s_lznt1_run), 64,
+            "match past end of buffer")
+        || lznt1_fails(s_lznt1_bad_off, sizeof(s_lznt1_bad_off), 4096,
+            "match before start of data"))
+        return 1;
+
+    return 0;
+}
+
+
+/*
+ * WOF: XPRESS Huffman and LZX
+ */
+
+/* gen_periodic(4096, 300, 7) compressed with XPRESS Huffman (which has
+ * matches with 1, 2 and 4 byte lengths) and gen_periodic(3000, 300, 11)
+ * compressed with LZX in a verbatim and an aligned offset block */
+static const unsigned char s_xpress_4k[331] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x50, 0x56, 0x56, 0x65, 0x64, 0x00, 0x04, 0x40, 0x06, 0x05, 0x05, 0x06,
+    0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x56, 0x06, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x60, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x60, 0x06, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x45, 0x50, 0x00, 0x00, 0x00, 0x60, 0x06, 0x00, 0x50, 0x00, 0x60,
+    0x06, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x00, 0x06, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x80, 0x5a, 0x61, 0x91, 0x11, 0x0b, 0x50, 0xaa,
+    0xa3, 0x25, 0xd1, 0x6a, 0xc5, 0x5a, 0x43, 0xc9, 0x07, 0x0b, 0x9d, 0x34,
+    0x45, 0xc3, 0x35, 0x15, 0x96, 0x37, 0x82, 0x74, 0x87, 0x6f, 0x9c, 0xc9,
+    0xe3, 0xf0, 0xf7, 0x11, 0x49, 0x7e, 0x09, 0xf4, 0x1e, 0xcb, 0x91, 0xbc,
+    0x37, 0xb8, 0x85, 0xc9, 0xc9, 0xf0, 0x9d, 0x1e, 0x3c, 0x6c, 0xf4, 0x75,
+    0x7d, 0xcd, 0x9b, 0x0d, 0x8f, 0x1e, 0xfa, 0xa1, 0x25, 0x27, 0xe5, 0x07,
+    0x80, 0x98, 0xff, 0xd1, 0x0e, 0x00, 0x00,
+};
+
+static const unsigned char s_lzx_3k[196] = {
+    0x42, 0x20, 0x00, 0xf2, 0x00, 0x00, 0x00, 0x00, 0x40, 0x23, 0x42, 0x00,
+    0x9d, 0x09, 0xe7, 0x7f, 0x97, 0x2b, 0xc1, 0x21, 0x8c, 0xc9, 0x7e, 0x23,
+    0xd2, 0xfc, 0x00, 0x00, 0x00, 0x00, 0x23, 0x00, 0x00, 0x40, 0x08, 0x24,
+    0x6f, 0xf5, 0x87, 0x91, 0xc4, 0x42, 0xc0, 0x8a, 0x38, 0x8c, 0x8a, 0x30,
+    0xf0, 0x30, 0x9d, 0xe8, 0x3b, 0x3b, 0xff, 0xff, 0x80, 0x81, 0x00, 0x00,
+    0x00, 0x00, 0x01, 0x00, 0x19, 0x10, 0xc0, 0x06, 0x8b, 0x3c, 0xef, 0xf7,
+    0x96, 0xdf, 0x57, 0xd2, 0x64, 0x31, 0x40, 0xc0, 0xa4, 0xd8, 0x09, 0x05,
+    0x60, 0x16, 0x75, 0x26, 0x6e, 0x16, 0x1a, 0xa2, 0x44, 0x41, 0x8e, 0xc4,
+    0xcb, 0x2c, 0xa4, 0x45, 0xa9, 0x13, 0x1a, 0x0b, 0x1d, 0xd2, 0xce, 0xfb,
+    0xbb, 0x34, 0x5c, 0xc7, 0xcc, 0xfb, 0xd2, 0xcb, 0x0e, 0xc3, 0xc5, 0xcc,
+    0x5f, 0x29, 0xe8, 0x5e, 0x7d, 0xd1, 0x9f, 0x87, 0x78, 0x3a, 0x59, 0xf9,
+    0xca, 0x16, 0xb9, 0xc4, 0x4d, 0xc7, 0x38, 0xa8, 0xd5, 0xff, 0x5a, 0xcd,
+    0x3c, 0xa0, 0x6d, 0x4b, 0xd8, 0xb6, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x87, 0x00, 0xff, 0xff, 0xe0, 0xff, 0x02, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x0c, 0x21, 0xdf, 0xe7, 0xf2, 0x7d, 0xc0, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x84, 0x0c, 0x7e, 0x1f, 0xfb, 0xfe,
+    0x65, 0xe2, 0x40, 0x55,
+};
+
+/* Expect ntfs_wof_decompress() to fail */
+static int
+wof_fails(uint32_t a_algo, const unsigned char *a_in, size_t a_in_len,
+    size_t a_out_len, const char *a_name)
+{
+    std::vector<unsigned char> out(a_out_len);
+
+    if (ntfs_wof_decompress(a_algo, a_in, a_in_len, &out[0],
+            a_out_len) == 0) {
+        fprintf(stderr, "WOF %s: no error\n", a_name);
+        return 1;
+    }
+    tsk_error_reset();
+    return 0;
+}
+
+/* Decode a vector, then check that it fails with a smaller output (a
+ * match goes past the end of the chunk) and once it is truncated */
+static int
+test_wof_chunk(uint32_t a_algo, const unsigned char *a_in,
+    size_t a_in_len, const std::vector<unsigned char> &a_exp,
+    size_t a_pad, const char *a_name)
+{
+    std::vector<unsigned char> out(a_exp.size());
+    std::string name(a_name);
+
+    if (ntfs_wof_decompress(a_algo, a_in, a_in_len, &out[0],
+            a_exp.size())) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if (memcmp(&out[0], &a_exp[0], a_exp.size())) {
+        fprintf(stderr, "WOF %s: wrong data\n", a_name);
+        return 1;
+    }
+
+    if (wof_fails(a_algo, a_in, a_in_len, 1000,
+            (name + " match past end of chunk").c_str()))
+        return 1;
+
+    /* The words past the end of the bit stream used to be read as 0s.
+     * a_pad bytes at the end are not needed. */
+    for (size_t len = 0; len < a_in_len - a_pad; len++) {
+        if (wof_fails(a_algo, a_in, len, a_exp.size(),
+                (name + " truncated").c_str())) {
+            fprintf(stderr, "  at %" PRIuSIZE " bytes\n", len);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int
+test_wof()
+{
+    if (test_wof_chunk(NTFS_WOF_XPRESS4K, s_xpress_4k,
+            sizeof(s_xpress_4k), gen_periodic(4096, 300, 7), 2,
+            "XPRESS"))
+        return 1;
+    if (test_wof_chunk(NTFS_WOF_LZX, s_lzx_3k, sizeof(s_lzx_3k),
+            gen_periodic(3000, 300, 11), 0, "LZX"))
+        return 1;
+
+    // more output than there is data in the chunk
+    if (wof_fails(NTFS_WOF_XPRESS4K, s_xpress_4k, sizeof(s_xpress_4k),
+            4200, "XPRESS past end of data")
+        || wof_fails(NTFS_WOF_LZX, s_lzx_3k, sizeof(s_lzx_3k), 3100,
+            "LZX past end of data")
+        || wof_fails(NTFS_WOF_LZX, s_lzx_3k, sizeof(s_lzx_3k),
+            NTFS_WOF_CHUNK_MAX + 1, "chunk larger than maximum"))
+        return 1;
+
+    return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    if (test_lznt1_unit()) {
+        fprintf(stderr, "LZNT1 compression unit failure\n");
+        retval = 1;
+    }
+    else if (test_lznt1_bounds()) {
+        fprintf(stderr, "LZNT1 bounds failure\n");
+        retval = 1;
+    }
+    else if (test_wof()) {
+        fprintf(stderr, "WOF decompression failure\n");
+        retval = 1;
+    }
+
+    if (retval == 0)
+        printf("Tests Passed\n");
+    return retval;
+}
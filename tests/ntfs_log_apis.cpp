@@ -0,0 +1,470 @@
+/*
+* The Sleuth Kit
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test the NTFS $LogFile restart page and record decoding on a log that
+ * is built in memory */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk/fs/tsk_ntfs.h"
+#include "tsk_test_img.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#define LOG_PAGE        4096
+#define LOG_NPAGES      70
+#define LOG_SEQ_BITS    44
+#define LOG_REC_HDR     48      /* sizeof(ntfs_log_rec) */
+#define LOG_DATA_OFF    64      /* record page header and its fixups */
+#define LOG_UPD_CNT     (1 + LOG_PAGE / NTFS_UPDATE_SEQ_STRIDE)
+
+static const char *s_out_path = "ntfs_log_apis.out";
+
+
+/* LSN of the record at a_off in the log */
+static uint64_t
+log_lsn(size_t a_off)
+{
+    return ((uint64_t) 1 << (64 - LOG_SEQ_BITS)) | (a_off >> 3);
+}
+
+/* A record that the walk must report */
+typedef struct {
+    TSK_DADDR_T page;
+    uint64_t lsn;
+    uint64_t prev_lsn;
+    uint32_t trans_id;
+    uint8_t restart;
+    uint8_t has_op;
+    uint16_t redo_op;
+    uint16_t undo_op;
+    uint16_t attr;
+    uint64_t vcn;
+    uint64_t lcn;               // 0 if the record has no LCN
+} LOG_TEST_REC;
+
+/*
+ * $LogFile with two restart pages and record pages that have records
+ * whose client data continues in the next pages.
+ */
+class LogFile {
+public:
+    LogFile() : m_buf(LOG_NPAGES * LOG_PAGE, 0) {
+    }
+
+    /* Write a restart page and protect it with fixups */
+    void restartPage(unsigned a_idx, uint64_t a_current_lsn) {
+        size_t off = a_idx * LOG_PAGE;
+        size_t ra = off + 0x30;
+
+        put_u32(m_buf, off, NTFS_LOG_RSTR_MAGIC);
+        put_u16(m_buf, off + 4, 0x1e);
+        put_u16(m_buf, off + 6, LOG_UPD_CNT);
+        put_u32(m_buf, off + 16, LOG_PAGE);
+        put_u32(m_buf, off + 20, LOG_PAGE);
+        put_u16(m_buf, off + 24, 0x30);
+        put_u16(m_buf, off + 26, 1);
+        put_u16(m_buf, off + 28, 1);
+
+        put_u64(m_buf, ra, a_current_lsn);
+        put_u16(m_buf, ra + 8, 1);
+        put_u32(m_buf, ra + 16, LOG_SEQ_BITS);
+        put_u64(m_buf, ra + 24, m_buf.size());
+        put_u16(m_buf, ra + 36, LOG_REC_HDR);
+        put_u16(m_buf, ra + 38, LOG_DATA_OFF);
+        fixup(off, 0x1e, 0x0101 + a_idx);
+    }
+
+    /* Start a record page (its fixups are applied by fixup()) */
+    void recordPage(TSK_DADDR_T a_page) {
+        size_t off = (size_t) a_page * LOG_PAGE;
+
+        put_u32(m_buf, off, NTFS_LOG_RCRD_MAGIC);
+        put_u16(m_buf, off + 4, 0x28);
+        put_u16(m_buf, off + 6, LOG_UPD_CNT);
+    }
+
+    /* Add a record at a_off (from the start of the log) with a_data_len
+     * bytes of client data, which continues after the header of the
+     * next pages.  a_rec has the fields to write. */
+    void addRecord(size_t a_off, uint32_t a_data_len,
+        LOG_TEST_REC a_rec) {
+        std::vector<uint8_t> data(a_data_len, 0);
+
+        a_rec.page = a_off / LOG_PAGE;
+        a_rec.lsn = log_lsn(a_off);
+        put_u64(m_buf, a_off, a_rec.lsn);
+        put_u64(m_buf, a_off + 8, a_rec.prev_lsn);
+        put_u32(m_buf, a_off + 24, a_data_len);
+        put_u32(m_buf, a_off + 32, a_rec.restart ?
+            NTFS_LOG_RECTYPE_RESTART : NTFS_LOG_RECTYPE_CLIENT);
+        put_u32(m_buf, a_off + 36, a_rec.trans_id);
+
+        // data that does not look like a record
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = (uint8_t) (0x80 + i * 7);
+        if (a_rec.has_op) {
+            for (size_t i = 0; i < 32; i++)
+                data[i] = 0;
+            put_u16(data, 0, a_rec.redo_op);
+            put_u16(data, 2, a_rec.undo_op);
+            put_u16(data, 12, a_rec.attr);
+            put_u16(data, 14, a_rec.lcn ? 1 : 0);
+            put_u64(data, 24, a_rec.vcn);
+            if (a_rec.lcn)
+                put_u64(data, 32, a_rec.lcn);
+        }
+
+        size_t pos = a_off + LOG_REC_HDR;
+        for (size_t i = 0; i < data.size(); i++) {
+            if (pos % LOG_PAGE == 0)
+                pos += LOG_DATA_OFF;
+            m_buf[pos++] = data[i];
+        }
+        m_recs.push_back(a_rec);
+    }
+
+    /* Replace the last 2 bytes of each sector with the update sequence
+     * number and save them in the array at a_upd_off */
+    void fixup(size_t a_page_off, size_t a_upd_off, uint16_t a_usn) {
+        size_t upd = a_page_off + a_upd_off;
+
+        put_u16(m_buf, upd, a_usn);
+        for (size_t i = 1; i < LOG_UPD_CNT; i++) {
+            size_t tail = a_page_off + i * NTFS_UPDATE_SEQ_STRIDE - 2;
+
+            m_buf[upd + 2 * i] = m_buf[tail];
+            m_buf[upd + 2 * i + 1] = m_buf[tail + 1];
+            put_u16(m_buf, tail, a_usn);
+        }
+    }
+
+    void fixupRecordPage(TSK_DADDR_T a_page, uint16_t a_usn) {
+        fixup((size_t) a_page * LOG_PAGE, 0x28, a_usn);
+    }
+
+    std::vector<uint8_t> m_buf;
+    std::vector<LOG_TEST_REC> m_recs;
+};
+
+static LOG_TEST_REC
+log_rec(uint32_t a_trans, uint16_t a_redo, uint16_t a_undo,
+    uint16_t a_attr, uint64_t a_vcn, uint64_t a_lcn)
+{
+    LOG_TEST_REC rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.prev_lsn = 0x1000 + a_trans;
+    rec.trans_id = a_trans;
+    rec.has_op = 1;
+    rec.redo_op = a_redo;
+    rec.undo_op = a_undo;
+    rec.attr = a_attr;
+    rec.vcn = a_vcn;
+    rec.lcn = a_lcn;
+    return rec;
+}
+
+/*
+ * Fill the record pages:
+ *  page 2: a record whose LCN is on a sector boundary, a client restart
+ *          record and a record whose LCN is in page 3
+ *  page 3: a record without LCN and one with 9000 bytes of data that
+ *          continues in pages 4 and 5
+ *  page 5: a record after the end of that data
+ *  page 6: a record in a page whose fixups do not match (torn write)
+ *  page 7: never used
+ *  page 8: an old copy of a page, whose LSN is not its offset
+ *  page 65: a record whose LCN is in page 66, which is decoded by the
+ *          next job
+ */
+static void
+log_fill(LogFile & a_log)
+{
+    LOG_TEST_REC rec;
+    size_t off;
+
+    a_log.restartPage(0, log_lsn(2 * LOG_PAGE));
+    a_log.restartPage(1, log_lsn(5 * LOG_PAGE));
+
+    for (TSK_DADDR_T p = 2; p <= 8; p++) {
+        if (p != 7)
+            a_log.recordPage(p);
+    }
+    a_log.recordPage(65);
+    a_log.recordPage(66);
+
+    // the LCN is at offset 504 to 511 of the page, which has a fixup
+    off = 2 * LOG_PAGE + 504 - LOG_REC_HDR - 32;
+    a_log.addRecord(off, 40, log_rec(7, 8, 8, 3, 5, 0x123456789ULL));
+    off += LOG_REC_HDR + 40;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.restart = 1;
+    a_log.addRecord(off, 16, rec);
+    off += LOG_REC_HDR + 16;
+
+    // only 16 bytes of the data are in page 2
+    off = 3 * LOG_PAGE - LOG_REC_HDR - 16;
+    a_log.addRecord(off, 40, log_rec(8, 21, 22, 4, 0x40, 0x5678));
+
+    off = 3 * LOG_PAGE + LOG_DATA_OFF + 24;
+    a_log.addRecord(off, 32, log_rec(9, 26, 0, 0, 0, 0));
+    off += LOG_REC_HDR + 32;
+    a_log.addRecord(off, 9000, log_rec(10, 2, 3, 6, 0x77, 0x9abc));
+
+    // 9000 bytes are in pages 3, 4 and 5
+    off += LOG_REC_HDR;
+    size_t left = 9000 - (4 * LOG_PAGE - off) - (LOG_PAGE - LOG_DATA_OFF);
+    off = 5 * LOG_PAGE + LOG_DATA_OFF + ((left + 7) & ~(size_t) 7);
+    a_log.addRecord(off, 40, log_rec(11, 37, 1, 2, 9, 0xdef0));
+
+    off = 66 * LOG_PAGE - LOG_REC_HDR - 24;
+    a_log.addRecord(off, 40, log_rec(14, 7, 7, 1, 3, 0x4242));
+
+    // not reported
+    std::vector<LOG_TEST_REC> recs = a_log.m_recs;
+    a_log.addRecord(6 * LOG_PAGE + LOG_DATA_OFF, 40,
+        log_rec(12, 8, 8, 3, 5, 0x1111));
+    a_log.addRecord(8 * LOG_PAGE + LOG_DATA_OFF, 40,
+        log_rec(13, 8, 8, 3, 5, 0x2222));
+    put_u64(a_log.m_buf, 8 * LOG_PAGE + LOG_DATA_OFF,
+        log_lsn(4 * LOG_PAGE + LOG_DATA_OFF));
+    a_log.m_recs = recs;
+
+    for (TSK_DADDR_T p = 2; p <= 66; p++) {
+        if ((p <= 8 && p != 7) || (p >= 65))
+            a_log.fixupRecordPage(p, (uint16_t) (0x0200 + p));
+    }
+    // tear page 6
+    a_log.m_buf[6 * LOG_PAGE + 3 * NTFS_UPDATE_SEQ_STRIDE - 1] ^= 0xff;
+}
+
+
+/* An NTFS file system with just the $LogFile data */
+class LogFs {
+public:
+    LogFs(const std::vector<uint8_t> &a_buf) {
+        memset(&m_ntfs, 0, sizeof(m_ntfs));
+        m_ntfs.fs_info.endian = TSK_LIT_ENDIAN;
+        m_ntfs.fs_info.block_size = 4096;
+        memset(&m_fs_file, 0, sizeof(m_fs_file));
+        m_fs_file.fs_info = &m_ntfs.fs_info;
+        memset(&m_loginfo, 0, sizeof(m_loginfo));
+        m_loginfo.fs_file = &m_fs_file;
+        m_loginfo.log_inum = NTFS_MFT_LOG;
+        m_attr = tsk_fs_attr_alloc(TSK_FS_ATTR_RES);
+        if (m_attr)
+            tsk_fs_attr_set_str(&m_fs_file, m_attr, "$Data",
+                TSK_FS_ATTR_TYPE_NTFS_DATA, 0, (void *) &a_buf[0],
+                a_buf.size());
+        m_loginfo.fs_attr = m_attr;
+        m_ntfs.loginfo = &m_loginfo;
+    }
+
+    ~LogFs() {
+        tsk_fs_attr_free(m_attr);
+    }
+
+    NTFS_INFO m_ntfs;
+    TSK_FS_FILE m_fs_file;
+    TSK_FS_ATTR *m_attr;
+    NTFS_LOGINFO m_loginfo;
+};
+
+
+static int
+test_log_restart()
+{
+    LogFile log;
+
+    log_fill(log);
+    {
+        LogFs fs(log.m_buf);
+
+        if (ntfs_log_load(&fs.m_ntfs.fs_info, &fs.m_loginfo)) {
+            tsk_error_print(stderr);
+            return 1;
+        }
+        if ((fs.m_loginfo.rstr_page != 1)
+            || (fs.m_loginfo.current_lsn != log_lsn(5 * LOG_PAGE))
+            || (fs.m_loginfo.page_size != LOG_PAGE)
+            || (fs.m_loginfo.seq_bits != LOG_SEQ_BITS)
+            || (fs.m_loginfo.rec_hdr_len != LOG_REC_HDR)
+            || (fs.m_loginfo.data_off != LOG_DATA_OFF)
+            || (fs.m_loginfo.file_size != (TSK_OFF_T) log.m_buf.size())) {
+            fprintf(stderr, "restart: wrong settings from page %" PRIuDADDR
+                "\n", fs.m_loginfo.rstr_page);
+            return 1;
+        }
+    }
+
+    // the newer restart page is torn, so the older one is used
+    log.m_buf[LOG_PAGE + NTFS_UPDATE_SEQ_STRIDE - 2] ^= 0xff;
+    {
+        LogFs fs(log.m_buf);
+
+        if (ntfs_log_load(&fs.m_ntfs.fs_info, &fs.m_loginfo)) {
+            tsk_error_print(stderr);
+            return 1;
+        }
+        if ((fs.m_loginfo.rstr_page != 0)
+            || (fs.m_loginfo.current_lsn != log_lsn(2 * LOG_PAGE))) {
+            fprintf(stderr, "torn restart: used page %" PRIuDADDR "\n",
+                fs.m_loginfo.rstr_page);
+            return 1;
+        }
+    }
+
+    // and none is valid
+    log.m_buf[0] = 0;
+    {
+        LogFs fs(log.m_buf);
+
+        if (ntfs_log_load(&fs.m_ntfs.fs_info, &fs.m_loginfo) == 0) {
+            fprintf(stderr, "no restart page: no error\n");
+            return 1;
+        }
+        tsk_error_reset();
+    }
+    return 0;
+}
+
+
+/* Records reported to the walk callback */
+typedef std::vector<std::pair<TSK_DADDR_T, TSK_DADDR_T> > LOG_TEST_SEEN;
+
+static TSK_WALK_RET_ENUM
+log_test_cb(TSK_FS_INFO * a_fs, TSK_FS_JENTRY * a_jentry, int a_flags,
+    void *a_ptr)
+{
+    LOG_TEST_SEEN *seen = (LOG_TEST_SEEN *) a_ptr;
+
+    seen->push_back(std::make_pair(a_jentry->jblk, a_jentry->fsblk));
+    return TSK_WALK_CONT;
+}
+
+/* Expected jls line of a record */
+static std::string
+log_line(const LOG_TEST_REC & a_rec)
+{
+    char line[512];
+
+    if (a_rec.restart) {
+        snprintf(line, sizeof(line), "%" PRIuDADDR
+            ":\tClient Restart (LSN: %" PRIu64 ")\n", a_rec.page,
+            a_rec.lsn);
+        return line;
+    }
+    snprintf(line, sizeof(line), "%" PRIuDADDR ":\tLSN: %" PRIu64
+        " (prev: %" PRIu64 ", trans: %" PRIu32 ")", a_rec.page, a_rec.lsn,
+        a_rec.prev_lsn, a_rec.trans_id);
+    return line;
+}
+
+static int
+test_log_records()
+{
+    LogFile log;
+    LOG_TEST_SEEN seen;
+
+    log_fill(log);
+    LogFs fs(log.m_buf);
+
+    if (ntfs_log_load(&fs.m_ntfs.fs_info, &fs.m_loginfo)
+        || ntfs_jentry_walk(&fs.m_ntfs.fs_info, 0, log_test_cb, &seen)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if (seen.size() != log.m_recs.size()) {
+        fprintf(stderr, "walk: %" PRIuSIZE " records instead of %"
+            PRIuSIZE "\n", seen.size(), log.m_recs.size());
+        return 1;
+    }
+    for (size_t i = 0; i < seen.size(); i++) {
+        if ((seen[i].first != log.m_recs[i].page)
+            || (seen[i].second != log.m_recs[i].lcn)) {
+            fprintf(stderr, "walk: record %" PRIuSIZE " in page %"
+                PRIuDADDR " with LCN 0x%" PRIxDADDR "\n", i,
+                seen[i].first, seen[i].second);
+            return 1;
+        }
+    }
+
+    /* The jls output has the other fields of the records */
+    FILE *out = fopen(s_out_path, "w+");
+    int saved;
+
+    if (out == NULL) {
+        fprintf(stderr, "error creating %s\n", s_out_path);
+        return 1;
+    }
+    fflush(stdout);
+    saved = dup(fileno(stdout));
+    dup2(fileno(out), fileno(stdout));
+    uint8_t ret = ntfs_jentry_walk(&fs.m_ntfs.fs_info, 0, NULL, NULL);
+    fflush(stdout);
+    dup2(saved, fileno(stdout));
+    close(saved);
+    if (ret) {
+        tsk_error_print(stderr);
+        fclose(out);
+        return 1;
+    }
+
+    std::vector<std::string> lines;
+    char line[512];
+    rewind(out);
+    while (fgets(line, sizeof(line), out))
+        lines.push_back(line);
+    fclose(out);
+    unlink(s_out_path);
+
+    if (lines.size() != log.m_recs.size() + 2) {
+        fprintf(stderr, "jls: %" PRIuSIZE " lines\n", lines.size());
+        return 1;
+    }
+    for (size_t i = 0; i < log.m_recs.size(); i++) {
+        std::string exp = log_line(log.m_recs[i]);
+
+        if (lines[i + 2].compare(0, exp.size(), exp)) {
+            fprintf(stderr, "jls: got %sexpected %s\n",
+                lines[i + 2].c_str(), exp.c_str());
+            return 1;
+        }
+    }
+    if (lines[2].find(" Redo: UpdateNonresidentValue Undo: "
+            "UpdateNonresidentValue Attr: 3 VCN: 5 LCN: 4886718345\n") ==
+        std::string::npos) {
+        fprintf(stderr, "jls: wrong operation in %s", lines[2].c_str());
+        return 1;
+    }
+    return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    if (test_log_restart()) {
+        fprintf(stderr, "$LogFile restart page failure\n");
+        retval = 1;
+    }
+    else if (test_log_records()) {
+        fprintf(stderr, "$LogFile record failure\n");
+        retval = 1;
+    }
+
+    if (retval == 0)
+        printf("Tests Passed\n");
+    return retval;
+}
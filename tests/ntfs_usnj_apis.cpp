@@ -0,0 +1,396 @@
+/*
+* The Sleuth Kit
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test the walk of the NTFS UsnJrnl $J records on a journal that is built
+ * in memory, with records that straddle the segments that are parsed in
+ * parallel, and on a sparse journal that is stored in an image */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk/fs/tsk_ntfs.h"
+#include "tsk_test_img.h"
+
+#include <string>
+#include <vector>
+
+/* The parser splits the journal in segments of this size */
+#define USNJ_TEST_SEGMENT   (4 * 1024 * 1024)
+
+#define USNJ_TEST_TIME      1577836800  /* 2020-01-01 */
+#define USNJ_TEST_NT_EPOCH  11644473600ULL
+
+
+static TskTestImg s_img("ntfs_usnj_apis.dd");
+
+
+/* A record that was written to the journal */
+typedef struct {
+    uint64_t off;
+    uint64_t refnum;
+    uint32_t time;
+    std::string name;
+} USNJ_TEST_REC;
+
+/* Journal with V 2.0 records.  A record straddles each segment boundary
+ * and there is a run of 0s (as at the start of a cleared page) before
+ * it. */
+class UsnJournal {
+public:
+    UsnJournal(size_t a_len) : m_buf(a_len, 0) {
+        uint64_t off = 0;
+        size_t boundary = USNJ_TEST_SEGMENT;
+
+        while (true) {
+            size_t idx = m_recs.size();
+            std::string name = recName(idx);
+            size_t len = (60 + 2 * name.size() + 7) & ~(size_t) 7;
+
+            if (off + len + 8 > m_buf.size())
+                break;
+
+            /* Skip to 40 bytes before the next segment */
+            if ((boundary < m_buf.size()) && (off + 200 > boundary)) {
+                off = boundary - 40;
+                boundary += USNJ_TEST_SEGMENT;
+            }
+            addRecord(off, len, idx, name);
+            off += len;
+        }
+    }
+
+    /* Journal with records only in the ranges [a_start, a_end) of a_ranges
+     * (as {start, end} pairs).  The rest is left as 0s. */
+    UsnJournal(size_t a_len, const std::vector<uint64_t> &a_ranges)
+    : m_buf(a_len, 0) {
+        for (size_t r = 0; r + 1 < a_ranges.size(); r += 2) {
+            uint64_t off = a_ranges[r];
+
+            while (true) {
+                size_t idx = m_recs.size();
+                std::string name = recName(idx);
+                size_t len = (60 + 2 * name.size() + 7) & ~(size_t) 7;
+
+                if (off + len > a_ranges[r + 1])
+                    break;
+                addRecord(off, len, idx, name);
+                off += len;
+            }
+        }
+    }
+
+    static std::string recName(size_t a_idx) {
+        return "file_" + std::to_string(a_idx) +
+            std::string(a_idx % 13, 'x') + ".txt";
+    }
+
+    void addRecord(uint64_t a_off, size_t a_len, size_t a_idx,
+        const std::string &a_name) {
+        USNJ_TEST_REC rec;
+
+        rec.off = a_off;
+        rec.refnum = 100 + a_idx;
+        rec.time = USNJ_TEST_TIME + (uint32_t) a_idx;
+        rec.name = a_name;
+        m_recs.push_back(rec);
+
+        put_u16(m_buf, a_off, (uint16_t) a_len);
+        put_u16(m_buf, a_off + 4, 2);
+        put_u64(m_buf, a_off + 8, rec.refnum | ((uint64_t) 1 << 48));
+        put_u64(m_buf, a_off + 16, 5 | ((uint64_t) 5 << 48));
+        put_u64(m_buf, a_off + 24, a_off);
+        put_u64(m_buf, a_off + 32,
+            (rec.time + USNJ_TEST_NT_EPOCH) * 10000000ULL);
+        put_u16(m_buf, a_off + 40, 0x100);
+        put_u16(m_buf, a_off + 56, (uint16_t) (2 * a_name.size()));
+        put_u16(m_buf, a_off + 58, 60);
+        for (size_t i = 0; i < a_name.size(); i++)
+            put_u16(m_buf, a_off + 60 + 2 * i, a_name[i]);
+    }
+
+    std::vector<uint8_t> m_buf;
+    std::vector<USNJ_TEST_REC> m_recs;
+};
+
+
+/* What the callback saw */
+typedef struct {
+    const UsnJournal *jrnl;
+    size_t next;                // index of the next expected record
+    size_t cnt;
+    size_t stop_after;          // 0 to walk all of the records
+    int err;
+} USNJ_TEST_WALK;
+
+static TSK_WALK_RET_ENUM
+usnj_test_cb(TSK_USN_RECORD_HEADER * a_header, void *a_record, void *a_ptr)
+{
+    USNJ_TEST_WALK *walk = (USNJ_TEST_WALK *) a_ptr;
+    TSK_USN_RECORD_V2 *rec = (TSK_USN_RECORD_V2 *) a_record;
+    const USNJ_TEST_REC *exp;
+
+    if (walk->next >= walk->jrnl->m_recs.size()) {
+        fprintf(stderr, "record after the last one\n");
+        walk->err = 1;
+        return TSK_WALK_ERROR;
+    }
+    exp = &walk->jrnl->m_recs[walk->next];
+    if ((a_header->major_version != 2) || (rec->usn != exp->off)
+        || (rec->refnum != exp->refnum) || (rec->refnum_seq != 1)
+        || (rec->parent_refnum != 5) || (rec->time_sec != exp->time)
+        || (exp->name != rec->fname)) {
+        fprintf(stderr, "record %" PRIuSIZE ": got USN %" PRIu64
+            " ref %" PRIu64 " time %" PRIu32 " name %s\n", walk->next,
+            rec->usn, rec->refnum, rec->time_sec, rec->fname);
+        walk->err = 1;
+        return TSK_WALK_ERROR;
+    }
+    walk->next++;
+    walk->cnt++;
+    if (walk->stop_after && (walk->cnt == walk->stop_after))
+        return TSK_WALK_STOP;
+    return TSK_WALK_CONT;
+}
+
+/* Walk the journal and check that the records a_first to a_last were
+ * reported in order */
+static int
+usnj_test_walk(const TSK_FS_ATTR * a_attr, const UsnJournal & a_jrnl,
+    const TSK_FS_USNJ_FILTER * a_filter, size_t a_first, size_t a_last,
+    size_t a_stop_after, const char *a_name)
+{
+    USNJ_TEST_WALK walk;
+
+    memset(&walk, 0, sizeof(walk));
+    walk.jrnl = &a_jrnl;
+    walk.next = a_first;
+    walk.stop_after = a_stop_after;
+
+    if (ntfs_usnj_walk_attr(a_attr, TSK_LIT_ENDIAN, a_filter, usnj_test_cb,
+            &walk)) {
+        fprintf(stderr, "%s: ", a_name);
+        if (walk.err == 0)
+            tsk_error_print(stderr);
+        return 1;
+    }
+    if (walk.next != a_last + 1) {
+        fprintf(stderr, "%s: %" PRIuSIZE " records instead of %" PRIuSIZE
+            "\n", a_name, walk.cnt, a_last + 1 - a_first);
+        return 1;
+    }
+    return 0;
+}
+
+static int
+test_usnj_walk()
+{
+    UsnJournal jrnl(3 * USNJ_TEST_SEGMENT - 4096);
+    TSK_FS_INFO fs;
+    TSK_FS_FILE fs_file;
+    TSK_FS_ATTR *fs_attr;
+    TSK_FS_USNJ_FILTER filter;
+    size_t last = jrnl.m_recs.size() - 1;
+    size_t straddle = 0;
+    int retval = 1;
+
+    for (size_t i = 0; i < jrnl.m_recs.size(); i++) {
+        if (jrnl.m_recs[i].off % USNJ_TEST_SEGMENT ==
+            USNJ_TEST_SEGMENT - 40)
+            straddle++;
+    }
+    if (straddle != 2) {
+        fprintf(stderr, "%" PRIuSIZE " records straddle a segment\n",
+            straddle);
+        return 1;
+    }
+
+    /* A resident attribute is read as one region, so the records must be
+     * found again after each segment boundary */
+    memset(&fs, 0, sizeof(fs));
+    fs.block_size = 4096;
+    fs.endian = TSK_LIT_ENDIAN;
+    memset(&fs_file, 0, sizeof(fs_file));
+    fs_file.fs_info = &fs;
+    if (((fs_attr = tsk_fs_attr_alloc(TSK_FS_ATTR_RES)) == NULL)
+        || tsk_fs_attr_set_str(&fs_file, fs_attr, "$J",
+            TSK_FS_ATTR_TYPE_NTFS_DATA, 0, &jrnl.m_buf[0],
+            jrnl.m_buf.size())) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+
+    if (usnj_test_walk(fs_attr, jrnl, NULL, 0, last, 0, "all records"))
+        goto end;
+
+    // USN (offset) limits, which need not be at the start of a record
+    memset(&filter, 0, sizeof(filter));
+    filter.usn_min = jrnl.m_recs[1000].off - 8;
+    filter.usn_max = jrnl.m_recs[60000].off;
+    if (usnj_test_walk(fs_attr, jrnl, &filter, 1000, 60000, 0,
+            "USN filter"))
+        goto end;
+
+    filter.usn_min = jrnl.m_recs[last].off;
+    filter.usn_max = 0;
+    if (usnj_test_walk(fs_attr, jrnl, &filter, last, last, 0,
+            "USN of last record"))
+        goto end;
+
+    // time limits, over the first segment boundary
+    memset(&filter, 0, sizeof(filter));
+    for (size_t i = 0; i < jrnl.m_recs.size(); i++) {
+        if (jrnl.m_recs[i].off == USNJ_TEST_SEGMENT - 40) {
+            filter.time_min = jrnl.m_recs[i - 5].time;
+            filter.time_max = jrnl.m_recs[i + 5].time;
+            if (usnj_test_walk(fs_attr, jrnl, &filter, i - 5, i + 5, 0,
+                    "time filter"))
+                goto end;
+            break;
+        }
+    }
+
+    // the callback stops the walk
+    if (usnj_test_walk(fs_attr, jrnl, NULL, 0, 9, 10, "stopped walk"))
+        goto end;
+
+    retval = 0;
+
+  end:
+    tsk_fs_attr_free(fs_attr);
+    return retval;
+}
+
+/* Block size of the raw file system that the sparse journal is read from */
+#define USNJ_TEST_BSIZE     512
+
+/* A non-resident journal: a leading sparse run, two data runs that
+ * follow each other in the journal but are stored out of order, another
+ * sparse run and a last data run.  Each entry is {journal block, length,
+ * image block} and the image block is 0 for a sparse run. */
+static const uint64_t s_usnj_runs[][3] = {
+    {0, 2048, 0},
+    {2048, 1024, 3072},
+    {3072, 1024, 1},
+    {4096, 1024, 0},
+    {5120, 512, 1025},
+};
+
+static int
+test_usnj_walk_sparse()
+{
+    const size_t nruns = sizeof(s_usnj_runs) / sizeof(s_usnj_runs[0]);
+    const size_t jlen = (5120 + 512) * USNJ_TEST_BSIZE;
+    // the last data run is only partly used
+    UsnJournal jrnl(jlen, std::vector<uint64_t> {
+        2048 * USNJ_TEST_BSIZE, 4096 * USNJ_TEST_BSIZE,
+        5120 * USNJ_TEST_BSIZE, 5120 * USNJ_TEST_BSIZE + 100000});
+    std::vector<uint8_t> img_buf(4096 * USNJ_TEST_BSIZE, 0);
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    TSK_FS_META meta;
+    TSK_FS_FILE fs_file;
+    TSK_FS_ATTR *fs_attr = NULL;
+    TSK_FS_ATTR_RUN *run_head = NULL, *run_prev = NULL;
+    TSK_FS_USNJ_FILTER filter;
+    size_t last = jrnl.m_recs.size() - 1;
+    size_t first_b = 0;
+    int retval = 1;
+
+    for (size_t i = 0; i < nruns; i++) {
+        if (s_usnj_runs[i][2] != 0) {
+            memcpy(&img_buf[s_usnj_runs[i][2] * USNJ_TEST_BSIZE],
+                &jrnl.m_buf[s_usnj_runs[i][0] * USNJ_TEST_BSIZE],
+                s_usnj_runs[i][1] * USNJ_TEST_BSIZE);
+        }
+    }
+    if (s_img.write(img_buf))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_RAW, &img)) == NULL)
+        return 1;
+
+    memset(&meta, 0, sizeof(meta));
+    memset(&fs_file, 0, sizeof(fs_file));
+    fs_file.fs_info = fs;
+    fs_file.meta = &meta;
+    for (size_t i = 0; i < nruns; i++) {
+        TSK_FS_ATTR_RUN *run = tsk_fs_attr_run_alloc();
+        if (run == NULL) {
+            tsk_error_print(stderr);
+            tsk_fs_attr_run_free(run_head);
+            goto end;
+        }
+        run->offset = s_usnj_runs[i][0];
+        run->len = s_usnj_runs[i][1];
+        run->addr = s_usnj_runs[i][2];
+        if (run->addr == 0)
+            run->flags = TSK_FS_ATTR_RUN_FLAG_SPARSE;
+        if (run_prev)
+            run_prev->next = run;
+        else
+            run_head = run;
+        run_prev = run;
+    }
+    if (((fs_attr = tsk_fs_attr_alloc(TSK_FS_ATTR_NONRES)) == NULL)
+        || tsk_fs_attr_set_run(&fs_file, fs_attr, run_head, "$J",
+            TSK_FS_ATTR_TYPE_NTFS_DATA, 0, jlen, jlen, jlen,
+            (TSK_FS_ATTR_FLAG_ENUM) (TSK_FS_ATTR_NONRES |
+                TSK_FS_ATTR_SPARSE), 0)) {
+        tsk_error_print(stderr);
+        goto end;
+    }
+
+    if (usnj_test_walk(fs_attr, jrnl, NULL, 0, last, 0,
+            "sparse: all records"))
+        goto end;
+
+    // a USN in the leading sparse run, and one in the last data run
+    for (size_t i = 0; i < jrnl.m_recs.size(); i++) {
+        if (jrnl.m_recs[i].off >= 5120 * USNJ_TEST_BSIZE) {
+            first_b = i;
+            break;
+        }
+    }
+    memset(&filter, 0, sizeof(filter));
+    filter.usn_min = 1000;
+    filter.usn_max = jrnl.m_recs[first_b - 1].off;
+    if (usnj_test_walk(fs_attr, jrnl, &filter, 0, first_b - 1, 0,
+            "sparse: USN in the sparse run"))
+        goto end;
+    filter.usn_min = jrnl.m_recs[first_b + 3].off - 8;
+    filter.usn_max = 0;
+    if (usnj_test_walk(fs_attr, jrnl, &filter, first_b + 3, last, 0,
+            "sparse: USN in the last run"))
+        goto end;
+
+    retval = 0;
+
+  end:
+    if (fs_attr)
+        tsk_fs_attr_free(fs_attr);
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    if (test_usnj_walk()) {
+        fprintf(stderr, "UsnJrnl walk failure\n");
+        retval = 1;
+    }
+    else if (test_usnj_walk_sparse()) {
+        fprintf(stderr, "sparse UsnJrnl walk failure\n");
+        retval = 1;
+    }
+
+    if (retval == 0)
+        printf("Tests Passed\n");
+    return retval;
+}
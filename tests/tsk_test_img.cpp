@@ -0,0 +1,78 @@
+/*
+* The Sleuth Kit
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+#include "tsk_test_img.h"
+
+#include <unistd.h>
+
+void
+put_u16(std::vector<uint8_t> &a_buf, size_t a_off, uint16_t a_val)
+{
+    a_buf[a_off] = a_val & 0xff;
+    a_buf[a_off + 1] = a_val >> 8;
+}
+
+void
+put_u32(std::vector<uint8_t> &a_buf, size_t a_off, uint32_t a_val)
+{
+    for (int i = 0; i < 4; i++)
+        a_buf[a_off + i] = (a_val >> (8 * i)) & 0xff;
+}
+
+void
+put_u64(std::vector<uint8_t> &a_buf, size_t a_off, uint64_t a_val)
+{
+    for (int i = 0; i < 8; i++)
+        a_buf[a_off + i] = (a_val >> (8 * i)) & 0xff;
+}
+
+TskTestImg::~TskTestImg()
+{
+    unlink(m_path);
+}
+
+int
+TskTestImg::write(const std::vector<uint8_t> &a_img, size_t a_len) const
+{
+    FILE *hFile;
+    size_t cnt;
+
+    if ((a_len == 0) || (a_len > a_img.size()))
+        a_len = a_img.size();
+    if ((hFile = fopen(m_path, "wb")) == NULL) {
+        fprintf(stderr, "Error writing %s\n", m_path);
+        return 1;
+    }
+    cnt = fwrite(&a_img[0], a_len, 1, hFile);
+    if ((fclose(hFile) != 0) || (cnt != 1)) {
+        fprintf(stderr, "Error writing %s\n", m_path);
+        return 1;
+    }
+    return 0;
+}
+
+TSK_FS_INFO *
+TskTestImg::openFs(TSK_FS_TYPE_ENUM a_ftype, TSK_IMG_INFO ** a_img) const
+{
+    TSK_FS_INFO *fs;
+
+    *a_img = tsk_img_open_utf8_sing(m_path, TSK_IMG_TYPE_RAW, 0);
+    if (*a_img == NULL) {
+        fprintf(stderr, "Error opening %s\n", m_path);
+        tsk_error_print(stderr);
+        return NULL;
+    }
+    fs = tsk_fs_open_img(*a_img, 0, a_ftype);
+    if (fs == NULL) {
+        fprintf(stderr, "Error opening %s file system in %s\n",
+            tsk_fs_type_toname(a_ftype), m_path);
+        tsk_error_print(stderr);
+        tsk_img_close(*a_img);
+        return NULL;
+    }
+    return fs;
+}
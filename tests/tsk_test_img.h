@@ -0,0 +1,47 @@
+/*
+* The Sleuth Kit
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+#ifndef _TSK_TEST_IMG_H
+#define _TSK_TEST_IMG_H
+
+/* Helpers for the tests that build their file system images in memory */
+
+#include "tsk/tsk_tools_i.h"
+
+#include <vector>
+
+/* Store little endian values in an image buffer */
+extern void put_u16(std::vector<uint8_t> &a_buf, size_t a_off,
+    uint16_t a_val);
+extern void put_u32(std::vector<uint8_t> &a_buf, size_t a_off,
+    uint32_t a_val);
+extern void put_u64(std::vector<uint8_t> &a_buf, size_t a_off,
+    uint64_t a_val);
+
+/* A raw image file that a test writes and opens.  The file is removed
+ * when the object is destroyed. */
+class TskTestImg {
+public:
+    TskTestImg(const char *a_path) : m_path(a_path) {}
+    ~TskTestImg();
+
+    const char *path() const { return m_path; }
+
+    /* Write a_img to the file, cut after a_len bytes if not 0.
+     * Prints a message and returns 1 on error. */
+    int write(const std::vector<uint8_t> &a_img, size_t a_len = 0) const;
+
+    /* Open the file and the file system in it.  Prints the error and
+     * returns NULL if either cannot be opened. */
+    TSK_FS_INFO *openFs(TSK_FS_TYPE_ENUM a_ftype,
+        TSK_IMG_INFO ** a_img) const;
+
+private:
+    const char *m_path;
+};
+
+#endif
@@ -0,0 +1,824 @@
+/*
+* The Sleuth Kit
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test the WFS0.4/5 video apis on a small image that is built in memory */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk/fs/tsk_wfsfs.h"
+#include "tsk_test_img.h"
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#define WFS_BS          512
+#define WFS_BPF         8
+#define WFS_FIRST_IDX   32
+#define WFS_RES         2
+
+static TskTestImg s_img("wfs_apis.dd");
+static const char *s_out_dir = "wfs_apis.out";
+static const char *s_keys_path = "wfs_apis.keys";
+
+
+/* Pack a WFS timestamp */
+static uint32_t
+wfs_time(int a_year, int a_mon, int a_mday, int a_hour, int a_min,
+    int a_sec)
+{
+    return ((uint32_t) (a_year - 2000) << 26) | (a_mon << 22) |
+        (a_mday << 17) | (a_hour << 12) | (a_min << 6) | a_sec;
+}
+
+static void
+store_u32(uint8_t * a_buf, uint32_t a_val)
+{
+    for (int i = 0; i < 4; i++)
+        a_buf[i] = (a_val >> (8 * i)) & 0xff;
+}
+
+/*
+ * WFS0.4 image with a_nidx fragments of WFS_BPF blocks.  Every data
+ * fragment is filled with a pattern that depends on its number.
+ */
+class WfsImage {
+public:
+    WfsImage(uint32_t a_nidx) {
+        m_first_data =
+            WFS_FIRST_IDX + (a_nidx * 32 + WFS_BS - 1) / WFS_BS + 4;
+        m_img.resize(((size_t) m_first_data + a_nidx * WFS_BPF) * WFS_BS);
+        memcpy(&m_img[0], "WFS0.4", 6);
+
+        size_t sb = 0x3000;
+        uint32_t t0 = wfs_time(2020, 3, 1, 10, 0, 0);
+        uint32_t t1 = wfs_time(2020, 3, 1, 12, 0, 0);
+        put_u32(m_img, sb + 16, t1);
+        put_u32(m_img, sb + 20, t1);
+        put_u32(m_img, sb + 24, 10);
+        put_u32(m_img, sb + 28, 2);
+        put_u32(m_img, sb + 32, a_nidx - 1);
+        put_u32(m_img, sb + 36, t0);
+        put_u32(m_img, sb + 40, t0);
+        put_u32(m_img, sb + 44, WFS_BS);
+        put_u32(m_img, sb + 48, WFS_BPF);
+        put_u32(m_img, sb + 56, WFS_RES);
+        put_u32(m_img, sb + 68, WFS_FIRST_IDX);
+        put_u32(m_img, sb + 72, m_first_data);
+        put_u32(m_img, sb + 76, a_nidx);
+
+        for (uint32_t f = 0; f < a_nidx; f++) {
+            size_t off = fragOffset(f);
+            for (size_t i = 0; i < WFS_BPF * WFS_BS; i++)
+                m_img[off + i] = (uint8_t) (f * 7 + i * 13 + (i >> 9));
+        }
+    }
+
+    size_t fragOffset(uint32_t a_frag) const {
+        return ((size_t) m_first_data + (size_t) a_frag * WFS_BPF) *
+            WFS_BS;
+    }
+
+    /* Add a video made of the fragments in a_chain; the last fragment
+     * holds a_blks_last blocks */
+    void addVideo(const std::vector<uint32_t> &a_chain,
+        uint16_t a_blks_last, uint8_t a_cam, uint32_t a_start,
+        uint32_t a_end) {
+        for (size_t i = 0; i < a_chain.size(); i++) {
+            size_t off = WFS_FIRST_IDX * WFS_BS + a_chain[i] * 32;
+            memset(&m_img[off], 0, 32);
+            m_img[off + 1] = (i == 0) ? 0x02 : 0x01;
+            put_u16(m_img, off + 2,
+                (uint16_t) ((i == 0) ? a_chain.size() - 1 : i));
+            put_u32(m_img, off + 4, (i == 0) ? 0 : a_chain[i - 1]);
+            put_u32(m_img, off + 8,
+                (i + 1 < a_chain.size()) ? a_chain[i + 1] : 0);
+            put_u32(m_img, off + 12, a_start);
+            put_u32(m_img, off + 16, a_end);
+            put_u16(m_img, off + 22, a_blks_last);
+            put_u32(m_img, off + 24, a_chain[0]);
+            m_img[off + 31] = a_cam;
+        }
+    }
+
+    /* Store a_data in the fragments of a_chain */
+    void setData(const std::vector<uint32_t> &a_chain,
+        const std::vector<uint8_t> &a_data) {
+        size_t frag_len = WFS_BPF * WFS_BS;
+        for (size_t i = 0; i < a_chain.size(); i++) {
+            size_t off = i * frag_len;
+            if (off >= a_data.size())
+                break;
+            size_t len = a_data.size() - off;
+            if (len > frag_len)
+                len = frag_len;
+            memcpy(&m_img[fragOffset(a_chain[i])], &a_data[off], len);
+        }
+    }
+
+    /* Expected content of a video added with addVideo */
+    std::vector<uint8_t> videoData(const std::vector<uint32_t> &a_chain,
+        uint16_t a_blks_last) const {
+        std::vector<uint8_t> data;
+        for (size_t i = 0; i < a_chain.size(); i++) {
+            size_t len = (i + 1 < a_chain.size())
+                ? WFS_BPF * WFS_BS : (size_t) a_blks_last * WFS_BS;
+            size_t off = fragOffset(a_chain[i]);
+            data.insert(data.end(), &m_img[off], &m_img[off] + len);
+        }
+        return data;
+    }
+
+    /* Write the image, cut after a_len bytes if not 0 */
+    int write(const TskTestImg & a_file, size_t a_len = 0) const {
+        return a_file.write(m_img, a_len);
+    }
+
+private:
+    uint32_t m_first_data;
+    std::vector<uint8_t> m_img;
+};
+
+typedef struct {
+    std::vector<uint32_t> chain;
+    uint16_t blks_last;
+    uint8_t cam;
+    uint32_t start;
+    uint32_t end;
+    TSK_INUM_T name_inum = 0;   // added to a duplicate name, 0 if unique
+} TEST_VIDEO;
+
+
+static void
+clean_out_dir()
+{
+    std::string cmd("rm -rf ");
+    cmd += s_out_dir;
+    if (system(cmd.c_str()) != 0)
+        fprintf(stderr, "Error removing %s\n", s_out_dir);
+}
+
+/* Compare an exported video with its expected content
+ * @param a_expected 1 if the video must have been exported, 0 if not
+ * @returns 1 if a test failed */
+static int
+check_video(const WfsImage & a_img, const TEST_VIDEO & a_video,
+    int a_expected)
+{
+    char name[WFSFS_MAXNAMLEN + 1];
+    uint8_t t_start[4], t_end[4];
+
+    store_u32(t_start, a_video.start);
+    store_u32(t_end, a_video.end);
+    wfsfs_gen_name(WFSFS_VIDEO_PREFIX, t_start, t_end, a_video.cam, name,
+        sizeof(name));
+    if (a_video.name_inum != 0) {
+        // Vid-...-HHMMSS.CCC.h264 -> Vid-...-HHMMSS.CCC-inum.h264
+        snprintf(name + strlen(name) - strlen(".h264"),
+            sizeof(name) - strlen(name) + strlen(".h264"),
+            "-%" PRIuINUM ".h264", a_video.name_inum);
+    }
+
+    std::string path(s_out_dir);
+    path += "/";
+    path += name;
+    FILE *hFile = fopen(path.c_str(), "rb");
+    if (hFile == NULL) {
+        if (a_expected) {
+            fprintf(stderr, "Video %s was not exported\n", name);
+            return 1;
+        }
+        return 0;
+    }
+    if (!a_expected) {
+        fprintf(stderr, "Video %s should not have been exported\n", name);
+        fclose(hFile);
+        return 1;
+    }
+
+    std::vector<uint8_t> expected =
+        a_img.videoData(a_video.chain, a_video.blks_last);
+    std::vector<uint8_t> data(expected.size() + 1);
+    size_t len = fread(&data[0], 1, data.size(), hFile);
+    fclose(hFile);
+    if ((len != expected.size())
+        || (memcmp(&data[0], &expected[0], len) != 0)) {
+        fprintf(stderr, "Video %s differs from its fragments (%" PRIuSIZE
+            " vs %" PRIuSIZE " bytes)\n", name, len, expected.size());
+        return 1;
+    }
+    return 0;
+}
+
+/* Export with the given options and compare the videos selected by
+ * a_expected
+ * @returns 1 if a test failed */
+static int
+test_export(const WfsImage & a_img, const std::vector<TEST_VIDEO> &a_videos,
+    const TSK_FS_WFSEXPORT_OPTS & a_opts, const std::vector<int> &a_expected)
+{
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    unsigned int count = 0, exp_count = 0;
+    int retval = 0;
+
+    clean_out_dir();
+    if (mkdir(s_out_dir, 0755) != 0) {
+        fprintf(stderr, "Error creating %s\n", s_out_dir);
+        return 1;
+    }
+
+    if ((fs = s_img.openFs(TSK_FS_TYPE_WFS_04, &img)) == NULL)
+        return 1;
+
+    if (tsk_fs_wfsexport(fs, s_out_dir, &a_opts, &count)) {
+        fprintf(stderr, "Error exporting videos (%u threads)\n",
+            a_opts.nthreads);
+        tsk_error_print(stderr);
+        retval = 1;
+    }
+    else {
+        for (size_t i = 0; i < a_videos.size(); i++) {
+            exp_count += a_expected[i];
+            if (check_video(a_img, a_videos[i], a_expected[i]))
+                retval = 1;
+        }
+        if (count != exp_count) {
+            fprintf(stderr, "Exported %u videos instead of %u\n", count,
+                exp_count);
+            retval = 1;
+        }
+    }
+
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+/* Export the videos of a small image with different selections.  The
+ * fragments of two videos are interleaved.
+ * @returns 1 if a test failed */
+static int
+test_wfsexport()
+{
+    WfsImage img(64);
+    std::vector<TEST_VIDEO> videos;
+    const uint32_t chains[4][4] =
+        { {2, 5, 3, 0}, {4, 0, 0, 0}, {6, 7, 8, 9}, {12, 20, 11, 0} };
+    const uint16_t blks_last[4] = { 3, 5, 8, 1 };
+    const uint8_t cams[4] = { 2, 6, 2, 10 };
+    // 2020-03-01 00:00:00 UTC
+    const time_t day = 1583020800;
+    TSK_FS_WFSEXPORT_OPTS opts;
+
+    for (int v = 0; v < 4; v++) {
+        TEST_VIDEO video;
+        for (int i = 0; i < 4 && chains[v][i] != 0; i++)
+            video.chain.push_back(chains[v][i]);
+        video.blks_last = blks_last[v];
+        video.cam = cams[v];
+        video.start = wfs_time(2020, 3, 1, 10 + v, 0, 0);
+        video.end = wfs_time(2020, 3, 1, 10 + v, 30, 0);
+        img.addVideo(video.chain, video.blks_last, video.cam, video.start,
+            video.end);
+        videos.push_back(video);
+    }
+    if (img.write(s_img))
+        return 1;
+
+    opts.camera = -1;
+    opts.start_time = 0;
+    opts.end_time = 0;
+    for (unsigned int t = 1; t <= 3; t++) {
+        opts.nthreads = t;
+        if (test_export(img, videos, opts, std::vector<int>(4, 1)))
+            return 1;
+    }
+
+    opts.nthreads = 2;
+    opts.camera = WFSFS_CAM_NUM(2);
+    if (test_export(img, videos, opts, std::vector<int>{1, 0, 1, 0}))
+        return 1;
+
+    // videos that end at or after 12:15
+    opts.camera = -1;
+    opts.start_time = day + 12 * 3600 + 15 * 60;
+    if (test_export(img, videos, opts, std::vector<int>{0, 0, 1, 1}))
+        return 1;
+
+    // videos that start at or before 12:15
+    opts.start_time = 0;
+    opts.end_time = day + 12 * 3600 + 15 * 60;
+    if (test_export(img, videos, opts, std::vector<int>{1, 1, 1, 0}))
+        return 1;
+
+    return 0;
+}
+
+/* Export more videos than files can be open, with the fragments of all
+ * videos interleaved, so that every writer switches files all the time.
+ * @returns 1 if a test failed */
+static int
+test_wfsexport_many()
+{
+    const uint32_t nvideos = 60;
+    WfsImage img(2 * nvideos + WFS_RES);
+    std::vector<TEST_VIDEO> videos;
+    struct rlimit old_lim, lim;
+    TSK_FS_WFSEXPORT_OPTS opts;
+    int retval;
+
+    for (uint32_t v = 0; v < nvideos; v++) {
+        TEST_VIDEO video;
+        video.chain.push_back(WFS_RES + v);
+        video.chain.push_back(WFS_RES + nvideos + v);
+        video.blks_last = 1 + v % WFS_BPF;
+        video.cam = v % 16;
+        video.start = wfs_time(2020, 3, 1, v / 60, v % 60, 0);
+        video.end = wfs_time(2020, 3, 1, v / 60, v % 60, 30);
+        img.addVideo(video.chain, video.blks_last, video.cam, video.start,
+            video.end);
+        videos.push_back(video);
+    }
+    if (img.write(s_img))
+        return 1;
+
+    if (getrlimit(RLIMIT_NOFILE, &old_lim) != 0) {
+        fprintf(stderr, "Error getting the open file limit\n");
+        return 1;
+    }
+    lim = old_lim;
+    lim.rlim_cur = 32;
+    if (setrlimit(RLIMIT_NOFILE, &lim) != 0) {
+        fprintf(stderr, "Error setting the open file limit\n");
+        return 1;
+    }
+
+    opts.camera = -1;
+    opts.start_time = 0;
+    opts.end_time = 0;
+    opts.nthreads = 4;
+    retval = test_export(img, videos, opts, std::vector<int>(nvideos, 1));
+
+    setrlimit(RLIMIT_NOFILE, &old_lim);
+    return retval;
+}
+
+/* Export videos that have the same times and camera, and so the same
+ * name, with their fragments interleaved with more videos than a writer
+ * keeps open.
+ * @returns 1 if a test failed */
+static int
+test_wfsexport_dup()
+{
+    const uint32_t nvideos = 12;
+    WfsImage img(2 * nvideos + WFS_RES);
+    std::vector<TEST_VIDEO> videos;
+    TSK_FS_WFSEXPORT_OPTS opts;
+
+    for (uint32_t v = 0; v < nvideos; v++) {
+        TEST_VIDEO video;
+        video.chain.push_back(WFS_RES + v);
+        video.chain.push_back(WFS_RES + nvideos + v);
+        video.blks_last = 1 + v % WFS_BPF;
+        video.cam = 3;
+        video.start = wfs_time(2020, 3, 1, 10, 0, 0);
+        video.end = wfs_time(2020, 3, 1, 10, 30, 0);
+        // the first video keeps the name, the others get their inode
+        if (v > 0)
+            video.name_inum = WFS_RES + v;
+        img.addVideo(video.chain, video.blks_last, video.cam, video.start,
+            video.end);
+        videos.push_back(video);
+    }
+    if (img.write(s_img))
+        return 1;
+
+    opts.camera = -1;
+    opts.start_time = 0;
+    opts.end_time = 0;
+    opts.nthreads = 2;
+    return test_export(img, videos, opts, std::vector<int>(nvideos, 1));
+}
+
+/* Decode timestamps and build names from them.  Times are converted with
+ * the daylight saving time rules of the local time zone.
+ * @returns 1 if a test failed */
+static int
+test_wfs_times()
+{
+    WfsImage img(16);
+    TSK_IMG_INFO *img_info;
+    TSK_FS_INFO *fs;
+    WFSFS_TIME tm;
+    uint8_t t_start[4], t_end[4];
+    char name[WFSFS_MAXNAMLEN + 1];
+    int retval = 0;
+
+    store_u32(t_start, wfs_time(2020, 7, 15, 12, 34, 56));
+    wfsfs_decode_time(t_start, &tm);
+    if ((tm.year != 2020) || (tm.mon != 7) || (tm.mday != 15)
+        || (tm.hour != 12) || (tm.min != 34) || (tm.sec != 56)) {
+        fprintf(stderr, "Wrong decoded time: %d-%d-%d %d:%d:%d\n",
+            tm.year, tm.mon, tm.mday, tm.hour, tm.min, tm.sec);
+        return 1;
+    }
+
+    // the end time only adds its time of day, the camera number is 1-based
+    store_u32(t_end, wfs_time(2020, 7, 16, 0, 0, 1));
+    wfsfs_gen_name(WFSFS_VIDEO_PREFIX, t_start, t_end, 6, name,
+        sizeof(name));
+    if (strcmp(name, "Vid-20200715-123456-000001.002.h264") != 0) {
+        fprintf(stderr, "Wrong video name: %s\n", name);
+        return 1;
+    }
+    wfsfs_gen_name(WFSFS_ORPHAN_PREFIX, t_start, t_end, 62, name,
+        sizeof(name));
+    if (strcmp(name, "Orphan-20200715-123456-000001.016.h264") != 0) {
+        fprintf(stderr, "Wrong orphan name: %s\n", name);
+        return 1;
+    }
+
+    // one video in winter and one in summer time, each one hour long
+    img.addVideo(std::vector<uint32_t>{2}, 1, 2,
+        wfs_time(2020, 1, 15, 12, 0, 0), wfs_time(2020, 1, 15, 13, 0, 0));
+    img.addVideo(std::vector<uint32_t>{3}, 1, 2,
+        wfs_time(2020, 7, 15, 12, 0, 0), wfs_time(2020, 7, 15, 13, 0, 0));
+    if (img.write(s_img))
+        return 1;
+
+    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset();
+    if ((fs = s_img.openFs(TSK_FS_TYPE_WFS_04, &img_info)) == NULL) {
+        retval = 1;
+    }
+    else {
+        // 2020-01-15 11:00:00 and 2020-07-15 10:00:00 UTC
+        const time_t expected[2] = { 1579086000, 1594807200 };
+        for (int i = 0; i < 2; i++) {
+            TSK_FS_FILE *fs_file = tsk_fs_file_open_meta(fs, NULL, 2 + i);
+            if (fs_file == NULL) {
+                fprintf(stderr, "Error opening video %d\n", 2 + i);
+                tsk_error_print(stderr);
+                retval = 1;
+                break;
+            }
+            if ((fs_file->meta->ctime != expected[i])
+                || (fs_file->meta->mtime != expected[i] + 3600)) {
+                fprintf(stderr, "Wrong times of video %d: %" PRIu64 " %"
+                    PRIu64 " instead of %" PRIu64 "\n", 2 + i,
+                    (uint64_t) fs_file->meta->ctime,
+                    (uint64_t) fs_file->meta->mtime,
+                    (uint64_t) expected[i]);
+                retval = 1;
+            }
+            tsk_fs_file_close(fs_file);
+        }
+
+        // around the switches to summer time (02:00 CET on 2020-03-29)
+        // and back (03:00 CEST on 2020-10-25)
+        const struct {
+            uint32_t wfs;
+            time_t utc;
+        } switches[] = {
+            { wfs_time(2020, 3, 29, 1, 59, 59), 1585443599 },
+            { wfs_time(2020, 3, 29, 3, 0, 0), 1585443600 },
+            { wfs_time(2020, 10, 25, 1, 59, 59), 1603583999 },
+            { wfs_time(2020, 10, 25, 3, 0, 0), 1603591200 },
+            { wfs_time(2063, 12, 31, 23, 0, 0), 2966364000 },
+        };
+        for (size_t i = 0; i < sizeof(switches) / sizeof(switches[0]);
+            i++) {
+            uint8_t t_buf[4];
+            time_t utc;
+
+            store_u32(t_buf, switches[i].wfs);
+            utc = wfsfs_mktime((WFSFS_INFO *) fs, t_buf);
+            if (utc != switches[i].utc) {
+                fprintf(stderr, "Wrong time %" PRIu64 " instead of %"
+                    PRIu64 " at DST switch %" PRIuSIZE "\n",
+                    (uint64_t) utc, (uint64_t) switches[i].utc, i);
+                retval = 1;
+            }
+        }
+        tsk_fs_close(fs);
+        tsk_img_close(img_info);
+    }
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    return retval;
+}
+
+/* Store a NAL unit header: a start code of a_sc_len bytes, the NAL
+ * header byte and the first byte of the payload */
+static void
+put_nal(std::vector<uint8_t> &a_buf, size_t a_off, int a_sc_len,
+    uint8_t a_nal, uint8_t a_payload)
+{
+    size_t i;
+    for (i = 0; i < (size_t) a_sc_len - 1; i++)
+        a_buf[a_off + i] = 0x00;
+    a_buf[a_off + i++] = 0x01;
+    a_buf[a_off + i++] = a_nal;
+    a_buf[a_off + i] = a_payload;
+}
+
+/* Compare two keyframe indexes
+ * @returns 1 if they differ */
+static int
+cmp_keys(const TSK_FS_WFSKEYS * a_keys1, const TSK_FS_WFSKEYS * a_keys2)
+{
+    if ((a_keys1->size != a_keys2->size)
+        || (a_keys1->count != a_keys2->count))
+        return 1;
+    for (size_t i = 0; i < a_keys1->count; i++) {
+        if ((a_keys1->keys[i].offset != a_keys2->keys[i].offset)
+            || (a_keys1->keys[i].time != a_keys2->keys[i].time))
+            return 1;
+    }
+    return 0;
+}
+
+/* Write a_len bytes of a file that was read into a_data
+ * @returns 1 on error */
+static int
+write_file(const char *a_path, const std::vector<uint8_t> &a_data,
+    size_t a_len)
+{
+    FILE *hFile = fopen(a_path, "wb");
+    if (hFile == NULL)
+        return 1;
+    size_t cnt = (a_len > 0) ? fwrite(&a_data[0], a_len, 1, hFile) : 1;
+    return (fclose(hFile) != 0 || cnt != 1);
+}
+
+/* Build the keyframe index of a synthetic H.264 video.  The start codes
+ * of some IDR pictures span the 1 MiB reads of the scan at different
+ * positions.  The index is then saved to and loaded from a sidecar file.
+ * @returns 1 if a test failed */
+static int
+test_wfskeys()
+{
+    const size_t mb = 1024 * 1024;
+    const size_t frag_len = WFS_BPF * WFS_BS;
+    const size_t vid_len = 5 * mb;
+    const uint32_t nfrags = (uint32_t) (vid_len / frag_len);
+    WfsImage img(nfrags + WFS_RES + 2);
+    std::vector<uint32_t> chain;
+    std::vector<uint8_t> data(vid_len, 0xAA);
+    std::vector<TSK_OFF_T> expected;
+    TSK_IMG_INFO *img_info;
+    TSK_FS_INFO *fs;
+    TSK_FS_FILE *fs_file;
+    TSK_FS_WFSKEYS *keys, *loaded;
+    // 2020-03-01 10:00:00 and 10:30:00 UTC
+    const time_t t_start = 1583056800, t_end = t_start + 1800;
+    int retval = 0;
+
+    // SPS and PPS in front of the IDR picture: the key starts at the SPS
+    put_nal(data, 1000, 4, 0x67, 0x42);
+    put_nal(data, 1010, 4, 0x68, 0xce);
+    put_nal(data, 1020, 4, 0x65, 0x88);
+    expected.push_back(1000);
+    // non-IDR slice, and an IDR slice that does not start a picture
+    put_nal(data, 5000, 3, 0x41, 0x9a);
+    put_nal(data, 6000, 3, 0x65, 0x08);
+    // start codes cut by the reads after 2, 4 and 5 of their 6 bytes
+    put_nal(data, mb - 2, 4, 0x65, 0x88);
+    expected.push_back(mb - 2);
+    put_nal(data, 2 * mb - 4, 4, 0x65, 0x88);
+    expected.push_back(2 * mb - 4);
+    put_nal(data, 3 * mb - 5, 4, 0x65, 0x88);
+    expected.push_back(3 * mb - 5);
+    // 3 byte start code cut after its first byte
+    put_nal(data, 4 * mb - 1, 3, 0x65, 0x88);
+    expected.push_back(4 * mb - 1);
+    put_nal(data, 4 * mb + 100, 4, 0x67, 0x42);
+    put_nal(data, 4 * mb + 120, 4, 0x65, 0xb8);
+    expected.push_back(4 * mb + 100);
+    // IDR picture at the very end of the video
+    put_nal(data, vid_len - 6, 4, 0x65, 0x88);
+    expected.push_back(vid_len - 6);
+
+    for (uint32_t i = 0; i < nfrags; i++)
+        chain.push_back(WFS_RES + i);
+    img.addVideo(chain, WFS_BPF, 2, wfs_time(2020, 3, 1, 10, 0, 0),
+        wfs_time(2020, 3, 1, 10, 30, 0));
+    img.setData(chain, data);
+    if (img.write(s_img))
+        return 1;
+
+    if ((fs = s_img.openFs(TSK_FS_TYPE_WFS_04, &img_info)) == NULL)
+        return 1;
+    if ((fs_file = tsk_fs_file_open_meta(fs, NULL, WFS_RES)) == NULL) {
+        fprintf(stderr, "Error opening video %d\n", WFS_RES);
+        tsk_error_print(stderr);
+        tsk_fs_close(fs);
+        tsk_img_close(img_info);
+        return 1;
+    }
+
+    if ((keys = tsk_fs_wfskeys_build(fs_file)) == NULL) {
+        fprintf(stderr, "Error building the keyframe index\n");
+        tsk_error_print(stderr);
+        retval = 1;
+    }
+    else if ((keys->count != expected.size())
+        || (keys->size != (TSK_OFF_T) vid_len)) {
+        fprintf(stderr, "Found %" PRIuSIZE " keyframes instead of %"
+            PRIuSIZE "\n", keys->count, expected.size());
+        retval = 1;
+    }
+    else {
+        for (size_t i = 0; i < keys->count; i++) {
+            if (keys->keys[i].offset != expected[i]) {
+                fprintf(stderr, "Keyframe %" PRIuSIZE " at %" PRIdOFF
+                    " instead of %" PRIdOFF "\n", i, keys->keys[i].offset,
+                    expected[i]);
+                retval = 1;
+            }
+            if ((keys->keys[i].time < t_start)
+                || (keys->keys[i].time > t_end)
+                || ((i > 0) && (keys->keys[i].time <
+                        keys->keys[i - 1].time))) {
+                fprintf(stderr, "Wrong time of keyframe %" PRIuSIZE "\n",
+                    i);
+                retval = 1;
+            }
+        }
+        if (tsk_fs_wfskeys_find(keys, t_start - 1) != &keys->keys[0]
+            || tsk_fs_wfskeys_find(keys, t_end + 1) !=
+            &keys->keys[keys->count - 1]) {
+            fprintf(stderr, "Wrong keyframe found for a time outside of "
+                "the video\n");
+            retval = 1;
+        }
+    }
+
+    if (retval == 0) {
+        std::vector<uint8_t> sidecar(WFS_BS);
+        size_t len;
+        FILE *hFile;
+
+        if (tsk_fs_wfskeys_save(keys, s_keys_path)) {
+            fprintf(stderr, "Error saving the keyframe index\n");
+            tsk_error_print(stderr);
+            retval = 1;
+        }
+        else if ((loaded = tsk_fs_wfskeys_load(s_keys_path)) == NULL) {
+            fprintf(stderr, "Error loading the keyframe index\n");
+            tsk_error_print(stderr);
+            retval = 1;
+        }
+        else {
+            if (cmp_keys(keys, loaded)) {
+                fprintf(stderr, "Loaded keyframe index differs\n");
+                retval = 1;
+            }
+            tsk_fs_wfskeys_free(loaded);
+        }
+
+        // a cut or damaged sidecar file must not be used
+        if ((hFile = fopen(s_keys_path, "rb")) == NULL) {
+            fprintf(stderr, "Error reading %s\n", s_keys_path);
+            retval = 1;
+        }
+        else {
+            len = fread(&sidecar[0], 1, sidecar.size(), hFile);
+            fclose(hFile);
+
+            for (int t = 0; t < 3 && retval == 0; t++) {
+                std::vector<uint8_t> bad(sidecar);
+                size_t bad_len = len;
+                if (t == 0)
+                    bad_len -= 8;           // last key cut
+                else if (t == 1)
+                    bad[0] = 'X';           // magic
+                else            // second key before the first
+                    memset(&bad[24 + 16 + 8], 0, 8);
+                if (write_file(s_keys_path, bad, bad_len)) {
+                    fprintf(stderr, "Error writing %s\n", s_keys_path);
+                    retval = 1;
+                }
+                else if ((loaded = tsk_fs_wfskeys_load(s_keys_path)) !=
+                    NULL) {
+                    fprintf(stderr, "Damaged sidecar file %d was loaded\n",
+                        t);
+                    tsk_fs_wfskeys_free(loaded);
+                    retval = 1;
+                }
+                tsk_error_reset();
+            }
+        }
+        unlink(s_keys_path);
+    }
+
+    tsk_fs_wfskeys_free(keys);
+    tsk_fs_file_close(fs_file);
+    tsk_fs_close(fs);
+    tsk_img_close(img_info);
+    return retval;
+}
+
+static TSK_WALK_RET_ENUM
+block_walk_cb(const TSK_FS_BLOCK * a_block, void *a_ptr)
+{
+    TSK_DADDR_T *last = (TSK_DADDR_T *) a_ptr;
+    *last = a_block->addr;
+    return TSK_WALK_CONT;
+}
+
+/* Walk the blocks of an image that is cut in the data area.  Blocks that
+ * are not in the image must give an error, also when only the addresses
+ * are asked for.
+ * @returns 1 if a test failed */
+static int
+test_block_walk_partial()
+{
+    WfsImage img(16);
+    TSK_IMG_INFO *img_info;
+    TSK_FS_INFO *fs;
+    int retval = 0;
+
+    if (img.write(s_img, img.fragOffset(9) + 3 * WFS_BS))
+        return 1;
+    if ((fs = s_img.openFs(TSK_FS_TYPE_WFS_04, &img_info)) == NULL)
+        return 1;
+
+    for (int aonly = 0; aonly < 2; aonly++) {
+        TSK_DADDR_T last = 0;
+        int flags = TSK_FS_BLOCK_WALK_FLAG_ALLOC |
+            TSK_FS_BLOCK_WALK_FLAG_UNALLOC;
+        if (aonly)
+            flags |= TSK_FS_BLOCK_WALK_FLAG_AONLY;
+
+        if (tsk_fs_block_walk(fs, fs->first_block, fs->last_block,
+                (TSK_FS_BLOCK_WALK_FLAG_ENUM) flags, block_walk_cb,
+                &last) == 0) {
+            fprintf(stderr, "Block walk (aonly %d) past the end of the "
+                "image did not fail\n", aonly);
+            retval = 1;
+        }
+        else if (last != fs->last_block_act) {
+            fprintf(stderr, "Block walk (aonly %d) stopped at %" PRIuDADDR
+                " instead of %" PRIuDADDR "\n", aonly, last,
+                fs->last_block_act);
+            retval = 1;
+        }
+        tsk_error_reset();
+    }
+
+    tsk_fs_close(fs);
+    tsk_img_close(img_info);
+    return retval;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    // the recorder clock is taken as local time
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    if (test_wfs_times()) {
+        fprintf(stderr, "WFS time and name failure\n");
+        retval = 1;
+    }
+    else if (test_wfsexport()) {
+        fprintf(stderr, "wfsexport failure\n");
+        retval = 1;
+    }
+    else if (test_wfsexport_many()) {
+        fprintf(stderr, "wfsexport with many videos failure\n");
+        retval = 1;
+    }
+    else if (test_wfsexport_dup()) {
+        fprintf(stderr, "wfsexport with duplicate names failure\n");
+        retval = 1;
+    }
+    else if (test_wfskeys()) {
+        fprintf(stderr, "wfskeys failure\n");
+        retval = 1;
+    }
+    else if (test_block_walk_partial()) {
+        fprintf(stderr, "block walk on a partial image failure\n");
+        retval = 1;
+    }
+
+    clean_out_dir();
+
+    if (retval == 0)
+        printf("Tests Passed\n");
+    return retval;
+}
@@ -10,6 +10,8 @@
 ** This software is distributed under the Common Public License 1.0
 */
 #include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_fs_i.h"
+#include "tsk/fs/tsk_ext2fs.h"
 #include <locale.h>
 
 #ifdef TSK_WIN32
@@ -24,9 +26,10 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-vV] image [images] [inode] blk\n"),
+        ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-F [-s seq]] [-vV] image [images] [inode] blk\n"),
         progname);
-    tsk_fprintf(stderr, "\tblk: The journal block to view\n");
+    tsk_fprintf(stderr,
+        "\tblk: The journal block to view (file system block with -F)\n");
     tsk_fprintf(stderr,
         "\tinode: The file system inode where the journal is located\n");
     tsk_fprintf(stderr,
@@ -37,6 +40,10 @@ usage()
         "\t-f fstype: File system type (use '-f list' for supported types)\n");
     tsk_fprintf(stderr,
         "\t-o imgoffset: The offset of the file system in the image (in sectors)\n");
+    tsk_fprintf(stderr,
+        "\t-F: Show the newest committed and not revoked copy of file system block blk from the journal (ext3 and ext4 only)\n");
+    tsk_fprintf(stderr,
+        "\t-s seq: Show the copy from transaction seq instead (with -F)\n");
     tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: print version\n");
     exit(1);
@@ -59,6 +66,9 @@ main(int argc, char **argv1)
     TSK_TCHAR *cp;
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
+    int fs_blk_copy = 0;
+    int use_seq = 0;
+    uint32_t seq = 0;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -74,7 +84,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:vV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:Fi:o:s:vV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -103,6 +113,9 @@ main(int argc, char **argv1)
                 usage();
             }
             break;
+        case _TSK_T('F'):
+            fs_blk_copy = 1;
+            break;
         case _TSK_T('i'):
             if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
                 tsk_img_type_print(stderr);
@@ -121,6 +134,16 @@ main(int argc, char **argv1)
                 exit(1);
             }
             break;
+        case _TSK_T('s'):
+            seq = (uint32_t) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG) {
+                TFPRINTF(stderr,
+                    _TSK_T("invalid argument: bad sequence: %s\n"),
+                    OPTARG);
+                usage();
+            }
+            use_seq = 1;
+            break;
         case _TSK_T('v'):
             tsk_verbose++;
             break;
@@ -130,6 +153,11 @@ main(int argc, char **argv1)
         }
     }
 
+    if (use_seq && (fs_blk_copy == 0)) {
+        tsk_fprintf(stderr, "-s can only be used with -F\n");
+        usage();
+    }
+
     /* We need at least two more arguments */
     if (OPTIND + 1 >= argc) {
         tsk_fprintf(stderr, "Missing image name and/or block address\n");
@@ -226,7 +254,73 @@ main(int argc, char **argv1)
         img->close(img);
         exit(1);
     }
-    if (fs->jblk_walk(fs, blk, blk, 0, 0, NULL)) {
+
+    if (fs_blk_copy) {
+        const EXT2FS_JBLK_COPY *copies;
+        const EXT2FS_JBLK_COPY *copy = NULL;
+        size_t cnt, i;
+        char *buf;
+        ssize_t len;
+
+        if (TSK_FS_TYPE_ISEXT(fs->ftype) == 0) {
+            tsk_fprintf(stderr,
+                "-F is only supported for ext3 and ext4 journals\n");
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+        if (ext2fs_jindex_find(fs, blk, &copies, &cnt)) {
+            tsk_error_print(stderr);
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+
+        // newest copy first
+        for (i = cnt; i > 0; i--) {
+            if ((use_seq && (copies[i - 1].seq == seq))
+                || ((use_seq == 0) && ((copies[i - 1].flags &
+                            (EXT2FS_JBLK_COPY_COMMIT |
+                                EXT2FS_JBLK_COPY_REVOKED)) ==
+                        EXT2FS_JBLK_COPY_COMMIT))) {
+                copy = &copies[i - 1];
+                break;
+            }
+        }
+        if (copy == NULL) {
+            tsk_fprintf(stderr,
+                "No copy of block %" PRIuDADDR " found in the journal\n",
+                blk);
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+
+        if ((buf = (char *) tsk_malloc(fs->block_size)) == NULL) {
+            tsk_error_print(stderr);
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+        if ((len = ext2fs_jblk_copy_read(fs, copy, buf,
+                    fs->block_size)) == -1) {
+            tsk_error_print(stderr);
+            free(buf);
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+        if ((len > 0) && (fwrite(buf, len, 1, stdout) != 1)) {
+            tsk_fprintf(stderr, "Error writing block %" PRIuDADDR "\n",
+                blk);
+            free(buf);
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+        free(buf);
+    }
+    else if (fs->jblk_walk(fs, blk, blk, 0, 0, NULL)) {
         tsk_error_print(stderr);
         fs->close(fs);
         img->close(img);
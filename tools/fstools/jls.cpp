@@ -20,7 +20,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-vV] image [inode]\n"),
+        ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-FvV] image [inode]\n"),
         progname);
     tsk_fprintf(stderr,
         "\t-i imgtype: The format of the image file (use '-i list' for supported types)\n");
@@ -30,6 +30,8 @@ usage()
         "\t-f fstype: File system type (use '-f list' for supported types)\n");
     tsk_fprintf(stderr,
         "\t-o imgoffset: The offset of the file system in the image (in sectors)\n");
+    tsk_fprintf(stderr,
+        "\t-F: List the journal copies of each file system block (ext3/ext4 only)\n");
     tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: print version\n");
     exit(1);
@@ -51,6 +53,7 @@ main(int argc, char **argv1)
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
     TSK_TCHAR *cp;
+    int walk_flags = TSK_FS_JENTRY_WALK_FLAG_NONE;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -66,7 +69,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:vV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:Ff:i:o:vV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -95,6 +98,9 @@ main(int argc, char **argv1)
                 usage();
             }
             break;
+        case _TSK_T('F'):
+            walk_flags |= TSK_FS_JENTRY_WALK_FLAG_FSBLK;
+            break;
         case _TSK_T('i'):
             if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
                 tsk_img_type_print(stderr);
@@ -207,7 +213,16 @@ main(int argc, char **argv1)
         img->close(img);
         exit(1);
     }
-    if (fs->jentry_walk(fs, 0, 0, NULL)) {
+    if ((walk_flags & TSK_FS_JENTRY_WALK_FLAG_FSBLK)
+        && (TSK_FS_TYPE_ISEXT(fs->ftype) == 0)) {
+        tsk_fprintf(stderr,
+            "-F is only supported for ext3 and ext4 journals\n");
+        fs->close(fs);
+        img->close(img);
+        exit(1);
+    }
+
+    if (fs->jentry_walk(fs, walk_flags, 0, NULL)) {
         tsk_error_print(stderr);
         fs->close(fs);
         img->close(img);
@@ -27,7 +27,8 @@ usage()
     TFPRINTF(stderr,
              _TSK_T
              ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size]"
-              " [-o imgoffset] [-lmvV] image [inode]\n"),
+              " [-o imgoffset] [-u usn_range] [-t time_range] [-lmvV]"
+              " image [inode]\n"),
              progname);
     tsk_fprintf(stderr,
                 "\t-i imgtype: The format of the image file "
@@ -41,6 +42,12 @@ usage()
     tsk_fprintf(stderr,
                 "\t-o imgoffset: The offset of the file system"
                 " in the image (in sectors)\n");
+    tsk_fprintf(stderr,
+                "\t-u usn_range: Only list the records with a USN in"
+                " the range (min-max, either can be left out)\n");
+    tsk_fprintf(stderr,
+                "\t-t time_range: Only list the records with a time in"
+                " the range (min-max, in seconds since 1970)\n");
     tsk_fprintf(stderr, "\t-l: Long output format with detailed information\n");
     tsk_fprintf(stderr, "\t-m: Time machine output format\n");
     tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
@@ -50,6 +57,45 @@ usage()
 }
 
 
+/*
+ * Parse a "min-max" range where either end can be left out.  The ends
+ * that are left out are set to 0.
+ *
+ * @returns 1 on error and 0 on success
+ */
+static int
+parse_range(const TSK_TCHAR * a_str, uint64_t a_limit, uint64_t * a_min,
+    uint64_t * a_max)
+{
+    TSK_TCHAR *cp;
+
+    *a_min = *a_max = 0;
+
+    if (*a_str != _TSK_T('-')) {
+        if ((*a_str < _TSK_T('0')) || (*a_str > _TSK_T('9')))
+            return 1;
+        *a_min = TSTRTOULL(a_str, &cp, 10);
+        a_str = cp;
+    }
+    if (*a_str != _TSK_T('-'))
+        return 1;
+    a_str++;
+
+    if (*a_str != _TSK_T('\0')) {
+        if ((*a_str < _TSK_T('0')) || (*a_str > _TSK_T('9')))
+            return 1;
+        *a_max = TSTRTOULL(a_str, &cp, 10);
+        if (*cp != _TSK_T('\0'))
+            return 1;
+    }
+
+    if ((*a_min > a_limit) || (*a_max > a_limit) ||
+        (*a_max && (*a_min > *a_max)))
+        return 1;
+    return 0;
+}
+
+
 int
 main(int argc, char **argv1)
 {
@@ -67,6 +113,10 @@ main(int argc, char **argv1)
     TSK_TCHAR *cp = NULL;
     unsigned int ssize = 0;
     TSK_FS_USNJLS_FLAG_ENUM flag = TSK_FS_USNJLS_NONE;
+    TSK_FS_USNJ_FILTER filter;
+    uint64_t tmin, tmax;
+
+    memset(&filter, 0, sizeof(filter));
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -82,7 +132,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:lmvV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:lmt:u:vV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'): {
             default:
@@ -136,6 +186,25 @@ main(int argc, char **argv1)
         case _TSK_T('m'):
             flag = TSK_FS_USNJLS_MAC;
             break;
+        case _TSK_T('t'):
+            if (parse_range(OPTARG, UINT32_MAX, &tmin, &tmax)) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: time range: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            filter.time_min = (uint32_t) tmin;
+            filter.time_max = (uint32_t) tmax;
+            break;
+        case _TSK_T('u'):
+            if (parse_range(OPTARG, UINT64_MAX, &filter.usn_min,
+                    &filter.usn_max)) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: USN range: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            break;
         case _TSK_T('v'):
             tsk_verbose++;
             break;
@@ -238,7 +307,7 @@ main(int argc, char **argv1)
         exit(1);
     }
 
-    if (tsk_fs_usnjls(fs, inum, flag)) {
+    if (tsk_fs_usnjls_filter(fs, inum, flag, &filter)) {
         tsk_error_print(stderr);
         fs->close(fs);
         img->close(img);
@@ -0,0 +1,280 @@
+/*
+** wfsexport
+** The Sleuth Kit
+**
+** Given a WFS0.4/5 image, exports its videos to a directory, reading
+** the data area in physical order.
+**
+** This software is distributed under the Common Public License 1.0
+**
+*/
+
+#include <locale.h>
+#include "tsk/fs/tsk_fs_i.h"
+
+
+static TSK_TCHAR *progname;
+
+
+/* usage - explain and terminate */
+static void
+usage()
+{
+    TFPRINTF(stderr,
+             _TSK_T
+             ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size]"
+              " [-o imgoffset] [-c camera] [-s start] [-e end]"
+              " [-t threads] [-vV] image [images] output_dir\n"),
+             progname);
+    tsk_fprintf(stderr,
+                "\t-i imgtype: The format of the image file "
+                "(use '-i list' for supported types)\n");
+    tsk_fprintf(stderr,
+                "\t-b dev_sector_size: The size (in bytes)"
+                " of the device sectors\n");
+    tsk_fprintf(stderr,
+                "\t-f fstype: File system type "
+                "(use '-f list' for supported types)\n");
+    tsk_fprintf(stderr,
+                "\t-o imgoffset: The offset of the file system"
+                " in the image (in sectors)\n");
+    tsk_fprintf(stderr, "\t-c camera: Export only videos of this camera\n");
+    tsk_fprintf(stderr,
+                "\t-s start: Export only videos that end at or after"
+                " this time (YYYYMMDD[HHMMSS], local time)\n");
+    tsk_fprintf(stderr,
+                "\t-e end: Export only videos that start at or before"
+                " this time (YYYYMMDD[HHMMSS], local time, a date alone"
+                " includes the whole day)\n");
+    tsk_fprintf(stderr, "\t-t threads: Number of writer threads\n");
+    tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
+    tsk_fprintf(stderr, "\t-V: print version\n");
+
+    exit(1);
+}
+
+/*
+ * Parse a YYYYMMDD[HHMMSS] local time, as used in the video names.
+ *
+ * @param a_end_of_day If a date is given without time, use 23:59:59
+ * instead of 00:00:00
+ * @returns -1 on error
+ */
+static time_t
+parse_time(const TSK_TCHAR * a_str, bool a_end_of_day)
+{
+    int val[6] = { 0, 0, 0, 0, 0, 0 };
+    const int width[6] = { 4, 2, 2, 2, 2, 2 };
+    const TSK_TCHAR *cp = a_str;
+    struct tm tm;
+
+    for (int i = 0; i < 6; i++) {
+        if ((i == 3) && (*cp == _TSK_T('\0'))) {
+            if (a_end_of_day) {
+                val[3] = 23;
+                val[4] = 59;
+                val[5] = 59;
+            }
+            break;
+        }
+        for (int j = 0; j < width[i]; j++, cp++) {
+            if ((*cp < _TSK_T('0')) || (*cp > _TSK_T('9')))
+                return -1;
+            val[i] = val[i] * 10 + (*cp - _TSK_T('0'));
+        }
+    }
+    if (*cp != _TSK_T('\0'))
+        return -1;
+
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = val[0] - 1900;
+    tm.tm_mon = val[1] - 1;
+    tm.tm_mday = val[2];
+    tm.tm_hour = val[3];
+    tm.tm_min = val[4];
+    tm.tm_sec = val[5];
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+
+int
+main(int argc, char **argv1)
+{
+    TSK_IMG_INFO *img = NULL;
+    TSK_IMG_TYPE_ENUM imgtype = TSK_IMG_TYPE_DETECT;
+
+    TSK_FS_INFO *fs = NULL;
+    TSK_OFF_T imgaddr = 0;
+    TSK_FS_TYPE_ENUM fstype = TSK_FS_TYPE_DETECT;
+    TSK_FS_WFSEXPORT_OPTS opts;
+    struct STAT_STR stat_buf;
+
+    int ch;
+    TSK_TCHAR **argv;
+    TSK_TCHAR *cp = NULL;
+    unsigned int ssize = 0;
+    unsigned int count = 0;
+
+#ifdef TSK_WIN32
+    // On Windows, get the wide arguments (mingw doesn't support wmain)
+    argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv == NULL) {
+        fprintf(stderr, "Error getting wide arguments\n");
+        exit(1);
+    }
+#else
+    argv = (TSK_TCHAR **) argv1;
+#endif
+
+    progname = argv[0];
+    setlocale(LC_ALL, "");
+
+    opts.camera = -1;
+    opts.start_time = 0;
+    opts.end_time = 0;
+    opts.nthreads = 0;
+
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:c:e:f:i:o:s:t:vV"))) > 0) {
+        switch (ch) {
+        case _TSK_T('?'):
+        default:
+            TFPRINTF(stderr, _TSK_T("Invalid argument: %s\n"),
+                     argv[OPTIND]);
+            usage();
+            break;
+        case _TSK_T('b'):
+            ssize = (unsigned int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || ssize < 1) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: sector size "
+                                "must be positive: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('c'):
+            opts.camera = (int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: camera: %s\n"), OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('e'):
+            if ((opts.end_time = parse_time(OPTARG, true)) == -1) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: end time: %s\n"), OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('f'):
+            if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
+                tsk_fs_type_print(stderr);
+                exit(1);
+            }
+            fstype = tsk_fs_type_toid(OPTARG);
+            if (fstype == TSK_FS_TYPE_UNSUPP) {
+                TFPRINTF(stderr,
+                         _TSK_T("Unsupported file system type: %s\n"), OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('i'):
+            if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
+                tsk_img_type_print(stderr);
+                exit(1);
+            }
+            imgtype = tsk_img_type_toid(OPTARG);
+            if (imgtype == TSK_IMG_TYPE_UNSUPP) {
+                TFPRINTF(stderr, _TSK_T("Unsupported image type: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('o'):
+            if ((imgaddr = tsk_parse_offset(OPTARG)) == -1) {
+                tsk_error_print(stderr);
+                exit(1);
+            }
+            break;
+        case _TSK_T('s'):
+            if ((opts.start_time = parse_time(OPTARG, false)) == -1) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: start time: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('t'):
+            opts.nthreads = (unsigned int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || opts.nthreads < 1) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: threads "
+                                "must be positive: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('v'):
+            tsk_verbose++;
+            break;
+        case _TSK_T('V'):
+            tsk_version_print(stdout);
+            exit(0);
+        }
+    }
+
+    /* We need at least two more arguments */
+    if (OPTIND + 1 >= argc) {
+        tsk_fprintf(stderr,
+                    "Missing output directory and/or image name\n");
+        usage();
+    }
+
+    if ((TSTAT(argv[argc - 1], &stat_buf) != 0)
+        || ((stat_buf.st_mode & S_IFMT) != S_IFDIR)) {
+        TFPRINTF(stderr,
+                 _TSK_T("Output directory does not exist: %s\n"),
+                 argv[argc - 1]);
+        exit(1);
+    }
+
+    img = tsk_img_open(argc - OPTIND - 1, &argv[OPTIND], imgtype, ssize);
+    if (img == NULL) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+
+    if ((imgaddr * img->sector_size) >= img->size) {
+        tsk_fprintf(stderr,
+                    "Sector offset is larger than disk image (maximum: %"
+                    PRIu64 ")\n", img->size / img->sector_size);
+        exit(1);
+    }
+
+    fs = tsk_fs_open_img(img, imgaddr * img->sector_size, fstype);
+    if (fs == NULL) {
+        tsk_error_print(stderr);
+
+        if (tsk_error_get_errno() == TSK_ERR_FS_UNSUPTYPE) {
+            tsk_fs_type_print(stderr);
+        }
+
+        img->close(img);
+        exit(1);
+    }
+
+    if (tsk_fs_wfsexport(fs, argv[argc - 1], &opts, &count)) {
+        tsk_error_print(stderr);
+        fs->close(fs);
+        img->close(img);
+        exit(1);
+    }
+
+    printf("Videos Exported: %u\n", count);
+
+    fs->close(fs);
+    img->close(img);
+    exit(0);
+}
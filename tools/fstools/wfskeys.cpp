@@ -0,0 +1,333 @@
+/*
+** wfskeys
+** The Sleuth Kit
+**
+** Given a WFS0.4/5 image and the address of a video, lists the H.264
+** keyframes of the video, saves them to a sidecar index or outputs the
+** video from the keyframe nearest to a given time.
+**
+** This software is distributed under the Common Public License 1.0
+**
+*/
+
+#include <locale.h>
+#include "tsk/fs/tsk_fs_i.h"
+
+/* Bytes of the video written at once by -s */
+#define WFSKEYS_OUT_SIZE    (1024 * 1024)
+
+
+static TSK_TCHAR *progname;
+
+
+/* usage - explain and terminate */
+static void
+usage()
+{
+    TFPRINTF(stderr,
+             _TSK_T
+             ("usage: %s [-f fstype] [-i imgtype] [-b dev_sector_size]"
+              " [-o imgoffset] [-r keyfile] [-w keyfile] [-s time] [-vV]"
+              " image [images] inum\n"),
+             progname);
+    tsk_fprintf(stderr,
+                "\t-i imgtype: The format of the image file "
+                "(use '-i list' for supported types)\n");
+    tsk_fprintf(stderr,
+                "\t-b dev_sector_size: The size (in bytes)"
+                " of the device sectors\n");
+    tsk_fprintf(stderr,
+                "\t-f fstype: File system type "
+                "(use '-f list' for supported types)\n");
+    tsk_fprintf(stderr,
+                "\t-o imgoffset: The offset of the file system"
+                " in the image (in sectors)\n");
+    tsk_fprintf(stderr,
+                "\t-r keyfile: Use the keyframe index saved in keyfile"
+                " instead of scanning the video\n");
+    tsk_fprintf(stderr,
+                "\t-w keyfile: Save the keyframe index to keyfile\n");
+    tsk_fprintf(stderr,
+                "\t-s time: Output the video to stdout from the keyframe"
+                " nearest to this time (YYYYMMDD[HHMMSS], local time)\n");
+    tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
+    tsk_fprintf(stderr, "\t-V: print version\n");
+
+    exit(1);
+}
+
+/*
+ * Parse a YYYYMMDD[HHMMSS] local time, as used in the video names.
+ *
+ * @returns -1 on error
+ */
+static time_t
+parse_time(const TSK_TCHAR * a_str)
+{
+    int val[6] = { 0, 0, 0, 0, 0, 0 };
+    const int width[6] = { 4, 2, 2, 2, 2, 2 };
+    const TSK_TCHAR *cp = a_str;
+    struct tm tm;
+
+    for (int i = 0; i < 6; i++) {
+        if ((i == 3) && (*cp == _TSK_T('\0')))
+            break;
+        for (int j = 0; j < width[i]; j++, cp++) {
+            if ((*cp < _TSK_T('0')) || (*cp > _TSK_T('9')))
+                return -1;
+            val[i] = val[i] * 10 + (*cp - _TSK_T('0'));
+        }
+    }
+    if (*cp != _TSK_T('\0'))
+        return -1;
+
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = val[0] - 1900;
+    tm.tm_mon = val[1] - 1;
+    tm.tm_mday = val[2];
+    tm.tm_hour = val[3];
+    tm.tm_min = val[4];
+    tm.tm_sec = val[5];
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/*
+ * Write the video to stdout, starting at the keyframe nearest to a_time.
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+output_from(TSK_FS_FILE * fs_file, const TSK_FS_WFSKEYS * keys,
+    time_t a_time)
+{
+    char *buf;
+    TSK_OFF_T off;
+    ssize_t cnt;
+
+#ifdef TSK_WIN32
+    if (-1 == _setmode(_fileno(stdout), _O_BINARY)) {
+        fprintf(stderr, "Error setting stdout to binary: %s\n",
+            strerror(errno));
+        return 1;
+    }
+#endif
+
+    if ((buf = (char *) tsk_malloc(WFSKEYS_OUT_SIZE)) == NULL)
+        return 1;
+
+    cnt = tsk_fs_wfskeys_read(fs_file, keys, a_time, buf,
+        WFSKEYS_OUT_SIZE, &off);
+    if (tsk_verbose)
+        tsk_fprintf(stderr, "wfskeys: starting at offset %" PRIdOFF "\n",
+            off);
+
+    while (cnt > 0) {
+        if (fwrite(buf, cnt, 1, stdout) != 1) {
+            fprintf(stderr, "Error writing to stdout: %s\n",
+                strerror(errno));
+            free(buf);
+            return 1;
+        }
+        off += cnt;
+        if (off >= fs_file->meta->size)
+            break;
+        cnt = tsk_fs_file_read(fs_file, off, buf, WFSKEYS_OUT_SIZE,
+            TSK_FS_FILE_READ_FLAG_NONE);
+    }
+    free(buf);
+
+    if (cnt < 0) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+
+int
+main(int argc, char **argv1)
+{
+    TSK_IMG_INFO *img = NULL;
+    TSK_IMG_TYPE_ENUM imgtype = TSK_IMG_TYPE_DETECT;
+
+    TSK_FS_INFO *fs = NULL;
+    TSK_FS_FILE *fs_file = NULL;
+    TSK_FS_WFSKEYS *keys = NULL;
+    TSK_OFF_T imgaddr = 0;
+    TSK_FS_TYPE_ENUM fstype = TSK_FS_TYPE_DETECT;
+    TSK_INUM_T inum;
+    TSK_TCHAR *keyfile_in = NULL;
+    TSK_TCHAR *keyfile_out = NULL;
+    time_t seek_time = -1;
+    int retval = 0;
+
+    int ch;
+    TSK_TCHAR **argv;
+    TSK_TCHAR *cp = NULL;
+    unsigned int ssize = 0;
+
+#ifdef TSK_WIN32
+    // On Windows, get the wide arguments (mingw doesn't support wmain)
+    argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv == NULL) {
+        fprintf(stderr, "Error getting wide arguments\n");
+        exit(1);
+    }
+#else
+    argv = (TSK_TCHAR **) argv1;
+#endif
+
+    progname = argv[0];
+    setlocale(LC_ALL, "");
+
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:r:s:w:vV"))) > 0) {
+        switch (ch) {
+        case _TSK_T('?'):
+        default:
+            TFPRINTF(stderr, _TSK_T("Invalid argument: %s\n"),
+                     argv[OPTIND]);
+            usage();
+            break;
+        case _TSK_T('b'):
+            ssize = (unsigned int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || ssize < 1) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: sector size "
+                                "must be positive: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('f'):
+            if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
+                tsk_fs_type_print(stderr);
+                exit(1);
+            }
+            fstype = tsk_fs_type_toid(OPTARG);
+            if (fstype == TSK_FS_TYPE_UNSUPP) {
+                TFPRINTF(stderr,
+                         _TSK_T("Unsupported file system type: %s\n"), OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('i'):
+            if (TSTRCMP(OPTARG, _TSK_T("list")) == 0) {
+                tsk_img_type_print(stderr);
+                exit(1);
+            }
+            imgtype = tsk_img_type_toid(OPTARG);
+            if (imgtype == TSK_IMG_TYPE_UNSUPP) {
+                TFPRINTF(stderr, _TSK_T("Unsupported image type: %s\n"),
+                         OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('o'):
+            if ((imgaddr = tsk_parse_offset(OPTARG)) == -1) {
+                tsk_error_print(stderr);
+                exit(1);
+            }
+            break;
+        case _TSK_T('r'):
+            keyfile_in = OPTARG;
+            break;
+        case _TSK_T('s'):
+            if ((seek_time = parse_time(OPTARG)) == -1) {
+                TFPRINTF(stderr,
+                         _TSK_T("invalid argument: time: %s\n"), OPTARG);
+                usage();
+            }
+            break;
+        case _TSK_T('w'):
+            keyfile_out = OPTARG;
+            break;
+        case _TSK_T('v'):
+            tsk_verbose++;
+            break;
+        case _TSK_T('V'):
+            tsk_version_print(stdout);
+            exit(0);
+        }
+    }
+
+    /* We need at least two more arguments */
+    if (OPTIND + 1 >= argc) {
+        tsk_fprintf(stderr, "Missing image name and/or address\n");
+        usage();
+    }
+
+    if (tsk_fs_parse_inum(argv[argc - 1], &inum, NULL, NULL, NULL, NULL)) {
+        TFPRINTF(stderr, _TSK_T("Invalid inode address: %s\n"),
+                 argv[argc - 1]);
+        usage();
+    }
+
+    img = tsk_img_open(argc - OPTIND - 1, &argv[OPTIND], imgtype, ssize);
+    if (img == NULL) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+
+    if ((imgaddr * img->sector_size) >= img->size) {
+        tsk_fprintf(stderr,
+                    "Sector offset is larger than disk image (maximum: %"
+                    PRIu64 ")\n", img->size / img->sector_size);
+        exit(1);
+    }
+
+    fs = tsk_fs_open_img(img, imgaddr * img->sector_size, fstype);
+    if (fs == NULL) {
+        tsk_error_print(stderr);
+
+        if (tsk_error_get_errno() == TSK_ERR_FS_UNSUPTYPE) {
+            tsk_fs_type_print(stderr);
+        }
+
+        img->close(img);
+        exit(1);
+    }
+
+    if ((fs_file = tsk_fs_file_open_meta(fs, NULL, inum)) == NULL) {
+        tsk_error_print(stderr);
+        fs->close(fs);
+        img->close(img);
+        exit(1);
+    }
+
+    if (keyfile_in != NULL)
+        keys = tsk_fs_wfskeys_load(keyfile_in);
+    else
+        keys = tsk_fs_wfskeys_build(fs_file);
+
+    if (keys == NULL) {
+        tsk_error_print(stderr);
+        retval = 1;
+    }
+    else if (keys->size != fs_file->meta->size) {
+        tsk_fprintf(stderr, "Keyframe index does not match inode %"
+                    PRIuINUM "\n", inum);
+        retval = 1;
+    }
+    else if ((keyfile_out != NULL) && tsk_fs_wfskeys_save(keys, keyfile_out)) {
+        tsk_error_print(stderr);
+        retval = 1;
+    }
+    else if (seek_time != -1) {
+        if (output_from(fs_file, keys, seek_time))
+            retval = 1;
+    }
+    else if (keyfile_out == NULL) {
+        char timeBuf[128];
+
+        for (size_t i = 0; i < keys->count; i++) {
+            tsk_printf("%" PRIdOFF "\t%s\n", keys->keys[i].offset,
+                tsk_fs_time_to_str(keys->keys[i].time, timeBuf));
+        }
+    }
+
+    tsk_fs_wfskeys_free(keys);
+    tsk_fs_file_close(fs_file);
+    fs->close(fs);
+    img->close(img);
+    exit(retval);
+}
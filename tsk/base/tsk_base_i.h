@@ -39,6 +39,11 @@ extern "C" {
     extern void tsk_take_lock(tsk_lock_t *);
     extern void tsk_release_lock(tsk_lock_t *);
 
+    typedef void (*TSK_PARALLEL_FOR_CB) (size_t a_idx, void *a_ptr);
+    extern unsigned int tsk_parallel_nthreads(void);
+    extern void tsk_parallel_for(size_t a_count, TSK_PARALLEL_FOR_CB a_cb,
+        void *a_ptr);
+
 #ifndef rounddown
 #define rounddown(x, y)	\
     ((((x) % (y)) == 0) ? (x) : \
@@ -0,0 +1,101 @@
+/*
+ * The Sleuth Kit
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/** \file tsk_parallel.cpp
+ * Contains a minimal helper to run independent pieces of work on several
+ * threads.  It is used by the file system code to split large scans (index
+ * tables, journals, bitmaps) into partitions.
+ */
+
+#include "tsk_base_i.h"
+
+#ifdef TSK_MULTITHREAD_LIB
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+#endif
+
+/** \internal
+ * Maximum number of threads started by tsk_parallel_for().
+ */
+#define TSK_PARALLEL_MAX_THREADS    16
+
+/**
+ * \internal
+ * Return the number of threads that tsk_parallel_for() will use.
+ * Callers can use this to size per-thread buffers.
+ */
+unsigned int
+tsk_parallel_nthreads()
+{
+#ifdef TSK_MULTITHREAD_LIB
+    unsigned int n = std::thread::hardware_concurrency();
+    if (n == 0)
+        n = 1;
+    else if (n > TSK_PARALLEL_MAX_THREADS)
+        n = TSK_PARALLEL_MAX_THREADS;
+    return n;
+#else
+    return 1;
+#endif
+}
+
+#ifdef TSK_MULTITHREAD_LIB
+static void
+parallel_worker(std::atomic<size_t> *a_next, size_t a_count,
+    TSK_PARALLEL_FOR_CB a_cb, void *a_ptr)
+{
+    size_t idx;
+    while ((idx = (*a_next)++) < a_count)
+        a_cb(idx, a_ptr);
+}
+#endif
+
+/**
+ * \internal
+ * Call a_cb once for every index in [0, a_count), spreading the calls
+ * over up to tsk_parallel_nthreads() threads (the calling thread is one of
+ * them).  Returns once all calls are done.  The callbacks run in parallel,
+ * so they must only write to data owned by their index.  Note that the
+ * TSK error state is per thread; callbacks must record failures in their
+ * own data and the caller must set the error after this returns.
+ *
+ * @param a_count Number of indexes to process
+ * @param a_cb Callback to call for each index
+ * @param a_ptr Pointer passed to the callback
+ */
+void
+tsk_parallel_for(size_t a_count, TSK_PARALLEL_FOR_CB a_cb, void *a_ptr)
+{
+#ifdef TSK_MULTITHREAD_LIB
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    size_t nthreads = tsk_parallel_nthreads();
+
+    if (nthreads > a_count)
+        nthreads = a_count;
+
+    for (size_t i = 1; i < nthreads; i++) {
+        try {
+            threads.push_back(std::thread(parallel_worker, &next, a_count,
+                    a_cb, a_ptr));
+        }
+        catch(const std::system_error &) {
+            // just continue with the threads we have
+            break;
+        }
+    }
+
+    parallel_worker(&next, a_count, a_cb, a_ptr);
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+#else
+    for (size_t i = 0; i < a_count; i++)
+        a_cb(i, a_ptr);
+#endif
+}
@@ -315,6 +315,77 @@ exfatfs_get_alloc_bitmap(FATFS_INFO *a_fatfs)
     return FATFS_FAIL;
 }
 
+/**
+ * \internal
+ * Reads the allocation bitmap found by exfatfs_get_alloc_bitmap() into
+ * memory so that cluster allocation queries do not need to go to the image.
+ * The copy is not changed after the file system is opened, so it can be 
+ * used by several threads without a lock. If the bitmap is only partially
+ * in the image, the part that could be read is kept and the remaining 
+ * clusters are looked up in the image as before. 
+ *
+ * @param [in, out] a_fatfs Generic FAT file system info structure.
+ * @return 0 on success, 1 otherwise, per TSK convention.
+ */
+static uint8_t
+exfatfs_load_alloc_bitmap(FATFS_INFO *a_fatfs)
+{
+    TSK_FS_INFO *fs = &(a_fatfs->fs_info);
+    TSK_OFF_T bitmap_offset = 0;
+    size_t bitmap_len = 0;
+    size_t words_cnt = 0;
+    size_t off = 0;
+    size_t i = 0;
+    uint64_t *words = NULL;
+
+    assert(a_fatfs != NULL);
+
+    /* Only the bits for the clusters in the data area are needed. */
+    bitmap_len = (size_t)((a_fatfs->clustcnt + 7) / 8);
+    if (bitmap_len == 0) {
+        return FATFS_OK;
+    }
+    words_cnt = (bitmap_len + 7) / 8;
+    if ((words = (uint64_t*)tsk_malloc(words_cnt * sizeof(uint64_t))) == NULL) {
+        return FATFS_FAIL;
+    }
+
+    /* Read in chunks so that a truncated image keeps what is there. */
+    bitmap_offset = (TSK_OFF_T)a_fatfs->EXFATFS_INFO.first_sector_of_alloc_bitmap * a_fatfs->ssize;
+    while (off < bitmap_len) {
+        size_t len = bitmap_len - off;
+        ssize_t bytes_read = 0;
+
+        if (len > FATFS_BLKWALK_READ_SIZE) {
+            len = FATFS_BLKWALK_READ_SIZE;
+        }
+        bytes_read = tsk_fs_read(fs, bitmap_offset + off, (char*)words + off, len);
+        if (bytes_read != (ssize_t)len) {
+            tsk_error_reset();
+            break;
+        }
+        off += len;
+    }
+
+    if (off == 0) {
+        free(words);
+        return FATFS_OK;
+    }
+
+    /* The bitmap is little endian, so this is only a copy on LE hosts. */
+    for (i = 0; i < words_cnt; i++) {
+        words[i] = tsk_getu64(TSK_LIT_ENDIAN, &words[i]);
+    }
+
+    a_fatfs->EXFATFS_INFO.alloc_bitmap_words = words;
+    a_fatfs->EXFATFS_INFO.alloc_bitmap_nclust = (TSK_DADDR_T)off * 8;
+    if (a_fatfs->EXFATFS_INFO.alloc_bitmap_nclust > a_fatfs->clustcnt) {
+        a_fatfs->EXFATFS_INFO.alloc_bitmap_nclust = a_fatfs->clustcnt;
+    }
+
+    return FATFS_OK;
+}
+
 /**
  * \internal
  * Parses the MBR of an exFAT file system to obtain a volume serial number to
@@ -488,6 +559,7 @@ exfatfs_set_func_ptrs(FATFS_INFO *a_fatfs)
 
     /* Specialization for exFAT functions. */
     a_fatfs->is_cluster_alloc = exfatfs_is_cluster_alloc;
+    a_fatfs->cluster_run_end = exfatfs_cluster_run_end;
     a_fatfs->is_dentry = exfatfs_is_dentry;
     a_fatfs->dinode_copy =  exfatfs_dinode_copy;
     a_fatfs->inode_lookup = exfatfs_inode_lookup;
@@ -527,7 +599,8 @@ exfatfs_open(FATFS_INFO *a_fatfs)
         return FATFS_FAIL;
     }
 
-    if (exfatfs_get_alloc_bitmap(a_fatfs) == FATFS_FAIL) {
+    if (exfatfs_get_alloc_bitmap(a_fatfs) == FATFS_FAIL ||
+        exfatfs_load_alloc_bitmap(a_fatfs) == FATFS_FAIL) {
         return FATFS_FAIL;
     }
 
@@ -31,6 +31,35 @@
 #include "tsk_fatfs.h"
 #include <assert.h>
 
+// MSVC doesn't have __builtin_ffsll
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_BitScanForward64)
+#endif
+
+/* @returns the (1-based) index of the lowest bit set in a_word, or 0 */
+static int
+exfatfs_bitmap_ffs(uint64_t a_word)
+{
+#if defined(__GNUC__)
+    return __builtin_ffsll(a_word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+
+    if (_BitScanForward64(&i, a_word))
+        return i + 1;
+    return 0;
+#else
+    int i;
+
+    if (a_word == 0)
+        return 0;
+    for (i = 1; (a_word & 1) == 0; i++)
+        a_word >>= 1;
+    return i;
+#endif
+}
+
 /**
  * \internal
  * Checks whether a specified cluster is allocated according to the allocation 
@@ -66,6 +95,13 @@ exfatfs_is_cluster_alloc(FATFS_INFO *a_fatfs, TSK_DADDR_T a_cluster_addr)
      /* Normalize the cluster address. */
     a_cluster_addr = a_cluster_addr - FATFS_FIRST_CLUSTER_ADDR;
 
+    /* Use the copy of the bitmap that was loaded when the file system was
+     * opened.  It only lacks the clusters whose bits are not in the image. */
+    if (a_cluster_addr < a_fatfs->EXFATFS_INFO.alloc_bitmap_nclust) {
+        return (int8_t)((a_fatfs->EXFATFS_INFO.alloc_bitmap_words[a_cluster_addr / 64] >>
+            (a_cluster_addr % 64)) & 1);
+    }
+
     /* Determine the offset of the byte in the allocation bitmap that contains
      * the bit for the specified cluster. */
     bitmap_byte_offset = (a_fatfs->EXFATFS_INFO.first_sector_of_alloc_bitmap * a_fatfs->ssize) + (a_cluster_addr / 8);
@@ -91,6 +127,58 @@ exfatfs_is_cluster_alloc(FATFS_INFO *a_fatfs, TSK_DADDR_T a_cluster_addr)
     }
 }
 
+/**
+ * \internal
+ * Finds the end of the run of clusters that starts at a given cluster and
+ * that all have the same allocation status, using the copy of the
+ * allocation bitmap that was loaded when the file system was opened.
+ *
+ * @param [in] a_fatfs A FATFS_INFO struct representing an exFAT file system.
+ * @param [in] a_cluster_addr The first cluster of the run.
+ * @param [in] a_last_cluster_addr The last cluster to consider.
+ * @param [out] a_is_alloc Set to 1 if the run is allocated, 0 if not.
+ * @return The cluster after the run (at most a_last_cluster_addr + 1), or 0
+ * if the allocation status of a_cluster_addr is not in the loaded bitmap.
+ */
+TSK_DADDR_T
+exfatfs_cluster_run_end(FATFS_INFO *a_fatfs, TSK_DADDR_T a_cluster_addr,
+    TSK_DADDR_T a_last_cluster_addr, int8_t *a_is_alloc)
+{
+    const uint64_t *words = a_fatfs->EXFATFS_INFO.alloc_bitmap_words;
+    TSK_DADDR_T bit, end, i;
+    uint64_t flip, w;
+
+    if ((words == NULL) || (a_cluster_addr < FATFS_FIRST_CLUSTER_ADDR) ||
+        (a_cluster_addr > a_last_cluster_addr)) {
+        return 0;
+    }
+
+    /* Work with bit indexes, bit 0 is the first cluster. */
+    bit = a_cluster_addr - FATFS_FIRST_CLUSTER_ADDR;
+    if (bit >= a_fatfs->EXFATFS_INFO.alloc_bitmap_nclust) {
+        return 0;
+    }
+    end = a_last_cluster_addr - FATFS_FIRST_CLUSTER_ADDR + 1;
+    if (end > a_fatfs->EXFATFS_INFO.alloc_bitmap_nclust) {
+        end = a_fatfs->EXFATFS_INFO.alloc_bitmap_nclust;
+    }
+
+    *a_is_alloc = (int8_t)((words[bit / 64] >> (bit % 64)) & 1);
+    flip = (*a_is_alloc) ? ~(uint64_t)0 : 0;
+
+    /* Look for the first bit that differs from the one for the cluster. */
+    i = bit / 64;
+    w = (words[i] ^ flip) & (~(uint64_t)0 << (bit % 64));
+    while (w == 0) {
+        if (++i * 64 >= end) {
+            return end + FATFS_FIRST_CLUSTER_ADDR;
+        }
+        w = words[i] ^ flip;
+    }
+    i = i * 64 + exfatfs_bitmap_ffs(w) - 1;
+    return ((i < end) ? i : end) + FATFS_FIRST_CLUSTER_ADDR;
+}
+
 /**
  * \internal
  * Determine whether the contents of a buffer may be an exFAT volume label
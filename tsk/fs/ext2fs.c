@@ -308,146 +308,404 @@ ext2fs_print_map(uint8_t * map, int len)
     ((tsk_getu32(ext2fs->fs_info.endian, ext2fs->fs->s_inodes_per_group) * ext2fs->inode_size - 1) \
            / ext2fs->fs_info.block_size + 1)
 
-/* ext2fs_bmap_load - look up block bitmap & load into cache
+/* ext2fs_group_flags - flags of the loaded group descriptor
  *
- * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ * Note: This routine assumes &ext2fs->lock is locked by the caller and
+ * the group descriptor is loaded.
  *
- * return 1 on error and 0 on success
+ * return the bg_flags value, or 0 if the file system does not maintain them
  * */
-static uint8_t
-ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+static uint16_t
+ext2fs_group_flags(EXT2FS_INFO * ext2fs)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
-    ssize_t cnt;
-    TSK_DADDR_T addr;
 
-    /*
-     * Look up the group descriptor info.  The load will do the sanity check.
-     */
-    if (ext2fs_group_load(ext2fs, grp_num)) {
-        return 1;
-    }
-
-    if (ext2fs->bmap_buf == NULL) {
-        if ((ext2fs->bmap_buf =
-                (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
-            return 1;
-        }
-    }
-    else if (ext2fs->bmap_grp_num == grp_num) {
+    if ((tsk_getu32(fs->endian, ext2fs->fs->s_feature_ro_compat) &
+            (EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM |
+                EXT4FS_FEATURE_RO_COMPAT_METADATA_CSUM)) == 0)
         return 0;
-    }
-    
-    if (ext2fs->ext4_grp_buf != NULL) { 
-        addr = ext4_getu64(fs->endian,
+
+    if (ext2fs->ext4_grp_buf != NULL)
+        return tsk_getu16(fs->endian, ext2fs->ext4_grp_buf->bg_flags);
+
+    /* the 32-byte descriptor has bg_flags at the same offset */
+    return tsk_getu16(fs->endian, ext2fs->grp_buf->f1);
+}
+
+/* ext2fs_group_map_addr - address of a bitmap of the loaded group descriptor
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller and
+ * the group descriptor is loaded.
+ * */
+static TSK_DADDR_T
+ext2fs_group_map_addr(EXT2FS_INFO * ext2fs, uint8_t a_is_inode)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+
+    if (ext2fs->ext4_grp_buf != NULL) {
+        if (a_is_inode)
+            return ext4_getu64(fs->endian,
+                ext2fs->ext4_grp_buf->bg_inode_bitmap_hi,
+                ext2fs->ext4_grp_buf->bg_inode_bitmap_lo);
+        return ext4_getu64(fs->endian,
             ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
             ext2fs->ext4_grp_buf->bg_block_bitmap_lo);
     }
-    else {
-        addr = (TSK_DADDR_T) tsk_getu32(fs->endian, ext2fs->grp_buf->bg_block_bitmap);
+    if (a_is_inode)
+        return (TSK_DADDR_T) tsk_getu32(fs->endian,
+            ext2fs->grp_buf->bg_inode_bitmap);
+    return (TSK_DADDR_T) tsk_getu32(fs->endian,
+        ext2fs->grp_buf->bg_block_bitmap);
+}
+
+/* ext2fs_map_uninit - build the bitmap of a group flagged INODE_UNINIT or
+ * BLOCK_UNINIT without reading it.  Like the kernel, an uninitialized block
+ * bitmap has only the group's own metadata blocks set: the superblock and
+ * group descriptor copies and the bitmaps and inode table stored in it.
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller and
+ * the group descriptor is loaded.
+ * */
+static void
+ext2fs_map_uninit(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    uint8_t a_is_inode, uint8_t * a_buf)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    ext2fs_sb *sb = ext2fs->fs;
+    TSK_DADDR_T dbase = ext4_cgbase_lcl(fs, sb, grp_num);
+    uint32_t bpg = tsk_getu32(fs->endian, sb->s_blocks_per_group);
+    TSK_DADDR_T itable;
+    uint64_t meta_cnt = 0;
+    uint64_t i;
+
+    memset(a_buf, 0, fs->block_size);
+    if (a_is_inode)
+        return;
+
+    /* superblock and group descriptor table copies */
+    {
+        size_t gd_size = sizeof(ext2fs_gd);
+        uint32_t gd_per_blk;
+        uint32_t first_meta_bg =
+            tsk_getu32(fs->endian, sb->s_first_meta_bg);
+        uint8_t has_super = ext2fs_is_super_bg(tsk_getu32(fs->endian,
+                sb->s_feature_ro_compat), grp_num) ? 1 : 0;
+
+        if (ext2fs->ext4_grp_buf != NULL) {
+            gd_size = tsk_getu16(fs->endian, sb->s_desc_size);
+            if (gd_size < sizeof(ext4fs_gd))
+                gd_size = sizeof(ext4fs_gd);
+        }
+        gd_per_blk = fs->block_size / (uint32_t) gd_size;
+
+        meta_cnt = has_super;
+        if (EXT2FS_HAS_INCOMPAT_FEATURE(fs, sb,
+                EXT2FS_FEATURE_INCOMPAT_META_BG)
+            && (uint64_t) grp_num >= (uint64_t) first_meta_bg * gd_per_blk) {
+            /* meta_bg groups hold a copy of their own descriptor block */
+            uint32_t idx = grp_num % gd_per_blk;
+            if (idx == 0 || idx == 1 || idx == gd_per_blk - 1)
+                meta_cnt++;
+        }
+        else if (has_super) {
+            if (EXT2FS_HAS_INCOMPAT_FEATURE(fs, sb,
+                    EXT2FS_FEATURE_INCOMPAT_META_BG))
+                meta_cnt += first_meta_bg;
+            else
+                meta_cnt += (ext2fs->groups_count + gd_per_blk -
+                    1) / gd_per_blk;
+            meta_cnt += tsk_getu16(fs->endian,
+                sb->pad_or_gdt.s_reserved_gdt_blocks);
+        }
     }
+    for (i = 0; i < meta_cnt && i < bpg; i++)
+        setbit(a_buf, i);
 
-    if (addr > fs->last_block) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-        tsk_error_set_errstr
-            ("ext2fs_bmap_load: Block too large for image: %" PRIu64, addr);
-        return 1;
+    /* bitmaps and inode table, if they are stored in this group */
+    if (ext2fs->ext4_grp_buf != NULL)
+        itable = ext4_getu64(fs->endian,
+            ext2fs->ext4_grp_buf->bg_inode_table_hi,
+            ext2fs->ext4_grp_buf->bg_inode_table_lo);
+    else
+        itable = tsk_getu32(fs->endian, ext2fs->grp_buf->bg_inode_table);
+
+    if (ext2fs_group_map_addr(ext2fs, 0) >= dbase
+        && ext2fs_group_map_addr(ext2fs, 0) - dbase < bpg)
+        setbit(a_buf, ext2fs_group_map_addr(ext2fs, 0) - dbase);
+    if (ext2fs_group_map_addr(ext2fs, 1) >= dbase
+        && ext2fs_group_map_addr(ext2fs, 1) - dbase < bpg)
+        setbit(a_buf, ext2fs_group_map_addr(ext2fs, 1) - dbase);
+    for (i = 0; i < INODE_TABLE_SIZE(ext2fs); i++) {
+        if (itable + i >= dbase && itable + i - dbase < bpg)
+            setbit(a_buf, itable + i - dbase);
     }
+}
 
-    cnt = tsk_fs_read(fs, addr * fs->block_size, 
-        (char *) ext2fs->bmap_buf, ext2fs->fs_info.block_size);
+/* ext2fs_map_run - count the groups, starting at grp_num, whose bitmaps can
+ * be read in one I/O.  With flex_bg the bitmaps of the groups in a flex group
+ * are stored back to back, so this is the run of groups in the flex group of
+ * grp_num whose bitmaps follow each other on disk and are not cached yet.
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.  It
+ * loads other group descriptors.
+ * */
+static EXT2_GRPNUM_T
+ext2fs_map_run(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    TSK_DADDR_T a_addr, uint8_t a_is_inode)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    uint8_t *loaded = a_is_inode ? ext2fs->imap_cache_loaded :
+        ext2fs->bmap_cache_loaded;
+    uint64_t flex_end;
+    EXT2_GRPNUM_T cnt;
 
-    if (cnt != ext2fs->fs_info.block_size) {
-        if (cnt >= 0) {
+    if (!EXT2FS_HAS_INCOMPAT_FEATURE(fs, ext2fs->fs,
+            EXT2FS_FEATURE_INCOMPAT_FLEX_BG)
+        || ext2fs->fs->s_log_groups_per_flex == 0
+        || ext2fs->fs->s_log_groups_per_flex >= 32)
+        return 1;
+
+    flex_end = (((uint64_t) grp_num >> ext2fs->fs->s_log_groups_per_flex) +
+        1) << ext2fs->fs->s_log_groups_per_flex;
+    if (flex_end > ext2fs->groups_count)
+        flex_end = ext2fs->groups_count;
+    if (flex_end > (uint64_t) grp_num + EXT2FS_MAP_RUN_MAX)
+        flex_end = (uint64_t) grp_num + EXT2FS_MAP_RUN_MAX;
+
+    for (cnt = 1; grp_num + cnt < flex_end; cnt++) {
+        if (isset(loaded, grp_num + cnt)
+            || a_addr + cnt > fs->last_block)
+            break;
+        if (ext2fs_group_load(ext2fs, grp_num + cnt)) {
             tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
+            break;
         }
-        tsk_error_set_errstr2("ext2fs_bmap_load: block bitmap %"
-            PRI_EXT2GRP " at %" PRIu64, grp_num, addr);
-        return 1;
+        if (ext2fs_group_map_addr(ext2fs, a_is_inode) != a_addr + cnt)
+            break;
     }
-
-    ext2fs->bmap_grp_num = grp_num;
-    if (tsk_verbose > 1)
-        ext2fs_print_map(ext2fs->bmap_buf,
-            tsk_getu32(fs->endian, ext2fs->fs->s_blocks_per_group));    
-    return 0;
+    return cnt;
 }
 
-
-/* ext2fs_imap_load - look up inode bitmap & load into cache
+/* ext2fs_map_load - look up a block or inode bitmap & load into cache
+ *
+ * If the bitmaps of all groups fit in memory they are kept in
+ * bmap_cache / imap_cache and bmap_buf / imap_buf point into them,
+ * otherwise the last loaded bitmap is kept in bmap_buf / imap_buf.
+ * On return the group descriptor of grp_num is loaded.
  *
  * Note: This routine assumes &ext2fs->lock is locked by the caller.
  *
- * return 0 on success and 1 on error
+ * return 1 on error and 0 on success
  * */
 static uint8_t
-    ext2fs_imap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+ext2fs_map_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    uint8_t a_is_inode)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    const char *myname =
+        a_is_inode ? "ext2fs_imap_load" : "ext2fs_bmap_load";
+    uint8_t *cache = a_is_inode ? ext2fs->imap_cache : ext2fs->bmap_cache;
+    uint8_t *loaded = a_is_inode ? ext2fs->imap_cache_loaded :
+        ext2fs->bmap_cache_loaded;
+    uint8_t **map_buf = a_is_inode ? &ext2fs->imap_buf : &ext2fs->bmap_buf;
+    EXT2_GRPNUM_T *map_grp_num =
+        a_is_inode ? &ext2fs->imap_grp_num : &ext2fs->bmap_grp_num;
+    uint16_t uninit =
+        a_is_inode ? EXT4_BG_INODE_UNINIT : EXT4_BG_BLOCK_UNINIT;
+    EXT2_GRPNUM_T run = 1;
+    EXT2_GRPNUM_T i;
+    uint8_t *buf;
     ssize_t cnt;
     TSK_DADDR_T addr;
 
     /*
-    * Look up the group descriptor info.
-    */
+     * Look up the group descriptor info.  The load will do the sanity check.
+     */
     if (ext2fs_group_load(ext2fs, grp_num)) {
         return 1;
     }
 
-    /* Allocate the cache buffer and exit if map is already loaded */
-    if (ext2fs->imap_buf == NULL) {
-        if ((ext2fs->imap_buf =
-            (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
-                return 1;
+    if (cache != NULL) {
+        buf = &cache[(size_t) grp_num * fs->block_size];
+        if (isset(loaded, grp_num)) {
+            *map_buf = buf;
+            *map_grp_num = grp_num;
+            return 0;
         }
     }
-    else if (ext2fs->imap_grp_num == grp_num) {
-        return 0;
+    else {
+        /* Allocate the cache buffer and exit if map is already loaded */
+        if (*map_buf == NULL) {
+            if ((*map_buf = (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
+                return 1;
+            }
+        }
+        else if (*map_grp_num == grp_num) {
+            return 0;
+        }
+        buf = *map_buf;
     }
 
-    /*
-    * Look up the inode allocation bitmap.
-    */
-    if (ext2fs->ext4_grp_buf != NULL) { 
-        addr = ext4_getu64(fs->endian,
-            ext2fs->ext4_grp_buf->bg_inode_bitmap_hi,
-            ext2fs->ext4_grp_buf->bg_inode_bitmap_lo);
+    if (ext2fs_group_flags(ext2fs) & uninit) {
+        ext2fs_map_uninit(ext2fs, grp_num, a_is_inode, buf);
     }
     else {
-        addr = (TSK_DADDR_T) tsk_getu32(fs->endian, ext2fs->grp_buf->bg_inode_bitmap);
-    }
+        addr = ext2fs_group_map_addr(ext2fs, a_is_inode);
+        if (addr > fs->last_block) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
+            tsk_error_set_errstr
+                ("%s: Block too large for image: %" PRIu64, myname, addr);
+            return 1;
+        }
 
-    if (addr > fs->last_block) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-        tsk_error_set_errstr
-            ("ext2fs_imap_load: Block too large for image: %" PRIu64, addr);
-        return 1;
-    }
+        if (cache != NULL)
+            run = ext2fs_map_run(ext2fs, grp_num, addr, a_is_inode);
 
-    cnt = tsk_fs_read(fs, addr * fs->block_size, 
-        (char *) ext2fs->imap_buf, ext2fs->fs_info.block_size);
+        cnt = -1;
+        if (run > 1) {
+            cnt = tsk_fs_read(fs, addr * fs->block_size, (char *) buf,
+                (size_t) run * fs->block_size);
+            if (cnt != (ssize_t) run * fs->block_size) {
+                tsk_error_reset();
+                run = 1;
+                cnt = -1;
+            }
+        }
+        if (run == 1) {
+            cnt = tsk_fs_read(fs, addr * fs->block_size,
+                (char *) buf, ext2fs->fs_info.block_size);
+            if (cnt != ext2fs->fs_info.block_size) {
+                if (cnt >= 0) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_FS_READ);
+                }
+                tsk_error_set_errstr2("%s: %s %" PRI_EXT2GRP " at %" PRIu64,
+                    myname, a_is_inode ? "Inode bitmap" : "block bitmap",
+                    grp_num, addr);
+                ext2fs_group_load(ext2fs, grp_num);
+                return 1;
+            }
+        }
 
-    if (cnt != ext2fs->fs_info.block_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
+        /* the other groups of the run; fix up the uninitialized ones */
+        for (i = 1; i < run; i++) {
+            if (ext2fs_group_load(ext2fs, grp_num + i)) {
+                tsk_error_reset();
+                break;
+            }
+            if (ext2fs_group_flags(ext2fs) & uninit)
+                ext2fs_map_uninit(ext2fs, grp_num + i, a_is_inode,
+                    &buf[(size_t) i * fs->block_size]);
+            setbit(loaded, grp_num + i);
         }
-        tsk_error_set_errstr2("ext2fs_imap_load: Inode bitmap %"
-            PRI_EXT2GRP " at %" PRIu64, grp_num, addr);
-        return 1;
+
+        /* ext2fs_map_run() may have loaded the descriptors of the groups
+         * after grp_num, even if the run ended up being just grp_num. */
+        if (ext2fs_group_load(ext2fs, grp_num))
+            return 1;
     }
 
-    ext2fs->imap_grp_num = grp_num;
+    if (cache != NULL) {
+        setbit(loaded, grp_num);
+        *map_buf = buf;
+    }
+    *map_grp_num = grp_num;
     if (tsk_verbose > 1)
-        ext2fs_print_map(ext2fs->imap_buf,
-        tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group));
-
+        ext2fs_print_map(buf, tsk_getu32(fs->endian, a_is_inode ?
+                ext2fs->fs->s_inodes_per_group :
+                ext2fs->fs->s_blocks_per_group));
     return 0;
 }
 
+/* ext2fs_bmap_load - look up block bitmap & load into cache
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ *
+ * return 1 on error and 0 on success
+ * */
+static uint8_t
+ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+{
+    return ext2fs_map_load(ext2fs, grp_num, 0);
+}
+
+
+/* ext2fs_imap_load - look up inode bitmap & load into cache
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ *
+ * return 0 on success and 1 on error
+ * */
+static uint8_t
+    ext2fs_imap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+{
+    return ext2fs_map_load(ext2fs, grp_num, 1);
+}
+
+/* ext2fs_dinode_print - verbose output of a loaded disk inode */
+static void
+ext2fs_dinode_print(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
+    const ext2fs_inode * dino_buf)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+
+    tsk_fprintf(stderr,
+        "%" PRIuINUM " m/l/s=%o/%d/%" PRIu32
+        " u/g=%d/%d macd=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32
+        "\n", dino_inum, tsk_getu16(fs->endian, dino_buf->i_mode),
+        tsk_getu16(fs->endian, dino_buf->i_nlink),
+        (tsk_getu32(fs->endian,
+                dino_buf->i_size) + (tsk_getu16(fs->endian,
+                    dino_buf->i_mode) & EXT2_IN_REG) ? (uint64_t)
+            tsk_getu32(fs->endian, dino_buf->i_size_high) << 32 : 0),
+        tsk_getu16(fs->endian,
+            dino_buf->i_uid) + (tsk_getu16(fs->endian,
+                dino_buf->i_uid_high) << 16), tsk_getu16(fs->endian,
+            dino_buf->i_gid) + (tsk_getu16(fs->endian,
+                dino_buf->i_gid_high) << 16), tsk_getu32(fs->endian,
+            dino_buf->i_mtime), tsk_getu32(fs->endian,
+            dino_buf->i_atime), tsk_getu32(fs->endian,
+            dino_buf->i_ctime), tsk_getu32(fs->endian,
+            dino_buf->i_dtime));
+}
+
+/* ext2fs_itable_used_cnt - number of inodes at the start of the loaded
+ * group's inode table that may have been used.  The inodes past the
+ * bg_itable_unused mark (or all of them in an INODE_UNINIT group) have
+ * never been used and are treated as zeroed.
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ * */
+static TSK_INUM_T
+ext2fs_itable_used_cnt(EXT2FS_INFO * ext2fs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    uint32_t ipg = tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group);
+    TSK_INUM_T unused;
+
+    /* bg_itable_unused is only maintained along with the group flags */
+    if (ext2fs_group_flags(ext2fs) & EXT4_BG_INODE_UNINIT)
+        return 0;
+    else if (ext2fs_group_flags(ext2fs) == 0
+        && (tsk_getu32(fs->endian, ext2fs->fs->s_feature_ro_compat) &
+            (EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM |
+                EXT4FS_FEATURE_RO_COMPAT_METADATA_CSUM)) == 0)
+        return ipg;
+
+    if (ext2fs->ext4_grp_buf != NULL)
+        unused = tsk_getu16(fs->endian,
+            ext2fs->ext4_grp_buf->bg_itable_unused_lo) |
+            ((TSK_INUM_T) tsk_getu16(fs->endian,
+                ext2fs->ext4_grp_buf->bg_itable_unused_hi) << 16);
+    else
+        /* the 32-byte descriptor has bg_itable_unused_lo at the
+         * same offset */
+        unused = tsk_getu16(fs->endian, &ext2fs->grp_buf->f1[10]);
+
+    return (unused < ipg) ? ipg - unused : 0;
+}
+
 /* ext2fs_dinode_load - look up disk inode & load into ext2fs_inode structure
  * @param ext2fs A ext2fs file system information structure
  * @param dino_inum Metadata address
@@ -456,7 +714,7 @@ static uint8_t
  * return 1 on error and 0 on success
  * */
 
-static uint8_t
+uint8_t
 ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     ext2fs_inode * dino_buf)
 {
@@ -464,6 +722,7 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     TSK_OFF_T addr;
     ssize_t cnt;
     TSK_INUM_T rel_inum;
+    TSK_INUM_T used_cnt;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
 
     /*
@@ -535,8 +794,17 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
             ext2fs->grp_buf->bg_inode_table) * (TSK_OFF_T) fs->block_size +
             rel_inum * (TSK_OFF_T) ext2fs->inode_size;
     }
+    used_cnt = ext2fs_itable_used_cnt(ext2fs);
     tsk_release_lock(&ext2fs->lock);
 
+    /* same as ext2fs_itable_load(), so that istat and ils agree */
+    if (rel_inum >= used_cnt) {
+        memset(dino_buf, 0, ext2fs->inode_size);
+        if (tsk_verbose)
+            ext2fs_dinode_print(ext2fs, dino_inum, dino_buf);
+        return 0;
+    }
+
     cnt = tsk_fs_read(fs, addr, (char *) dino_buf, ext2fs->inode_size);
 
     if (cnt != ext2fs->inode_size) {
@@ -551,26 +819,8 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
 //DEBUG    printf("Inode Size: %d, %d, %d, %d\n", sizeof(ext2fs_inode), *ext2fs->fs->s_inode_size, ext2fs->inode_size, *ext2fs->fs->s_want_extra_isize);
 //DEBUG    debug_print_buf((char *)dino_buf, ext2fs->inode_size);
 
-    if (tsk_verbose) {
-        tsk_fprintf(stderr,
-            "%" PRIuINUM " m/l/s=%o/%d/%" PRIu32
-            " u/g=%d/%d macd=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32
-            "\n", dino_inum, tsk_getu16(fs->endian, dino_buf->i_mode),
-            tsk_getu16(fs->endian, dino_buf->i_nlink),
-            (tsk_getu32(fs->endian,
-                    dino_buf->i_size) + (tsk_getu16(fs->endian,
-                        dino_buf->i_mode) & EXT2_IN_REG) ? (uint64_t)
-                tsk_getu32(fs->endian, dino_buf->i_size_high) << 32 : 0),
-            tsk_getu16(fs->endian,
-                dino_buf->i_uid) + (tsk_getu16(fs->endian,
-                    dino_buf->i_uid_high) << 16), tsk_getu16(fs->endian,
-                dino_buf->i_gid) + (tsk_getu16(fs->endian,
-                    dino_buf->i_gid_high) << 16), tsk_getu32(fs->endian,
-                dino_buf->i_mtime), tsk_getu32(fs->endian,
-                dino_buf->i_atime), tsk_getu32(fs->endian,
-                dino_buf->i_ctime), tsk_getu32(fs->endian,
-                dino_buf->i_dtime));
-    }
+    if (tsk_verbose)
+        ext2fs_dinode_print(ext2fs, dino_inum, dino_buf);
 
     return 0;
 }
@@ -935,6 +1185,95 @@ ext2fs_inode_lookup(TSK_FS_INFO * fs, TSK_FS_FILE * a_fs_file,
 
 
 
+/* ext2fs_itable_load - read a slice of a group's inode table
+ * @param ext2fs A ext2fs file system information structure
+ * @param inum First inode of the slice
+ * @param last_inum Last inode wanted (the slice also ends at the end of
+ *  the group and after EXT2FS_INODE_WALK_READ_SIZE bytes)
+ * @param buf Buffer of EXT2FS_INODE_WALK_READ_SIZE bytes
+ *
+ * Inodes past the group's bg_itable_unused mark (or in an INODE_UNINIT
+ * group) have never been used; they are returned zeroed without I/O.
+ *
+ * return the number of inodes in buf, 0 on error
+ * */
+static TSK_INUM_T
+ext2fs_itable_load(EXT2FS_INFO * ext2fs, TSK_INUM_T inum,
+    TSK_INUM_T last_inum, uint8_t * buf)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    uint32_t ipg = tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group);
+    EXT2_GRPNUM_T grp_num;
+    TSK_INUM_T rel_inum;
+    TSK_INUM_T used_cnt;
+    TSK_INUM_T cnt;
+    TSK_DADDR_T itable;
+    TSK_OFF_T addr;
+    ssize_t len;
+
+    grp_num = (EXT2_GRPNUM_T) ((inum - 1) / ipg);
+    rel_inum = (inum - 1) - (TSK_INUM_T) ipg * grp_num;
+
+    /* lock access to grp_buf */
+    tsk_take_lock(&ext2fs->lock);
+
+    if (ext2fs_group_load(ext2fs, grp_num)) {
+        tsk_release_lock(&ext2fs->lock);
+        return 0;
+    }
+
+    if (ext2fs->ext4_grp_buf != NULL) {
+        itable = ext4_getu64(fs->endian,
+            ext2fs->ext4_grp_buf->bg_inode_table_hi,
+            ext2fs->ext4_grp_buf->bg_inode_table_lo);
+    }
+    else {
+        itable = tsk_getu32(fs->endian, ext2fs->grp_buf->bg_inode_table);
+    }
+
+    used_cnt = ext2fs_itable_used_cnt(ext2fs);
+    tsk_release_lock(&ext2fs->lock);
+
+    cnt = ipg - rel_inum;
+    if (cnt > last_inum - inum + 1)
+        cnt = last_inum - inum + 1;
+    if (cnt > EXT2FS_INODE_WALK_READ_SIZE / ext2fs->inode_size)
+        cnt = EXT2FS_INODE_WALK_READ_SIZE / ext2fs->inode_size;
+
+    if (rel_inum >= used_cnt) {
+        memset(buf, 0, (size_t) cnt * ext2fs->inode_size);
+        return cnt;
+    }
+    if (cnt > used_cnt - rel_inum)
+        cnt = used_cnt - rel_inum;
+
+    /* Test for possible overflow */
+    if (itable >= LLONG_MAX / fs->block_size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr
+            ("ext2fs_itable_load: Overflow when calculating address");
+        return 0;
+    }
+    addr = (TSK_OFF_T) itable * (TSK_OFF_T) fs->block_size +
+        rel_inum * (TSK_OFF_T) ext2fs->inode_size;
+
+    len = tsk_fs_read(fs, addr, (char *) buf,
+        (size_t) cnt * ext2fs->inode_size);
+
+    /* keep the inodes that were read in full from a truncated image */
+    if (len < ext2fs->inode_size) {
+        if (len >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2("ext2fs_itable_load: Inode %" PRIuINUM
+            " from %" PRIdOFF, inum, addr);
+        return 0;
+    }
+    return (TSK_INUM_T) len / ext2fs->inode_size;
+}
+
 /* ext2fs_inode_walk - inode iterator
  *
  * flags used: TSK_FS_META_FLAG_USED, TSK_FS_META_FLAG_UNUSED,
@@ -957,6 +1296,9 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     unsigned int myflags;
     ext2fs_inode *dino_buf = NULL;
     unsigned int size = 0;
+    uint8_t *itable_buf = NULL;
+    TSK_INUM_T itable_start = 0;        /* first inode in itable_buf */
+    TSK_INUM_T itable_cnt = 0;  /* number of inodes in itable_buf */
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -1040,6 +1382,12 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     if ((dino_buf = (ext2fs_inode *) tsk_malloc(size)) == NULL) {
         return 1;
     }
+    /* the inode table is read in slices rather than an inode at a time */
+    if ((itable_buf =
+            (uint8_t *) tsk_malloc(EXT2FS_INODE_WALK_READ_SIZE)) == NULL) {
+        free(dino_buf);
+        return 1;
+    }
 
     for (inum = start_inum; inum <= end_inum_tmp; inum++) {
         int retval;
@@ -1059,6 +1407,7 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (ext2fs_imap_load(ext2fs, grp_num)) {
             tsk_release_lock(&ext2fs->lock);
             free(dino_buf);
+            free(itable_buf);
             return 1;
         }
         ibase =
@@ -1071,6 +1420,7 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if ((inum - ibase) > fs->block_size*8) {
             tsk_release_lock(&ext2fs->lock);
             free(dino_buf);
+            free(itable_buf);
             tsk_error_reset();
             tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
             tsk_error_set_errstr("%s: Invalid offset into imap_buf (inum %" PRIuINUM " - ibase %" PRIuINUM ")",
@@ -1084,16 +1434,52 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         myflags = (isset(ext2fs->imap_buf, inum - ibase) ?
             TSK_FS_META_FLAG_ALLOC : TSK_FS_META_FLAG_UNALLOC);
 
-        tsk_release_lock(&ext2fs->lock);
-
-        if ((flags & myflags) != myflags)
+        if ((flags & myflags) != myflags) {
+            tsk_release_lock(&ext2fs->lock);
             continue;
+        }
 
-        if (ext2fs_dinode_load(ext2fs, inum, dino_buf)) {
-            tsk_fs_file_close(fs_file);
-            free(dino_buf);
-            return 1;
+        /*
+         * Read the next slice of the inode table if this inode is not in
+         * the current one.  If only allocated inodes are wanted, end it
+         * at the last allocated inode it would cover.
+         */
+        if (inum < itable_start || inum >= itable_start + itable_cnt) {
+            TSK_INUM_T last_inum = ibase + tsk_getu32(fs->endian,
+                ext2fs->fs->s_inodes_per_group) - 1;
+
+            if (last_inum > end_inum_tmp)
+                last_inum = end_inum_tmp;
+            if (last_inum - inum >=
+                EXT2FS_INODE_WALK_READ_SIZE / ext2fs->inode_size)
+                last_inum = inum +
+                    EXT2FS_INODE_WALK_READ_SIZE / ext2fs->inode_size - 1;
+            if ((flags & TSK_FS_META_FLAG_UNALLOC) == 0) {
+                while (last_inum > inum
+                    && !isset(ext2fs->imap_buf, last_inum - ibase))
+                    last_inum--;
+            }
+            tsk_release_lock(&ext2fs->lock);
+
+            itable_start = inum;
+            if ((itable_cnt =
+                    ext2fs_itable_load(ext2fs, inum, last_inum,
+                        itable_buf)) == 0) {
+                tsk_fs_file_close(fs_file);
+                free(dino_buf);
+                free(itable_buf);
+                return 1;
+            }
         }
+        else {
+            tsk_release_lock(&ext2fs->lock);
+        }
+
+        memcpy(dino_buf,
+            &itable_buf[(size_t) (inum - itable_start) * ext2fs->inode_size],
+            ext2fs->inode_size);
+        if (tsk_verbose)
+            ext2fs_dinode_print(ext2fs, inum, dino_buf);
 
 
         /*
@@ -1122,6 +1508,7 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (ext2fs_dinode_copy(ext2fs, fs_file->meta, inum, dino_buf)) {
             tsk_fs_meta_close(fs_file->meta);
             free(dino_buf);
+            free(itable_buf);
             return 1;
         }
 
@@ -1129,11 +1516,13 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(itable_buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(itable_buf);
             return 1;
         }
     }
@@ -1147,6 +1536,7 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (tsk_fs_dir_make_orphan_dir_meta(fs, fs_file->meta)) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(itable_buf);
             return 1;
         }
         /* call action */
@@ -1154,11 +1544,13 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(itable_buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(itable_buf);
             return 1;
         }
     }
@@ -1168,6 +1560,7 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
      */
     tsk_fs_file_close(fs_file);
     free(dino_buf);
+    free(itable_buf);
 
     return 0;
 }
@@ -1427,20 +1820,95 @@ ext2fs_make_data_run_extent(TSK_FS_INFO * fs_info, TSK_FS_ATTR * fs_attr,
 }
 
 
+/** \internal
+ * Read an extent tree block.  The last EXT2FS_EXTENT_CACHE_NUM blocks
+ * read are kept in a cache shared by all files of the file system, so
+ * reloading the attributes of a file does not read its tree again.
+ * @param buf Buffer of block_size bytes to copy the block to
+ * @return 0 on success, 1 on error.
+ */
+static uint8_t
+ext2fs_extent_node_load(EXT2FS_INFO * ext2fs, TSK_DADDR_T addr,
+    uint8_t * buf)
+{
+    TSK_FS_INFO *fs_info = (TSK_FS_INFO *) & ext2fs->fs_info;
+    ssize_t cnt;
+    int i, slot;
+
+    /* lock access to the extent cache */
+    tsk_take_lock(&ext2fs->lock);
+    if (ext2fs->extent_cache != NULL) {
+        for (i = 0; i < EXT2FS_EXTENT_CACHE_NUM; i++) {
+            if (ext2fs->extent_cache_addr[i] == addr) {
+                memcpy(buf,
+                    &ext2fs->extent_cache[(size_t) i *
+                        fs_info->block_size], fs_info->block_size);
+                ext2fs->extent_cache_used[i] = ++ext2fs->extent_cache_tick;
+                tsk_release_lock(&ext2fs->lock);
+                return 0;
+            }
+        }
+    }
+    tsk_release_lock(&ext2fs->lock);
+
+    cnt = tsk_fs_read_block(fs_info, addr, (char *) buf,
+        fs_info->block_size);
+    if (cnt != fs_info->block_size) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        return 1;
+    }
+
+    /* block 0 is never part of an extent tree and marks unused slots */
+    if (addr == 0)
+        return 0;
+
+    tsk_take_lock(&ext2fs->lock);
+    if (ext2fs->extent_cache == NULL) {
+        ext2fs->extent_cache = (uint8_t *) tsk_malloc((size_t)
+            EXT2FS_EXTENT_CACHE_NUM * fs_info->block_size);
+        if (ext2fs->extent_cache == NULL) {
+            tsk_release_lock(&ext2fs->lock);
+            tsk_error_reset();
+            return 0;
+        }
+    }
+    /* replace the least recently used block */
+    slot = 0;
+    for (i = 0; i < EXT2FS_EXTENT_CACHE_NUM; i++) {
+        if (ext2fs->extent_cache_addr[i] == addr) {
+            slot = i;
+            break;
+        }
+        if (ext2fs->extent_cache_used[i] < ext2fs->extent_cache_used[slot])
+            slot = i;
+    }
+    memcpy(&ext2fs->extent_cache[(size_t) slot * fs_info->block_size], buf,
+        fs_info->block_size);
+    ext2fs->extent_cache_addr[slot] = addr;
+    ext2fs->extent_cache_used[slot] = ++ext2fs->extent_cache_tick;
+    tsk_release_lock(&ext2fs->lock);
+
+    return 0;
+}
+
 /** \internal
  * Given a block that contains an extent node (which starts with extent_header),
  * walk it, and add everything encountered to the appropriate attributes.
+ * @param depth Depth the node must have, one less than its parent's
+ * @param node_cnt Incremented for each extent block added to fs_attr_extent
  * @return 0 on success, 1 on error.
  */
 static TSK_OFF_T
 ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
     TSK_FS_ATTR * fs_attr, TSK_FS_ATTR * fs_attr_extent,
-    TSK_DADDR_T idx_block)
+    TSK_DADDR_T idx_block, uint16_t depth, int32_t * node_cnt)
 {
     ext2fs_extent_header *header;
     TSK_FS_ATTR_RUN *data_run;
     uint8_t *buf;
-    ssize_t cnt;
     unsigned int i;
 
     /* first, read the block specified by the parameter */
@@ -1449,13 +1917,7 @@ ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
         return 1;
     }
 
-    cnt =
-        tsk_fs_read_block(fs_info, idx_block, (char *) buf, fs_blocksize);
-    if (cnt != fs_blocksize) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
-        }
+    if (ext2fs_extent_node_load((EXT2FS_INFO *) fs_info, idx_block, buf)) {
         tsk_error_set_errstr("ext2fs_make_data_run_extent_index: Block %"
             PRIuDADDR, idx_block);
         free(buf);
@@ -1472,23 +1934,50 @@ ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
         return 1;
     }
 
+    /* a child is exactly one level below its parent, which also keeps
+     * a corrupt tree from looping */
+    if (tsk_getu16(fs_info->endian, header->eh_depth) != depth) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ext2fs_make_data_run_extent_index: Block %" PRIuDADDR
+            " has depth %" PRIu16 " instead of %" PRIu16, idx_block,
+            tsk_getu16(fs_info->endian, header->eh_depth), depth);
+        free(buf);
+        return 1;
+    }
+
     data_run = tsk_fs_attr_run_alloc();
     if (data_run == NULL) {
         free(buf);
         return 1;
     }
+    /* the extent attribute holds the tree blocks in walk order */
+    data_run->offset = *node_cnt;
     data_run->addr = idx_block;
-    data_run->len = fs_blocksize;
+    data_run->len = 1;
 
     if (tsk_fs_attr_add_run(fs_info, fs_attr_extent, data_run)) {
         tsk_fs_attr_run_free(data_run);
         free(buf);
         return 1;
     }
+    (*node_cnt)++;
 
     /* process leaf nodes */
     if (tsk_getu16(fs_info->endian, header->eh_depth) == 0) {
         ext2fs_extent *extents = (ext2fs_extent *) (header + 1);
+        if (tsk_getu16(fs_info->endian, header->eh_entries) >
+            (fs_blocksize - sizeof(ext2fs_extent_header)) /
+            sizeof(ext2fs_extent)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+                ("ext2fs_make_data_run_extent_index: Block %" PRIuDADDR
+                " reports too many extents", idx_block);
+            free(buf);
+            return 1;
+        }
         for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries);
             i++) {
             ext2fs_extent extent = extents[i];
@@ -1501,6 +1990,17 @@ ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
     /* recurse on interior nodes */
     else {
         ext2fs_extent_idx *indices = (ext2fs_extent_idx *) (header + 1);
+        if (tsk_getu16(fs_info->endian, header->eh_entries) >
+            (fs_blocksize - sizeof(ext2fs_extent_header)) /
+            sizeof(ext2fs_extent_idx)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+                ("ext2fs_make_data_run_extent_index: Block %" PRIuDADDR
+                " reports too many extent indices", idx_block);
+            free(buf);
+            return 1;
+        }
         for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries);
             i++) {
             ext2fs_extent_idx *index = &indices[i];
@@ -1509,7 +2009,7 @@ ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
                         index->ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
                 endian, index->ei_leaf_lo);
             if (ext2fs_make_data_run_extent_index(fs_info, fs_attr,
-                    fs_attr_extent, child_block)) {
+                    fs_attr_extent, child_block, depth - 1, node_cnt)) {
                 free(buf);
                 return 1;
             }
@@ -1520,71 +2020,6 @@ ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
     return 0;
 }
 
-/** \internal
- * Get the number of extent blocks rooted at the given extent_header.
- * The count does not include the extent header passed as a parameter.
- *
- * @return the number of extent blocks, or -1 on error.
- */
-static int32_t
-ext2fs_extent_tree_index_count(TSK_FS_INFO * fs_info,
-    TSK_FS_META * fs_meta, ext2fs_extent_header * header)
-{
-    int fs_blocksize = fs_info->block_size;
-    ext2fs_extent_idx *indices;
-    int count = 0;
-    uint8_t *buf;
-    int i;
-
-    if (tsk_getu16(fs_info->endian, header->eh_magic) != 0xF30A) {
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("ext2fs_load_attrs: extent header magic valid incorrect!");
-        return -1;
-    }
-
-    if (tsk_getu16(fs_info->endian, header->eh_depth) == 0) {
-        return 0;
-    }
-
-    if ((buf = (uint8_t *) tsk_malloc(fs_blocksize)) == NULL) {
-        return -1;
-    }
-
-    indices = (ext2fs_extent_idx *) (header + 1);
-    for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries); i++) {
-        ext2fs_extent_idx *index = &indices[i];
-        TSK_DADDR_T block =
-            (((uint32_t) tsk_getu16(fs_info->endian,
-                    index->ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
-            endian, index->ei_leaf_lo);
-        ssize_t cnt =
-            tsk_fs_read_block(fs_info, block, (char *) buf, fs_blocksize);
-        int ret;
-
-        if (cnt != fs_blocksize) {
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
-            }
-            tsk_error_set_errstr2("ext2fs_extent_tree_index_count: Block %"
-                PRIuDADDR, block);
-            return -1;
-        }
-
-        if ((ret =
-                ext2fs_extent_tree_index_count(fs_info, fs_meta,
-                    (ext2fs_extent_header *) buf)) < 0) {
-            return -1;
-        }
-        count += ret;
-        count++;
-    }
-
-    free(buf);
-    return count;
-}
-
 
 /**
  * \internal
@@ -1677,7 +2112,7 @@ ext4_load_attrs_extents(TSK_FS_FILE *fs_file)
     }
     else {                  /* interior node */
         TSK_FS_ATTR *fs_attr_extent;
-        int32_t extent_index_size;
+        int32_t extent_index_size = 0;
         
         if (num_entries >
             (fs_info->block_size -
@@ -1688,6 +2123,13 @@ ext4_load_attrs_extents(TSK_FS_FILE *fs_file)
             ("ext2fs_load_attr: Inode reports too many extent indices");
             return 1;
         }
+        if (depth > EXT2FS_EXTENT_DEPTH_MAX) {
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+            ("ext2fs_load_attr: Inode reports extent tree depth %" PRIu16,
+             depth);
+            return 1;
+        }
         
         if ((fs_attr_extent =
              tsk_fs_attrlist_getnew(fs_meta->attr,
@@ -1695,20 +2137,14 @@ ext4_load_attrs_extents(TSK_FS_FILE *fs_file)
              return 1;
          }
         
-        extent_index_size =
-        ext2fs_extent_tree_index_count(fs_info, fs_meta, header);
-        if (extent_index_size < 0) {
-            return 1;
-        }
-        
         if (tsk_fs_attr_set_run(fs_file, fs_attr_extent, NULL, NULL,
                                 TSK_FS_ATTR_TYPE_UNIX_EXTENT, TSK_FS_ATTR_ID_DEFAULT,
-                                fs_info->block_size * extent_index_size,
-                                fs_info->block_size * extent_index_size,
-                                fs_info->block_size * extent_index_size, 0, 0)) {
+                                0, 0, 0, 0, 0)) {
             return 1;
         }
         
+        /* the tree is walked once; the extent blocks are counted as they
+         * are added */
         indices = (ext2fs_extent_idx *) (header + 1);
         for (i = 0; i < num_entries; i++) {
             ext2fs_extent_idx *index = &indices[i];
@@ -1718,10 +2154,15 @@ ext4_load_attrs_extents(TSK_FS_FILE *fs_file)
                                     ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
                                                                      endian, index->ei_leaf_lo);
             if (ext2fs_make_data_run_extent_index(fs_info, fs_attr,
-                                                  fs_attr_extent, child_block)) {
+                                                  fs_attr_extent, child_block,
+                                                  depth - 1, &extent_index_size)) {
                 return 1;
             }
         }
+        
+        fs_attr_extent->size = fs_attr_extent->nrd.allocsize =
+            fs_attr_extent->nrd.initsize =
+            (TSK_OFF_T) fs_info->block_size * extent_index_size;
     }
     
     fs_meta->attr_state = TSK_FS_META_ATTR_STUDIED;
@@ -3166,8 +3607,18 @@ ext2fs_close(TSK_FS_INFO * fs)
     free(ext2fs->fs);
     free(ext2fs->grp_buf);
     free(ext2fs->ext4_grp_buf);
-    free(ext2fs->bmap_buf);
-    free(ext2fs->imap_buf);
+    if (ext2fs->bmap_cache != NULL)
+        free(ext2fs->bmap_cache);
+    else
+        free(ext2fs->bmap_buf);
+    free(ext2fs->bmap_cache_loaded);
+    if (ext2fs->imap_cache != NULL)
+        free(ext2fs->imap_cache);
+    else
+        free(ext2fs->imap_buf);
+    free(ext2fs->imap_cache_loaded);
+    free(ext2fs->extent_cache);
+    ext2fs_jinfo_free(ext2fs);
 
     tsk_deinit_lock(&ext2fs->lock);
 
@@ -3486,6 +3937,31 @@ ext2fs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     ext2fs->grp_buf = NULL;
     ext2fs->grp_num = 0xffffffff;
 
+    /* bitmaps of all groups, if they fit.  calloc() instead of
+     * tsk_malloc() so that the memset does not touch every page up
+     * front; large blocks come zeroed from the OS and their pages are
+     * only touched as groups get loaded. */
+    if ((uint64_t) ext2fs->groups_count * fs->block_size <=
+        EXT2FS_MAP_CACHE_MAX) {
+        size_t len = (size_t) ext2fs->groups_count * fs->block_size;
+        size_t loaded_len = (ext2fs->groups_count + 7) / 8;
+
+        if (((ext2fs->bmap_cache = (uint8_t *) calloc(len, 1)) == NULL)
+            || ((ext2fs->bmap_cache_loaded =
+                    (uint8_t *) tsk_malloc(loaded_len)) == NULL)
+            || ((ext2fs->imap_cache = (uint8_t *) calloc(len, 1)) == NULL)
+            || ((ext2fs->imap_cache_loaded =
+                    (uint8_t *) tsk_malloc(loaded_len)) == NULL)) {
+            free(ext2fs->bmap_cache);
+            free(ext2fs->bmap_cache_loaded);
+            free(ext2fs->imap_cache);
+            free(ext2fs->imap_cache_loaded);
+            ext2fs->bmap_cache = ext2fs->bmap_cache_loaded = NULL;
+            ext2fs->imap_cache = ext2fs->imap_cache_loaded = NULL;
+            tsk_error_reset();
+        }
+    }
+
 
     /*
      * Print some stats.
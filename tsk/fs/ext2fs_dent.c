@@ -372,3 +372,412 @@ ext2fs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
 
     return retval_final;
 }
+
+
+/*
+ * Directory hash functions, as used by the htree index.  The signed
+ * variants treat the name as signed char, as on the x86 systems that
+ * did not record EXT2_FLAGS_UNSIGNED_HASH.
+ */
+
+#define EXT2_DX_ROL32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+
+static void
+ext2fs_dx_tea_transform(uint32_t buf[4], const uint32_t in[4])
+{
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    uint32_t a = in[0], b = in[1], c = in[2], d = in[3];
+    int n = 16;
+
+    do {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+        b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+    } while (--n);
+
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+#define EXT2_DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT2_DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT2_DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define EXT2_DX_ROUND(f, a, b, c, d, x, s) \
+    (a += f(b, c, d) + (x), a = EXT2_DX_ROL32(a, s))
+#define EXT2_DX_K2 0x5A827999U
+#define EXT2_DX_K3 0x6ED9EBA1U
+
+/* MD4 with 3 rounds of 8 steps instead of 16 */
+static void
+ext2fs_dx_half_md4_transform(uint32_t buf[4], const uint32_t in[8])
+{
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    EXT2_DX_ROUND(EXT2_DX_F, a, b, c, d, in[0], 3);
+    EXT2_DX_ROUND(EXT2_DX_F, d, a, b, c, in[1], 7);
+    EXT2_DX_ROUND(EXT2_DX_F, c, d, a, b, in[2], 11);
+    EXT2_DX_ROUND(EXT2_DX_F, b, c, d, a, in[3], 19);
+    EXT2_DX_ROUND(EXT2_DX_F, a, b, c, d, in[4], 3);
+    EXT2_DX_ROUND(EXT2_DX_F, d, a, b, c, in[5], 7);
+    EXT2_DX_ROUND(EXT2_DX_F, c, d, a, b, in[6], 11);
+    EXT2_DX_ROUND(EXT2_DX_F, b, c, d, a, in[7], 19);
+
+    EXT2_DX_ROUND(EXT2_DX_G, a, b, c, d, in[1] + EXT2_DX_K2, 3);
+    EXT2_DX_ROUND(EXT2_DX_G, d, a, b, c, in[3] + EXT2_DX_K2, 5);
+    EXT2_DX_ROUND(EXT2_DX_G, c, d, a, b, in[5] + EXT2_DX_K2, 9);
+    EXT2_DX_ROUND(EXT2_DX_G, b, c, d, a, in[7] + EXT2_DX_K2, 13);
+    EXT2_DX_ROUND(EXT2_DX_G, a, b, c, d, in[0] + EXT2_DX_K2, 3);
+    EXT2_DX_ROUND(EXT2_DX_G, d, a, b, c, in[2] + EXT2_DX_K2, 5);
+    EXT2_DX_ROUND(EXT2_DX_G, c, d, a, b, in[4] + EXT2_DX_K2, 9);
+    EXT2_DX_ROUND(EXT2_DX_G, b, c, d, a, in[6] + EXT2_DX_K2, 13);
+
+    EXT2_DX_ROUND(EXT2_DX_H, a, b, c, d, in[3] + EXT2_DX_K3, 3);
+    EXT2_DX_ROUND(EXT2_DX_H, d, a, b, c, in[7] + EXT2_DX_K3, 9);
+    EXT2_DX_ROUND(EXT2_DX_H, c, d, a, b, in[2] + EXT2_DX_K3, 11);
+    EXT2_DX_ROUND(EXT2_DX_H, b, c, d, a, in[6] + EXT2_DX_K3, 15);
+    EXT2_DX_ROUND(EXT2_DX_H, a, b, c, d, in[1] + EXT2_DX_K3, 3);
+    EXT2_DX_ROUND(EXT2_DX_H, d, a, b, c, in[5] + EXT2_DX_K3, 9);
+    EXT2_DX_ROUND(EXT2_DX_H, c, d, a, b, in[0] + EXT2_DX_K3, 11);
+    EXT2_DX_ROUND(EXT2_DX_H, b, c, d, a, in[4] + EXT2_DX_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+/* Pack up to num*4 bytes of the name into num words, padded with the
+ * length of the name */
+static void
+ext2fs_dx_str2hashbuf(const char *msg, int len, uint32_t * buf, int num,
+    uint8_t is_unsigned)
+{
+    uint32_t pad, val;
+    int i;
+
+    pad = (uint32_t) len | ((uint32_t) len << 8);
+    pad |= pad << 16;
+
+    val = pad;
+    if (len > num * 4)
+        len = num * 4;
+    for (i = 0; i < len; i++) {
+        if (is_unsigned)
+            val = (uint32_t) ((const unsigned char *) msg)[i] + (val << 8);
+        else
+            val = (uint32_t) (int) ((const signed char *) msg)[i] +
+                (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0)
+        *buf++ = val;
+    while (--num >= 0)
+        *buf++ = pad;
+}
+
+/** \internal
+ * Hash a name the way the htree index of the file system does.
+ * @param a_version Hash version, EXT2_DX_HASH_UNSIGNED added if needed
+ * @param a_hash [out] Hash, with the low (collision) bit cleared
+ * @returns 1 if the hash version is not supported, 0 otherwise
+ */
+uint8_t
+ext2fs_dx_hash(EXT2FS_INFO * ext2fs, uint8_t a_version, const char *a_name,
+    uint32_t * a_hash)
+{
+    int len = (int) strlen(a_name);
+    uint8_t is_unsigned = (a_version >= EXT2_DX_HASH_UNSIGNED);
+    uint32_t buf[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    uint32_t in[8];
+    uint32_t hash;
+    const char *p;
+    int i;
+
+    /* the volume's seed replaces the default one unless it is all zero */
+    for (i = 0; i < 4; i++) {
+        if (tsk_getu32(TSK_LIT_ENDIAN, &ext2fs->fs->s_hash_seed[i * 4])) {
+            for (i = 0; i < 4; i++)
+                buf[i] = tsk_getu32(TSK_LIT_ENDIAN,
+                    &ext2fs->fs->s_hash_seed[i * 4]);
+            break;
+        }
+    }
+
+    switch (a_version % EXT2_DX_HASH_UNSIGNED) {
+    case EXT2_DX_HASH_LEGACY:{
+            uint32_t hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+            hash = hash0;
+            for (i = 0; i < len; i++) {
+                int c = is_unsigned ? (int) ((const unsigned char *)
+                    a_name)[i] : (int) ((const signed char *) a_name)[i];
+                hash = hash1 + (hash0 ^ ((uint32_t) c * 7152373));
+                if (hash & 0x80000000)
+                    hash -= 0x7fffffff;
+                hash1 = hash0;
+                hash0 = hash;
+            }
+            hash = hash0 << 1;
+            break;
+        }
+    case EXT2_DX_HASH_HALF_MD4:
+        for (p = a_name; len > 0; len -= 32, p += 32) {
+            ext2fs_dx_str2hashbuf(p, len, in, 8, is_unsigned);
+            ext2fs_dx_half_md4_transform(buf, in);
+        }
+        hash = buf[1];
+        break;
+    case EXT2_DX_HASH_TEA:
+        for (p = a_name; len > 0; len -= 16, p += 16) {
+            ext2fs_dx_str2hashbuf(p, len, in, 4, is_unsigned);
+            ext2fs_dx_tea_transform(buf, in);
+        }
+        hash = buf[0];
+        break;
+    default:
+        return 1;
+    }
+
+    hash &= ~1;
+    /* 0xfffffffe marks the end of directory in readdir cookies */
+    if (hash == 0xfffffffe)
+        hash = 0xfffffffc;
+    *a_hash = hash;
+    return 0;
+}
+
+/*
+ * One level of the htree path: a node and the entry followed in it.
+ */
+typedef struct {
+    uint8_t *buf;               // block holding the node
+    ext2fs_dx_entry *entries;   // entries of the node (entries[0] is the count/limit)
+    uint16_t count;             // number of entries
+    uint16_t at;                // entry followed
+} EXT2FS_DX_FRAME;
+
+/**
+ * Find the entry of an index node that covers a hash.
+ * @param a_off Offset of the entries in the node's block
+ * @returns 1 if the node is not valid, 0 otherwise
+ */
+static uint8_t
+ext2fs_dx_frame_search(TSK_FS_INFO * fs, size_t a_off, uint32_t a_hash,
+    EXT2FS_DX_FRAME * a_frame)
+{
+    ext2fs_dx_countlimit *cl;
+    int lo, hi;
+
+    if (a_off + sizeof(ext2fs_dx_countlimit) > fs->block_size)
+        return 1;
+    cl = (ext2fs_dx_countlimit *) & a_frame->buf[a_off];
+    a_frame->entries = (ext2fs_dx_entry *) cl;
+    a_frame->count = tsk_getu16(fs->endian, cl->count);
+    if ((a_frame->count == 0)
+        || (a_frame->count > tsk_getu16(fs->endian, cl->limit))
+        || (tsk_getu16(fs->endian, cl->limit) >
+            (fs->block_size - a_off) / sizeof(ext2fs_dx_entry)))
+        return 1;
+
+    /* the last entry whose hash is not above the one searched for */
+    lo = 1;
+    hi = a_frame->count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (tsk_getu32(fs->endian, a_frame->entries[mid].hash) > a_hash)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+    a_frame->at = (uint16_t) (lo - 1);
+    return 0;
+}
+
+/* Read block a_blk of the directory.  Returns 1 on error. */
+static uint8_t
+ext2fs_dx_block_read(TSK_FS_FILE * a_fs_file, uint32_t a_blk, uint8_t * a_buf)
+{
+    TSK_FS_INFO *fs = a_fs_file->fs_info;
+
+    if (tsk_fs_file_read(a_fs_file, (TSK_OFF_T) a_blk * fs->block_size,
+            (char *) a_buf, fs->block_size,
+            TSK_FS_FILE_READ_FLAG_NONE) != (ssize_t) fs->block_size)
+        return 1;
+    return 0;
+}
+
+/** \internal
+ * Look a name up in the htree index of a directory, reading only the
+ * index path and the leaf block(s) the name hashes to.
+ *
+ * The returned FS_DIR holds the entries of those leaf blocks and is only
+ * returned if one of them is an allocated entry with the given name. For
+ * anything else -- unindexed, unallocated or unsupported directories, or
+ * a name that is not in the index -- NULL is returned and the caller
+ * should fall back to tsk_fs_dir_open_meta(), which also finds deleted
+ * entries.
+ *
+ * @param a_fs File system to analyze
+ * @param a_addr Address of directory to search
+ * @param a_name Name to look for
+ * @returns Partial directory or NULL
+ */
+TSK_FS_DIR *
+ext2fs_dir_open_name(TSK_FS_INFO * a_fs, TSK_INUM_T a_addr,
+    const char *a_name)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) a_fs;
+    EXT2FS_DX_FRAME frames[EXT2_DX_LEVELS_MAX];
+    ext2fs_dx_root_info *info;
+    ext2fs_inode *dino_buf = NULL;
+    TSK_FS_DIR *fs_dir = NULL;
+    TSK_LIST *list_seen = NULL;
+    uint8_t *leaf = NULL;
+    uint8_t version;
+    uint32_t hash;
+    int levels = 0;
+    int lvl;
+    size_t i;
+    uint8_t found = 0;
+
+    memset(frames, 0, sizeof(frames));
+
+    if (a_addr < a_fs->first_inum || a_addr >= a_fs->last_inum
+        || ext2fs->deentry_type != EXT2_DE_V2
+        || !EXT2FS_HAS_COMPAT_FEATURE(a_fs, ext2fs->fs,
+            EXT2FS_FEATURE_COMPAT_DIR_INDEX))
+        return NULL;
+
+    /* only indexed directories with plain names */
+    if ((dino_buf = (ext2fs_inode *) tsk_malloc(ext2fs->inode_size >
+                sizeof(ext2fs_inode) ? ext2fs->inode_size :
+                sizeof(ext2fs_inode))) == NULL)
+        goto fallback;
+    if (ext2fs_dinode_load(ext2fs, a_addr, dino_buf))
+        goto fallback;
+    if (((tsk_getu32(a_fs->endian, dino_buf->i_flags) & EXT2_IN_INDEX) == 0)
+        || (tsk_getu32(a_fs->endian, dino_buf->i_flags) &
+            (EXT4_IN_ENCRYPT | EXT4_IN_CASEFOLD)))
+        goto fallback;
+
+    if ((fs_dir = tsk_fs_dir_alloc(a_fs, a_addr, 16)) == NULL)
+        goto fallback;
+    if ((fs_dir->fs_file =
+            tsk_fs_file_open_meta(a_fs, NULL, a_addr)) == NULL)
+        goto fallback;
+    if ((fs_dir->fs_file->meta->type != TSK_FS_META_TYPE_DIR)
+        || ((fs_dir->fs_file->meta->flags & TSK_FS_META_FLAG_ALLOC) == 0))
+        goto fallback;
+
+    for (lvl = 0; lvl < EXT2_DX_LEVELS_MAX; lvl++) {
+        if ((frames[lvl].buf =
+                (uint8_t *) tsk_malloc(a_fs->block_size)) == NULL)
+            goto fallback;
+    }
+    if ((leaf = (uint8_t *) tsk_malloc(a_fs->block_size)) == NULL)
+        goto fallback;
+
+    /* The root info follows '.' and '..' in block 0 */
+    if (ext2fs_dx_block_read(fs_dir->fs_file, 0, frames[0].buf))
+        goto fallback;
+    info = (ext2fs_dx_root_info *) & frames[0].buf[EXT2_DX_ROOT_INFO_OFF];
+    version = info->hash_version;
+    levels = info->indirect_levels + 1;
+    if ((tsk_getu32(a_fs->endian, info->reserved_zero) != 0)
+        || (version > EXT2_DX_HASH_TEA)
+        || (info->info_length < sizeof(ext2fs_dx_root_info))
+        || (levels > ((EXT2FS_HAS_INCOMPAT_FEATURE(a_fs, ext2fs->fs,
+                        EXT4FS_FEATURE_INCOMPAT_LARGEDIR)) ?
+                EXT2_DX_LEVELS_MAX : 2)))
+        goto fallback;
+    if (tsk_getu32(a_fs->endian, ext2fs->fs->s_flags) &
+        EXT2_FLAGS_UNSIGNED_HASH)
+        version += EXT2_DX_HASH_UNSIGNED;
+    if (ext2fs_dx_hash(ext2fs, version, a_name, &hash))
+        goto fallback;
+
+    /* walk down to the leaf; interior nodes start with a fake dentry */
+    if (ext2fs_dx_frame_search(a_fs,
+            EXT2_DX_ROOT_INFO_OFF + info->info_length, hash, &frames[0]))
+        goto fallback;
+    for (lvl = 1; lvl < levels; lvl++) {
+        if (ext2fs_dx_block_read(fs_dir->fs_file,
+                tsk_getu32(a_fs->endian,
+                    frames[lvl - 1].entries[frames[lvl - 1].at].block) &
+                0x0fffffff, frames[lvl].buf)
+            || ext2fs_dx_frame_search(a_fs, 8, hash, &frames[lvl]))
+            goto fallback;
+    }
+
+    while (found == 0) {
+        uint32_t blk = tsk_getu32(a_fs->endian,
+            frames[levels - 1].entries[frames[levels - 1].at].block) &
+            0x0fffffff;
+        uint32_t next_hash;
+
+        if (ext2fs_dx_block_read(fs_dir->fs_file, blk, leaf))
+            goto fallback;
+
+        if (ext2fs_dent_parse_block(ext2fs, fs_dir, 0, &list_seen,
+                (char *) leaf, a_fs->block_size) == TSK_ERR)
+            goto fallback;
+
+        for (i = 0; i < fs_dir->names_used; i++) {
+            if ((fs_dir->names[i].flags & TSK_FS_NAME_FLAG_ALLOC)
+                && (fs_dir->names[i].name)
+                && (strcmp(fs_dir->names[i].name, a_name) == 0)) {
+                found = 1;
+                break;
+            }
+        }
+        if (found)
+            break;
+
+        /* Names whose hashes collide can continue in the next leaf,
+         * which then starts with the same hash and the low bit set */
+        lvl = levels - 1;
+        while (1) {
+            frames[lvl].at++;
+            if (frames[lvl].at < frames[lvl].count)
+                break;
+            if (lvl == 0)
+                goto fallback;
+            lvl--;
+        }
+        next_hash = tsk_getu32(a_fs->endian,
+            frames[lvl].entries[frames[lvl].at].hash);
+        if ((next_hash & ~1) != hash)
+            goto fallback;
+        for (lvl++; lvl < levels; lvl++) {
+            if (ext2fs_dx_block_read(fs_dir->fs_file,
+                    tsk_getu32(a_fs->endian,
+                        frames[lvl - 1].entries[frames[lvl - 1].at].block) &
+                    0x0fffffff, frames[lvl].buf)
+                || ext2fs_dx_frame_search(a_fs, 8, 0, &frames[lvl]))
+                goto fallback;
+        }
+    }
+
+    for (lvl = 0; lvl < EXT2_DX_LEVELS_MAX; lvl++)
+        free(frames[lvl].buf);
+    free(leaf);
+    free(dino_buf);
+    tsk_list_free(list_seen);
+    return fs_dir;
+
+  fallback:
+    for (lvl = 0; lvl < EXT2_DX_LEVELS_MAX; lvl++)
+        free(frames[lvl].buf);
+    free(leaf);
+    free(dino_buf);
+    tsk_list_free(list_seen);
+    if (fs_dir)
+        tsk_fs_dir_close(fs_dir);
+    tsk_error_reset();
+    return NULL;
+}
@@ -68,6 +68,8 @@ load_sb_action(TSK_FS_FILE * fs_file, TSK_OFF_T a_off, TSK_DADDR_T addr,
     jinfo->last_block = big_tsk_getu32(sb->num_blk) - 1;
     jinfo->start_blk = big_tsk_getu32(sb->start_blk);
     jinfo->start_seq = big_tsk_getu32(sb->start_seq);
+    if (big_tsk_getu32(sb->entrytype) == EXT2_J_ETYPE_SB2)
+        jinfo->feature_incompat = big_tsk_getu32(sb->feature_incompat);
 
     return TSK_WALK_STOP;
 }
@@ -92,6 +94,7 @@ ext2fs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
         return 1;
     }
 
+    ext2fs_jinfo_free(ext2fs);
     ext2fs->jinfo = jinfo =
         (EXT2FS_JINFO *) tsk_malloc(sizeof(EXT2FS_JINFO));
     if (jinfo == NULL) {
@@ -102,6 +105,7 @@ ext2fs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
     jinfo->fs_file = tsk_fs_file_open_meta(fs, NULL, inum);
     if (!jinfo->fs_file) {
         free(jinfo);
+        ext2fs->jinfo = NULL;
         return 1;
 //      error("error finding journal inode %" PRIu32, inum);
     }
@@ -112,6 +116,7 @@ ext2fs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
         tsk_error_set_errstr("Error loading ext3 journal");
         tsk_fs_file_close(jinfo->fs_file);
         free(jinfo);
+        ext2fs->jinfo = NULL;
         return 1;
     }
 
@@ -125,7 +130,818 @@ ext2fs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
 }
 
 
-/* Limitations: does not use the action or any flags 
+/* Free the journal info of the file system, if any */
+void
+ext2fs_jinfo_free(EXT2FS_INFO * ext2fs)
+{
+    EXT2FS_JINFO *jinfo = ext2fs->jinfo;
+
+    if (jinfo == NULL)
+        return;
+    if (jinfo->fs_file)
+        tsk_fs_file_close(jinfo->fs_file);
+    free(jinfo->copies);
+    free(jinfo);
+    ext2fs->jinfo = NULL;
+}
+
+
+/*
+ * Journal block index.
+ *
+ * The journal is read in EXT2FS_JOURNAL_READ_SIZE chunks, which are
+ * scanned in parallel for blocks with the journal magic.  The descriptor
+ * blocks are kept and their tags are then decoded in parallel (one work
+ * item per descriptor) into the journal blocks that follow them.  The
+ * result is sorted by file system block so that all of the copies of a
+ * block can be found with a binary search.  The revoke blocks of the
+ * committed transactions are kept as well and mark the copies from the
+ * same or earlier transactions as revoked, which is what recovery would
+ * skip.
+ */
+
+/* A journal block that starts with the journal magic */
+typedef struct {
+    TSK_DADDR_T jblk;
+    uint32_t type;
+    uint32_t seq;
+} EXT2FS_JHEAD;
+
+/* A file system block in a revoke block */
+typedef struct {
+    TSK_DADDR_T fs_blk;
+    uint32_t seq;
+} EXT2FS_JREVOKE;
+
+/* Result of scanning one chunk or decoding one descriptor */
+typedef struct {
+    EXT2FS_JHEAD *heads;
+    size_t heads_cnt;
+    uint8_t *descs;             // copies of the descriptor and revoke blocks in heads
+    size_t descs_cnt;
+    EXT2FS_JBLK_COPY *copies;
+    size_t copies_cnt;
+    uint8_t err;
+} EXT2FS_JINDEX_RESULT;
+
+typedef struct {
+    EXT2FS_JINFO *jinfo;
+    size_t chunk_blks;          // journal blocks in a chunk
+    size_t batch_start;         // first chunk of the batch being scanned
+    EXT2FS_JINDEX_RESULT *results;
+
+    EXT2FS_JHEAD *heads;        // all journal structures, by jblk
+    size_t heads_cnt;
+    uint8_t **desc_bufs;        // descriptor and revoke blocks of each chunk
+    uint8_t **descs;            // descriptor blocks
+    size_t *desc_heads;         // index in heads of each descriptor
+    size_t descs_cnt;
+    uint8_t **revs;             // revoke blocks
+    size_t *rev_heads;          // index in heads of each revoke block
+    size_t revs_cnt;
+    EXT2FS_JREVOKE *revokes;    // revoked blocks of committed transactions
+    size_t revokes_cnt;
+    uint32_t *commits;          // sorted sequences of the commit blocks
+    size_t commits_cnt;
+    size_t tag_size;
+    size_t tail_size;
+} EXT2FS_JINDEX_PARSE;
+
+
+/*
+ * tsk_parallel_for callback: read a chunk of the journal and save the
+ * location, type and sequence of its journal structures, and a copy of
+ * its descriptor and revoke blocks.
+ */
+static void
+ext2fs_jindex_scan_chunk(size_t a_idx, void *a_ptr)
+{
+    EXT2FS_JINDEX_PARSE *parse = (EXT2FS_JINDEX_PARSE *) a_ptr;
+    EXT2FS_JINFO *jinfo = parse->jinfo;
+    EXT2FS_JINDEX_RESULT *result = &parse->results[a_idx];
+    TSK_DADDR_T start =
+        (TSK_DADDR_T) (parse->batch_start + a_idx) * parse->chunk_blks;
+    size_t cnt = parse->chunk_blks;
+    size_t heads_max = 0, descs_max = 0;
+    uint8_t *buf;
+    size_t i;
+
+    if (start + cnt > jinfo->last_block + 1)
+        cnt = (size_t) (jinfo->last_block + 1 - start);
+
+    if ((buf = (uint8_t *) tsk_malloc(cnt * jinfo->bsize)) == NULL) {
+        result->err = 1;
+        return;
+    }
+    if (tsk_fs_file_read(jinfo->fs_file, (TSK_OFF_T) start * jinfo->bsize,
+            (char *) buf, cnt * jinfo->bsize,
+            TSK_FS_FILE_READ_FLAG_NONE) != (ssize_t) (cnt * jinfo->bsize)) {
+        free(buf);
+        result->err = 1;
+        return;
+    }
+
+    for (i = 0; i < cnt; i++) {
+        ext2fs_journ_head *head =
+            (ext2fs_journ_head *) & buf[i * jinfo->bsize];
+
+        if (big_tsk_getu32(head->magic) != EXT2_JMAGIC)
+            continue;
+
+        if (result->heads_cnt == heads_max) {
+            heads_max = heads_max ? 2 * heads_max : 64;
+            if ((result->heads = (EXT2FS_JHEAD *) tsk_realloc(result->heads,
+                        heads_max * sizeof(EXT2FS_JHEAD))) == NULL) {
+                result->err = 1;
+                break;
+            }
+        }
+        result->heads[result->heads_cnt].jblk = start + i;
+        result->heads[result->heads_cnt].type =
+            big_tsk_getu32(head->entry_type);
+        result->heads[result->heads_cnt].seq =
+            big_tsk_getu32(head->entry_seq);
+        result->heads_cnt++;
+
+        if ((big_tsk_getu32(head->entry_type) != EXT2_J_ETYPE_DESC)
+            && (big_tsk_getu32(head->entry_type) != EXT2_J_ETYPE_REV))
+            continue;
+
+        if (result->descs_cnt == descs_max) {
+            descs_max = descs_max ? 2 * descs_max : 8;
+            if ((result->descs = (uint8_t *) tsk_realloc(result->descs,
+                        descs_max * jinfo->bsize)) == NULL) {
+                result->err = 1;
+                break;
+            }
+        }
+        memcpy(&result->descs[result->descs_cnt * jinfo->bsize], head,
+            jinfo->bsize);
+        result->descs_cnt++;
+    }
+
+    free(buf);
+}
+
+
+/* Return 1 if the journal block holds a journal structure */
+static uint8_t
+ext2fs_jindex_is_head(EXT2FS_JINDEX_PARSE * a_parse, TSK_DADDR_T a_jblk)
+{
+    size_t lo = 0, hi = a_parse->heads_cnt;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a_parse->heads[mid].jblk == a_jblk)
+            return 1;
+        else if (a_parse->heads[mid].jblk < a_jblk)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return 0;
+}
+
+
+/* Return 1 if a commit block with the sequence was found */
+static uint8_t
+ext2fs_jindex_is_committed(EXT2FS_JINDEX_PARSE * a_parse, uint32_t a_seq)
+{
+    size_t lo = 0, hi = a_parse->commits_cnt;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a_parse->commits[mid] == a_seq)
+            return 1;
+        else if (a_parse->commits[mid] < a_seq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return 0;
+}
+
+
+/*
+ * tsk_parallel_for callback: decode the tags of a descriptor block into
+ * the copies of the file system blocks that follow it.  The log wraps from
+ * the last block of the journal to the first.  The copies end at the last
+ * tag or at the first block that holds a journal structure, which means
+ * that the rest of the transaction was not written or was overwritten.
+ */
+static void
+ext2fs_jindex_decode_desc(size_t a_idx, void *a_ptr)
+{
+    EXT2FS_JINDEX_PARSE *parse = (EXT2FS_JINDEX_PARSE *) a_ptr;
+    EXT2FS_JINFO *jinfo = parse->jinfo;
+    EXT2FS_JINDEX_RESULT *result = &parse->results[a_idx];
+    const EXT2FS_JHEAD *jhead = &parse->heads[parse->desc_heads[a_idx]];
+    const uint8_t *desc = parse->descs[a_idx];
+    size_t off = sizeof(ext2fs_journ_head);
+    size_t end = jinfo->bsize - parse->tail_size;
+    size_t copies_max = (end - off) / parse->tag_size;
+    TSK_DADDR_T jblk = jhead->jblk;
+    uint32_t flags = 0;
+
+    if (copies_max == 0)
+        return;
+    if ((result->copies = (EXT2FS_JBLK_COPY *) tsk_malloc(copies_max *
+                sizeof(EXT2FS_JBLK_COPY))) == NULL) {
+        result->err = 1;
+        return;
+    }
+
+    if ((int32_t) (jhead->seq - jinfo->start_seq) >= 0)
+        flags |= EXT2FS_JBLK_COPY_ALLOC;
+    if (ext2fs_jindex_is_committed(parse, jhead->seq))
+        flags |= EXT2FS_JBLK_COPY_COMMIT;
+
+    while (off + parse->tag_size <= end) {
+        const uint8_t *tag = &desc[off];
+        EXT2FS_JBLK_COPY *copy;
+        uint32_t tag_flags = big_tsk_getu32(&tag[4]);
+
+        if ((jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_CSUM_V3) == 0)
+            tag_flags &= 0xffff;
+
+        if (++jblk > jinfo->last_block)
+            jblk = jinfo->first_block;
+        if ((jblk == jhead->jblk) || ext2fs_jindex_is_head(parse, jblk))
+            break;
+
+        copy = &result->copies[result->copies_cnt++];
+        copy->fs_blk = big_tsk_getu32(&tag[0]);
+        if (jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_64BIT)
+            copy->fs_blk |= (TSK_DADDR_T) big_tsk_getu32(&tag[8]) << 32;
+        copy->jblk = jblk;
+        copy->seq = jhead->seq;
+        copy->flags = flags;
+        if (tag_flags & EXT2_J_DENTRY_ESC)
+            copy->flags |= EXT2FS_JBLK_COPY_ESC;
+
+        if ((tag_flags & EXT2_J_DENTRY_LAST)
+            || (result->copies_cnt == copies_max))
+            break;
+
+        /* The UUID follows the first tag and any tag without SAMEID */
+        off += parse->tag_size;
+        if ((tag_flags & EXT2_J_DENTRY_SAMEID) == 0)
+            off += 16;
+    }
+}
+
+
+/* qsort callback: order copies by journal block, then sequence */
+static int
+ext2fs_jindex_jblk_cmp(const void *a_a, const void *a_b)
+{
+    const EXT2FS_JBLK_COPY *a = (const EXT2FS_JBLK_COPY *) a_a;
+    const EXT2FS_JBLK_COPY *b = (const EXT2FS_JBLK_COPY *) a_b;
+
+    if (a->jblk != b->jblk)
+        return (a->jblk < b->jblk) ? -1 : 1;
+    if (a->seq != b->seq)
+        return (a->seq < b->seq) ? -1 : 1;
+    return 0;
+}
+
+
+/* qsort callback: order copies by file system block, then sequence */
+static int
+ext2fs_jindex_fsblk_cmp(const void *a_a, const void *a_b)
+{
+    const EXT2FS_JBLK_COPY *a = (const EXT2FS_JBLK_COPY *) a_a;
+    const EXT2FS_JBLK_COPY *b = (const EXT2FS_JBLK_COPY *) a_b;
+
+    if (a->fs_blk != b->fs_blk)
+        return (a->fs_blk < b->fs_blk) ? -1 : 1;
+    if (a->seq != b->seq)
+        return (a->seq < b->seq) ? -1 : 1;
+    if (a->jblk != b->jblk)
+        return (a->jblk < b->jblk) ? -1 : 1;
+    return 0;
+}
+
+
+/* qsort callback: order revoked blocks by file system block, then
+ * sequence */
+static int
+ext2fs_jindex_revoke_cmp(const void *a_a, const void *a_b)
+{
+    const EXT2FS_JREVOKE *a = (const EXT2FS_JREVOKE *) a_a;
+    const EXT2FS_JREVOKE *b = (const EXT2FS_JREVOKE *) a_b;
+
+    if (a->fs_blk != b->fs_blk)
+        return (a->fs_blk < b->fs_blk) ? -1 : 1;
+    if (a->seq != b->seq)
+        return (a->seq < b->seq) ? -1 : 1;
+    return 0;
+}
+
+
+/*
+ * Decode the revoke blocks of the committed transactions into a list of
+ * revoked blocks that is sorted by file system block.  A revoke block
+ * without a commit block would not be applied by recovery.
+ *
+ * return 0 on success and 1 on error
+ */
+static uint8_t
+ext2fs_jindex_load_revokes(EXT2FS_JINDEX_PARSE * a_parse)
+{
+    EXT2FS_JINFO *jinfo = a_parse->jinfo;
+    size_t rec_size =
+        (jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_64BIT) ? 8 : 4;
+    size_t revokes_max = 0, i;
+
+    for (i = 0; i < a_parse->revs_cnt; i++) {
+        const EXT2FS_JHEAD *jhead = &a_parse->heads[a_parse->rev_heads[i]];
+        const uint8_t *rev = a_parse->revs[i];
+        size_t end =
+            big_tsk_getu32(((ext2fs_journ_revoke_head *) rev)->count);
+        size_t off;
+
+        if (ext2fs_jindex_is_committed(a_parse, jhead->seq) == 0)
+            continue;
+        if (end > jinfo->bsize - a_parse->tail_size)
+            end = jinfo->bsize - a_parse->tail_size;
+
+        for (off = sizeof(ext2fs_journ_revoke_head); off + rec_size <= end;
+            off += rec_size) {
+            EXT2FS_JREVOKE *revoke;
+
+            if (a_parse->revokes_cnt == revokes_max) {
+                revokes_max = revokes_max ? 2 * revokes_max : 64;
+                if ((a_parse->revokes = (EXT2FS_JREVOKE *)
+                        tsk_realloc(a_parse->revokes,
+                            revokes_max * sizeof(EXT2FS_JREVOKE))) == NULL)
+                    return 1;
+            }
+            revoke = &a_parse->revokes[a_parse->revokes_cnt++];
+            if (rec_size == 8)
+                revoke->fs_blk =
+                    ((TSK_DADDR_T) big_tsk_getu32(&rev[off]) << 32) |
+                    big_tsk_getu32(&rev[off + 4]);
+            else
+                revoke->fs_blk = big_tsk_getu32(&rev[off]);
+            revoke->seq = jhead->seq;
+        }
+    }
+
+    if (a_parse->revokes_cnt)
+        qsort(a_parse->revokes, a_parse->revokes_cnt,
+            sizeof(EXT2FS_JREVOKE), ext2fs_jindex_revoke_cmp);
+    return 0;
+}
+
+
+/* Mark the copies that are revoked by a transaction with the same or a
+ * later sequence.  The copies must be sorted by file system block. */
+static void
+ext2fs_jindex_apply_revokes(EXT2FS_JINDEX_PARSE * a_parse)
+{
+    EXT2FS_JINFO *jinfo = a_parse->jinfo;
+    size_t r = 0, i, k;
+
+    for (i = 0; i < jinfo->copies_cnt; i++) {
+        EXT2FS_JBLK_COPY *copy = &jinfo->copies[i];
+
+        while ((r < a_parse->revokes_cnt)
+            && (a_parse->revokes[r].fs_blk < copy->fs_blk))
+            r++;
+        for (k = r; (k < a_parse->revokes_cnt)
+            && (a_parse->revokes[k].fs_blk == copy->fs_blk); k++) {
+            if ((int32_t) (a_parse->revokes[k].seq - copy->seq) >= 0) {
+                copy->flags |= EXT2FS_JBLK_COPY_REVOKED;
+                break;
+            }
+        }
+    }
+}
+
+
+/* qsort callback: order sequences */
+static int
+ext2fs_jindex_seq_cmp(const void *a_a, const void *a_b)
+{
+    uint32_t a = *(const uint32_t *) a_a;
+    uint32_t b = *(const uint32_t *) a_b;
+
+    if (a != b)
+        return (a < b) ? -1 : 1;
+    return 0;
+}
+
+
+/* Free the results and everything else that was allocated while
+ * building the index */
+static void
+ext2fs_jindex_parse_free(EXT2FS_JINDEX_PARSE * a_parse, size_t a_chunk_cnt,
+    size_t a_results_cnt)
+{
+    size_t i;
+
+    if (a_parse->results) {
+        for (i = 0; i < a_results_cnt; i++) {
+            free(a_parse->results[i].heads);
+            free(a_parse->results[i].descs);
+            free(a_parse->results[i].copies);
+        }
+        free(a_parse->results);
+    }
+    if (a_parse->desc_bufs) {
+        for (i = 0; i < a_chunk_cnt; i++)
+            free(a_parse->desc_bufs[i]);
+        free(a_parse->desc_bufs);
+    }
+    free(a_parse->heads);
+    free(a_parse->descs);
+    free(a_parse->desc_heads);
+    free(a_parse->revs);
+    free(a_parse->rev_heads);
+    free(a_parse->revokes);
+    free(a_parse->commits);
+}
+
+
+/**
+ * \internal
+ * Build the index of the copies of file system blocks in the journal,
+ * which must have been opened with ext2fs_jopen().  Does nothing if the
+ * index was already built.
+ *
+ * @param fs File system
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ext2fs_jindex_load(TSK_FS_INFO * fs)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
+    EXT2FS_JINFO *jinfo = ext2fs->jinfo;
+    EXT2FS_JINDEX_PARSE parse;
+    size_t chunk_cnt, batch_size, results_cnt;
+    size_t heads_max = 0, descs_max = 0, revs_max = 0, copies_cnt, i, j;
+
+    if ((jinfo == NULL) || (jinfo->fs_file == NULL)
+        || (jinfo->fs_file->meta == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ext2fs_jindex_load: journal is not open");
+        return 1;
+    }
+    if (jinfo->copies_loaded)
+        return 0;
+
+    if ((jinfo->bsize < 1024) || (jinfo->bsize > EXT2FS_JOURNAL_READ_SIZE)
+        || (jinfo->bsize & (jinfo->bsize - 1))
+        || (jinfo->first_block == 0)
+        || (jinfo->first_block > jinfo->last_block)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ext2fs_jindex_load: invalid journal super block");
+        return 1;
+    }
+    if ((TSK_DADDR_T) jinfo->fs_file->meta->size !=
+        (jinfo->last_block + 1) * jinfo->bsize) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("ext2fs_jindex_load: journal file size is different from size reported in journal super block");
+        return 1;
+    }
+
+    memset(&parse, 0, sizeof(parse));
+    parse.jinfo = jinfo;
+    parse.chunk_blks = EXT2FS_JOURNAL_READ_SIZE / jinfo->bsize;
+    if (jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_CSUM_V3) {
+        parse.tag_size = 16;
+    }
+    else {
+        parse.tag_size = 8;
+        if (jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_CSUM_V2)
+            parse.tag_size += 2;
+        if (jinfo->feature_incompat & JBD2_FEATURE_INCOMPAT_64BIT)
+            parse.tag_size += 4;
+    }
+    if (jinfo->feature_incompat & (JBD2_FEATURE_INCOMPAT_CSUM_V2 |
+            JBD2_FEATURE_INCOMPAT_CSUM_V3))
+        parse.tail_size = 4;
+
+    chunk_cnt = (size_t) ((jinfo->last_block + parse.chunk_blks) /
+        parse.chunk_blks);
+    batch_size = 2 * tsk_parallel_nthreads();
+    results_cnt = batch_size;
+    if (((parse.results = (EXT2FS_JINDEX_RESULT *) tsk_malloc(results_cnt *
+                    sizeof(EXT2FS_JINDEX_RESULT))) == NULL)
+        || ((parse.desc_bufs = (uint8_t **) tsk_malloc(chunk_cnt *
+                    sizeof(uint8_t *))) == NULL))
+        goto on_error;
+
+    /* Find the journal structures, one batch of chunks at a time so that
+     * only batch_size chunks are in memory */
+    for (parse.batch_start = 0; parse.batch_start < chunk_cnt;
+        parse.batch_start += batch_size) {
+        size_t cnt = chunk_cnt - parse.batch_start;
+        if (cnt > batch_size)
+            cnt = batch_size;
+
+        tsk_parallel_for(cnt, ext2fs_jindex_scan_chunk, &parse);
+
+        for (i = 0; i < cnt; i++) {
+            EXT2FS_JINDEX_RESULT *result = &parse.results[i];
+            size_t d = 0;
+
+            if (result->err) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+                tsk_error_set_errstr
+                    ("ext2fs_jindex_load: error reading journal block %"
+                    PRIuDADDR, (TSK_DADDR_T) (parse.batch_start +
+                        i) * parse.chunk_blks);
+                goto on_error;
+            }
+
+            if (parse.heads_cnt + result->heads_cnt > heads_max) {
+                heads_max = 2 * (parse.heads_cnt + result->heads_cnt);
+                if ((parse.heads = (EXT2FS_JHEAD *) tsk_realloc(parse.heads,
+                            heads_max * sizeof(EXT2FS_JHEAD))) == NULL)
+                    goto on_error;
+            }
+            if (parse.descs_cnt + result->descs_cnt > descs_max) {
+                descs_max = 2 * (parse.descs_cnt + result->descs_cnt);
+                if (((parse.descs = (uint8_t **) tsk_realloc(parse.descs,
+                                descs_max * sizeof(uint8_t *))) == NULL)
+                    || ((parse.desc_heads = (size_t *)
+                            tsk_realloc(parse.desc_heads,
+                                descs_max * sizeof(size_t))) == NULL))
+                    goto on_error;
+            }
+            if (parse.revs_cnt + result->descs_cnt > revs_max) {
+                revs_max = 2 * (parse.revs_cnt + result->descs_cnt);
+                if (((parse.revs = (uint8_t **) tsk_realloc(parse.revs,
+                                revs_max * sizeof(uint8_t *))) == NULL)
+                    || ((parse.rev_heads = (size_t *)
+                            tsk_realloc(parse.rev_heads,
+                                revs_max * sizeof(size_t))) == NULL))
+                    goto on_error;
+            }
+
+            for (j = 0; j < result->heads_cnt; j++) {
+                if (result->heads[j].type == EXT2_J_ETYPE_DESC) {
+                    parse.descs[parse.descs_cnt] =
+                        &result->descs[d++ * jinfo->bsize];
+                    parse.desc_heads[parse.descs_cnt++] = parse.heads_cnt;
+                }
+                else if (result->heads[j].type == EXT2_J_ETYPE_REV) {
+                    parse.revs[parse.revs_cnt] =
+                        &result->descs[d++ * jinfo->bsize];
+                    parse.rev_heads[parse.revs_cnt++] = parse.heads_cnt;
+                }
+                else if (result->heads[j].type == EXT2_J_ETYPE_COM) {
+                    parse.commits_cnt++;
+                }
+                parse.heads[parse.heads_cnt++] = result->heads[j];
+            }
+
+            /* the copies are used until the tags and revoke records are
+             * decoded */
+            parse.desc_bufs[parse.batch_start + i] = result->descs;
+            result->descs = NULL;
+            free(result->heads);
+            result->heads = NULL;
+            result->heads_cnt = result->descs_cnt = 0;
+        }
+    }
+
+    if (parse.commits_cnt) {
+        if ((parse.commits = (uint32_t *) tsk_malloc(parse.commits_cnt *
+                    sizeof(uint32_t))) == NULL)
+            goto on_error;
+        for (i = 0, j = 0; i < parse.heads_cnt; i++) {
+            if (parse.heads[i].type == EXT2_J_ETYPE_COM)
+                parse.commits[j++] = parse.heads[i].seq;
+        }
+        qsort(parse.commits, parse.commits_cnt, sizeof(uint32_t),
+            ext2fs_jindex_seq_cmp);
+    }
+    if (ext2fs_jindex_load_revokes(&parse))
+        goto on_error;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ext2fs_jindex_load: %" PRIuSIZE " journal structures, %"
+            PRIuSIZE " descriptors, %" PRIuSIZE " commits, %" PRIuSIZE
+            " revoked blocks\n", parse.heads_cnt, parse.descs_cnt,
+            parse.commits_cnt, parse.revokes_cnt);
+
+    /* Decode the descriptors */
+    if (parse.descs_cnt > results_cnt) {
+        free(parse.results);
+        results_cnt = parse.descs_cnt;
+        if ((parse.results = (EXT2FS_JINDEX_RESULT *)
+                tsk_malloc(results_cnt * sizeof(EXT2FS_JINDEX_RESULT))) ==
+            NULL)
+            goto on_error;
+    }
+    tsk_parallel_for(parse.descs_cnt, ext2fs_jindex_decode_desc, &parse);
+
+    copies_cnt = 0;
+    for (i = 0; i < parse.descs_cnt; i++) {
+        if (parse.results[i].err) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_AUX_MALLOC);
+            tsk_error_set_errstr
+                ("ext2fs_jindex_load: error decoding descriptor at journal block %"
+                PRIuDADDR, parse.heads[parse.desc_heads[i]].jblk);
+            goto on_error;
+        }
+        copies_cnt += parse.results[i].copies_cnt;
+    }
+    if (copies_cnt) {
+        if ((jinfo->copies = (EXT2FS_JBLK_COPY *) tsk_malloc(copies_cnt *
+                    sizeof(EXT2FS_JBLK_COPY))) == NULL)
+            goto on_error;
+        for (i = 0; i < parse.descs_cnt; i++) {
+            memcpy(&jinfo->copies[jinfo->copies_cnt],
+                parse.results[i].copies,
+                parse.results[i].copies_cnt * sizeof(EXT2FS_JBLK_COPY));
+            jinfo->copies_cnt += parse.results[i].copies_cnt;
+        }
+
+        /* A journal block holds the copy of the last descriptor that
+         * claims it; older claims were overwritten when the log wrapped */
+        qsort(jinfo->copies, jinfo->copies_cnt, sizeof(EXT2FS_JBLK_COPY),
+            ext2fs_jindex_jblk_cmp);
+        for (i = 0, j = 0; i < jinfo->copies_cnt; i++) {
+            if ((i + 1 < jinfo->copies_cnt)
+                && (jinfo->copies[i + 1].jblk == jinfo->copies[i].jblk))
+                continue;
+            jinfo->copies[j++] = jinfo->copies[i];
+        }
+        jinfo->copies_cnt = j;
+        qsort(jinfo->copies, jinfo->copies_cnt, sizeof(EXT2FS_JBLK_COPY),
+            ext2fs_jindex_fsblk_cmp);
+        ext2fs_jindex_apply_revokes(&parse);
+    }
+
+    ext2fs_jindex_parse_free(&parse, chunk_cnt, results_cnt);
+    jinfo->copies_loaded = 1;
+    return 0;
+
+  on_error:
+    ext2fs_jindex_parse_free(&parse, chunk_cnt, results_cnt);
+    free(jinfo->copies);
+    jinfo->copies = NULL;
+    jinfo->copies_cnt = 0;
+    return 1;
+}
+
+
+/**
+ * \internal
+ * Find the copies of a file system block in the journal.  The journal
+ * block index is built if needed.
+ *
+ * @param fs File system
+ * @param a_fs_blk File system block
+ * @param a_copies [out] First copy of the block (oldest transaction first)
+ * @param a_cnt [out] Number of copies, 0 if the block is not in the journal
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ext2fs_jindex_find(TSK_FS_INFO * fs, TSK_DADDR_T a_fs_blk,
+    const EXT2FS_JBLK_COPY ** a_copies, size_t * a_cnt)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
+    EXT2FS_JINFO *jinfo;
+    size_t lo, hi, end;
+
+    *a_copies = NULL;
+    *a_cnt = 0;
+    if (ext2fs_jindex_load(fs))
+        return 1;
+    jinfo = ext2fs->jinfo;
+
+    /* first copy of the block */
+    lo = 0;
+    hi = jinfo->copies_cnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (jinfo->copies[mid].fs_blk < a_fs_blk)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (end = lo; (end < jinfo->copies_cnt)
+        && (jinfo->copies[end].fs_blk == a_fs_blk); end++);
+
+    if (end > lo) {
+        *a_copies = &jinfo->copies[lo];
+        *a_cnt = end - lo;
+    }
+    return 0;
+}
+
+
+/**
+ * \internal
+ * Read a copy of a file system block from the journal, with the journal
+ * magic restored if it was escaped.
+ *
+ * @param fs File system
+ * @param a_copy Copy to read, as returned by ext2fs_jindex_find()
+ * @param a_buf Buffer to read into
+ * @param a_len Size of the buffer (at most one journal block is read)
+ * @returns Number of bytes read or -1 on error
+ */
+ssize_t
+ext2fs_jblk_copy_read(TSK_FS_INFO * fs, const EXT2FS_JBLK_COPY * a_copy,
+    char *a_buf, size_t a_len)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
+    EXT2FS_JINFO *jinfo = ext2fs->jinfo;
+    ssize_t cnt;
+
+    if ((jinfo == NULL) || (jinfo->fs_file == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ext2fs_jblk_copy_read: journal is not open");
+        return -1;
+    }
+
+    if (a_len > jinfo->bsize)
+        a_len = jinfo->bsize;
+    cnt = tsk_fs_file_read(jinfo->fs_file,
+        (TSK_OFF_T) a_copy->jblk * jinfo->bsize, a_buf, a_len,
+        TSK_FS_FILE_READ_FLAG_NONE);
+    if ((cnt >= 4) && (a_copy->flags & EXT2FS_JBLK_COPY_ESC)) {
+        a_buf[0] = (char) 0xC0;
+        a_buf[1] = (char) 0x3B;
+        a_buf[2] = (char) 0x39;
+        a_buf[3] = (char) 0x98;
+    }
+    return cnt;
+}
+
+
+/*
+ * List the copies of file system blocks in the journal, by file system
+ * block.  If action is NULL, they are printed.
+ *
+ * return 0 on success and 1 on error
+ */
+static uint8_t
+ext2fs_jindex_walk(TSK_FS_INFO * fs, TSK_FS_JENTRY_WALK_CB action,
+    void *ptr)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) fs;
+    EXT2FS_JINFO *jinfo;
+    size_t i;
+
+    if (ext2fs_jindex_load(fs))
+        return 1;
+    jinfo = ext2fs->jinfo;
+
+    if (action == NULL)
+        tsk_printf("FS Blk\tDescription\n");
+
+    for (i = 0; i < jinfo->copies_cnt; i++) {
+        const EXT2FS_JBLK_COPY *copy = &jinfo->copies[i];
+
+        if (action == NULL) {
+            const char *status;
+
+            if (copy->flags & EXT2FS_JBLK_COPY_REVOKED)
+                status = "Revoked ";
+            else if (copy->flags & EXT2FS_JBLK_COPY_ALLOC)
+                status = "Allocated ";
+            else
+                status = "Unallocated ";
+            tsk_printf("%" PRIuDADDR ":\t%sJBlk %" PRIuDADDR " (seq: %"
+                PRIu32 "%s)\n", copy->fs_blk, status, copy->jblk, copy->seq,
+                (copy->flags & EXT2FS_JBLK_COPY_COMMIT) ? "" :
+                ", no commit");
+        }
+        else {
+            TSK_FS_JENTRY jentry;
+            TSK_WALK_RET_ENUM retval;
+
+            jentry.jblk = copy->jblk;
+            jentry.fsblk = copy->fs_blk;
+            retval = action(fs, &jentry, (int) copy->flags, ptr);
+            if (retval == TSK_WALK_ERROR)
+                return 1;
+            else if (retval == TSK_WALK_STOP)
+                break;
+        }
+    }
+    return 0;
+}
+
+
+/* Limitations: does not use the action unless the
+ * TSK_FS_JENTRY_WALK_FLAG_FSBLK flag is given
  *
  * return 0 on success and 1 on error
  * */
@@ -154,6 +970,9 @@ ext2fs_jentry_walk(TSK_FS_INFO * fs, int flags,
         return 1;
     }
 
+    if (flags & TSK_FS_JENTRY_WALK_FLAG_FSBLK)
+        return ext2fs_jindex_walk(fs, action, ptr);
+
     if ((TSK_DADDR_T)jinfo->fs_file->meta->size !=
         (jinfo->last_block + 1) * jinfo->bsize) {
         tsk_error_reset();
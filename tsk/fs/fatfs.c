@@ -19,6 +19,142 @@
 #include "tsk_fatxxfs.h"
 #include "tsk_exfatfs.h"
 
+/**
+ * \internal
+ * Decode the first FAT into fatfs->fat_table so that fatfs_getFAT() can
+ * follow cluster chains with a simple lookup instead of going through the
+ * sector cache. It is built once by fatfs_open() before the file system
+ * is returned and is not changed until it is closed, so threads can read
+ * it without taking cache_lock.
+ * Entries that are past the end of the FAT or of the image are not decoded
+ * and are left to the cache. Failing to build the table is not an error,
+ * fatfs_getFAT() then uses the cache for everything.
+ *
+ * @param fatfs File system to load the FAT of
+ */
+static void
+fatfs_load_fat_table(FATFS_INFO * fatfs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & fatfs->fs_info;
+    TSK_DADDR_T nent, clust, i;
+    TSK_OFF_T fat_len;
+    uint32_t *table = NULL;
+    uint8_t *buf;
+
+    /* Number of entries that the FAT can hold */
+    fat_len = (TSK_OFF_T) fatfs->sectperfat << fatfs->ssize_sh;
+    if (fs->ftype == TSK_FS_TYPE_FAT12)
+        nent = fat_len * 2 / 3;
+    else if (fs->ftype == TSK_FS_TYPE_FAT16)
+        nent = fat_len / 2;
+    else
+        nent = fat_len / 4;
+
+    if (nent > fatfs->lastclust + 1)
+        nent = fatfs->lastclust + 1;
+
+    if (nent > 0) {
+        if ((table =
+                (uint32_t *) tsk_malloc(nent * sizeof(uint32_t))) == NULL) {
+            tsk_error_reset();
+            return;
+        }
+        if ((buf =
+                (uint8_t *) tsk_malloc(FATFS_FAT_TABLE_CHUNK * 4)) == NULL) {
+            tsk_error_reset();
+            free(table);
+            return;
+        }
+
+        for (clust = 0; clust < nent; clust += FATFS_FAT_TABLE_CHUNK) {
+            TSK_DADDR_T n = nent - clust;
+            TSK_OFF_T off;
+            size_t len;
+            ssize_t cnt;
+
+            if (n > FATFS_FAT_TABLE_CHUNK)
+                n = FATFS_FAT_TABLE_CHUNK;
+
+            /* clust is even, so FAT12 chunks start on a byte boundary */
+            if (fs->ftype == TSK_FS_TYPE_FAT12) {
+                off = clust + (clust >> 1);
+                len = (size_t) (n * 3 + 1) / 2;
+            }
+            else if (fs->ftype == TSK_FS_TYPE_FAT16) {
+                off = clust * 2;
+                len = (size_t) n * 2;
+            }
+            else {
+                off = clust * 4;
+                len = (size_t) n * 4;
+            }
+
+            cnt = tsk_fs_read(fs,
+                ((TSK_OFF_T) fatfs->firstfatsect << fatfs->ssize_sh) + off,
+                (char *) buf, len);
+            if (cnt != (ssize_t) len) {
+                /* Keep the entries that we got and leave the rest to the
+                 * cache */
+                tsk_error_reset();
+                if (cnt < 0)
+                    cnt = 0;
+                if (fs->ftype == TSK_FS_TYPE_FAT12)
+                    n = cnt * 2 / 3;
+                else if (fs->ftype == TSK_FS_TYPE_FAT16)
+                    n = cnt / 2;
+                else
+                    n = cnt / 4;
+                nent = clust + n;
+            }
+
+            for (i = 0; i < n; i++) {
+                uint32_t value;
+
+                if (fs->ftype == TSK_FS_TYPE_FAT12) {
+                    uint16_t tmp16 =
+                        tsk_getu16(fs->endian, &buf[i + (i >> 1)]);
+                    if (i & 1)
+                        tmp16 >>= 4;
+                    value = tmp16;
+                }
+                else if (fs->ftype == TSK_FS_TYPE_FAT16) {
+                    value = tsk_getu16(fs->endian, &buf[i * 2]);
+                }
+                else {
+                    value = tsk_getu32(fs->endian, &buf[i * 4]);
+                }
+                value &= fatfs->mask;
+
+                /* same sanity check as fatfs_getFAT() */
+                if ((value > fatfs->lastclust) &&
+                    (value < (0x0ffffff7 & fatfs->mask))) {
+                    if (tsk_verbose)
+                        tsk_fprintf(stderr,
+                            "fatfs_load_fat_table: contents of entry %"
+                            PRIuDADDR " too large - resetting\n",
+                            clust + i);
+                    value = 0;
+                }
+                table[clust + i] = value;
+            }
+        }
+        free(buf);
+
+        if (nent == 0) {
+            free(table);
+            table = NULL;
+        }
+    }
+
+    fatfs->fat_table = table;
+    fatfs->fat_table_cnt = table ? nent : 0;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "fatfs_load_fat_table: Loaded %" PRIuDADDR " FAT entries\n",
+            fatfs->fat_table_cnt);
+}
+
 /**
  * \internal
  * Open part of a disk image as a FAT file system. 
@@ -129,6 +265,7 @@ fatfs_open(TSK_IMG_INFO *a_img_info, TSK_OFF_T a_offset, TSK_FS_TYPE_ENUM a_ftyp
     if ((a_ftype == TSK_FS_TYPE_FAT_DETECT && (fatxxfs_open(fatfs) == 0 || exfatfs_open(fatfs) == 0)) ||
 		(a_ftype == TSK_FS_TYPE_EXFAT && exfatfs_open(fatfs) == 0) ||
 		(fatxxfs_open(fatfs) == 0)) {
+        fatfs_load_fat_table(fatfs);
     	return (TSK_FS_INFO*)fatfs;
 	} 
     else {
@@ -259,6 +396,12 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
         return 1;
     }
 
+    /* Use the decoded FAT if the entry is in it */
+    if (clust < fatfs->fat_table_cnt) {
+        *value = fatfs->fat_table[clust];
+        return 0;
+    }
+
     switch (fatfs->fs_info.ftype) {
     case TSK_FS_TYPE_FAT12:
         if (clust & 0xf000) {
@@ -438,6 +581,8 @@ fatfs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
     TSK_FS_BLOCK *fs_block;
 
     TSK_DADDR_T addr;
+    TSK_DADDR_T data_end;
+    size_t buf_clust;
     int myflags;
     unsigned int i;
 
@@ -586,14 +731,23 @@ fatfs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
 
 
     /* Now we read in the clusters in cluster-sized chunks,
-     * sectors are too small
+     * sectors are too small.  If the file system can tell us how far a 
+     * run of clusters with the same allocation status goes, then we skip
+     * or read the whole run at once.
      */
 
     /* Determine the base sector of the cluster where the first 
      * sector is located */
     addr = FATFS_CLUST_2_SECT(fatfs, (FATFS_SECT_2_CLUST(fatfs, addr)));
 
-    if ((data_buf = tsk_malloc(fs->block_size * fatfs->csize)) == NULL) {
+    /* First sector after the clusters (the rest is the unused area) */
+    data_end = fatfs->firstclustsect + fatfs->csize * fatfs->clustcnt;
+
+    buf_clust = FATFS_BLKWALK_READ_SIZE / (fs->block_size * fatfs->csize);
+    if (buf_clust == 0)
+        buf_clust = 1;
+
+    if ((data_buf = tsk_malloc(fs->block_size * fatfs->csize * buf_clust)) == NULL) {
         tsk_fs_block_free(fs_block);
         return 1;
     }
@@ -603,88 +757,120 @@ fatfs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
             "fatfs_block_walk: Walking data area blocks (%" PRIuDADDR
             " to %" PRIuDADDR ")\n", addr, a_end_blk);
 
-    for (; addr <= a_end_blk; addr += fatfs->csize) {
-        int retval;
-        size_t read_size;
+    while (addr <= a_end_blk) {
+        TSK_DADDR_T run_end = 0;        // first sector after the run
 
         /* Identify its allocation status */
-        retval = fatfs_is_sectalloc(fatfs, addr);
-        if (retval == -1) {
-            free(data_buf);
-            tsk_fs_block_free(fs_block);
-            return 1;
-        }
-        else if (retval == 1) {
-            myflags = TSK_FS_BLOCK_FLAG_ALLOC;
+        if ((fatfs->cluster_run_end) && (addr < data_end)) {
+            TSK_DADDR_T last_clust;
+            TSK_DADDR_T end_clust;
+            int8_t is_alloc;
+
+            last_clust = FATFS_SECT_2_CLUST(fatfs,
+                (a_end_blk < data_end) ? a_end_blk : data_end - 1);
+            end_clust = fatfs->cluster_run_end(fatfs,
+                FATFS_SECT_2_CLUST(fatfs, addr), last_clust, &is_alloc);
+            if (end_clust != 0) {
+                run_end = FATFS_CLUST_2_SECT(fatfs, end_clust);
+                myflags = is_alloc ? TSK_FS_BLOCK_FLAG_ALLOC :
+                    TSK_FS_BLOCK_FLAG_UNALLOC;
+            }
         }
-        else {
-            myflags = TSK_FS_BLOCK_FLAG_UNALLOC;
+        if (run_end == 0) {
+            int retval = fatfs_is_sectalloc(fatfs, addr);
+            if (retval == -1) {
+                free(data_buf);
+                tsk_fs_block_free(fs_block);
+                return 1;
+            }
+            else if (retval == 1) {
+                myflags = TSK_FS_BLOCK_FLAG_ALLOC;
+            }
+            else {
+                myflags = TSK_FS_BLOCK_FLAG_UNALLOC;
+            }
+            run_end = addr + fatfs->csize;
         }
 
         /* At this point, there should be no more meta - just content */
         myflags |= TSK_FS_BLOCK_FLAG_CONT;
 
-        // test if we should call the callback with this one
+        // test if we should call the callback with this run
         if ((myflags & TSK_FS_BLOCK_FLAG_CONT)
-            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_CONT)))
+            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_CONT))) {
+            addr = run_end;
             continue;
+        }
         else if ((myflags & TSK_FS_BLOCK_FLAG_ALLOC)
-            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC)))
+            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC))) {
+            addr = run_end;
             continue;
+        }
         else if ((myflags & TSK_FS_BLOCK_FLAG_UNALLOC)
-            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC)))
+            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC))) {
+            addr = run_end;
             continue;
+        }
 
         if (a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY)
             myflags |= TSK_FS_BLOCK_FLAG_AONLY;
 
-        
-        /* The final cluster may not be full */
-        if (a_end_blk - addr + 1 < fatfs->csize)
-            read_size = (size_t) (a_end_blk - addr + 1);
-        else
-            read_size = fatfs->csize;
-
-        if ((a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY) == 0) {
-            cnt = tsk_fs_read_block
-                (fs, addr, data_buf, fs->block_size * read_size);
-            if (cnt != (ssize_t)(fs->block_size * read_size)) {
-                if (cnt >= 0) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_READ);
+        while ((addr < run_end) && (addr <= a_end_blk)) {
+            size_t read_size;
+
+            /* Read up to the end of the run, but stop at the end of
+             * the image so that the clusters before it are still
+             * returned.  The final cluster may not be full. */
+            read_size = fatfs->csize * buf_clust;
+            if (addr > fs->last_block_act)
+                read_size = fatfs->csize;
+            else if (fs->last_block_act - addr + 1 < read_size)
+                read_size = (size_t) (fs->last_block_act - addr + 1);
+            if (run_end - addr < read_size)
+                read_size = (size_t) (run_end - addr);
+            if (a_end_blk - addr + 1 < read_size)
+                read_size = (size_t) (a_end_blk - addr + 1);
+
+            if ((a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY) == 0) {
+                cnt = tsk_fs_read_block
+                    (fs, addr, data_buf, fs->block_size * read_size);
+                if (cnt != (ssize_t)(fs->block_size * read_size)) {
+                    if (cnt >= 0) {
+                        tsk_error_reset();
+                        tsk_error_set_errno(TSK_ERR_FS_READ);
+                    }
+                    tsk_error_set_errstr2("fatfs_block_walk: block: %"
+                        PRIuDADDR, addr);
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
                 }
-                tsk_error_set_errstr2("fatfs_block_walk: block: %"
-                    PRIuDADDR, addr);
-                free(data_buf);
-                tsk_fs_block_free(fs_block);
-                return 1;
             }
-        }
 
-        /* go through each sector in the cluster */
-        for (i = 0; i < read_size; i++) {
-            int retval;
+            /* go through each sector that we read */
+            for (i = 0; i < read_size; i++) {
+                int retval;
 
-            if (addr + i < a_start_blk)
-                continue;
-            else if (addr + i > a_end_blk)
-                break;
+                if (addr + i < a_start_blk)
+                    continue;
 
-            tsk_fs_block_set(fs, fs_block, addr + i,
-                myflags | TSK_FS_BLOCK_FLAG_RAW,
-                &data_buf[i * fs->block_size]);
+                tsk_fs_block_set(fs, fs_block, addr + i,
+                    myflags | TSK_FS_BLOCK_FLAG_RAW,
+                    &data_buf[i * fs->block_size]);
 
-            retval = a_action(fs_block, a_ptr);
-            if (retval == TSK_WALK_STOP) {
-                free(data_buf);
-                tsk_fs_block_free(fs_block);
-                return 0;
-            }
-            else if (retval == TSK_WALK_ERROR) {
-                free(data_buf);
-                tsk_fs_block_free(fs_block);
-                return 1;
+                retval = a_action(fs_block, a_ptr);
+                if (retval == TSK_WALK_STOP) {
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 0;
+                }
+                else if (retval == TSK_WALK_ERROR) {
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
+                }
             }
+            addr += read_size;
         }
     }
 
@@ -819,6 +1005,13 @@ fatfs_close(TSK_FS_INFO *fs)
     FATFS_INFO *fatfs = (FATFS_INFO *) fs;
  
     fatfs_dir_buf_free(fatfs);
+    free(fatfs->dir_sectors_bitmap);
+    fatfs->dir_sectors_bitmap = NULL;
+    free(fatfs->EXFATFS_INFO.alloc_bitmap_words);
+    fatfs->EXFATFS_INFO.alloc_bitmap_words = NULL;
+    free(fatfs->fat_table);
+    fatfs->fat_table = NULL;
+    fatfs->fat_table_cnt = 0;
 
     fs->tag = 0;
 	memset(fatfs->boot_sector_buffer, 0, FATFS_MASTER_BOOT_RECORD_SIZE);
@@ -791,6 +791,27 @@ fatfs_make_data_runs(TSK_FS_FILE * a_fs_file)
             full_len_s += fatfs->csize;
             size_remain -= (fatfs->csize * fs->block_size);
 
+            /* With the decoded FAT, take the rest of a range of contiguous
+             * clusters here instead of going around the loop for each. */
+            while (((int64_t) size_remain > 0) &&
+                (clust < fatfs->fat_table_cnt) &&
+                (fatfs->fat_table[clust] == clust + 1) &&
+                (sbase + 2 * fatfs->csize - 1 <= fs->last_block) &&
+                (tsk_list_find(list_seen, clust + 1) == 0)) {
+                clust++;
+                sbase += fatfs->csize;
+                if (tsk_list_add(&list_seen, clust)) {
+                    fs_meta->attr_state = TSK_FS_META_ATTR_ERROR;
+                    tsk_fs_attr_run_free(data_run_head);
+                    tsk_list_free(list_seen);
+                    list_seen = NULL;
+                    return 1;
+                }
+                data_run->len += fatfs->csize;
+                full_len_s += fatfs->csize;
+                size_remain -= (fatfs->csize * fs->block_size);
+            }
+
             if ((int64_t) size_remain > 0) {
                 TSK_DADDR_T nxt;
                 if (fatfs_getFAT(fatfs, clust, &nxt)) {
@@ -1051,6 +1072,211 @@ inode_walk_dent_act(TSK_FS_FILE * fs_file, const char *a_path, void *a_ptr)
     return TSK_WALK_CONT;
 }
 
+/**
+ * \internal
+ * Get the bitmap of the sectors that are allocated to directories. It is
+ * built the first time with a walk of the directory tree and then kept
+ * until the file system is closed, so the caller must not free it.
+ *
+ * @param [in] a_fatfs File system
+ * @return The bitmap or NULL on error
+ */
+static const uint8_t *
+fatfs_get_dir_sectors_bitmap(FATFS_INFO *a_fatfs)
+{
+    TSK_FS_INFO *fs = &a_fatfs->fs_info;
+    TSK_FS_FILE *fs_file = NULL;
+    uint8_t *bitmap = NULL;
+
+    tsk_take_lock(&a_fatfs->dir_lock);
+    bitmap = a_fatfs->dir_sectors_bitmap;
+    tsk_release_lock(&a_fatfs->dir_lock);
+    if (bitmap != NULL) {
+        return bitmap;
+    }
+
+    if (tsk_verbose) {
+        tsk_fprintf(stderr,
+            "fatfs_inode_walk: Walking directories to collect sector info\n");
+    }
+
+    if ((bitmap =
+            (uint8_t*)tsk_malloc((size_t) ((fs->block_count +
+                        7) / 8))) == NULL) {
+        return NULL;
+    }
+
+    if (((fs_file = tsk_fs_file_alloc(fs)) == NULL) ||
+        ((fs_file->meta =
+            tsk_fs_meta_alloc(FATFS_FILE_CONTENT_LEN)) == NULL)) {
+        tsk_fs_file_close(fs_file);
+        free(bitmap);
+        return NULL;
+    }
+
+    /* Manufacture an inode for the root directory and do a file_walk on
+     * it to set the bits for each sector allocated to the root directory. */
+    if ((fatfs_make_root(a_fatfs, fs_file->meta)) ||
+        (tsk_fs_file_walk(fs_file,
+                (TSK_FS_FILE_WALK_FLAG_ENUM)(TSK_FS_FILE_WALK_FLAG_SLACK | TSK_FS_FILE_WALK_FLAG_AONLY),
+                inode_walk_file_act, (void*)bitmap))) {
+        tsk_fs_file_close(fs_file);
+        free(bitmap);
+        return NULL;
+    }
+    tsk_fs_file_close(fs_file);
+
+    /* Now walk recursively through the entire directory tree to set the 
+     * bits for each sector allocated to the children of the root
+     * directory. */
+    if (tsk_fs_dir_walk(fs, fs->root_inum,
+            (TSK_FS_DIR_WALK_FLAG_ENUM)(TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE |
+            TSK_FS_DIR_WALK_FLAG_NOORPHAN), inode_walk_dent_act,
+            (void *) bitmap)) {
+        tsk_error_errstr2_concat
+            ("- fatfs_inode_walk: mapping directories");
+        free(bitmap);
+        return NULL;
+    }
+
+    /* Another thread may have built it at the same time. */
+    tsk_take_lock(&a_fatfs->dir_lock);
+    if (a_fatfs->dir_sectors_bitmap == NULL) {
+        a_fatfs->dir_sectors_bitmap = bitmap;
+    }
+    else {
+        free(bitmap);
+        bitmap = a_fatfs->dir_sectors_bitmap;
+    }
+    tsk_release_lock(&a_fatfs->dir_lock);
+
+    return bitmap;
+}
+
+/* A cluster (or a FAT12/FAT16 root directory sector) that has been read
+ * into the buffer of an inode walk batch */
+typedef struct {
+    TSK_DADDR_T sect;           // first sector
+    size_t num_sectors;         // number of sectors read
+    size_t buf_sect;            // index of the first sector in the buffer
+    int cluster_is_alloc;
+    uint8_t do_basic_dentry_test;
+} FATFS_INODE_WALK_CLUST;
+
+/* Clusters that fatfs_inode_walk() reads and checks at a time */
+typedef struct {
+    FATFS_INFO *fatfs;
+    const uint8_t *dir_sectors_bitmap;
+    unsigned int flags;         // inode selection flags
+    TSK_INUM_T start_inum;
+    TSK_INUM_T end_inum;
+
+    char *buf;                  // sectors of all of the clusters
+    FATFS_INODE_WALK_CLUST *clusts;
+    size_t clust_cnt;
+    uint8_t *sect_ok;           // one per sector in buf: 1 if it may hold entries
+    uint8_t *dentry_ok;         // one per entry in buf: 1 if it is reported
+} FATFS_INODE_WALK_BATCH;
+
+/* tsk_parallel_for() callback that tests the directory entries of one
+ * cluster in an inode walk batch.  The results go in sect_ok and dentry_ok
+ * and fatfs_inode_walk() then loads and reports the entries in order. */
+static void
+fatfs_inode_walk_check_clust(size_t a_idx, void *a_ptr)
+{
+    FATFS_INODE_WALK_BATCH *batch = (FATFS_INODE_WALK_BATCH *) a_ptr;
+    FATFS_INFO *fatfs = batch->fatfs;
+    const FATFS_INODE_WALK_CLUST *clust = &batch->clusts[a_idx];
+    FATFS_DATA_UNIT_ALLOC_STATUS_ENUM alloc_status =
+        (FATFS_DATA_UNIT_ALLOC_STATUS_ENUM) clust->cluster_is_alloc;
+    size_t sector_idx;
+
+    for (sector_idx = 0; sector_idx < clust->num_sectors; sector_idx++) {
+        TSK_DADDR_T sect = clust->sect + sector_idx;
+        size_t buf_sect = clust->buf_sect + sector_idx;
+        FATFS_DENTRY *dep =
+            (FATFS_DENTRY *) &batch->buf[buf_sect << fatfs->ssize_sh];
+        uint8_t *ok = &batch->dentry_ok[buf_sect * fatfs->dentry_cnt_se];
+        TSK_INUM_T inum = FATFS_SECT_2_INODE(fatfs, sect);
+        unsigned int dentry_idx;
+
+        batch->sect_ok[buf_sect] = 0;
+
+        /* If the last inode in this sector is before the start 
+         * inode, skip the sector. */
+        if (FATFS_SECT_2_INODE(fatfs, sect + 1) < batch->start_inum) {
+            continue;
+        }
+
+        /* If the sector is not allocated to a directory and the first 
+         * chunk is not a directory entry, skip the sector. */
+        if (!isset(batch->dir_sectors_bitmap, sect) &&
+            !fatfs->is_dentry(fatfs, dep, alloc_status,
+                clust->do_basic_dentry_test)) {
+            continue;
+        }
+        batch->sect_ok[buf_sect] = 1;
+
+        /* If the potential entry is likely not an entry, or it is an  
+         * entry that is not reported in an inode walk, or it does not   
+         * satisfy the inode selection flags, then skip it. */
+        for (dentry_idx = 0; dentry_idx < fatfs->dentry_cnt_se;
+            dentry_idx++, inum++, dep++) {
+            ok[dentry_idx] = ((inum >= batch->start_inum) &&
+                (inum <= batch->end_inum) &&
+                fatfs->is_dentry(fatfs, dep, alloc_status,
+                    clust->do_basic_dentry_test) &&
+                !fatfs->inode_walk_should_skip_dentry(fatfs, inum, dep,
+                    batch->flags, clust->cluster_is_alloc));
+        }
+    }
+}
+
+/* Read the clusters of an inode walk batch into its buffer, one read for
+ * each range of consecutive sectors.  If a read fails, the batch is cut
+ * before the cluster that could not be read.
+ * Returns the number of clusters that were read. */
+static size_t
+fatfs_inode_walk_read_batch(FATFS_INODE_WALK_BATCH *a_batch)
+{
+    FATFS_INFO *fatfs = a_batch->fatfs;
+    TSK_FS_INFO *fs = &fatfs->fs_info;
+    size_t i = 0;
+
+    while (i < a_batch->clust_cnt) {
+        const FATFS_INODE_WALK_CLUST *first = &a_batch->clusts[i];
+        size_t j = i + 1;
+        size_t len = first->num_sectors << fatfs->ssize_sh;
+        ssize_t cnt;
+
+        while ((j < a_batch->clust_cnt) &&
+            (a_batch->clusts[j].sect ==
+                a_batch->clusts[j - 1].sect + a_batch->clusts[j - 1].num_sectors)) {
+            len += a_batch->clusts[j].num_sectors << fatfs->ssize_sh;
+            j++;
+        }
+
+        cnt = tsk_fs_read_block(fs, first->sect,
+            &a_batch->buf[first->buf_sect << fatfs->ssize_sh], len);
+        if (cnt != (ssize_t) len) {
+            /* Read them one at a time to find the one that failed. */
+            for (; i < j; i++) {
+                const FATFS_INODE_WALK_CLUST *clust = &a_batch->clusts[i];
+                len = clust->num_sectors << fatfs->ssize_sh;
+                if (tsk_fs_read_block(fs, clust->sect,
+                        &a_batch->buf[clust->buf_sect << fatfs->ssize_sh],
+                        len) != (ssize_t) len) {
+                    tsk_error_reset();
+                    return i;
+                }
+            }
+            tsk_error_reset();
+        }
+        i = j;
+    }
+    return a_batch->clust_cnt;
+}
+
 /**
  * Walk the inodes in a specified range and do a TSK_FS_META_WALK_CB callback
  * for each inode that satisfies criteria specified by a set of 
@@ -1080,11 +1306,11 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
     TSK_DADDR_T ssect = 0; 
     TSK_DADDR_T lsect = 0; 
     TSK_DADDR_T sect = 0; 
-    char *dino_buf = NULL;
-    FATFS_DENTRY *dep = NULL;
-    unsigned int dentry_idx = 0;
-    uint8_t *dir_sectors_bitmap = NULL;
-    ssize_t cnt = 0;
+    const uint8_t *dir_sectors_bitmap = NULL;
+    uint8_t *orphan_bitmap = NULL;
+    FATFS_INODE_WALK_BATCH batch;
+    size_t buf_size = 0;
+    size_t buf_sect_cnt = 0;
     uint8_t done = 0;
 
     tsk_error_reset();
@@ -1189,56 +1415,26 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
         }
     }
 
-    /* Allocate a bitmap to keep track of which sectors are allocated to
-     * directories. */
-    if ((dir_sectors_bitmap =
-            (uint8_t*)tsk_malloc((size_t) ((a_fs->block_count +
-                        7) / 8))) == NULL) {
-        tsk_fs_file_close(fs_file);
-        return 1;
-    }
-
-    /* If not doing an orphan files search, populate the directory sectors 
+    /* If not doing an orphan files search, get the directory sectors 
      * bitmap. The bitmap will be used to make sure that no sector marked as
      * allocated to a directory is skipped when searching for directory 
-     * entries to map to inodes. */
+     * entries to map to inodes. An orphan files search uses an empty
+     * bitmap. */
     if ((flags & TSK_FS_META_FLAG_ORPHAN) == 0) {
-        if (tsk_verbose) {
-            tsk_fprintf(stderr,
-                "fatfs_inode_walk: Walking directories to collect sector info\n");
-        }
-
-        /* Manufacture an inode for the root directory. */
-        if (fatfs_make_root(fatfs, fs_file->meta)) {
-            tsk_fs_file_close(fs_file);
-            free(dir_sectors_bitmap);
-            return 1;
-        }
-
-        /* Do a file_walk on the root directory to set the bits in the 
-         * directory sectors bitmap for each sector allocated to the root
-         * directory. */
-        if (tsk_fs_file_walk(fs_file,
-                (TSK_FS_FILE_WALK_FLAG_ENUM)(TSK_FS_FILE_WALK_FLAG_SLACK | TSK_FS_FILE_WALK_FLAG_AONLY),
-                inode_walk_file_act, (void*)dir_sectors_bitmap)) {
+        if ((dir_sectors_bitmap =
+                fatfs_get_dir_sectors_bitmap(fatfs)) == NULL) {
             tsk_fs_file_close(fs_file);
-            free(dir_sectors_bitmap);
             return 1;
         }
-
-        /* Now walk recursively through the entire directory tree to set the 
-         * bits in the directory sectors bitmap for each sector allocated to 
-         * the children of the root directory. */
-        if (tsk_fs_dir_walk(a_fs, a_fs->root_inum,
-                (TSK_FS_DIR_WALK_FLAG_ENUM)(TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE |
-                TSK_FS_DIR_WALK_FLAG_NOORPHAN), inode_walk_dent_act,
-                (void *) dir_sectors_bitmap)) {
-            tsk_error_errstr2_concat
-                ("- fatfs_inode_walk: mapping directories");
+    }
+    else {
+        if ((orphan_bitmap =
+                (uint8_t*)tsk_malloc((size_t) ((a_fs->block_count +
+                            7) / 8))) == NULL) {
             tsk_fs_file_close(fs_file);
-            free(dir_sectors_bitmap);
             return 1;
         }
+        dir_sectors_bitmap = orphan_bitmap;
     }
 
     /* If the end inode is the one of the virtual virtual FAT files or the 
@@ -1261,7 +1457,7 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
             ("%s: Begin inode in sector too big for image: %"
             PRIuDADDR, func_name, ssect);
         tsk_fs_file_close(fs_file);
-        free(dir_sectors_bitmap);
+        free(orphan_bitmap);
         return 1;
     }
 
@@ -1273,240 +1469,289 @@ fatfs_inode_walk(TSK_FS_INFO *a_fs, TSK_INUM_T a_start_inum,
             ("%s: End inode in sector too big for image: %"
             PRIuDADDR, func_name, lsect);
         tsk_fs_file_close(fs_file);
-        free(dir_sectors_bitmap);
+        free(orphan_bitmap);
         return 1;
     }
 
-    /* Allocate a buffer big enough to read in a cluster at a time. */
-    if ((dino_buf = (char*)tsk_malloc(fatfs->csize << fatfs->ssize_sh)) ==
-        NULL) {
+    /* Allocate the batch buffers.  The buffer holds at least one
+     * cluster. */
+    memset(&batch, 0, sizeof(batch));
+    batch.fatfs = fatfs;
+    batch.dir_sectors_bitmap = dir_sectors_bitmap;
+    batch.flags = flags;
+    batch.start_inum = a_start_inum;
+    batch.end_inum = end_inum_tmp;
+
+    buf_size = FATFS_INODE_WALK_READ_SIZE;
+    if (buf_size < ((size_t) fatfs->csize << fatfs->ssize_sh)) {
+        buf_size = (size_t) fatfs->csize << fatfs->ssize_sh;
+    }
+    buf_sect_cnt = buf_size >> fatfs->ssize_sh;
+
+    if (((batch.buf = (char*)tsk_malloc(buf_size)) == NULL) ||
+        ((batch.clusts = (FATFS_INODE_WALK_CLUST*)tsk_malloc(buf_sect_cnt *
+                    sizeof(FATFS_INODE_WALK_CLUST))) == NULL) ||
+        ((batch.sect_ok = (uint8_t*)tsk_malloc(buf_sect_cnt)) == NULL) ||
+        ((batch.dentry_ok = (uint8_t*)tsk_malloc(buf_sect_cnt *
+                    fatfs->dentry_cnt_se)) == NULL)) {
         tsk_fs_file_close(fs_file);
-        free(dir_sectors_bitmap);
+        free(orphan_bitmap);
+        free(batch.buf);
+        free(batch.clusts);
+        free(batch.sect_ok);
         return 1;
     }
 
     /* Walk the inodes. */
     sect = ssect;
-    while (sect <= lsect) {
-        int cluster_is_alloc = 0;
-        size_t num_sectors_to_process = 0;       
-        size_t sector_idx = 0;            
-        uint8_t do_basic_dentry_test = 0; 
-
-        /* Read in a chunk of the image to process on this iteration of the inode
-         * walk. The actual size of the read will depend on whether or not it is 
-         * coming from the root directory of a FAT12 or FAT16 file system. As 
-         * indicated by the size of the buffer, the data area (exFAT cluster 
-         * heap) will for the most part be read in a cluster at a time. 
-         * However, the root directory for a FAT12/FAT16 file system precedes 
-         * the data area and the read size for it should be a sector, not a 
-         * cluster. */
-        if (sect < fatfs->firstclustsect) {
-
-            if ((flags & TSK_FS_META_FLAG_ORPHAN) != 0) {
-                /* If orphan file hunting, there are no orphans in the root 
-                 * directory, so skip ahead to the data area. */
-                sect = fatfs->firstclustsect;
-                continue;
+    while ((sect <= lsect) && (done == 0)) {
+        size_t buf_sect = 0;
+        size_t clust_idx = 0;
+
+        /* Collect the clusters to process on this iteration of the inode
+         * walk. The data area (exFAT cluster heap) is processed a cluster
+         * at a time. However, the root directory for a FAT12/FAT16 file 
+         * system precedes the data area and it is processed a sector at a
+         * time. */
+        batch.clust_cnt = 0;
+        while (sect <= lsect) {
+            FATFS_INODE_WALK_CLUST *clust;
+            int cluster_is_alloc = 0;
+            size_t num_sectors_to_process = 0;
+
+            if (sect < fatfs->firstclustsect) {
+                if ((flags & TSK_FS_META_FLAG_ORPHAN) != 0) {
+                    /* If orphan file hunting, there are no orphans in the
+                     * root directory, so skip ahead to the data area. */
+                    sect = fatfs->firstclustsect;
+                    continue;
+                }
+                cluster_is_alloc = 1;
+                num_sectors_to_process = 1;
             }
+            else {
+                /* Get the base sector for the cluster that contains the
+                 * current sector. */
+                sect =
+                    FATFS_CLUST_2_SECT(fatfs, (FATFS_SECT_2_CLUST(fatfs,
+                            sect)));
+
+                /* Determine whether the cluster is allocated. Skip it if it
+                 * is not allocated and the UNALLOCATED inode selection flag
+                 * is not set. */
+                cluster_is_alloc = fatfs_is_sectalloc(fatfs, sect);
+                if ((cluster_is_alloc == 0)
+                    && ((flags & TSK_FS_META_FLAG_UNALLOC) == 0)) {
+                    sect += fatfs->csize;
+                    continue;
+                }
+                else if (cluster_is_alloc == -1) {
+                    /* Report the error once the clusters before this one
+                     * have been processed. */
+                    if (batch.clust_cnt > 0) {
+                        tsk_error_reset();
+                        break;
+                    }
+                    tsk_fs_file_close(fs_file);
+                    free(orphan_bitmap);
+                    free(batch.buf);
+                    free(batch.clusts);
+                    free(batch.sect_ok);
+                    free(batch.dentry_ok);
+                    return 1;
+                }
 
-            /* Read in a FAT12/FAT16 root directory sector. */
-            cnt = tsk_fs_read_block(a_fs, sect, dino_buf, fatfs->ssize);
-            if (cnt != fatfs->ssize) {
-                if (cnt >= 0) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_READ);
+                /* If the cluster is allocated but is not allocated to a 
+                 * directory, then skip it.  NOTE: This will miss orphan file 
+                 * entries in the slack space of files.
+                 */
+                if ((cluster_is_alloc == 1) && (isset(dir_sectors_bitmap, sect) == 0)) {
+                    sect += fatfs->csize;
+                    continue;
                 }
-                tsk_error_set_errstr2
-                    ("%s (root dir): sector: %" PRIuDADDR,
-                    func_name, sect);
-                tsk_fs_file_close(fs_file);
-                free(dir_sectors_bitmap);
-                free(dino_buf);
-                return 1;
-            }
 
-            cluster_is_alloc = 1;
-            num_sectors_to_process = 1;
-        }
-        else {
-            /* The walk has proceeded into the data area (exFAT cluster heap).
-             * It's time to read in a cluster at a time. Get the base sector 
-             * for the cluster that contains the current sector. */
-            sect =
-                FATFS_CLUST_2_SECT(fatfs, (FATFS_SECT_2_CLUST(fatfs,
-                        sect)));
-
-            /* Determine whether the cluster is allocated. Skip it if it is
-             * not allocated and the UNALLOCATED inode selection flag is not 
-             * set. */
-            cluster_is_alloc = fatfs_is_sectalloc(fatfs, sect);
-            if ((cluster_is_alloc == 0)
-                && ((flags & TSK_FS_META_FLAG_UNALLOC) == 0)) {
-                sect += fatfs->csize;
-                continue;
-            }
-            else if (cluster_is_alloc == -1) {
-                tsk_fs_file_close(fs_file);
-                free(dir_sectors_bitmap);
-                free(dino_buf);
-                return 1;
+                /* The final cluster may not be full. */
+                if (lsect - sect + 1 < fatfs->csize) {
+                    num_sectors_to_process = (size_t) (lsect - sect + 1);
+                }
+                else {
+                    num_sectors_to_process = fatfs->csize;
+                }
             }
 
-            /* If the cluster is allocated but is not allocated to a 
-             * directory, then skip it.  NOTE: This will miss orphan file 
-             * entries in the slack space of files.
-             */
-            if ((cluster_is_alloc == 1) && (isset(dir_sectors_bitmap, sect) == 0)) {
-                sect += fatfs->csize;
-                continue;
+            if (buf_sect + num_sectors_to_process > buf_sect_cnt) {
+                break;
             }
 
-            /* The final cluster may not be full. */
-            if (lsect - sect + 1 < fatfs->csize) {
-                num_sectors_to_process = (size_t) (lsect - sect + 1);
-            }
-            else {
-                num_sectors_to_process = fatfs->csize;
+            clust = &batch.clusts[batch.clust_cnt++];
+            clust->sect = sect;
+            clust->num_sectors = num_sectors_to_process;
+            clust->buf_sect = buf_sect;
+            clust->cluster_is_alloc = cluster_is_alloc;
+
+            /* Only do a basic test to confirm the contents of each chunk is
+             * a directory entry unless the sector that contains it is not
+             * allocated to a directory or is unallocated. */
+            clust->do_basic_dentry_test = 1;
+            if ((isset(dir_sectors_bitmap, sect) == 0) || (cluster_is_alloc == 0)) {
+                clust->do_basic_dentry_test = 0;
             }
 
-            /* Read in a cluster. */
-            cnt = tsk_fs_read_block
-                (a_fs, sect, dino_buf, num_sectors_to_process << fatfs->ssize_sh);
-            if (cnt != (ssize_t)(num_sectors_to_process << fatfs->ssize_sh)) {
+            buf_sect += num_sectors_to_process;
+            sect += num_sectors_to_process;
+        }
+
+        if (batch.clust_cnt == 0) {
+            break;
+        }
+
+        /* Read in the clusters. If one cannot be read, process the ones
+         * before it and then read it again on its own to report the
+         * error. */
+        clust_idx = fatfs_inode_walk_read_batch(&batch);
+        if (clust_idx == 0) {
+            FATFS_INODE_WALK_CLUST *clust = &batch.clusts[0];
+            ssize_t cnt = tsk_fs_read_block(a_fs, clust->sect, batch.buf,
+                clust->num_sectors << fatfs->ssize_sh);
+            if (cnt != (ssize_t)(clust->num_sectors << fatfs->ssize_sh)) {
                 if (cnt >= 0) {
                     tsk_error_reset();
                     tsk_error_set_errno(TSK_ERR_FS_READ);
                 }
-                tsk_error_set_errstr2("%s: sector: %"
-                    PRIuDADDR, func_name, sect);
+                if (clust->sect < fatfs->firstclustsect) {
+                    tsk_error_set_errstr2
+                        ("%s (root dir): sector: %" PRIuDADDR,
+                        func_name, clust->sect);
+                }
+                else {
+                    tsk_error_set_errstr2("%s: sector: %"
+                        PRIuDADDR, func_name, clust->sect);
+                }
                 tsk_fs_file_close(fs_file);
-                free(dir_sectors_bitmap);
-                free(dino_buf);
+                free(orphan_bitmap);
+                free(batch.buf);
+                free(batch.clusts);
+                free(batch.sect_ok);
+                free(batch.dentry_ok);
                 return 1;
             }
+            clust_idx = 1;
         }
-
-        /* Now that the sectors are read in, prepare to step through them in 
-         * directory entry size chunks. Only do a basic test to confirm the 
-         * contents of each chunk is a directory entry unless the sector that
-         * contains it is not allocated to a directory or is unallocated.*/
-        do_basic_dentry_test = 1;
-        if ((isset(dir_sectors_bitmap, sect) == 0) || (cluster_is_alloc == 0)) {
-            do_basic_dentry_test = 0;
+        if (clust_idx < batch.clust_cnt) {
+            batch.clust_cnt = clust_idx;
+            sect = batch.clusts[clust_idx].sect;
         }
 
-        /* Walk through the sectors read in. */
-        for (sector_idx = 0; sector_idx < num_sectors_to_process; sector_idx++) {
-            TSK_INUM_T inum = 0;
-
-            /* If the last inode in this sector is before the start 
-             * inode, skip the sector. */
-            if (FATFS_SECT_2_INODE(fatfs, sect + 1) < a_start_inum) {
-                sect++;
-                continue;
-            }
-
-            /* Advance the directory entry pointer to the start of the 
-             * sector. */
-            dep = (FATFS_DENTRY*)(&dino_buf[sector_idx << fatfs->ssize_sh]);
-
-            /* If the sector is not allocated to a directory and the first 
-             * chunk is not a directory entry, skip the sector. */
-            if (!isset(dir_sectors_bitmap, sect) &&
-                !fatfs->is_dentry(fatfs, dep, (FATFS_DATA_UNIT_ALLOC_STATUS_ENUM)cluster_is_alloc, do_basic_dentry_test)) {
-                sect++;
-                continue;
-            }
-
-            /* Get the base inode address of this sector. */
-            inum = FATFS_SECT_2_INODE(fatfs, sect);
-            if (tsk_verbose) {
-                tsk_fprintf(stderr,
-                    "%s: Processing sector %" PRIuDADDR
-                    " starting at inode %" PRIuINUM "\n", func_name, sect, inum);
-            }
-
-            /* Walk through the potential directory entries in the sector. */
-            for (dentry_idx = 0; dentry_idx < fatfs->dentry_cnt_se;
-                dentry_idx++, inum++, dep++) {
-                int retval;
-                TSK_RETVAL_ENUM retval2 = TSK_OK;
-
-                /* If the inode address of the potential entry is less than
-                 * the beginning inode address for the inode walk, skip it. */
-                if (inum < a_start_inum) {
+        /* Test the potential directory entries on several threads. */
+        tsk_parallel_for(batch.clust_cnt, fatfs_inode_walk_check_clust,
+            &batch);
+
+        /* Load and report the entries in order. */
+        for (clust_idx = 0; clust_idx < batch.clust_cnt && done == 0;
+            clust_idx++) {
+            const FATFS_INODE_WALK_CLUST *clust = &batch.clusts[clust_idx];
+            size_t sector_idx = 0;
+
+            for (sector_idx = 0; sector_idx < clust->num_sectors;
+                sector_idx++) {
+                TSK_DADDR_T dsect = clust->sect + sector_idx;
+                size_t bsect = clust->buf_sect + sector_idx;
+                FATFS_DENTRY *dep =
+                    (FATFS_DENTRY*)&batch.buf[bsect << fatfs->ssize_sh];
+                const uint8_t *ok =
+                    &batch.dentry_ok[bsect * fatfs->dentry_cnt_se];
+                unsigned int dentry_idx = 0;
+                TSK_INUM_T inum = 0;
+
+                if (batch.sect_ok[bsect] == 0) {
                     continue;
                 }
 
-                /* If inode address of the potential entry is greater than the
-                 * ending inode address for the walk, terminate the inode walk. */ 
-                if (inum > end_inum_tmp) {
-                    done = 1;
-                    break;
+                /* Get the base inode address of this sector. */
+                inum = FATFS_SECT_2_INODE(fatfs, dsect);
+                if (tsk_verbose) {
+                    tsk_fprintf(stderr,
+                        "%s: Processing sector %" PRIuDADDR
+                        " starting at inode %" PRIuINUM "\n", func_name, dsect, inum);
                 }
 
-                /* If the potential entry is likely not an entry, or it is an  
-                 * entry that is not reported in an inode walk, or it does not   
-                 * satisfy the inode selection flags, then skip it. */
-                if (!fatfs->is_dentry(fatfs, dep, (FATFS_DATA_UNIT_ALLOC_STATUS_ENUM)cluster_is_alloc, do_basic_dentry_test) ||
-                    fatfs->inode_walk_should_skip_dentry(fatfs, inum, dep, flags, cluster_is_alloc)) {
-                    continue;
-                }
+                /* Walk through the potential directory entries in the sector. */
+                for (dentry_idx = 0; dentry_idx < fatfs->dentry_cnt_se;
+                    dentry_idx++, inum++, dep++) {
+                    int retval;
+                    TSK_RETVAL_ENUM retval2 = TSK_OK;
 
-                retval2 = fatfs->dinode_copy(fatfs, inum, dep, cluster_is_alloc, fs_file);
+                    /* If the inode address of the potential entry is less than
+                     * the beginning inode address for the inode walk, skip it. */
+                    if (inum < a_start_inum) {
+                        continue;
+                    }
 
-                if (retval2 != TSK_OK) {
-                    if (retval2 == TSK_COR) {
-                        /* Corrupted, move on to the next chunk. */
-                        if (tsk_verbose) {
-                            tsk_error_print(stderr);
-                        }
-                        tsk_error_reset();
+                    /* If inode address of the potential entry is greater than the
+                     * ending inode address for the walk, terminate the inode walk. */ 
+                    if (inum > end_inum_tmp) {
+                        done = 1;
+                        break;
+                    }
+
+                    if (ok[dentry_idx] == 0) {
                         continue;
                     }
-                    else {
-                        tsk_fs_file_close(fs_file);
-                        free(dir_sectors_bitmap);
-                        free(dino_buf);
-                        return 1;
+
+                    retval2 = fatfs->dinode_copy(fatfs, inum, dep,
+                        clust->cluster_is_alloc, fs_file);
+
+                    if (retval2 != TSK_OK) {
+                        if (retval2 == TSK_COR) {
+                            /* Corrupted, move on to the next chunk. */
+                            if (tsk_verbose) {
+                                tsk_error_print(stderr);
+                            }
+                            tsk_error_reset();
+                            continue;
+                        }
+                        else {
+                            tsk_fs_file_close(fs_file);
+                            free(orphan_bitmap);
+                            free(batch.buf);
+                            free(batch.clusts);
+                            free(batch.sect_ok);
+                            free(batch.dentry_ok);
+                            return 1;
+                        }
                     }
-                }
 
-                if (tsk_verbose) {
-                    tsk_fprintf(stderr,
-                        "%s: Directory Entry %" PRIuINUM
-                        " (%u) at sector %" PRIuDADDR "\n", func_name, inum, dentry_idx,
-                        sect);
-                }
+                    if (tsk_verbose) {
+                        tsk_fprintf(stderr,
+                            "%s: Directory Entry %" PRIuINUM
+                            " (%u) at sector %" PRIuDADDR "\n", func_name, inum, dentry_idx,
+                            dsect);
+                    }
 
-                /* Do the callback. */
-                retval = a_action(fs_file, a_ptr);
-                if (retval == TSK_WALK_STOP) {
-                    tsk_fs_file_close(fs_file);
-                    free(dir_sectors_bitmap);
-                    free(dino_buf);
-                    return 0;
+                    /* Do the callback. */
+                    retval = a_action(fs_file, a_ptr);
+                    if ((retval == TSK_WALK_STOP) || (retval == TSK_WALK_ERROR)) {
+                        tsk_fs_file_close(fs_file);
+                        free(orphan_bitmap);
+                        free(batch.buf);
+                        free(batch.clusts);
+                        free(batch.sect_ok);
+                        free(batch.dentry_ok);
+                        return (retval == TSK_WALK_ERROR) ? 1 : 0;
+                    }
                 }
-                else if (retval == TSK_WALK_ERROR) {
-                    tsk_fs_file_close(fs_file);
-                    free(dir_sectors_bitmap);
-                    free(dino_buf);
-                    return 1;
+                if (done) {
+                    break;
                 }
-            }                  
-            sect++;
-            if (done) {
-                break;
             }
         }
-        if (done) {
-            break;
-        }
     }
 
-    free(dir_sectors_bitmap);
-    free(dino_buf);
+    free(orphan_bitmap);
+    free(batch.buf);
+    free(batch.clusts);
+    free(batch.sect_ok);
+    free(batch.dentry_ok);
 
     // handle the virtual orphans folder and FAT files if they asked for them
     if ((a_end_inum > a_fs->last_inum - FATFS_NUM_VIRT_FILES(fatfs))
@@ -809,6 +809,7 @@ fatxxfs_open(FATFS_INFO *fatfs)
     fs->jopen = fatfs_jopen;
 
     fatfs->is_cluster_alloc = fatxxfs_is_cluster_alloc;
+    fatfs->cluster_run_end = fatxxfs_cluster_run_end;
     fatfs->is_dentry = fatxxfs_is_dentry;
     fatfs->dinode_copy =  fatxxfs_dinode_copy;
     fatfs->inode_lookup = fatxxfs_inode_lookup;
@@ -861,3 +862,41 @@ fatxxfs_is_cluster_alloc(FATFS_INFO *fatfs, TSK_DADDR_T clust)
     else
         return 1;
 }
+
+/**
+ * \internal
+ * Finds the end of the run of clusters that starts at a given cluster and
+ * that all have the same allocation status, using the FAT that was decoded
+ * when the file system was opened.
+ *
+ * @param fatfs File system
+ * @param clust The first cluster of the run.
+ * @param last_clust The last cluster to consider.
+ * @param [out] is_alloc Set to 1 if the run is allocated, 0 if not.
+ * @return The cluster after the run (at most last_clust + 1), or 0 if
+ * clust is not in the decoded FAT.
+ */
+TSK_DADDR_T
+fatxxfs_cluster_run_end(FATFS_INFO *fatfs, TSK_DADDR_T clust,
+    TSK_DADDR_T last_clust, int8_t *is_alloc)
+{
+    const uint32_t *table = fatfs->fat_table;
+    TSK_DADDR_T table_cnt = fatfs->fat_table_cnt;
+    TSK_DADDR_T end;
+
+    if ((clust < FATFS_FIRST_CLUSTER_ADDR) || (clust > last_clust) ||
+        (clust >= table_cnt)) {
+        return 0;
+    }
+
+    end = last_clust + 1;
+    if (end > table_cnt)
+        end = table_cnt;
+
+    *is_alloc = (table[clust] != FATFS_UNALLOC);
+    for (clust++; clust < end; clust++) {
+        if ((table[clust] != FATFS_UNALLOC) != *is_alloc)
+            break;
+    }
+    return clust;
+}
@@ -194,6 +194,9 @@ tsk_fs_meta_reset(TSK_FS_META * a_fs_meta)
  * Walk a range of metadata structures and call a callback for each
  * structure that matches the flags supplied.   For example, it can
  * call the callback on only allocated or unallocated entries. 
+ * The structures are usually given in address order, but a file system
+ * can use another order when that is much cheaper to read.  HFS+ gives
+ * large ranges in catalog file (parent folder and name) order.
  *
  * @param a_fs File system to process
  * @param a_start Metadata address to start walking from
@@ -292,6 +292,161 @@ hfs_extents_to_attr(TSK_FS_INFO * a_fs, const hfs_ext_desc * a_extents,
 }
 
 
+/** \internal
+ * Read a node of one of the B-tree files (catalog, extents or attributes).
+ * Recently read nodes are kept in a small per-tree cache so that the upper
+ * levels of the tree, which every lookup passes through, are not read from
+ * the image again and again.
+ *
+ * @param hfs File system being analyzed
+ * @param cache Node cache of the B-tree
+ * @param attr Data attribute of the B-tree file
+ * @param node_num Number of the node to read
+ * @param nodesize Size of the nodes in the B-tree
+ * @param buf [out] Buffer of nodesize bytes to copy the node into
+ * @returns Number of bytes read or -1 on error (as tsk_fs_attr_read())
+ */
+static ssize_t
+hfs_bt_node_read(HFS_INFO * hfs, HFS_BT_CACHE * cache,
+    const TSK_FS_ATTR * attr, uint32_t node_num, uint16_t nodesize,
+    char *buf)
+{
+    ssize_t cnt;
+    int i, slot;
+
+    tsk_take_lock(&(hfs->bt_cache_lock));
+    if ((cache->data != NULL) && (cache->nodesize == nodesize)) {
+        for (i = 0; i < HFS_BT_CACHE_NUM; i++) {
+            if ((cache->used[i]) && (cache->node[i] == node_num)) {
+                memcpy(buf, &cache->data[(size_t) i * nodesize], nodesize);
+                cache->used[i] = ++cache->tick;
+                tsk_release_lock(&(hfs->bt_cache_lock));
+                return nodesize;
+            }
+        }
+    }
+    tsk_release_lock(&(hfs->bt_cache_lock));
+
+    cnt = tsk_fs_attr_read(attr, (TSK_OFF_T) node_num * nodesize, buf,
+        nodesize, 0);
+    if (cnt != nodesize)
+        return cnt;
+
+    tsk_take_lock(&(hfs->bt_cache_lock));
+    if (cache->nodesize != nodesize) {
+        // The cache is only an optimization, so do not report a failure
+        // to allocate it.
+        free(cache->data);
+        memset(cache->used, 0, sizeof(cache->used));
+        cache->tick = 0;
+        cache->nodesize = 0;
+        cache->data = (char *) malloc((size_t) HFS_BT_CACHE_NUM * nodesize);
+        if (cache->data != NULL)
+            cache->nodesize = nodesize;
+    }
+    if (cache->data != NULL) {
+        // replace the least recently used slot, unless another thread
+        // added the node while we were reading it
+        slot = 0;
+        for (i = 0; i < HFS_BT_CACHE_NUM; i++) {
+            if ((cache->used[i]) && (cache->node[i] == node_num)) {
+                slot = i;
+                break;
+            }
+            if (cache->used[i] < cache->used[slot])
+                slot = i;
+        }
+        memcpy(&cache->data[(size_t) slot * nodesize], buf, nodesize);
+        cache->node[slot] = node_num;
+        cache->used[slot] = ++cache->tick;
+    }
+    tsk_release_lock(&(hfs->bt_cache_lock));
+
+    return cnt;
+}
+
+
+/** \internal
+ * Save the catalog entry of a file or folder that was found while listing
+ * a folder, so that the lookup of its metadata that usually follows (for
+ * example, by fls) does not have to search the catalog B-tree for its
+ * thread and file records.  Hard links must not be given, since their
+ * lookup returns the entry of the target.
+ *
+ * @param hfs File system
+ * @param cur_key Key of the record (its name must have been checked
+ * against the key length)
+ * @param rec File or folder record
+ */
+void
+hfs_entry_cache_add(HFS_INFO * hfs, const hfs_btree_key_cat * cur_key,
+    const hfs_file_folder * rec)
+{
+    TSK_FS_INFO *fs = &(hfs->fs_info);
+    uint16_t rec_type = tsk_getu16(fs->endian, rec->file.std.rec_type);
+    uint16_t name_len = tsk_getu16(fs->endian, cur_key->name.length);
+    uint32_t cnid = tsk_getu32(fs->endian, rec->file.std.cnid);
+    HFS_ENTRY *entry;
+
+    if ((cnid == 0)
+        || (2 * (size_t) name_len > sizeof(cur_key->name.unicode))
+        || ((rec_type != HFS_FOLDER_RECORD)
+            && (rec_type != HFS_FILE_RECORD)))
+        return;
+
+    tsk_take_lock(&(hfs->bt_cache_lock));
+    // The cache is only an optimization, so do not report a failure to
+    // allocate it.
+    if ((hfs->entry_cache == NULL) && ((hfs->entry_cache = (HFS_ENTRY *)
+                calloc(HFS_ENTRY_CACHE_NUM, sizeof(HFS_ENTRY))) == NULL)) {
+        tsk_release_lock(&(hfs->bt_cache_lock));
+        return;
+    }
+    entry = &hfs->entry_cache[cnid % HFS_ENTRY_CACHE_NUM];
+    memset((char *) entry, 0, sizeof(HFS_ENTRY));
+    memcpy((char *) &entry->cat, (char *) rec,
+        (rec_type == HFS_FOLDER_RECORD) ? sizeof(hfs_folder) :
+        sizeof(hfs_file));
+    entry->flags = TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED;
+    entry->inum = cnid;
+
+    // the thread record holds the key of the file or folder record
+    entry->thread.rec_type[1] = (rec_type == HFS_FOLDER_RECORD) ?
+        HFS_FOLDER_THREAD : HFS_FILE_THREAD;
+    memcpy((char *) entry->thread.parent_cnid,
+        (char *) cur_key->parent_cnid, sizeof(entry->thread.parent_cnid));
+    memcpy((char *) &entry->thread.name, (char *) &cur_key->name,
+        2 + 2 * (size_t) name_len);
+    tsk_release_lock(&(hfs->bt_cache_lock));
+}
+
+
+/** \internal
+ * Get the catalog entry of a file or folder from the entries that were
+ * saved by hfs_entry_cache_add().
+ *
+ * @param hfs File system
+ * @param inum CNID to look for
+ * @param entry [out] Entry, as hfs_cat_file_lookup() would return it
+ * @returns 1 if the entry was found and 0 if not
+ */
+static uint8_t
+hfs_entry_cache_get(HFS_INFO * hfs, TSK_INUM_T inum, HFS_ENTRY * entry)
+{
+    uint8_t found = 0;
+
+    tsk_take_lock(&(hfs->bt_cache_lock));
+    if ((hfs->entry_cache != NULL) && (inum != 0)
+        && (hfs->entry_cache[inum % HFS_ENTRY_CACHE_NUM].inum == inum)) {
+        memcpy((char *) entry, (char *) &hfs->entry_cache[inum %
+                HFS_ENTRY_CACHE_NUM], sizeof(HFS_ENTRY));
+        found = 1;
+    }
+    tsk_release_lock(&(hfs->bt_cache_lock));
+    return found;
+}
+
+
 /**
  * Look in the extents catalog for entries for a given file. Add the runs
  * to the passed attribute structure.
@@ -417,8 +572,8 @@ hfs_ext_find_extent_record_attr(HFS_INFO * hfs, uint32_t cnid,
                 "hfs_ext_find_extent_record: reading node %" PRIu32
                 " at offset %" PRIdOFF "\n", cur_node, cur_off);
 
-        cnt = tsk_fs_attr_read(hfs->extents_attr, cur_off,
-            node, nodesize, 0);
+        cnt = hfs_bt_node_read(hfs, &(hfs->ext_cache),
+            hfs->extents_attr, cur_node, nodesize, node);
         if (cnt != nodesize) {
             if (cnt >= 0) {
                 tsk_error_reset();
@@ -771,8 +926,8 @@ hfs_cat_traverse(HFS_INFO * hfs,
 
         // read the current node
         cur_off = (TSK_OFF_T)cur_node * nodesize;
-        cnt = tsk_fs_attr_read(hfs->catalog_attr, cur_off,
-            node, nodesize, 0);
+        cnt = hfs_bt_node_read(hfs, &(hfs->cat_cache),
+            hfs->catalog_attr, cur_node, nodesize, node);
         if (cnt != nodesize) {
             if (cnt >= 0) {
                 tsk_error_reset();
@@ -1007,54 +1162,190 @@ hfs_cat_traverse(HFS_INFO * hfs,
     return 0;
 }
 
-typedef struct {
-    const hfs_btree_key_cat *targ_key;
-    TSK_OFF_T off;
-} HFS_CAT_GET_RECORD_OFFSET_DATA;
-
-static uint8_t
-hfs_cat_get_record_offset_cb(HFS_INFO * hfs, int8_t level_type,
-    const hfs_btree_key_cat * cur_key,
-    TSK_OFF_T key_off, void *ptr)
+/** \internal
+ * Get the key of a record in a catalog B-tree node and check that the key
+ * (including its name) lies within the node.
+ * @param hfs File System being analyzed
+ * @param node Node to get the key from
+ * @param nodesize Size of the node
+ * @param cur_node Number of the node (for error messages)
+ * @param rec Index of the record in the node
+ * @param rec_off [out] Byte offset of the record in the node
+ * @returns Pointer to the key or NULL on error
+ */
+static const hfs_btree_key_cat *
+hfs_cat_node_key(HFS_INFO * hfs, const char *node, uint16_t nodesize,
+    uint32_t cur_node, int rec, size_t * rec_off)
 {
-    HFS_CAT_GET_RECORD_OFFSET_DATA *offset_data = (HFS_CAT_GET_RECORD_OFFSET_DATA *)ptr;
-    const hfs_btree_key_cat *targ_key = offset_data->targ_key;
+    TSK_FS_INFO *fs = &(hfs->fs_info);
+    const hfs_btree_key_cat *key;
+    size_t keylen;
 
-    if (tsk_verbose)
-        tsk_fprintf(stderr,
-            "hfs_cat_get_record_offset_cb: %s node want: %" PRIu32
-            " vs have: %" PRIu32 "\n",
-            (level_type == HFS_BT_NODE_TYPE_IDX) ? "Index" : "Leaf",
-            tsk_getu32(hfs->fs_info.endian, targ_key->parent_cnid),
-            tsk_getu32(hfs->fs_info.endian, cur_key->parent_cnid));
-
-    if (level_type == HFS_BT_NODE_TYPE_IDX) {
-        int diff = hfs_cat_compare_keys(hfs, cur_key, targ_key);
-        if (diff < 0)
-            return HFS_BTREE_CB_IDX_LT;
-        else
-            return HFS_BTREE_CB_IDX_EQGT;
+    *rec_off = tsk_getu16(fs->endian, &node[nodesize - (rec + 1) * 2]);
+    if (*rec_off + 8 > nodesize) {
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr
+            ("hfs_cat_node_key: offset of record %d in node %"
+            PRIu32 " too large (%d vs %" PRIu16 ")", rec, cur_node,
+            (int) *rec_off, nodesize);
+        return NULL;
     }
-    else {
-        int diff = hfs_cat_compare_keys(hfs, cur_key, targ_key);
 
-        // see if this record is for our file or if we passed the interesting entries
-        if (diff < 0) {
-            return HFS_BTREE_CB_LEAF_GO;
+    key = (const hfs_btree_key_cat *) &node[*rec_off];
+    keylen = 2 + tsk_getu16(fs->endian, key->key_len);
+    if ((keylen > nodesize - *rec_off)
+        || (8 + 2 * (size_t) tsk_getu16(fs->endian,
+                key->name.length) > keylen)) {
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr
+            ("hfs_cat_node_key: length of key %d in node %" PRIu32
+            " too large (%d vs %" PRIu16 ")", rec, cur_node, (int) keylen,
+            (int) (nodesize - *rec_off));
+        return NULL;
+    }
+    return key;
+}
+
+
+/** \internal
+ * Descend the catalog B-tree from the root to the leaf node that holds
+ * (or would hold) a key, using a binary search in each index node.  If
+ * the key sorts before every key in an index node, the first child is
+ * used.
+ * @param hfs File System being analyzed
+ * @param needle Key to search for
+ * @param node [out] Buffer of nodesize bytes that the leaf node is read into
+ * @returns Number of the leaf node or 0 on error or if the catalog is
+ * empty. Check tsk_errno to determine if error occurred.
+ */
+static uint32_t
+hfs_cat_find_leaf(HFS_INFO * hfs, const hfs_btree_key_cat * needle,
+    char *node)
+{
+    TSK_FS_INFO *fs = &(hfs->fs_info);
+    uint16_t nodesize;
+    uint32_t cur_node;
+    int depth;
+
+    nodesize = tsk_getu16(fs->endian, hfs->catalog_header.nodesize);
+
+    /* start at root node (zero if the catalog is empty) */
+    cur_node = tsk_getu32(fs->endian, hfs->catalog_header.rootNode);
+
+    for (depth = 0; cur_node != 0; depth++) {
+        hfs_btree_node *node_desc;
+        hfs_btree_index_record *idx_rec;
+        const hfs_btree_key_cat *key;
+        size_t rec_off, keylen;
+        uint32_t next_node;
+        uint16_t num_rec;
+        ssize_t cnt;
+        int lo, hi, mid, found = 0;
+
+        if (depth >= HFS_BT_MAX_DEPTH) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("hfs_cat_find_leaf: more than %d levels in catalog btree",
+                HFS_BT_MAX_DEPTH);
+            return 0;
         }
-        else if (diff == 0) {
-            offset_data->off =
-                key_off + 2 + tsk_getu16(hfs->fs_info.endian,
-                cur_key->key_len);
+
+        if (cur_node > tsk_getu32(fs->endian,
+                hfs->catalog_header.totalNodes)) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("hfs_cat_find_leaf: Node %" PRIu32 " too large for file",
+                cur_node);
+            return 0;
         }
-        return HFS_BTREE_CB_LEAF_STOP;
+
+        cnt = hfs_bt_node_read(hfs, &(hfs->cat_cache), hfs->catalog_attr,
+            cur_node, nodesize, node);
+        if (cnt != nodesize) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2
+                ("hfs_cat_find_leaf: Error reading node %" PRIu32,
+                cur_node);
+            return 0;
+        }
+
+        node_desc = (hfs_btree_node *) node;
+        num_rec = tsk_getu16(fs->endian, node_desc->num_rec);
+        if ((num_rec == 0)
+            || (sizeof(hfs_btree_node) + 2 * (size_t) num_rec > nodesize)) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("hfs_cat_find_leaf: invalid number of records (%" PRIu16
+                ") in node %" PRIu32, num_rec, cur_node);
+            return 0;
+        }
+
+        if (node_desc->type == HFS_BT_NODE_TYPE_LEAF)
+            return cur_node;
+
+        if (node_desc->type != HFS_BT_NODE_TYPE_IDX) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr("hfs_cat_find_leaf: btree node %" PRIu32
+                " is neither index nor leaf (%" PRId8 ")",
+                cur_node, node_desc->type);
+            return 0;
+        }
+
+        /* find the record with the largest key that is smaller
+         * than or equal to the needle */
+        lo = 1;
+        hi = num_rec - 1;
+        while (lo <= hi) {
+            mid = lo + (hi - lo) / 2;
+            if ((key = hfs_cat_node_key(hfs, node, nodesize, cur_node,
+                        mid, &rec_off)) == NULL)
+                return 0;
+            if (hfs_cat_compare_keys(hfs, key, needle) <= 0) {
+                found = mid;
+                lo = mid + 1;
+            }
+            else {
+                hi = mid - 1;
+            }
+        }
+
+        if ((key = hfs_cat_node_key(hfs, node, nodesize, cur_node,
+                    found, &rec_off)) == NULL)
+            return 0;
+        keylen = 2 + hfs_get_idxkeylen(hfs,
+            tsk_getu16(fs->endian, key->key_len), &(hfs->catalog_header));
+        if ((keylen > nodesize - rec_off)
+            || (sizeof(hfs_btree_index_record) >
+                nodesize - rec_off - keylen)) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("hfs_cat_find_leaf: truncated btree index record %d in node %"
+                PRIu32, found, cur_node);
+            return 0;
+        }
+        idx_rec = (hfs_btree_index_record *) & node[rec_off + keylen];
+        next_node = tsk_getu32(fs->endian, idx_rec->childNode);
+
+        if (next_node == cur_node) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("hfs_cat_find_leaf: node %" PRIu32
+                " references itself as next node", cur_node);
+            return 0;
+        }
+        cur_node = next_node;
     }
+    return 0;
 }
 
 
 /** \internal
  * Find the byte offset (from the start of the catalog file) to a record
- * in the catalog file.
+ * in the catalog file.  The tree is descended from the root to the leaf
+ * that can hold the key, which is then binary searched for the record.
  * @param hfs File System being analyzed
  * @param needle Key to search for
  * @returns Byte offset or 0 on error. 0 is also returned if catalog
@@ -1063,13 +1354,256 @@ hfs_cat_get_record_offset_cb(HFS_INFO * hfs, int8_t level_type,
 static TSK_OFF_T
 hfs_cat_get_record_offset(HFS_INFO * hfs, const hfs_btree_key_cat * needle)
 {
-    HFS_CAT_GET_RECORD_OFFSET_DATA offset_data;
-    offset_data.off = 0;
-    offset_data.targ_key = needle;
-    if (hfs_cat_traverse(hfs, hfs_cat_get_record_offset_cb, &offset_data)) {
+    TSK_FS_INFO *fs = &(hfs->fs_info);
+    const hfs_btree_key_cat *key;
+    uint16_t nodesize;
+    uint32_t cur_node;
+    uint16_t num_rec;
+    size_t rec_off;
+    char *node;
+    TSK_OFF_T off = 0;
+    int lo, hi, mid, diff;
+
+    tsk_error_reset();
+
+    nodesize = tsk_getu16(fs->endian, hfs->catalog_header.nodesize);
+    if (nodesize < sizeof(hfs_btree_node)) {
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr
+            ("hfs_cat_get_record_offset: Node size %d is too small to be valid",
+            nodesize);
+        return 0;
+    }
+    if ((node = (char *) tsk_malloc(nodesize)) == NULL)
+        return 0;
+
+    if ((cur_node = hfs_cat_find_leaf(hfs, needle, node)) == 0) {
+        free(node);
         return 0;
     }
-    return offset_data.off;
+
+    num_rec = tsk_getu16(fs->endian, ((hfs_btree_node *) node)->num_rec);
+    lo = 0;
+    hi = num_rec - 1;
+    while (lo <= hi) {
+        mid = lo + (hi - lo) / 2;
+        if ((key = hfs_cat_node_key(hfs, node, nodesize, cur_node,
+                    mid, &rec_off)) == NULL)
+            break;
+        diff = hfs_cat_compare_keys(hfs, key, needle);
+        if (diff == 0) {
+            off = (TSK_OFF_T) cur_node * nodesize + rec_off + 2 +
+                tsk_getu16(fs->endian, key->key_len);
+            break;
+        }
+        else if (diff < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    free(node);
+    return off;
+}
+
+
+/** \internal
+ * Walk the leaf records of the catalog file in key order by following the
+ * flink chain of the leaf nodes.  The walk starts in the leaf node that
+ * holds the first record of a parent folder (or in the first leaf node)
+ * and calls the callback for each record until it returns
+ * HFS_BTREE_CB_LEAF_STOP.  Runs of
+ * consecutive leaf nodes are read with one read of up to
+ * HFS_CAT_LEAF_READ_SIZE bytes, so a walk over the whole catalog reads the
+ * catalog file sequentially and only once.
+ *
+ * The key passed to the callback points into the node buffer.  At least
+ * sizeof(hfs_file_folder) bytes of buffer follow every node, so a fixed
+ * size record after a key can be accessed without further bounds checks.
+ *
+ * @param hfs File system
+ * @param parent_cnid Folder whose records are of interest or 0 to start
+ * at the first leaf node
+ * @param a_cb callback (called with HFS_BT_NODE_TYPE_LEAF only)
+ * @param ptr Pointer to pass to callback
+ * @returns 1 on error
+ */
+uint8_t
+hfs_cat_leaf_walk(HFS_INFO * hfs, uint32_t parent_cnid,
+    TSK_HFS_BTREE_CB a_cb, void *ptr)
+{
+    TSK_FS_INFO *fs = &(hfs->fs_info);
+    uint16_t nodesize;
+    uint32_t total_nodes;
+    uint32_t cur_node;
+    uint32_t max_batch;         /* max number of nodes in one read */
+    uint32_t batch_want = 1;    /* number of nodes to read next */
+    uint32_t batch_start = 0;   /* first node in buf */
+    uint32_t batch_cnt = 0;     /* number of nodes in buf */
+    uint32_t visited = 0;
+    size_t buf_len;
+    char *buf;
+
+    tsk_error_reset();
+
+    nodesize = tsk_getu16(fs->endian, hfs->catalog_header.nodesize);
+    total_nodes = tsk_getu32(fs->endian, hfs->catalog_header.totalNodes);
+    if (nodesize < sizeof(hfs_btree_node)) {
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr
+            ("hfs_cat_leaf_walk: Node size %d is too small to be valid",
+            nodesize);
+        return 1;
+    }
+    // The records of a single folder usually fit in a few nodes.  Read
+    // those through the node cache, where the lookups of the folder's
+    // entries that typically follow will find them.
+    max_batch = parent_cnid ? 1 : HFS_CAT_LEAF_READ_SIZE / nodesize;
+    if (max_batch == 0)
+        max_batch = 1;
+
+    buf_len = nodesize;
+    if ((buf = (char *) tsk_malloc(buf_len + sizeof(hfs_file_folder))) == NULL)
+        return 1;
+
+    if (parent_cnid) {
+        hfs_btree_key_cat start;
+
+        // the thread record (empty name) sorts first for its parent
+        memset((char *) &start, 0, sizeof(hfs_btree_key_cat));
+        cnid_to_array(parent_cnid, start.parent_cnid);
+        if ((cur_node = hfs_cat_find_leaf(hfs, &start, buf)) == 0) {
+            free(buf);
+            return tsk_error_get_errno() ? 1 : 0;
+        }
+        batch_start = cur_node;
+        batch_cnt = 1;
+    }
+    else {
+        cur_node = tsk_getu32(fs->endian, hfs->catalog_header.firstLeafNode);
+    }
+
+    while (cur_node != 0) {
+        hfs_btree_node *node_desc;
+        char *node;
+        uint16_t num_rec;
+        int rec;
+
+        if ((cur_node >= total_nodes) || (++visited > total_nodes)) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("hfs_cat_leaf_walk: Invalid or looping leaf node %" PRIu32,
+                cur_node);
+            free(buf);
+            return 1;
+        }
+
+        // read more nodes if the next one is not in the buffer.  Grow the
+        // read size while the chain is sequential and start over with a
+        // single node when it jumps.
+        if ((cur_node < batch_start)
+            || (cur_node - batch_start >= batch_cnt)) {
+            ssize_t cnt;
+
+            if ((batch_cnt) && (cur_node == batch_start + batch_cnt)) {
+                batch_want *= 2;
+                if (batch_want > max_batch)
+                    batch_want = max_batch;
+            }
+            else {
+                batch_want = 1;
+            }
+            if (batch_want > total_nodes - cur_node)
+                batch_want = total_nodes - cur_node;
+
+            if ((size_t) batch_want * nodesize > buf_len) {
+                char *tmp;
+                buf_len = (size_t) batch_want * nodesize;
+                if ((tmp = (char *) tsk_realloc(buf,
+                            buf_len + sizeof(hfs_file_folder))) == NULL) {
+                    free(buf);
+                    return 1;
+                }
+                buf = tmp;
+            }
+
+            if (batch_want == 1) {
+                cnt = hfs_bt_node_read(hfs, &(hfs->cat_cache),
+                    hfs->catalog_attr, cur_node, nodesize, buf);
+            }
+            else {
+                cnt = tsk_fs_attr_read(hfs->catalog_attr,
+                    (TSK_OFF_T) cur_node * nodesize, buf,
+                    (size_t) batch_want * nodesize, 0);
+            }
+            if (cnt < nodesize) {
+                if (cnt >= 0) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_FS_READ);
+                }
+                tsk_error_set_errstr2
+                    ("hfs_cat_leaf_walk: Error reading node %" PRIu32,
+                    cur_node);
+                free(buf);
+                return 1;
+            }
+            batch_start = cur_node;
+            batch_cnt = (uint32_t) (cnt / nodesize);
+            memset(&buf[(size_t) batch_cnt * nodesize], 0,
+                sizeof(hfs_file_folder));
+        }
+
+        node = &buf[(size_t) (cur_node - batch_start) * nodesize];
+        node_desc = (hfs_btree_node *) node;
+        num_rec = tsk_getu16(fs->endian, node_desc->num_rec);
+
+        if (node_desc->type != HFS_BT_NODE_TYPE_LEAF) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr("hfs_cat_leaf_walk: btree node %" PRIu32
+                " is not a leaf (%" PRId8 ")", cur_node, node_desc->type);
+            free(buf);
+            return 1;
+        }
+        if (sizeof(hfs_btree_node) + 2 * (size_t) num_rec > nodesize) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("hfs_cat_leaf_walk: invalid number of records (%" PRIu16
+                ") in node %" PRIu32, num_rec, cur_node);
+            free(buf);
+            return 1;
+        }
+
+        for (rec = 0; rec < num_rec; ++rec) {
+            const hfs_btree_key_cat *key;
+            size_t rec_off;
+            uint8_t retval;
+
+            if ((key = hfs_cat_node_key(hfs, node, nodesize, cur_node, rec,
+                        &rec_off)) == NULL) {
+                free(buf);
+                return 1;
+            }
+
+            retval = a_cb(hfs, HFS_BT_NODE_TYPE_LEAF, key,
+                (TSK_OFF_T) cur_node * nodesize + rec_off, ptr);
+            if (retval == HFS_BTREE_CB_LEAF_STOP) {
+                free(buf);
+                return 0;
+            }
+            else if (retval == HFS_BTREE_CB_ERR) {
+                tsk_error_set_errno(TSK_ERR_FS_GENFS);
+                tsk_error_set_errstr2
+                    ("hfs_cat_leaf_walk: Callback returned error");
+                free(buf);
+                return 1;
+            }
+        }
+
+        cur_node = tsk_getu32(fs->endian, node_desc->flink);
+    }
+
+    free(buf);
+    return 0;
 }
 
 
@@ -2393,6 +2927,36 @@ hfs_dinode_copy(HFS_INFO * a_hfs, const HFS_ENTRY * a_hfs_entry,
 }
 
 
+/** \internal
+ * Fill in the generic metadata of a file from its catalog entry.
+ * @param hfs File system being analyzed
+ * @param entry Catalog entry of the file
+ * @param a_fs_file [out] File to fill in (its meta must be allocated and reset)
+ * @returns 1 on error
+ */
+static uint8_t
+hfs_entry_copy(HFS_INFO * hfs, const HFS_ENTRY * entry,
+    TSK_FS_FILE * a_fs_file)
+{
+    /* Copy the structure in hfs to generic fs_inode */
+    if (hfs_dinode_copy(hfs, entry, a_fs_file)) {
+        return 1;
+    }
+
+    /* If this is potentially a compressed file, its
+     * actual size is unknown until we examine the
+     * extended attributes */
+    if ((a_fs_file->meta->size == 0) &&
+        (a_fs_file->meta->type == TSK_FS_META_TYPE_REG) &&
+        (a_fs_file->meta->attr_state != TSK_FS_META_ATTR_ERROR) &&
+        ((a_fs_file->meta->attr_state != TSK_FS_META_ATTR_STUDIED) ||
+            (a_fs_file->meta->attr == NULL))) {
+        hfs_load_attrs(a_fs_file);
+    }
+
+    return 0;
+}
+
 /** \internal
  * Load a catalog file entry and save it in the TSK_FS_FILE structure.
  *
@@ -2474,28 +3038,14 @@ hfs_inode_lookup(TSK_FS_INFO * fs, TSK_FS_FILE * a_fs_file,
         return hfs_make_attrfile(hfs, a_fs_file);
     }
 
-    /* Lookup inode and store it in the HFS structure */
-    if (hfs_cat_file_lookup(hfs, inum, &entry, TRUE)) {
-        return 1;
-    }
-
-    /* Copy the structure in hfs to generic fs_inode */
-    if (hfs_dinode_copy(hfs, &entry, a_fs_file)) {
+    /* Lookup inode and store it in the HFS structure.  The entries of a
+     * folder that was just listed are usually in the entry cache. */
+    if ((hfs_entry_cache_get(hfs, inum, &entry) == 0)
+        && (hfs_cat_file_lookup(hfs, inum, &entry, TRUE))) {
         return 1;
     }
 
-    /* If this is potentially a compressed file, its
-     * actual size is unknown until we examine the
-     * extended attributes */
-    if ((a_fs_file->meta->size == 0) &&
-        (a_fs_file->meta->type == TSK_FS_META_TYPE_REG) &&
-        (a_fs_file->meta->attr_state != TSK_FS_META_ATTR_ERROR) &&
-        ((a_fs_file->meta->attr_state != TSK_FS_META_ATTR_STUDIED) ||
-            (a_fs_file->meta->attr == NULL))) {
-        hfs_load_attrs(a_fs_file);
-    }
-
-    return 0;
+    return hfs_entry_copy(hfs, &entry, a_fs_file);
 }
 
 typedef struct {
@@ -3653,6 +4203,7 @@ static int hfs_file_read_lzvn_attr(TSK_FS_FILE* fs_file,
 typedef struct {
     TSK_FS_INFO *fs;            // the HFS file system
     TSK_FS_FILE *file;          // the Attributes file, if open
+    const TSK_FS_ATTR *attr;    // the data attribute of the Attributes file
     hfs_btree_header_record *header;    // the Attributes btree header record.
     // For Convenience, unpacked values.
     TSK_ENDIAN_ENUM endian;
@@ -3730,6 +4281,15 @@ open_attr_file(TSK_FS_INFO * fs, ATTR_FILE_T * attr_file)
         return 1;
     }
 
+    attr_file->attr = tsk_fs_file_attr_get(attr_file->file);
+    if (attr_file->attr == NULL) {
+        tsk_error_errstr2_concat
+            (" - open_attr_file: data attribute not found in the Attributes file");
+        tsk_fs_file_close(attr_file->file);
+        free(hrec);
+        return 1;
+    }
+
     // Fill in the fields of the attr_file struct (which was passed in by the caller)
     attr_file->fs = fs;
     attr_file->header = hrec;
@@ -3891,10 +4451,8 @@ hfs_load_extended_attrs(TSK_FS_FILE * fs_file,
 
 
         /* Read the node */
-        cnt = tsk_fs_file_read(attrFile.file,
-            (TSK_OFF_T)nodeID * attrFile.nodeSize,
-            (char *) nodeData,
-            attrFile.nodeSize, (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+        cnt = hfs_bt_node_read(hfs, &(hfs->attr_cache), attrFile.attr,
+            nodeID, attrFile.nodeSize, (char *) nodeData);
         if (cnt != (ssize_t)attrFile.nodeSize) {
             error_returned
                 ("hfs_load_extended_attrs: Could not read in a node from the Attributes File");
@@ -4326,10 +4884,8 @@ hfs_load_extended_attrs(TSK_FS_FILE * fs_file,
 
             nodeID = newNodeID;
 
-            cnt = tsk_fs_file_read(attrFile.file,
-                nodeID * attrFile.nodeSize,
-                (char *) nodeData,
-                attrFile.nodeSize, (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+            cnt = hfs_bt_node_read(hfs, &(hfs->attr_cache), attrFile.attr,
+                nodeID, attrFile.nodeSize, (char *) nodeData);
             if (cnt != (ssize_t)attrFile.nodeSize) {
                 error_returned
                     ("hfs_load_extended_attrs: Could not read in the next LEAF node from the Attributes File btree");
@@ -5180,13 +5736,96 @@ hfs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T start_blk,
 }
 
 
+// used to pass data to hfs_inode_walk_cb
+typedef struct {
+    TSK_FS_FILE *fs_file;
+    TSK_INUM_T start_inum;
+    TSK_INUM_T end_inum;
+    TSK_FS_META_FLAG_ENUM flags;
+    TSK_FS_META_WALK_CB action;
+    void *ptr;
+    TSK_WALK_RET_ENUM retval;   // result of the last call to action
+} HFS_INODE_WALK_INFO;
+
+/** \internal
+ * Leaf record callback of hfs_inode_walk.  Fills in the metadata of each
+ * file and folder record in the range and calls the walk action with it.
+ */
+static uint8_t
+hfs_inode_walk_cb(HFS_INFO * hfs, int8_t level_type,
+    const hfs_btree_key_cat * cur_key, TSK_OFF_T key_off, void *ptr)
+{
+    HFS_INODE_WALK_INFO *info = (HFS_INODE_WALK_INFO *) ptr;
+    TSK_FS_INFO *fs = &(hfs->fs_info);
+    TSK_FS_FILE *fs_file = info->fs_file;
+    const uint8_t *rec_buf;
+    uint16_t rec_type;
+    HFS_ENTRY entry;
+    TSK_INUM_T inum, target_cnid;
+    unsigned char is_err;
+
+    // hfs_cat_leaf_walk() leaves room for a file record after each key
+    rec_buf = (const uint8_t *) cur_key + 2 +
+        tsk_getu16(fs->endian, cur_key->key_len);
+    rec_type = tsk_getu16(fs->endian, rec_buf);
+    if ((rec_type != HFS_FOLDER_RECORD) && (rec_type != HFS_FILE_RECORD))
+        return HFS_BTREE_CB_LEAF_GO;
+
+    memset((char *) &entry, 0, sizeof(HFS_ENTRY));
+    memcpy((char *) &entry.cat, rec_buf,
+        (rec_type == HFS_FOLDER_RECORD) ? sizeof(hfs_folder) :
+        sizeof(hfs_file));
+
+    inum = tsk_getu32(fs->endian, entry.cat.std.cnid);
+    if ((inum < HFS_FIRST_USER_CNID) || (inum < info->start_inum)
+        || (inum > info->end_inum))
+        return HFS_BTREE_CB_LEAF_GO;
+
+    target_cnid = hfs_follow_hard_link(hfs, &entry.cat, &is_err);
+    if (is_err > 1) {
+        info->retval = TSK_WALK_ERROR;
+        return HFS_BTREE_CB_LEAF_STOP;
+    }
+    if (target_cnid != inum) {
+        // let the regular lookup deal with hard links
+        if (hfs_inode_lookup(fs, fs_file, inum)) {
+            if (tsk_error_get_errno() == TSK_ERR_FS_INODE_NUM) {
+                tsk_error_reset();
+                return HFS_BTREE_CB_LEAF_GO;
+            }
+            info->retval = TSK_WALK_ERROR;
+            return HFS_BTREE_CB_LEAF_STOP;
+        }
+    }
+    else {
+        tsk_fs_meta_reset(fs_file->meta);
+        entry.flags = TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED;
+        entry.inum = inum;
+        if (hfs_entry_copy(hfs, &entry, fs_file)) {
+            info->retval = TSK_WALK_ERROR;
+            return HFS_BTREE_CB_LEAF_STOP;
+        }
+    }
+
+    if ((fs_file->meta->flags & info->flags) != fs_file->meta->flags)
+        return HFS_BTREE_CB_LEAF_GO;
+
+    info->retval = info->action(fs_file, info->ptr);
+    if (info->retval != TSK_WALK_CONT)
+        return HFS_BTREE_CB_LEAF_STOP;
+    return HFS_BTREE_CB_LEAF_GO;
+}
+
+
 uint8_t
 hfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     TSK_INUM_T end_inum, TSK_FS_META_FLAG_ENUM flags,
     TSK_FS_META_WALK_CB action, void *ptr)
 {
+    HFS_INFO *hfs = (HFS_INFO *) fs;
     TSK_INUM_T inum;
     TSK_FS_FILE *fs_file;
+    int sweep;
 
     if (tsk_verbose)
         tsk_fprintf(stderr,
@@ -5244,9 +5883,25 @@ hfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     if (start_inum > end_inum)
         XSWAP(start_inum, end_inum);
 
+    /* A lookup costs two descents of the catalog B-tree (for the thread
+     * and the file record), so when many CNIDs are wanted, walk the
+     * catalog leaf records once instead.  Each file and folder has a
+     * record and usually a thread record in the leaves, so the walk is
+     * used when the range has at least half as many CNIDs as there are
+     * leaf records.  The special files and reserved CNIDs are still looked
+     * up one at a time and the others are then reported in catalog
+     * (parent and name) order, not in CNID order. */
+    sweep = (end_inum >= HFS_FIRST_USER_CNID) &&
+        (2 * (end_inum - (start_inum > HFS_FIRST_USER_CNID ? start_inum :
+                    HFS_FIRST_USER_CNID) + 1) >= tsk_getu32(fs->endian,
+            hfs->catalog_header.leafRecords));
+
     for (inum = start_inum; inum <= end_inum; ++inum) {
         int retval;
 
+        if ((sweep) && (inum >= HFS_FIRST_USER_CNID))
+            break;
+
         if (hfs_inode_lookup(fs, fs_file, inum)) {
             // deleted files may not exist in the catalog
             if (tsk_error_get_errno() == TSK_ERR_FS_INODE_NUM) {
@@ -5273,6 +5928,23 @@ hfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         }
     }
 
+    if (sweep) {
+        HFS_INODE_WALK_INFO info;
+
+        info.fs_file = fs_file;
+        info.start_inum = start_inum;
+        info.end_inum = end_inum;
+        info.flags = flags;
+        info.action = action;
+        info.ptr = ptr;
+        info.retval = TSK_WALK_CONT;
+        if ((hfs_cat_leaf_walk(hfs, 0, hfs_inode_walk_cb, &info))
+            || (info.retval == TSK_WALK_ERROR)) {
+            tsk_fs_file_close(fs_file);
+            return 1;
+        }
+    }
+
     tsk_fs_file_close(fs_file);
     return 0;
 }
@@ -6333,6 +7005,12 @@ hfs_close(TSK_FS_INFO * fs)
     tsk_release_lock(&(hfs->metadata_dir_cache_lock));
     tsk_deinit_lock(&(hfs->metadata_dir_cache_lock));
 
+    free(hfs->cat_cache.data);
+    free(hfs->ext_cache.data);
+    free(hfs->attr_cache.data);
+    free(hfs->entry_cache);
+    tsk_deinit_lock(&(hfs->bt_cache_lock));
+
     tsk_fs_free((TSK_FS_INFO *)hfs);
 }
 
@@ -6504,8 +7182,9 @@ hfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
         fs->last_block_act =
             (img_info->size - offset) / fs->block_size - 1;
 
-    // Initialize the lock
+    // Initialize the locks
     tsk_init_lock(&(hfs->metadata_dir_cache_lock));
+    tsk_init_lock(&(hfs->bt_cache_lock));
 
     /*
      * Set function pointers
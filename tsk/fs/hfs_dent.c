@@ -279,6 +279,7 @@ hfs_dir_open_meta_cb(HFS_INFO * hfs, int8_t level_type,
                     HFS_U16U8_FLAG_REPLACE_SLASH)) {
                 return HFS_BTREE_CB_ERR;
             }
+            hfs_entry_cache_add(hfs, cur_key, (hfs_file_folder *) folder);
         }
 
         /* This is a normal file in the folder */
@@ -339,6 +340,8 @@ hfs_dir_open_meta_cb(HFS_INFO * hfs, int8_t level_type,
                     HFS_U16U8_FLAG_REPLACE_SLASH)) {
                 return HFS_BTREE_CB_ERR;
             }
+            if (target_cnid == file_cnid)
+                hfs_entry_cache_add(hfs, cur_key, (hfs_file_folder *) file);
         }
         else {
             tsk_error_set_errno(TSK_ERR_FS_GENFS);
@@ -496,7 +499,7 @@ hfs_dir_open_meta(TSK_FS_INFO * fs, TSK_FS_DIR ** a_fs_dir,
     }
 
     info.cnid = cnid;
-    if (hfs_cat_traverse(hfs, hfs_dir_open_meta_cb, &info)) {
+    if (hfs_cat_leaf_walk(hfs, cnid, hfs_dir_open_meta_cb, &info)) {
         tsk_fs_name_free(fs_name);
         return TSK_ERR;
     }
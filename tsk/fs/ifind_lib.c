@@ -27,6 +27,7 @@
 
 #include "tsk_fs_i.h"
 #include "tsk_hfs.h"
+#include "tsk_ext2fs.h"
 
 
 /*******************************************************************************
@@ -233,8 +234,12 @@ tsk_fs_path2inum(TSK_FS_INFO * a_fs, const char *a_path,
 
         TSK_FS_DIR *fs_dir = NULL;
 
-        // open the next directory in the recursion
-        if ((fs_dir = tsk_fs_dir_open_meta(a_fs, next_meta)) == NULL) {
+        // open the next directory in the recursion.  For indexed ext
+        // directories, try to load only the leaf block with the name.
+        if (TSK_FS_TYPE_ISEXT(a_fs->ftype))
+            fs_dir = ext2fs_dir_open_name(a_fs, next_meta, cur_dir);
+        if ((fs_dir == NULL)
+            && ((fs_dir = tsk_fs_dir_open_meta(a_fs, next_meta)) == NULL)) {
             free(cpath);
             return -1;
         }
@@ -21,6 +21,12 @@
 
 #include <ctype.h>
 
+// MSVC doesn't have __builtin_ffsll
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#pragma intrinsic(_BitScanForward64)
+#endif
+
 /**
  * \file ntfs.c
  * Contains the TSK internal general NTFS processing code
@@ -118,9 +124,131 @@ nt2nano(uint64_t ntdate)
 
 
 /**
- * Read an MFT entry and save it in raw form in the given buffer.
- * NOTE: This will remove the update sequence integrity checks in the
- * structure.
+ * Check and remove the update sequence values of an MFT entry that has
+ * been read into a buffer.
+ *
+ * @param a_ntfs File system the entry is from
+ * @param a_buf Buffer with the raw entry.  Must be of size NTFS_INFO.mft_rsize_b
+ *
+ * @returns Error value
+ */
+static TSK_RETVAL_ENUM
+ntfs_mft_fixup(NTFS_INFO * a_ntfs, char *a_buf)
+{
+    int i;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
+    ntfs_upd *upd;
+    uint16_t sig_seq;
+    ntfs_mft *mft;
+
+    /* Sanity Check */
+#if 0
+    /* This is no longer applied because it caused too many problems
+     * with images that had 0 and 1 etc. as values.  Testing shows that
+     * even Windows XP doesn't care if entries have an invalid entry, so
+     * this is no longer checked.  The update sequence check should find
+     * corrupt entries
+     * */
+    if ((tsk_getu32(fs->endian, mft->magic) != NTFS_MFT_MAGIC)
+        && (tsk_getu32(fs->endian, mft->magic) != NTFS_MFT_MAGIC_BAAD)
+        && (tsk_getu32(fs->endian, mft->magic) != NTFS_MFT_MAGIC_ZERO)) {
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr("entry %d has an invalid MFT magic: %x",
+            mftnum, tsk_getu32(fs->endian, mft->magic));
+        return 1;
+    }
+#endif
+    /* The MFT entries have error and integrity checks in them
+     * called update sequences.  They must be checked and removed
+     * so that later functions can process the data as normal.
+     * They are located in the last 2 bytes of each 512-bytes of data.
+     *
+     * We first verify that the the 2-byte value is a give value and
+     * then replace it with what should be there
+     */
+    /* sanity check so we don't run over in the next loop */
+    mft = (ntfs_mft *) a_buf;
+    if ((tsk_getu16(fs->endian, mft->upd_cnt) > 0) &&
+        (((uint32_t) (tsk_getu16(fs->endian,
+                        mft->upd_cnt) - 1) * NTFS_UPDATE_SEQ_STRIDE) >
+            a_ntfs->mft_rsize_b)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("dinode_lookup: More Update Sequence Entries than MFT size");
+        return TSK_COR;
+    }
+    if (tsk_getu16(fs->endian, mft->upd_off) + 
+            sizeof(ntfs_upd) + 
+            2*(tsk_getu16(fs->endian, mft->upd_cnt) - 1) > a_ntfs->mft_rsize_b) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("dinode_lookup: Update sequence would read past MFT size");
+        return TSK_COR;
+    }
+
+    /* Apply the update sequence structure template */
+    upd =
+        (ntfs_upd *) ((uintptr_t) a_buf + tsk_getu16(fs->endian,
+            mft->upd_off));
+    /* Get the sequence value that each 16-bit value should be */
+    sig_seq = tsk_getu16(fs->endian, upd->upd_val);
+    /* cycle through each sector */
+    for (i = 1; i < tsk_getu16(fs->endian, mft->upd_cnt); i++) {
+        uint8_t *new_val, *old_val;
+        /* The offset into the buffer of the value to analyze */
+        size_t offset = i * NTFS_UPDATE_SEQ_STRIDE - 2;
+
+        /* Check that there is room in the buffer to read the current sequence value */
+        if (offset + 2 > a_ntfs->mft_rsize_b) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+            ("dinode_lookup: Ran out of data while parsing update sequence values");
+            return TSK_COR;
+        }
+
+        /* get the current sequence value */
+        uint16_t cur_seq =
+            tsk_getu16(fs->endian, (uintptr_t) a_buf + offset);
+        if (cur_seq != sig_seq) {
+            /* get the replacement value */
+            uint16_t cur_repl =
+                tsk_getu16(fs->endian, &upd->upd_seq + (i - 1) * 2);
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+
+            tsk_error_set_errstr
+                ("Incorrect update sequence value in MFT entry\nSignature Value: 0x%"
+                PRIx16 " Actual Value: 0x%" PRIx16
+                " Replacement Value: 0x%" PRIx16
+                "\nThis is typically because of a corrupted entry",
+                sig_seq, cur_seq, cur_repl);
+            return TSK_COR;
+        }
+
+        new_val = &upd->upd_seq + (i - 1) * 2;
+        old_val = (uint8_t *) ((uintptr_t) a_buf + offset);
+        /*
+           if (tsk_verbose)
+           tsk_fprintf(stderr,
+           "ntfs_dinode_lookup: upd_seq %i   Replacing: %.4"
+           PRIx16 "   With: %.4" PRIx16 "\n", i,
+           tsk_getu16(fs->endian, old_val), tsk_getu16(fs->endian,
+           new_val));
+         */
+        *old_val++ = *new_val++;
+        *old_val = *new_val;
+    }
+
+    return TSK_OK;
+}
+
+
+/**
+ * Read an MFT entry from disk (without using the cache) and save it in
+ * raw form in the given buffer.
  *
  * @param a_ntfs File system to read from
  * @param a_buf Buffer to save raw data to.  Must be of size NTFS_INFO.mft_rsize_b
@@ -128,17 +256,13 @@ nt2nano(uint64_t ntdate)
  *
  * @returns Error value
  */
-TSK_RETVAL_ENUM
-ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
+static TSK_RETVAL_ENUM
+ntfs_dinode_read(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
 {
     TSK_OFF_T mftaddr_b, mftaddr2_b, offset;
     size_t mftaddr_len = 0;
-    int i;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
     TSK_FS_ATTR_RUN *data_run;
-    ntfs_upd *upd;
-    uint16_t sig_seq;
-    ntfs_mft *mft;
 
 
     /* sanity checks */
@@ -338,112 +462,355 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
         }
     }
 
-    /* Sanity Check */
-#if 0
-    /* This is no longer applied because it caused too many problems
-     * with images that had 0 and 1 etc. as values.  Testing shows that
-     * even Windows XP doesn't care if entries have an invalid entry, so
-     * this is no longer checked.  The update sequence check should find
-     * corrupt entries
-     * */
-    if ((tsk_getu32(fs->endian, mft->magic) != NTFS_MFT_MAGIC)
-        && (tsk_getu32(fs->endian, mft->magic) != NTFS_MFT_MAGIC_BAAD)
-        && (tsk_getu32(fs->endian, mft->magic) != NTFS_MFT_MAGIC_ZERO)) {
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr("entry %d has an invalid MFT magic: %x",
-            mftnum, tsk_getu32(fs->endian, mft->magic));
+    return ntfs_mft_fixup(a_ntfs, a_buf);
+}
+
+
+/*
+ * MFT entry cache
+ *
+ * Entries are read from $MFT in windows of consecutive entries and are
+ * kept, with their update sequences applied, in an LRU cache.  The window
+ * doubles (up to NTFS_MFT_WIN_MAX) each time the entry after the last
+ * window is needed, so that walks in MFT order end up doing large
+ * sequential reads.
+ */
+
+/*
+ * Allocate the buffers of the cache.
+ * @returns 1 if the cache cannot be used and 0 on success
+ */
+static uint8_t
+ntfs_mft_cache_alloc(NTFS_INFO * a_ntfs)
+{
+    NTFS_MFT_CACHE *cache = &a_ntfs->mft_cache;
+    size_t win_recs;
+    int32_t i;
+
+    if (cache->disabled)
         return 1;
-    }
-#endif
-    /* The MFT entries have error and integrity checks in them
-     * called update sequences.  They must be checked and removed
-     * so that later functions can process the data as normal.
-     * They are located in the last 2 bytes of each 512-bytes of data.
-     *
-     * We first verify that the the 2-byte value is a give value and
-     * then replace it with what should be there
-     */
-    /* sanity check so we don't run over in the next loop */
-    mft = (ntfs_mft *) a_buf;
-    if ((tsk_getu16(fs->endian, mft->upd_cnt) > 0) &&
-        (((uint32_t) (tsk_getu16(fs->endian,
-                        mft->upd_cnt) - 1) * NTFS_UPDATE_SEQ_STRIDE) >
-            a_ntfs->mft_rsize_b)) {
+
+    cache->cap = NTFS_MFT_CACHE_SIZE / a_ntfs->mft_rsize_b;
+    if (cache->cap < 1)
+        cache->cap = 1;
+    win_recs = NTFS_MFT_WIN_MAX / a_ntfs->mft_rsize_b;
+    if (win_recs < 1)
+        win_recs = 1;
+
+    cache->recs =
+        (char *) tsk_malloc((size_t) cache->cap * a_ntfs->mft_rsize_b);
+    cache->ents = (NTFS_MFT_CACHE_ENT *) tsk_malloc((size_t) cache->cap *
+        sizeof(NTFS_MFT_CACHE_ENT));
+    cache->buckets =
+        (int32_t *) tsk_malloc((size_t) cache->cap * sizeof(int32_t));
+    cache->win_buf = (char *) tsk_malloc(win_recs * a_ntfs->mft_rsize_b);
+    if ((cache->recs == NULL) || (cache->ents == NULL)
+        || (cache->buckets == NULL) || (cache->win_buf == NULL)) {
+        free(cache->recs);
+        free(cache->ents);
+        free(cache->buckets);
+        free(cache->win_buf);
+        cache->recs = NULL;
+        cache->ents = NULL;
+        cache->buckets = NULL;
+        cache->win_buf = NULL;
+        cache->disabled = 1;
         tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("dinode_lookup: More Update Sequence Entries than MFT size");
-        return TSK_COR;
+        return 1;
     }
-    if (tsk_getu16(fs->endian, mft->upd_off) + 
-            sizeof(ntfs_upd) + 
-            2*(tsk_getu16(fs->endian, mft->upd_cnt) - 1) > a_ntfs->mft_rsize_b) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("dinode_lookup: Update sequence would read past MFT size");
-        return TSK_COR;
+
+    for (i = 0; i < cache->cap; i++)
+        cache->buckets[i] = -1;
+    cache->count = 0;
+    cache->lru_head = cache->lru_tail = -1;
+    cache->win_start = cache->win_end = 0;
+    cache->win_recs = 0;
+    return 0;
+}
+
+/* @returns the index of a_mftnum in the cache or -1 if it is not there */
+static int32_t
+ntfs_mft_cache_find(NTFS_MFT_CACHE * a_cache, TSK_INUM_T a_mftnum)
+{
+    int32_t i;
+
+    for (i = a_cache->buckets[a_mftnum % a_cache->cap]; i != -1;
+        i = a_cache->ents[i].hnext) {
+        if (a_cache->ents[i].mftnum == a_mftnum)
+            return i;
     }
+    return -1;
+}
 
-    /* Apply the update sequence structure template */
-    upd =
-        (ntfs_upd *) ((uintptr_t) a_buf + tsk_getu16(fs->endian,
-            mft->upd_off));
-    /* Get the sequence value that each 16-bit value should be */
-    sig_seq = tsk_getu16(fs->endian, upd->upd_val);
-    /* cycle through each sector */
-    for (i = 1; i < tsk_getu16(fs->endian, mft->upd_cnt); i++) {
-        uint8_t *new_val, *old_val;
-        /* The offset into the buffer of the value to analyze */
-        size_t offset = i * NTFS_UPDATE_SEQ_STRIDE - 2;
+/* Remove entry a_idx from the LRU list */
+static void
+ntfs_mft_cache_unlink(NTFS_MFT_CACHE * a_cache, int32_t a_idx)
+{
+    NTFS_MFT_CACHE_ENT *ent = &a_cache->ents[a_idx];
 
-        /* Check that there is room in the buffer to read the current sequence value */
-        if (offset + 2 > a_ntfs->mft_rsize_b) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-            tsk_error_set_errstr
-            ("dinode_lookup: Ran out of data while parsing update sequence values");
-            return TSK_COR;
+    if (ent->prev != -1)
+        a_cache->ents[ent->prev].next = ent->next;
+    else
+        a_cache->lru_head = ent->next;
+    if (ent->next != -1)
+        a_cache->ents[ent->next].prev = ent->prev;
+    else
+        a_cache->lru_tail = ent->prev;
+}
+
+/* Add entry a_idx to the front of the LRU list */
+static void
+ntfs_mft_cache_push(NTFS_MFT_CACHE * a_cache, int32_t a_idx)
+{
+    NTFS_MFT_CACHE_ENT *ent = &a_cache->ents[a_idx];
+
+    ent->prev = -1;
+    ent->next = a_cache->lru_head;
+    if (a_cache->lru_head != -1)
+        a_cache->ents[a_cache->lru_head].prev = a_idx;
+    a_cache->lru_head = a_idx;
+    if (a_cache->lru_tail == -1)
+        a_cache->lru_tail = a_idx;
+}
+
+/*
+ * Copy an entry (with its update sequence already applied) into the
+ * cache, replacing the least recently used entry if the cache is full.
+ */
+static void
+ntfs_mft_cache_add(NTFS_INFO * a_ntfs, TSK_INUM_T a_mftnum,
+    const char *a_rec)
+{
+    NTFS_MFT_CACHE *cache = &a_ntfs->mft_cache;
+    int32_t i, *prev;
+
+    if ((i = ntfs_mft_cache_find(cache, a_mftnum)) != -1) {
+        ntfs_mft_cache_unlink(cache, i);
+    }
+    else {
+        if (cache->count < cache->cap) {
+            i = cache->count++;
+        }
+        else {
+            i = cache->lru_tail;
+            ntfs_mft_cache_unlink(cache, i);
+            for (prev = &cache->buckets[cache->ents[i].mftnum % cache->cap];
+                *prev != i; prev = &cache->ents[*prev].hnext);
+            *prev = cache->ents[i].hnext;
         }
+        cache->ents[i].mftnum = a_mftnum;
+        cache->ents[i].hnext = cache->buckets[a_mftnum % cache->cap];
+        cache->buckets[a_mftnum % cache->cap] = i;
+    }
+    ntfs_mft_cache_push(cache, i);
+    memcpy(&cache->recs[(size_t) i * a_ntfs->mft_rsize_b], a_rec,
+        a_ntfs->mft_rsize_b);
+}
 
-        /* get the current sequence value */
-        uint16_t cur_seq =
-            tsk_getu16(fs->endian, (uintptr_t) a_buf + offset);
-        if (cur_seq != sig_seq) {
-            /* get the replacement value */
-            uint16_t cur_repl =
-                tsk_getu16(fs->endian, &upd->upd_seq + (i - 1) * 2);
+/*
+ * Read the window of entries that holds a_mftnum and add the entries that
+ * have a valid update sequence to the cache.  The window is limited to
+ * the run of $MFT that holds a_mftnum.
+ *
+ * @returns 1 if the window could not be read (the entry must then be
+ * read on its own) and 0 on success
+ */
+static uint8_t
+ntfs_mft_cache_fill(NTFS_INFO * a_ntfs, TSK_INUM_T a_mftnum)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
+    NTFS_MFT_CACHE *cache = &a_ntfs->mft_cache;
+    uint32_t rsize = a_ntfs->mft_rsize_b;
+    uint32_t min_recs, max_recs, recs;
+    TSK_INUM_T start, end, inum;
+    TSK_FS_ATTR_RUN *data_run;
+    TSK_OFF_T offset, run_off, run_len = 0;
+    size_t len;
+    ssize_t cnt;
+
+    min_recs = NTFS_MFT_WIN_MIN / rsize;
+    if (min_recs < 1)
+        min_recs = 1;
+    max_recs = NTFS_MFT_WIN_MAX / rsize;
+    if (max_recs < min_recs)
+        max_recs = min_recs;
+
+    /* Grow the window if the entries are being read in order */
+    if ((cache->win_recs) && (a_mftnum >= cache->win_end)
+        && (a_mftnum < cache->win_end + cache->win_recs)) {
+        recs = cache->win_recs * 2;
+        if (recs > max_recs)
+            recs = max_recs;
+        start = a_mftnum;
+    }
+    else {
+        recs = min_recs;
+        start = a_mftnum - a_mftnum % min_recs;
+    }
+    end = start + recs;
+    if (end > fs->last_inum)
+        end = fs->last_inum;
+
+    /* Find the run that holds the entry */
+    offset = a_mftnum * rsize;
+    run_off = 0;
+    for (data_run = a_ntfs->mft_data->nrd.run; data_run != NULL;
+        data_run = data_run->next) {
+        if (data_run->len >= (TSK_DADDR_T) (LLONG_MAX / a_ntfs->csize_b))
+            return 1;
+        run_len = data_run->len * a_ntfs->csize_b;
+        if (offset < run_off + run_len)
+            break;
+        run_off += run_len;
+    }
+    if ((data_run == NULL) || (data_run->flags & (TSK_FS_ATTR_RUN_FLAG_SPARSE
+                | TSK_FS_ATTR_RUN_FLAG_FILLER)))
+        return 1;
+
+    /* Only keep the entries that are entirely in the run */
+    if (start < (TSK_INUM_T) ((run_off + rsize - 1) / rsize))
+        start = (TSK_INUM_T) ((run_off + rsize - 1) / rsize);
+    if (end > (TSK_INUM_T) ((run_off + run_len) / rsize))
+        end = (TSK_INUM_T) ((run_off + run_len) / rsize);
+    if ((a_mftnum < start) || (a_mftnum >= end))
+        return 1;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ntfs_mft_cache_fill: Reading MFT entries %" PRIuINUM " to %"
+            PRIuINUM "\n", start, end - 1);
+
+    len = (size_t) (end - start) * rsize;
+    cnt = tsk_fs_read(fs, data_run->addr * a_ntfs->csize_b +
+        (TSK_OFF_T) start * rsize - run_off, cache->win_buf, len);
+    if (cnt != (ssize_t) len) {
+        tsk_error_reset();
+        return 1;
+    }
+
+    for (inum = start; inum < end; inum++) {
+        char *rec = &cache->win_buf[(size_t) (inum - start) * rsize];
+        if (ntfs_mft_fixup(a_ntfs, rec) == TSK_OK)
+            ntfs_mft_cache_add(a_ntfs, inum, rec);
+        else
             tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+    }
 
-            tsk_error_set_errstr
-                ("Incorrect update sequence value in MFT entry\nSignature Value: 0x%"
-                PRIx16 " Actual Value: 0x%" PRIx16
-                " Replacement Value: 0x%" PRIx16
-                "\nThis is typically because of a corrupted entry",
-                sig_seq, cur_seq, cur_repl);
-            return TSK_COR;
-        }
+    cache->win_start = start;
+    cache->win_end = end;
+    cache->win_recs = recs;
+    return 0;
+}
 
-        new_val = &upd->upd_seq + (i - 1) * 2;
-        old_val = (uint8_t *) ((uintptr_t) a_buf + offset);
-        /*
-           if (tsk_verbose)
-           tsk_fprintf(stderr,
-           "ntfs_dinode_lookup: upd_seq %i   Replacing: %.4"
-           PRIx16 "   With: %.4" PRIx16 "\n", i,
-           tsk_getu16(fs->endian, old_val), tsk_getu16(fs->endian,
-           new_val));
-         */
-        *old_val++ = *new_val++;
-        *old_val = *new_val;
+/*
+ * Copy an MFT entry from the cache, reading its window from $MFT if
+ * it is not cached yet.
+ *
+ * @returns 1 if the entry is not in the cache (and must be read on its
+ * own) and 0 if it was copied to a_buf
+ */
+static uint8_t
+ntfs_mft_cache_get(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
+{
+    NTFS_MFT_CACHE *cache = &a_ntfs->mft_cache;
+    int32_t i;
+
+    tsk_take_lock(&a_ntfs->mft_cache_lock);
+    if ((cache->recs == NULL) && (ntfs_mft_cache_alloc(a_ntfs))) {
+        tsk_release_lock(&a_ntfs->mft_cache_lock);
+        return 1;
     }
 
-    return TSK_OK;
+    /* Entries of the last window that are not in the cache were either
+     * not valid or have since been replaced */
+    if (((i = ntfs_mft_cache_find(cache, a_mftnum)) == -1)
+        && ((cache->win_recs == 0) || (a_mftnum < cache->win_start)
+            || (a_mftnum >= cache->win_end))
+        && (ntfs_mft_cache_fill(a_ntfs, a_mftnum) == 0)) {
+        i = ntfs_mft_cache_find(cache, a_mftnum);
+    }
+
+    if (i == -1) {
+        tsk_release_lock(&a_ntfs->mft_cache_lock);
+        return 1;
+    }
+    ntfs_mft_cache_unlink(cache, i);
+    ntfs_mft_cache_push(cache, i);
+    memcpy(a_buf, &cache->recs[(size_t) i * a_ntfs->mft_rsize_b],
+        a_ntfs->mft_rsize_b);
+    tsk_release_lock(&a_ntfs->mft_cache_lock);
+    return 0;
 }
 
+/* Free the buffers of the MFT entry cache */
+static void
+ntfs_mft_cache_free(NTFS_INFO * a_ntfs)
+{
+    NTFS_MFT_CACHE *cache = &a_ntfs->mft_cache;
+
+    free(cache->recs);
+    free(cache->ents);
+    free(cache->buckets);
+    free(cache->win_buf);
+    cache->recs = NULL;
+    cache->ents = NULL;
+    cache->buckets = NULL;
+    cache->win_buf = NULL;
+}
 
 
+/**
+ * Read an MFT entry and save it in raw form in the given buffer.
+ * NOTE: This will remove the update sequence integrity checks in the
+ * structure.  Once $MFT is loaded, entries are served from the MFT entry
+ * cache.
+ *
+ * @param a_ntfs File system to read from
+ * @param a_buf Buffer to save raw data to.  Must be of size NTFS_INFO.mft_rsize_b
+ * @param a_mftnum Address of MFT entry to read
+ *
+ * @returns Error value
+ */
+TSK_RETVAL_ENUM
+ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
+
+    /* Invalid entries are never cached, so the direct read reports
+     * their errors */
+    if ((a_buf) && (a_ntfs->mft_data) && (!a_ntfs->loading_the_MFT)
+        && (a_mftnum >= fs->first_inum) && (a_mftnum < fs->last_inum)
+        && (ntfs_mft_cache_get(a_ntfs, a_buf, a_mftnum) == 0))
+        return TSK_OK;
+
+    return ntfs_dinode_read(a_ntfs, a_buf, a_mftnum);
+}
+
+
+
+/* @returns the (1-based) index of the lowest bit set in a_word, or 0 */
+static int
+ntfs_bmap_ffs(uint64_t a_word)
+{
+#if defined(__GNUC__)
+    return __builtin_ffsll(a_word);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+
+    if (_BitScanForward64(&i, a_word))
+        return i + 1;
+    return 0;
+#else
+    int i;
+
+    if (a_word == 0)
+        return 0;
+    for (i = 1; (a_word & 1) == 0; i++)
+        a_word >>= 1;
+    return i;
+#endif
+}
+
 /*
  * given a cluster, return the allocation status or
  * -1 if an error occurs
@@ -451,11 +818,6 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
 static int
 is_clustalloc(NTFS_INFO * ntfs, TSK_DADDR_T addr)
 {
-    int bits_p_clust, b;
-    TSK_DADDR_T base;
-    int8_t ret;
-    bits_p_clust = 8 * ntfs->fs_info.block_size;
-
     /* While we are loading the MFT, assume that everything
      * is allocated.  This should only be needed when we are
      * dealing with an attribute list ...
@@ -463,7 +825,7 @@ is_clustalloc(NTFS_INFO * ntfs, TSK_DADDR_T addr)
     if (ntfs->loading_the_MFT == 1) {
         return 1;
     }
-    else if (ntfs->bmap == NULL) {
+    else if (ntfs->bmap_words == NULL) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_ARG);
 
@@ -480,70 +842,55 @@ is_clustalloc(NTFS_INFO * ntfs, TSK_DADDR_T addr)
         return -1;
     }
 
-    /* identify the base cluster in the bitmap file */
-    base = addr / bits_p_clust;
-    b = (int) (addr % bits_p_clust);
-
-    tsk_take_lock(&ntfs->lock);
-
-    /* is this the same as in the cached buffer? */
-    if (base != ntfs->bmap_buf_off) {
-        TSK_DADDR_T c = base;
-        TSK_FS_ATTR_RUN *run;
-        TSK_DADDR_T fsaddr = 0;
-        ssize_t cnt;
-
-        /* get the file system address of the bitmap cluster */
-        for (run = ntfs->bmap; run; run = run->next) {
-            if (run->len <= c) {
-                c -= run->len;
-            }
-            else {
-                fsaddr = run->addr + c;
-                break;
-            }
-        }
-
-        if (fsaddr == 0) {
-            tsk_release_lock(&ntfs->lock);
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-            tsk_error_set_errstr
-                ("is_clustalloc: cluster not found in bitmap: %" PRIuDADDR
-                "", c);
-            return -1;
-        }
-        if (fsaddr > ntfs->fs_info.last_block) {
-            tsk_release_lock(&ntfs->lock);
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-            tsk_error_set_errstr
-                ("is_clustalloc: Cluster in bitmap too large for image: %"
-                PRIuDADDR, fsaddr);
-            return -1;
-        }
-        ntfs->bmap_buf_off = base;
-        cnt = tsk_fs_read_block
-            (&ntfs->fs_info, fsaddr, ntfs->bmap_buf,
-            ntfs->fs_info.block_size);
-        if (cnt != ntfs->fs_info.block_size) {
-            tsk_release_lock(&ntfs->lock);
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
-            }
-            tsk_error_set_errstr2
-                ("is_clustalloc: Error reading bitmap at %" PRIuDADDR,
-                fsaddr);
-            return -1;
-        }
+    /* $Bitmap is shorter than the volume or could not be read to the end */
+    if (addr >= ntfs->bmap_nclust) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
+        tsk_error_set_errstr
+            ("is_clustalloc: cluster not found in bitmap: %" PRIuDADDR
+            "", addr);
+        return -1;
     }
 
-    /* identify if the cluster is allocated or not */
-    ret = (isset(ntfs->bmap_buf, b)) ? 1 : 0;
+    return (ntfs->bmap_words[addr / 64] >> (addr % 64)) & 1;
+}
 
-    tsk_release_lock(&ntfs->lock);
-    return ret;
+/*
+ * Find the end of the run of clusters that starts at a_addr and that
+ * all have the same allocation status.  a_addr must be in the bitmap.
+ *
+ * @param ntfs File system
+ * @param a_addr First cluster of the run
+ * @param a_last Last cluster to consider
+ * @param a_alloc [out] Set to 1 if the run is allocated and 0 if not
+ *
+ * @returns the cluster after the run (at most a_last + 1)
+ */
+static TSK_DADDR_T
+ntfs_bmap_run_end(NTFS_INFO * ntfs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_last, int *a_alloc)
+{
+    const uint64_t *words = ntfs->bmap_words;
+    TSK_DADDR_T end, i;
+    uint64_t flip, w;
+
+    end = a_last + 1;
+    if (end > ntfs->bmap_nclust)
+        end = ntfs->bmap_nclust;
+
+    *a_alloc = (int) ((words[a_addr / 64] >> (a_addr % 64)) & 1);
+    flip = (*a_alloc) ? ~(uint64_t) 0 : 0;
+
+    /* look for the first bit that differs from the one at a_addr */
+    i = a_addr / 64;
+    w = (words[i] ^ flip) & (~(uint64_t) 0 << (a_addr % 64));
+    while (w == 0) {
+        if (++i * 64 >= end)
+            return end;
+        w = words[i] ^ flip;
+    }
+    i = i * 64 + ntfs_bmap_ffs(w) - 1;
+    return (i < end) ? i : end;
 }
 
 
@@ -868,6 +1215,52 @@ ntfs_uncompress_done(NTFS_COMP_INFO * comp)
 }
 
 
+ /**
+  * Copy a phrase token match within the uncompressed buffer.  The match
+  * can overlap the data that it creates, so 8 or 16 bytes are only copied
+  * at once when the offset allows it.  These wide copies can write up to
+  * 15 bytes past the end of the match when there is room in the buffer.
+  *
+  * @param a_buf Uncompressed buffer
+  * @param a_buf_size Size of a_buf
+  * @param a_dst Index in a_buf to copy to
+  * @param a_offset Distance back from a_dst to copy from
+  * @param a_len Number of bytes to copy
+  */
+void
+ntfs_uncompress_copy(unsigned char *a_buf, size_t a_buf_size,
+    size_t a_dst, size_t a_offset, size_t a_len)
+{
+    unsigned char *dst = &a_buf[a_dst];
+    const unsigned char *src = dst - a_offset;
+    const unsigned char *end = dst + a_len;
+
+    if (a_offset == 1) {
+        memset(dst, *src, a_len);
+        return;
+    }
+    if (a_dst + a_len + 16 <= a_buf_size) {
+        if (a_offset >= 16) {
+            do {
+                memcpy(dst, src, 16);
+                dst += 16;
+                src += 16;
+            } while (dst < end);
+            return;
+        }
+        else if (a_offset >= 8) {
+            do {
+                memcpy(dst, src, 8);
+                dst += 8;
+                src += 8;
+            } while (dst < end);
+            return;
+        }
+    }
+    while (dst < end)
+        *dst++ = *src++;
+}
+
  /**
   * Uncompress the block of data in comp->comp_buf,
   * which has a size of comp->comp_len.
@@ -880,6 +1273,8 @@ ntfs_uncompress_done(NTFS_COMP_INFO * comp)
 static uint8_t
 ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
 {
+    const unsigned char *cbuf = (const unsigned char *) comp->comp_buf;
+    unsigned char *ubuf = (unsigned char *) comp->uncomp_buf;
     size_t cl_index;
 
     tsk_error_reset();
@@ -936,20 +1331,40 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
 
         // the 4096 size seems to occur at the same times as no compression
         if ((iscomp) && (blk_size - 2 != 4096)) {
+            /* The number of bits for the start and length in the 2-byte
+             * phrase header change depending on the location in the
+             * block.  shift only grows as we move through the block, so
+             * we keep the position at which it next grows. */
+            int shift = 0;
+            size_t shift_pos = 0x10;
 
             // cycle through the block
             while (cl_index < blk_end) {
                 int a;
 
                 // get the header header
-                unsigned char header = comp->comp_buf[cl_index];
+                unsigned char header = cbuf[cl_index];
                 cl_index++;
 
                 if (tsk_verbose)
                     tsk_fprintf(stderr,
                         "ntfs_uncompress_compunit: New Tag: %x\n", header);
 
-                for (a = 0; a < 8 && cl_index < blk_end; a++) {
+                /* A tag of 0 is followed by 8 symbol tokens */
+                if ((header == 0) && (cl_index + 8 <= blk_end)
+                    && (comp->uncomp_idx + 8 <= comp->buf_size_b)
+                    && (!tsk_verbose)) {
+                    memcpy(&ubuf[comp->uncomp_idx], &cbuf[cl_index], 8);
+                    comp->uncomp_idx += 8;
+                    cl_index += 8;
+                    continue;
+                }
+
+                for (a = 0; a < 8 && cl_index < blk_end; a++, header >>= 1) {
+                    size_t pos;
+                    unsigned int offset = 0;
+                    unsigned int length = 0;
+                    uint16_t pheader;
 
                     /* Determine token type and parse appropriately. *
                      * Symbol tokens are the symbol themselves, so copy it
@@ -968,114 +1383,86 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
                                 PRIuSIZE "", comp->uncomp_idx);
                             return 1;
                         }
-                        comp->uncomp_buf[comp->uncomp_idx++] =
-                            comp->comp_buf[cl_index];
-
-                        cl_index++;
+                        ubuf[comp->uncomp_idx++] = cbuf[cl_index++];
+                        continue;
                     }
 
                     /* Otherwise, it is a phrase token, which points back
                      * to a previous sequence of bytes.
                      */
-                    else {
-                        size_t i;
-                        int shift;
-                        size_t start_position_index = 0;
-                        size_t end_position_index = 0;
-                        unsigned int offset = 0;
-                        unsigned int length = 0;
-                        uint16_t pheader;
-
-                        if (cl_index + 1 >= blk_end) {
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Phrase token index is past end of block: %d",
-                                a);
-                            return 1;
-                        }
+                    if (cl_index + 1 >= blk_end) {
+                        tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                        tsk_error_set_errstr
+                            ("ntfs_uncompress_compunit: Phrase token index is past end of block: %d",
+                            a);
+                        return 1;
+                    }
 
-                        pheader =
-                            ((((comp->comp_buf[cl_index +
-                                            1]) << 8) & 0xFF00) |
-                            (comp->comp_buf[cl_index] & 0xFF));
-                        cl_index += 2;
-
-
-                        /* The number of bits for the start and length
-                         * in the 2-byte header change depending on the
-                         * location in the compression unit.  This identifies
-                         * how many bits each has */
-                        shift = 0;
-                        for (i =
-                            comp->uncomp_idx -
-                            blk_st_uncomp - 1; i >= 0x10; i >>= 1) {
+                    pheader = (uint16_t) (cbuf[cl_index] |
+                        (cbuf[cl_index + 1] << 8));
+                    cl_index += 2;
+
+                    /* shift would be more than 12 (this includes a phrase
+                     * at the start of the block, where pos wraps) */
+                    pos = comp->uncomp_idx - blk_st_uncomp - 1;
+                    if (pos >= ((size_t) 0x10 << 12)) {
+                        for (shift = 0; pos >= 0x10; pos >>= 1)
                             shift++;
-                        }
-                        if (shift > 12) {
-                            tsk_error_reset();
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
+                        tsk_error_reset();
+                        tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                        tsk_error_set_errstr
                             ("ntfs_uncompress_compunit: Shift is too large: %d", shift);
-                            return 1;
-                        }
-
-                        //tsk_fprintf(stderr, "Start: %X  Shift: %d  UnComp_IDX %d  BlkStart: %lu  BlkIdx: %d  BlkSize: %d\n", (int)(comp->uncomp_idx - comp->blk_st - 1), shift, comp->uncomp_idx, comp->blk_st, comp->blk_idx, comp->blk_size);
-
-                        offset = (pheader >> (12 - shift)) + 1;
-                        length = (pheader & (0xFFF >> shift)) + 2;
-
-                        start_position_index = comp->uncomp_idx - offset;
-                        end_position_index = start_position_index + length;
-
-                        if (tsk_verbose)
-                            tsk_fprintf(stderr,
-                                "ntfs_uncompress_compunit: Phrase Token: %"
-                                PRIuSIZE "\t%d\t%d\t%x\n", cl_index,
-                                length, offset, pheader);
+                        return 1;
+                    }
+                    while (pos >= shift_pos) {
+                        shift++;
+                        shift_pos <<= 1;
+                    }
 
-                        /* Sanity checks on values */
-                        if (offset > comp->uncomp_idx) {
-                            tsk_error_reset();
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Phrase token offset is too large:  %d (max: %"
-                                PRIuSIZE ")", offset, comp->uncomp_idx);
-                            return 1;
-                        }
-                        else if (length + start_position_index >
-                            comp->buf_size_b) {
-                            tsk_error_reset();
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Phrase token length is too large:  %d (max: %" PRIuSIZE")",
-                                length,
-                                comp->buf_size_b - start_position_index);
-                            return 1;
-                        }
-                        else if (end_position_index -
-                            start_position_index + 1 >
-                            comp->buf_size_b - comp->uncomp_idx) {
-                            tsk_error_reset();
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Phrase token length is too large for rest of uncomp buf:  %" PRIuSIZE" (max: %"
-                                PRIuSIZE ")",
-                                end_position_index - start_position_index +
-                                1, comp->buf_size_b - comp->uncomp_idx);
-                            return 1;
-                        }
+                    offset = (pheader >> (12 - shift)) + 1;
+                    length = (pheader & (0xFFF >> shift)) + 2;
 
-                        for (;
-                            start_position_index <= end_position_index
-                            && comp->uncomp_idx < comp->buf_size_b;
-                            start_position_index++) {
+                    if (tsk_verbose)
+                        tsk_fprintf(stderr,
+                            "ntfs_uncompress_compunit: Phrase Token: %"
+                            PRIuSIZE "\t%d\t%d\t%x\n", cl_index,
+                            length, offset, pheader);
 
-                            // Copy the previous data to the current position
-                            comp->uncomp_buf[comp->uncomp_idx++]
-                                = comp->uncomp_buf[start_position_index];
-                        }
+                    /* Sanity checks on values */
+                    if (offset > comp->uncomp_idx) {
+                        tsk_error_reset();
+                        tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                        tsk_error_set_errstr
+                            ("ntfs_uncompress_compunit: Phrase token offset is too large:  %d (max: %"
+                            PRIuSIZE ")", offset, comp->uncomp_idx);
+                        return 1;
+                    }
+                    else if (length + comp->uncomp_idx - offset >
+                        comp->buf_size_b) {
+                        tsk_error_reset();
+                        tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                        tsk_error_set_errstr
+                            ("ntfs_uncompress_compunit: Phrase token length is too large:  %d (max: %" PRIuSIZE")",
+                            length,
+                            comp->buf_size_b - (comp->uncomp_idx - offset));
+                        return 1;
+                    }
+                    else if ((size_t) length + 1 >
+                        comp->buf_size_b - comp->uncomp_idx) {
+                        tsk_error_reset();
+                        tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                        tsk_error_set_errstr
+                            ("ntfs_uncompress_compunit: Phrase token length is too large for rest of uncomp buf:  %" PRIuSIZE" (max: %"
+                            PRIuSIZE ")",
+                            (size_t) length + 1,
+                            comp->buf_size_b - comp->uncomp_idx);
+                        return 1;
                     }
-                    header >>= 1;
+
+                    // Copy the previous data to the current position
+                    ntfs_uncompress_copy(ubuf, comp->buf_size_b,
+                        comp->uncomp_idx, offset, (size_t) length + 1);
+                    comp->uncomp_idx += (size_t) length + 1;
                 }               // end of loop inside of token group
 
             }                   // end of loop inside of block
@@ -1083,24 +1470,66 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
 
         // this block contains uncompressed data
         else {
-            while (cl_index < blk_end && cl_index < comp->comp_len) {
-                /* This seems to happen only with corrupt data -- such as
-                 * when an unallocated file is being processed... */
-                if (comp->uncomp_idx >= comp->buf_size_b) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                    tsk_error_set_errstr
-                        ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer (1) -- corrupt data?)");
-                    return 1;
-                }
+            size_t len = blk_end - cl_index;
 
-                // Place data in uncompression_buffer
-                comp->uncomp_buf[comp->uncomp_idx++] =
-                    comp->comp_buf[cl_index++];
+            if (blk_end > comp->comp_len)
+                len = comp->comp_len - cl_index;
+
+            /* This seems to happen only with corrupt data -- such as
+             * when an unallocated file is being processed... */
+            if (len > comp->buf_size_b - comp->uncomp_idx) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                tsk_error_set_errstr
+                    ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer (1) -- corrupt data?)");
+                return 1;
             }
+
+            // Place data in uncompression_buffer
+            memcpy(&ubuf[comp->uncomp_idx], &cbuf[cl_index], len);
+            comp->uncomp_idx += len;
+            cl_index += len;
         }
     }                           // end of loop inside of compression unit
 
+    /* Clear what the wide copies wrote past the end of the data */
+    if (comp->uncomp_idx < comp->buf_size_b) {
+        size_t len = comp->buf_size_b - comp->uncomp_idx;
+        memset(&ubuf[comp->uncomp_idx], 0, (len < 16) ? len : 16);
+    }
+
+    return 0;
+}
+
+/**
+ * Uncompress LZNT1 data that is already in memory, such as one
+ * compression unit.  This is the decoder that ntfs_proc_compunit() uses,
+ * without the reading of the clusters.
+ *
+ * @param a_in Compressed data
+ * @param a_in_len Number of bytes in a_in
+ * @param a_out Buffer to store the uncompressed data in
+ * @param a_out_size Size of a_out in bytes
+ * @param a_out_len [out] Number of bytes that were uncompressed (the rest
+ * of a_out is not set)
+ *
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_uncompress_buf(const unsigned char *a_in, size_t a_in_len,
+    unsigned char *a_out, size_t a_out_size, size_t * a_out_len)
+{
+    NTFS_COMP_INFO comp;
+
+    comp.comp_buf = (char *) a_in;
+    comp.comp_len = a_in_len;
+    comp.uncomp_buf = (char *) a_out;
+    comp.buf_size_b = a_out_size;
+    comp.uncomp_idx = 0;
+
+    if (ntfs_uncompress_compunit(&comp))
+        return 1;
+    *a_out_len = comp.uncomp_idx;
     return 0;
 }
 
@@ -1218,6 +1647,144 @@ ntfs_proc_compunit(NTFS_INFO * ntfs, NTFS_COMP_INFO * comp,
 
 
 
+/*
+ * Cache of decompressed compression units
+ *
+ * ntfs_file_read_special() is given the offset and length of each read
+ * and must decompress all of the units that the read covers.  Small reads
+ * would otherwise decompress the same unit many times, so the last units
+ * that were decompressed are kept.  Units are identified by the attribute
+ * (MFT entry, sequence, type and id) and their first cluster.
+ */
+
+/* @returns 1 if the cache entry is for the given unit */
+static int
+ntfs_compunit_cache_match(const NTFS_COMPUNIT_CACHE_ENT * a_ent,
+    const TSK_FS_ATTR * a_fs_attr, TSK_DADDR_T a_vcn)
+{
+    return ((a_ent->buf != NULL)
+        && (a_ent->vcn == a_vcn)
+        && (a_ent->addr == a_fs_attr->fs_file->meta->addr)
+        && (a_ent->seq == a_fs_attr->fs_file->meta->seq)
+        && (a_ent->type == a_fs_attr->type)
+        && (a_ent->id == a_fs_attr->id));
+}
+
+/*
+ * Copy data from a decompressed unit in the cache.
+ *
+ * @param ntfs File system
+ * @param a_fs_attr Attribute that the unit is in
+ * @param a_vcn First cluster of the unit in the attribute
+ * @param a_off Offset in the unit to start copying from
+ * @param a_buf Buffer to copy to
+ * @param a_len Maximum number of bytes to copy
+ * @param a_unit_len [out] Number of bytes of data in the unit
+ *
+ * @returns -1 if the unit is not in the cache or the number of bytes
+ * copied
+ */
+ssize_t
+ntfs_compunit_cache_read(NTFS_INFO * ntfs, const TSK_FS_ATTR * a_fs_attr,
+    TSK_DADDR_T a_vcn, size_t a_off, char *a_buf, size_t a_len,
+    size_t * a_unit_len)
+{
+    ssize_t retval = -1;
+    int i;
+
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    for (i = 0; i < NTFS_COMPUNIT_CACHE_CNT; i++) {
+        NTFS_COMPUNIT_CACHE_ENT *ent = &ntfs->comp_cache[i];
+
+        if (ntfs_compunit_cache_match(ent, a_fs_attr, a_vcn) == 0)
+            continue;
+
+        *a_unit_len = ent->len;
+        if (a_off > ent->len) {
+            retval = 0;
+        }
+        else {
+            if (a_len > ent->len - a_off)
+                a_len = ent->len - a_off;
+            memcpy(a_buf, &ent->buf[a_off], a_len);
+            retval = (ssize_t) a_len;
+        }
+        ent->used = ++ntfs->comp_cache_clock;
+        break;
+    }
+    tsk_release_lock(&ntfs->comp_cache_lock);
+    return retval;
+}
+
+/*
+ * Add a decompressed unit to the cache, replacing the least recently
+ * used one.  The unit is not cached if memory cannot be allocated.
+ */
+void
+ntfs_compunit_cache_add(NTFS_INFO * ntfs, const TSK_FS_ATTR * a_fs_attr,
+    TSK_DADDR_T a_vcn, const char *a_data, size_t a_len)
+{
+    NTFS_COMPUNIT_CACHE_ENT *ent = NULL;
+    int i;
+
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    for (i = 0; i < NTFS_COMPUNIT_CACHE_CNT; i++) {
+        NTFS_COMPUNIT_CACHE_ENT *cur = &ntfs->comp_cache[i];
+
+        if ((cur->buf == NULL)
+            || (ntfs_compunit_cache_match(cur, a_fs_attr, a_vcn))) {
+            ent = cur;
+            break;
+        }
+        if ((ent == NULL) || (cur->used < ent->used))
+            ent = cur;
+    }
+
+    if (ent->buf_size < a_len) {
+        char *buf;
+        if ((buf = (char *) tsk_realloc(ent->buf, a_len)) == NULL) {
+            free(ent->buf);
+            ent->buf = NULL;
+            ent->buf_size = 0;
+            tsk_error_reset();
+            tsk_release_lock(&ntfs->comp_cache_lock);
+            return;
+        }
+        ent->buf = buf;
+        ent->buf_size = a_len;
+    }
+    else if (ent->buf == NULL) {
+        /* a_len is 0 */
+        tsk_release_lock(&ntfs->comp_cache_lock);
+        return;
+    }
+
+    ent->addr = a_fs_attr->fs_file->meta->addr;
+    ent->seq = a_fs_attr->fs_file->meta->seq;
+    ent->type = a_fs_attr->type;
+    ent->id = a_fs_attr->id;
+    ent->vcn = a_vcn;
+    ent->len = a_len;
+    memcpy(ent->buf, a_data, a_len);
+    ent->used = ++ntfs->comp_cache_clock;
+    tsk_release_lock(&ntfs->comp_cache_lock);
+}
+
+/* Free the buffers of the compression unit cache */
+static void
+ntfs_compunit_cache_free(NTFS_INFO * ntfs)
+{
+    int i;
+
+    for (i = 0; i < NTFS_COMPUNIT_CACHE_CNT; i++) {
+        free(ntfs->comp_cache[i].buf);
+        ntfs->comp_cache[i].buf = NULL;
+        ntfs->comp_cache[i].buf_size = 0;
+    }
+}
+
+
+
 /**
  * Currently ignores the SPARSE flag
  */
@@ -1521,6 +2088,7 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
         size_t byteoffset;      // byte offset in compression unit of where we want to start reading from
         TSK_DADDR_T *comp_unit;
         uint32_t comp_unit_idx = 0;
+        TSK_DADDR_T comp_unit_vcn = 0;  // first cluster of the unit in comp_unit
         NTFS_COMP_INFO comp;
         size_t buf_idx = 0;
 
@@ -1557,16 +2125,14 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
             return len;
         }
 
-        /* Allocate the buffers and state structure */
-        if (ntfs_uncompress_setup(fs, &comp, a_fs_attr->nrd.compsize)) {
-            return -1;
-        }
+        /* The buffers and state structure are only allocated when a unit
+         * is not in the cache */
+        memset(&comp, 0, sizeof(comp));
 
         comp_unit =
             (TSK_DADDR_T *) tsk_malloc(a_fs_attr->nrd.compsize *
             sizeof(TSK_DADDR_T));
         if (comp_unit == NULL) {
-            ntfs_uncompress_done(&comp);
             return -1;
         }
 
@@ -1608,52 +2174,70 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
             for (; a < data_run_cur->len && buf_idx < a_len; a++) {
 
                 // queue up the addresses until we get a full unit
+                if (comp_unit_idx == 0)
+                    comp_unit_vcn = data_run_cur->offset + a;
                 comp_unit[comp_unit_idx++] = addr;
 
                 // time to decompress (if queue is full or this is the last block)
                 if ((comp_unit_idx == a_fs_attr->nrd.compsize)
                     || ((a == data_run_cur->len - 1)
                         && (data_run_cur->next == NULL))) {
-                    size_t cpylen;
+                    size_t cpylen, unit_len = 0;
+                    ssize_t cnt;
 
-                    // decompress the unit
-                    if (ntfs_proc_compunit(ntfs, &comp, comp_unit,
-                            comp_unit_idx)) {
-                        tsk_error_set_errstr2("%" PRIuINUM " - type: %"
-                            PRIu32 "  id: %d  Status: %s",
-                            a_fs_attr->fs_file->meta->addr,
-                            a_fs_attr->type, a_fs_attr->id,
-                            (a_fs_attr->fs_file->meta->
-                                flags & TSK_FS_META_FLAG_ALLOC) ?
-                            "Allocated" : "Deleted");
-                        free(comp_unit);
-                        ntfs_uncompress_done(&comp);
-                        return -1;
+                    // Make sure not to return more bytes than are in the file
+                    cpylen = a_len - buf_idx;
+                    if (cpylen > (a_fs_attr->size - (a_offset + buf_idx)))
+                        cpylen =
+                            (size_t) (a_fs_attr->size - (a_offset +
+                                buf_idx));
+
+                    cnt = ntfs_compunit_cache_read(ntfs, a_fs_attr,
+                        comp_unit_vcn, byteoffset, &a_buf[buf_idx], cpylen,
+                        &unit_len);
+                    if (cnt == -1) {
+                        if ((comp.uncomp_buf == NULL)
+                            && (ntfs_uncompress_setup(fs, &comp,
+                                    a_fs_attr->nrd.compsize))) {
+                            free(comp_unit);
+                            return -1;
+                        }
+
+                        // decompress the unit
+                        if (ntfs_proc_compunit(ntfs, &comp, comp_unit,
+                                comp_unit_idx)) {
+                            tsk_error_set_errstr2("%" PRIuINUM " - type: %"
+                                PRIu32 "  id: %d  Status: %s",
+                                a_fs_attr->fs_file->meta->addr,
+                                a_fs_attr->type, a_fs_attr->id,
+                                (a_fs_attr->fs_file->meta->
+                                    flags & TSK_FS_META_FLAG_ALLOC) ?
+                                "Allocated" : "Deleted");
+                            free(comp_unit);
+                            ntfs_uncompress_done(&comp);
+                            return -1;
+                        }
+                        ntfs_compunit_cache_add(ntfs, a_fs_attr,
+                            comp_unit_vcn, comp.uncomp_buf,
+                            comp.uncomp_idx);
+                        unit_len = comp.uncomp_idx;
                     }
 
                     // copy uncompressed data to the output buffer
-                    if (comp.uncomp_idx < byteoffset) {
+                    if (unit_len < byteoffset) {
 
                         // @@ ERROR
                         free(comp_unit);
                         ntfs_uncompress_done(&comp);
                         return -1;
                     }
-                    else if (comp.uncomp_idx - byteoffset <
-                        a_len - buf_idx) {
-                        cpylen = comp.uncomp_idx - byteoffset;
+                    else if (unit_len - byteoffset < cpylen) {
+                        cpylen = unit_len - byteoffset;
                     }
-                    else {
-                        cpylen = a_len - buf_idx;
-                    }
-                    // Make sure not to return more bytes than are in the file
-                    if (cpylen > (a_fs_attr->size - (a_offset + buf_idx)))
-                        cpylen =
-                            (size_t) (a_fs_attr->size - (a_offset +
-                                buf_idx));
 
-                    memcpy(&a_buf[buf_idx], &comp.uncomp_buf[byteoffset],
-                        cpylen);
+                    if (cnt == -1)
+                        memcpy(&a_buf[buf_idx],
+                            &comp.uncomp_buf[byteoffset], cpylen);
 
                     // reset this in case we need to also read from the next run
                     byteoffset = 0;
@@ -1706,6 +2290,263 @@ typedef struct {
     uint32_t newId[256];
 } NTFS_ATTRLIST_MAP;
 
+/* Run list fragments that proc_attrseq found in the extension entries
+ * of an attribute list.  Fragments for attributes that already exist
+ * are collected in this contiguous array instead of being added one
+ * at a time with tsk_fs_attr_add_run() (which scans the run list for
+ * every insert).  proc_attrlist then sorts them by attribute and
+ * starting VCN and splices each attribute's fragments into its run
+ * list in a single pass.
+ */
+typedef struct {
+    TSK_FS_ATTR *fs_attr;       // attribute that the runs belong to
+    TSK_FS_ATTR_RUN *run;       // first run of the fragment
+    TSK_FS_ATTR_RUN *run_end;   // last run of the fragment
+    TSK_DADDR_T len;            // total length of the fragment (in clusters)
+    size_t seq;                 // order that the fragment was found in
+} NTFS_RUN_FRAG;
+
+typedef struct {
+    NTFS_RUN_FRAG *frags;
+    size_t cnt;
+    size_t alloc;
+} NTFS_RUN_FRAGS;
+
+
+/**
+ * Queue a run list fragment to be merged into an attribute by
+ * ntfs_run_frags_merge().
+ *
+ * @param a_frags Fragment list to add to
+ * @param a_fs_attr Attribute that the runs belong to
+ * @param a_run Runs to add (ownership is taken by the list)
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_run_frags_add(NTFS_RUN_FRAGS * a_frags, TSK_FS_ATTR * a_fs_attr,
+    TSK_FS_ATTR_RUN * a_run)
+{
+    NTFS_RUN_FRAG *frag;
+
+    if (a_frags->cnt == a_frags->alloc) {
+        size_t alloc = a_frags->alloc ? a_frags->alloc * 2 : 16;
+        NTFS_RUN_FRAG *tmp = (NTFS_RUN_FRAG *) tsk_realloc(a_frags->frags,
+            alloc * sizeof(NTFS_RUN_FRAG));
+        if (tmp == NULL)
+            return 1;
+        a_frags->frags = tmp;
+        a_frags->alloc = alloc;
+    }
+
+    frag = &a_frags->frags[a_frags->cnt];
+    frag->fs_attr = a_fs_attr;
+    frag->run = a_run;
+    frag->len = a_run->len;
+    frag->seq = a_frags->cnt;
+    for (frag->run_end = a_run; frag->run_end->next;
+        frag->run_end = frag->run_end->next)
+        frag->len += frag->run_end->next->len;
+    a_frags->cnt++;
+    return 0;
+}
+
+/* Free the fragments that have not been merged and reset the list */
+static void
+ntfs_run_frags_clear(NTFS_RUN_FRAGS * a_frags)
+{
+    size_t i;
+
+    for (i = 0; i < a_frags->cnt; i++)
+        tsk_fs_attr_run_free(a_frags->frags[i].run);
+    a_frags->cnt = 0;
+}
+
+/* qsort callback: group by attribute, then order by starting VCN */
+static int
+ntfs_run_frag_compar(const void *a_left, const void *a_right)
+{
+    const NTFS_RUN_FRAG *left = (const NTFS_RUN_FRAG *) a_left;
+    const NTFS_RUN_FRAG *right = (const NTFS_RUN_FRAG *) a_right;
+
+    if (left->fs_attr != right->fs_attr)
+        return ((uintptr_t) left->fs_attr <
+            (uintptr_t) right->fs_attr) ? -1 : 1;
+    if (left->run->offset != right->run->offset)
+        return (left->run->offset < right->run->offset) ? -1 : 1;
+    if (left->seq != right->seq)
+        return (left->seq < right->seq) ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Merge the queued fragments into their attributes.  The fragments of
+ * each attribute are sorted by VCN so that they can be spliced in with
+ * one walk of the existing run list.  Fragments that do not fit into
+ * a filler or that overlap existing runs are handed to
+ * tsk_fs_attr_add_run() so that duplicates and corrupt lists are
+ * handled the same as before.
+ *
+ * @param fs File system that the attributes are from
+ * @param a_frags Fragments to merge (the list is empty on return)
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_run_frags_merge(TSK_FS_INFO * fs, NTFS_RUN_FRAGS * a_frags)
+{
+    TSK_FS_ATTR *fs_attr = NULL;
+    TSK_FS_ATTR_RUN *prev = NULL, *cur = NULL;
+    size_t i;
+
+    if (a_frags->cnt > 1)
+        qsort(a_frags->frags, a_frags->cnt, sizeof(NTFS_RUN_FRAG),
+            ntfs_run_frag_compar);
+
+    for (i = 0; i < a_frags->cnt; i++) {
+        NTFS_RUN_FRAG *frag = &a_frags->frags[i];
+        TSK_DADDR_T off = frag->run->offset;
+
+        /* start over at the head of the list for a new attribute */
+        if (frag->fs_attr != fs_attr) {
+            fs_attr = frag->fs_attr;
+            prev = NULL;
+            cur = fs_attr->nrd.run;
+        }
+
+        /* skip the runs that end before the fragment starts */
+        while ((cur) && (cur->offset + cur->len <= off)) {
+            prev = cur;
+            cur = cur->next;
+        }
+
+        /* the fragment goes after the end of the list */
+        if ((cur == NULL)
+            && ((prev == NULL) || (prev->offset + prev->len <= off))) {
+            TSK_DADDR_T end = prev ? prev->offset + prev->len : 0;
+
+            if (end < off) {
+                TSK_FS_ATTR_RUN *fill_run = tsk_fs_attr_run_alloc();
+                if (fill_run == NULL)
+                    goto on_error;
+                fill_run->flags = TSK_FS_ATTR_RUN_FLAG_FILLER;
+                fill_run->offset = end;
+                fill_run->len = off - end;
+                fill_run->next = frag->run;
+                frag->run = fill_run;
+            }
+            if (prev)
+                prev->next = frag->run;
+            else
+                fs_attr->nrd.run = frag->run;
+            prev = fs_attr->nrd.run_end = frag->run_end;
+        }
+
+        /* the fragment fits inside of a filler entry */
+        else if ((cur) && (cur->flags & TSK_FS_ATTR_RUN_FLAG_FILLER)
+            && (cur->offset <= off)
+            && (off + frag->len <= cur->offset + cur->len)) {
+
+            /* keep a filler for the part before the fragment */
+            if (cur->offset < off) {
+                TSK_FS_ATTR_RUN *fill_run = tsk_fs_attr_run_alloc();
+                if (fill_run == NULL)
+                    goto on_error;
+                fill_run->flags = TSK_FS_ATTR_RUN_FLAG_FILLER;
+                fill_run->offset = cur->offset;
+                fill_run->len = off - cur->offset;
+                cur->offset = off;
+                cur->len -= fill_run->len;
+                if (prev)
+                    prev->next = fill_run;
+                else
+                    fs_attr->nrd.run = fill_run;
+                prev = fill_run;
+            }
+
+            if (prev)
+                prev->next = frag->run;
+            else
+                fs_attr->nrd.run = frag->run;
+
+            /* replace the filler or shrink it to what is left */
+            if (frag->len == cur->len) {
+                frag->run_end->next = cur->next;
+                if (fs_attr->nrd.run_end == cur)
+                    fs_attr->nrd.run_end = frag->run_end;
+                free(cur);
+            }
+            else {
+                frag->run_end->next = cur;
+                cur->offset += frag->len;
+                cur->len -= frag->len;
+            }
+            prev = frag->run_end;
+            cur = prev->next;
+        }
+
+        /* let the generic code sort out everything else */
+        else {
+            /* a bad fragment only loses its own runs; keep merging
+             * the rest so that the attribute can still be read */
+            if (tsk_fs_attr_add_run(fs, fs_attr, frag->run)) {
+                if (tsk_verbose)
+                    tsk_error_print(stderr);
+                tsk_error_reset();
+                tsk_fs_attr_run_free(frag->run);
+            }
+            prev = NULL;
+            cur = fs_attr->nrd.run;
+        }
+    }
+
+    a_frags->cnt = 0;
+    return 0;
+
+  on_error:
+    // free the fragments that were not added to an attribute
+    for (; i < a_frags->cnt; i++)
+        tsk_fs_attr_run_free(a_frags->frags[i].run);
+    a_frags->cnt = 0;
+    return 1;
+}
+
+
+/**
+ * Check if the $Data runs of $MFT that have been loaded so far
+ * cover an MFT entry.  Used while $MFT is being loaded to decide when
+ * the queued fragments of its attribute list have to be merged.
+ *
+ * @param ntfs File system
+ * @param a_mftnum Entry to look for
+ * @returns 1 if the entry is in runs that are not fillers and 0 if not
+ */
+static uint8_t
+ntfs_mft_entry_mapped(NTFS_INFO * ntfs, TSK_INUM_T a_mftnum)
+{
+    TSK_FS_ATTR_RUN *data_run;
+    TSK_DADDR_T off, end;
+
+    /* ntfs_dinode_lookup() calculates the address without runs */
+    if (ntfs->mft_data == NULL)
+        return 1;
+
+    off = a_mftnum * ntfs->mft_rsize_b / ntfs->csize_b;
+    end = ((a_mftnum + 1) * ntfs->mft_rsize_b - 1) / ntfs->csize_b;
+    for (data_run = ntfs->mft_data->nrd.run; data_run;
+        data_run = data_run->next) {
+        if (data_run->offset + data_run->len <= off)
+            continue;
+        if ((data_run->offset > off)
+            || (data_run->flags & TSK_FS_ATTR_RUN_FLAG_FILLER))
+            return 0;
+        if (data_run->offset + data_run->len > end)
+            return 1;
+        // the entry crosses into the next run
+        off = data_run->offset + data_run->len;
+    }
+    return 0;
+}
+
+
 /*
  * Process an NTFS attribute sequence and load the data into data
  * structures.
@@ -1721,12 +2562,15 @@ typedef struct {
  * the attribute list attribute (if it exists) or NULL if there is no attrlist.
  * @param a_seen_inum_list List of inums that have been previously processed based on attribute lists. 
  *    Can be NULL when this is called for the first time. Should be non-NULL when this is called recursively by proc_attrlist.
+ * @param a_run_frags List to queue the runs of already known non-resident
+ * attributes on (or NULL to add them to the attribute right away).
  * @returns Error code
  */
 static TSK_RETVAL_ENUM
 ntfs_proc_attrseq(NTFS_INFO * ntfs,
     TSK_FS_FILE * fs_file, const ntfs_attr * a_attrseq, size_t len,
-    TSK_INUM_T a_attrinum, const NTFS_ATTRLIST_MAP * a_attr_map, TSK_STACK * a_seen_inum_list)
+    TSK_INUM_T a_attrinum, const NTFS_ATTRLIST_MAP * a_attr_map, TSK_STACK * a_seen_inum_list,
+    NTFS_RUN_FRAGS * a_run_frags)
 {
     const ntfs_attr *attr;
     const TSK_FS_ATTR *fs_attr_attrl = NULL;
@@ -2132,6 +2976,12 @@ ntfs_proc_attrseq(NTFS_INFO * ntfs,
                 }
 
             }
+            else if ((a_run_frags) && (fs_attr_run)) {
+                if (ntfs_run_frags_add(a_run_frags, fs_attr, fs_attr_run)) {
+                    tsk_fs_attr_run_free(fs_attr_run);
+                    return TSK_ERR;
+                }
+            }
             else {
                 if (tsk_fs_attr_add_run(fs, fs_attr, fs_attr_run)) {
                     tsk_error_errstr2_concat(" - proc_attrseq: put run");
@@ -2414,6 +3264,7 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
     NTFS_ATTRLIST_MAP *map;
     uint16_t nextid = 0;
     TSK_STACK * mftSeenList = NULL;
+    NTFS_RUN_FRAGS run_frags;
     int a;
 
     if (tsk_verbose)
@@ -2434,6 +3285,7 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
 
     /* Clear the contents of the todo buffer */
     memset(mftToDo, 0, sizeof(mftToDo));
+    memset(&run_frags, 0, sizeof(run_frags));
 
     /* Get a copy of the attribute list stream using the above action */
     load_file.left = load_file.total = (size_t) fs_attr_attrlist->size;
@@ -2573,6 +3425,21 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
             continue;
         }
 
+        /* The extension entries of $MFT are found using the runs
+         * that we have so far, so only add the queued ones once an
+         * entry is not covered by them. */
+        if ((ntfs->loading_the_MFT) && (run_frags.cnt)
+            && (ntfs_mft_entry_mapped(ntfs, mftToDo[a]) == 0)
+            && (ntfs_run_frags_merge(fs, &run_frags))) {
+            free(mft);
+            free(map);
+            free(buf);
+            free(run_frags.frags);
+            if (mftSeenList != NULL)
+                tsk_stack_free(mftSeenList);
+            return TSK_ERR;
+        }
+
         if ((retval =
                 ntfs_dinode_lookup(ntfs, (char *) mft,
                     mftToDo[a])) != TSK_OK) {
@@ -2587,6 +3454,8 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
             free(mft);
             free(map);
             free(buf);
+            ntfs_run_frags_clear(&run_frags);
+            free(run_frags.frags);
             tsk_error_errstr2_concat(" - proc_attrlist");
             return TSK_ERR;
         }
@@ -2616,6 +3485,8 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
                 free(mft);
                 free(map);
                 free(buf);
+                ntfs_run_frags_clear(&run_frags);
+                free(run_frags.frags);
                 return TSK_COR;
             }
         }
@@ -2643,6 +3514,8 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
             free(mft);
             free(map);
             free(buf);
+            ntfs_run_frags_clear(&run_frags);
+            free(run_frags.frags);
             return TSK_COR;
         }
 
@@ -2660,7 +3533,8 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
                 ntfs_proc_attrseq(ntfs, fs_file, (ntfs_attr *) ((uintptr_t)
                         mft + tsk_getu16(fs->endian, mft->attr_off)),
                     ntfs->mft_rsize_b - tsk_getu16(fs->endian,
-                        mft->attr_off), mftToDo[a], map, processed_inum_list)) != TSK_OK) {
+                        mft->attr_off), mftToDo[a], map, processed_inum_list,
+                    &run_frags)) != TSK_OK) {
 
             if (retval == TSK_COR) {
                 if (tsk_verbose)
@@ -2672,15 +3546,25 @@ ntfs_proc_attrlist(NTFS_INFO * ntfs,
             free(mft);
             free(map);
             free(buf);
+            ntfs_run_frags_clear(&run_frags);
+            free(run_frags.frags);
             if (mftSeenList != NULL)
                 tsk_stack_free(mftSeenList);
             return TSK_ERR;
         }
+
     }
 
     free(mft);
     free(map);
     free(buf);
+    if ((run_frags.cnt) && (ntfs_run_frags_merge(fs, &run_frags))) {
+        free(run_frags.frags);
+        if (mftSeenList != NULL)
+            tsk_stack_free(mftSeenList);
+        return TSK_ERR;
+    }
+    free(run_frags.frags);
     if (mftSeenList != NULL)
         tsk_stack_free(mftSeenList);
     return TSK_OK;
@@ -2799,10 +3683,13 @@ ntfs_dinode_copy(NTFS_INFO * ntfs, TSK_FS_FILE * a_fs_file, char *a_buf,
     if ((retval = ntfs_proc_attrseq(ntfs, a_fs_file, attr,
                 ntfs->mft_rsize_b - tsk_getu16(fs->endian,
                     mft->attr_off), a_fs_file->meta->addr,
-                NULL, NULL)) != TSK_OK) {
+                NULL, NULL, NULL)) != TSK_OK) {
         return retval;
     }
 
+    /* Files compressed by WOF have their data in another stream */
+    ntfs_wof_setup(a_fs_file);
+
     /* The entry has been 'used' if it has attributes */
 
     if ((a_fs_file->meta->attr == NULL)
@@ -3064,7 +3951,7 @@ ntfs_attrname_lookup(TSK_FS_INFO * fs, uint16_t type, char *name, int len)
 }
 
 
-/* Load the block bitmap $Data run  and allocate a buffer for a cache
+/* Load the block bitmap $Data run and the contents of the bitmap
  *
  * return 1 on error and 0 on success
  * */
@@ -3072,6 +3959,9 @@ static uint8_t
 ntfs_load_bmap(NTFS_INFO * ntfs)
 {
     ssize_t cnt = 0;
+    TSK_FS_ATTR_RUN *run;
+    size_t bmap_len, off;
+    TSK_OFF_T len, avail;
     ntfs_attr *attr = NULL;
     ntfs_attr *data_attr = NULL;
     TSK_FS_INFO *fs = NULL;
@@ -3131,14 +4021,6 @@ ntfs_load_bmap(NTFS_INFO * ntfs)
                 NULL, NTFS_MFT_BMAP)) != TSK_OK) {
         goto on_error;
     }
-    ntfs->bmap_buf = (char *) tsk_malloc(fs->block_size);
-    if (ntfs->bmap_buf == NULL) {
-        goto on_error;
-    }
-
-    /* Load the first cluster so that we have something there */
-    ntfs->bmap_buf_off = 0;
-
     // Check ntfs->bmap before it is accessed.
     if (ntfs->bmap == NULL) {
         goto on_error;
@@ -3151,19 +4033,75 @@ ntfs_load_bmap(NTFS_INFO * ntfs)
             "", ntfs->bmap->addr);
         goto on_error;
     }
-    cnt =
-        tsk_fs_read_block(fs,
-        ntfs->bmap->addr, ntfs->bmap_buf, fs->block_size);
-    if (cnt != fs->block_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
+
+    /* Load all of the bitmap.  It is only needed for the clusters of the
+     * volume and we can only load the part that is in the image. */
+    bmap_len = (size_t) ((fs->last_block / 64) + 1) * 8;
+    avail = 0;
+    for (run = ntfs->bmap; (run != NULL) && (avail < (TSK_OFF_T) bmap_len);
+        run = run->next) {
+        if ((run->addr == 0) || (run->addr > fs->last_block_act)
+            || (run->flags & (TSK_FS_ATTR_RUN_FLAG_SPARSE |
+                    TSK_FS_ATTR_RUN_FLAG_FILLER)))
+            break;
+        if (run->addr + run->len - 1 > fs->last_block_act) {
+            avail += (TSK_OFF_T) (fs->last_block_act - run->addr + 1) *
+                fs->block_size;
+            break;
         }
-        tsk_error_set_errstr2("ntfs_load_bmap: Error reading block at %"
+        avail += (TSK_OFF_T) run->len * fs->block_size;
+    }
+    if (avail < (TSK_OFF_T) bmap_len)
+        bmap_len = (size_t) avail;
+    if (bmap_len == 0) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr("ntfs_load_bmap: Error reading block at %"
             PRIuDADDR, ntfs->bmap->addr);
         goto on_error;
     }
 
+    if ((ntfs->bmap_words = (uint64_t *) tsk_malloc((bmap_len + 7) & ~7))
+        == NULL) {
+        goto on_error;
+    }
+
+    for (off = 0, run = ntfs->bmap; (run != NULL) && (off < bmap_len);
+        run = run->next) {
+        len = (TSK_OFF_T) run->len * fs->block_size;
+        if (len > (TSK_OFF_T) (bmap_len - off))
+            len = (TSK_OFF_T) (bmap_len - off);
+
+        cnt = tsk_fs_read(fs, (TSK_OFF_T) run->addr * fs->block_size,
+            (char *) ntfs->bmap_words + off, (size_t) len);
+        if (cnt != (ssize_t) len) {
+            /* the bitmap must at least start in the image */
+            if (off == 0) {
+                if (cnt >= 0) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_FS_READ);
+                }
+                tsk_error_set_errstr2
+                    ("ntfs_load_bmap: Error reading block at %" PRIuDADDR,
+                    run->addr);
+                goto on_error;
+            }
+            tsk_error_reset();
+            break;
+        }
+        off += (size_t) len;
+    }
+
+    ntfs->bmap_nclust = (TSK_DADDR_T) off * 8;
+    if (ntfs->bmap_nclust > fs->last_block + 1)
+        ntfs->bmap_nclust = fs->last_block + 1;
+
+    /* the bitmap is little endian, so this is only a copy on LE hosts */
+    for (off = 0; off < (bmap_len + 7) / 8; off++) {
+        ntfs->bmap_words[off] =
+            tsk_getu64(TSK_LIT_ENDIAN, &ntfs->bmap_words[off]);
+    }
+
     free (mft);
     return 0;
 
@@ -3270,7 +4208,7 @@ ntfs_sds_to_str(TSK_FS_INFO * a_fs, const ntfs_attr_sds * a_sds,
     owner_offset =
         tsk_getu32(a_fs->endian, a_sds->self_rel_sec_desc.owner);
 
-    if (((uintptr_t) & a_sds->self_rel_sec_desc + owner_offset) >
+    if (((uintptr_t) & a_sds->self_rel_sec_desc + owner_offset + 8) >
         ((uintptr_t) a_sds + tsk_getu32(a_fs->endian, a_sds->ent_size))) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
@@ -3287,7 +4225,17 @@ ntfs_sds_to_str(TSK_FS_INFO * a_fs, const ntfs_attr_sds * a_sds,
 
     // This check helps not process invalid data, which was noticed while testing
     // a failing harddrive
-    if (sid->revision == 1) {
+    if ((sid->revision == 1) && ((uintptr_t) & sid->sub_auth[0] +
+            sid->sub_auth_count * sizeof(uint32_t) >
+            (uintptr_t) a_sds + tsk_getu32(a_fs->endian,
+                a_sds->ent_size))) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ntfs_sds_to_str: owner SID larger than a_sds length");
+        return 1;
+    }
+    else if (sid->revision == 1) {
         uint64_t authority = 0;
         int i, len;
         char *sid_str_offset = NULL;
@@ -3334,20 +4282,20 @@ ntfs_sds_to_str(TSK_FS_INFO * a_fs, const ntfs_attr_sds * a_sds,
 
 
 /** \internal
- * Maps a security id value from a file to its SDS structure
+ * Returns the SDS structure that a $SII entry points to, after checking
+ * that the two agree.
  *
- * Note: This routine assumes &ntfs->sid_lock is locked by the caller.
+ * Note: This routine assumes &ntfs->sid_lock is locked by the caller
+ * or that it is called from ntfs_open.
  *
  * @param fs File system
- * @param secid Security Id to find SDS for.
+ * @param sii $SII entry
  * @returns NULL on error
  */
 static const ntfs_attr_sds *
-ntfs_get_sds(TSK_FS_INFO * fs, uint32_t secid)
+ntfs_get_sii_sds(TSK_FS_INFO * fs, const ntfs_attr_sii * sii)
 {
-    uint32_t i = 0;
     NTFS_INFO *ntfs = (NTFS_INFO *) fs;
-    ntfs_attr_sii *sii = NULL;
     ntfs_attr_sds *sds = NULL;
     uint32_t sii_secid = 0;
     uint32_t sds_secid = 0;
@@ -3359,45 +4307,15 @@ ntfs_get_sds(TSK_FS_INFO * fs, uint32_t secid)
     uint32_t sii_sds_ent_size = 0;
 
 
-    if ((fs == NULL) || (secid == 0)) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_ARG);
-        tsk_error_set_errstr("Invalid argument");
-        return NULL;
-    }
-
-
-    // Loop through all the SII entries looking for the security id matching that found in the file.
-    // This lookup is obviously O(n^2) for all n files. However, since so many files have the exact
-    // same security identifier, it is not really that bad. In reality, 100,000 files may only map to
-    // 10,000 security identifiers. Since SII entries are 0x28 bytes each and security identifiers
-    // increase incrementally, we could go directly to the entry in question ((secid * 0x28) + 256).
-    // SII entries started at 256 on Vista; however, I did not look at the starting secid for other
-    // versions of NTFS.
-    for (i = 0; i < ntfs->sii_data.used; i++) {
-        if (tsk_getu32(fs->endian,
-                ((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i].
-                key_sec_id) == secid) {
-            sii = &((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i];
-            break;
-        }
-    }
-
-    if (sii == NULL) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_GENFS);
-        tsk_error_set_errstr("ntfs_get_sds: SII entry not found (%" PRIu32
-            ")", secid);
-        return NULL;
-    }
-
     sii_secid = tsk_getu32(fs->endian, sii->key_sec_id);
     sii_sechash = tsk_getu32(fs->endian, sii->data_hash_sec_desc);
     sii_sds_file_off = tsk_getu64(fs->endian, sii->sec_desc_off);
     sii_sds_ent_size = tsk_getu32(fs->endian, sii->sec_desc_size);
 
     // Check that we do not go out of bounds.
-    if ((uint32_t) sii_sds_file_off > ntfs->sds_data.size) {
+    if ((sii_sds_file_off > ntfs->sds_data.size)
+        || (ntfs->sds_data.size - sii_sds_file_off <
+            sizeof(ntfs_attr_sds))) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_GENFS);
         tsk_error_set_errstr("ntfs_get_sds: SII offset too large (%" PRIu64
@@ -3422,8 +4340,12 @@ ntfs_get_sds(TSK_FS_INFO * fs, uint32_t secid)
 
     // Sanity check to make sure the $SII entry points to
     // the correct $SDS entry.
+    // The size of the $SDS entry is used by ntfs_sds_to_str(), so it
+    // must stay inside the buffer.
     if ((sds_secid == sii_secid) &&
         (sds_sechash == sii_sechash) && (sds_file_off == sii_sds_file_off)
+        && (tsk_getu32(fs->endian, sds->ent_size) <=
+            ntfs->sds_data.size - sii_sds_file_off)
         //&& (sds_ent_size == sii_sds_ent_size)
         ) {
         return sds;
@@ -3449,6 +4371,150 @@ ntfs_get_sds(TSK_FS_INFO * fs, uint32_t secid)
     tsk_error_set_errstr("ntfs_get_sds: Got to end w/out data");
     return NULL;
 }
+
+
+/** \internal
+ * Maps a security id value from a file to its SDS structure
+ *
+ * Note: This routine assumes &ntfs->sid_lock is locked by the caller.
+ *
+ * @param fs File system
+ * @param secid Security Id to find SDS for.
+ * @returns NULL on error
+ */
+static const ntfs_attr_sds *
+ntfs_get_sds(TSK_FS_INFO * fs, uint32_t secid)
+{
+    uint32_t i = 0;
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    ntfs_attr_sii *sii = NULL;
+
+    if ((fs == NULL) || (secid == 0)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("Invalid argument");
+        return NULL;
+    }
+
+    // Loop through all the SII entries looking for the security id matching that
+    // found in the file.  This is only used when the ID is not in ntfs->sid_map.
+    for (i = 0; i < ntfs->sii_data.used; i++) {
+        if (tsk_getu32(fs->endian,
+                ((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i].
+                key_sec_id) == secid) {
+            sii = &((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i];
+            break;
+        }
+    }
+
+    if (sii == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr("ntfs_get_sds: SII entry not found (%" PRIu32
+            ")", secid);
+        return NULL;
+    }
+
+    return ntfs_get_sii_sds(fs, sii);
+}
+
+
+/** \internal
+ * Returns the slot of a security ID in ntfs->sid_map. This is either the
+ * slot with that ID or the empty slot where it would be added.
+ *
+ * @param ntfs File system
+ * @param sec_id Security ID (must not be 0)
+ */
+static NTFS_SID_ENT *
+ntfs_sid_map_slot(NTFS_INFO * ntfs, uint32_t sec_id)
+{
+    uint32_t mask = ntfs->sid_map_size - 1;
+    // Security IDs are given out in increasing order, so the low bits
+    // spread them over the table without further hashing.
+    uint32_t i = sec_id & mask;
+
+    while ((ntfs->sid_map[i].sec_id != 0)
+        && (ntfs->sid_map[i].sec_id != sec_id))
+        i = (i + 1) & mask;
+    return &ntfs->sid_map[i];
+}
+
+
+/** \internal
+ * Resolve the owner SID of every entry in $SII and store the strings in
+ * ntfs->sid_map.  Most volumes have only a few hundred different security
+ * IDs, so this is much cheaper than finding and formatting them for every
+ * file.  Entries that cannot be resolved are stored with a NULL string.
+ *
+ * Note: This routine is called only from ntfs_load_secure.
+ *
+ * @returns 1 on error (which occurs only if malloc fails)
+ */
+static uint8_t
+ntfs_sid_map_build(NTFS_INFO * ntfs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+    ntfs_attr_sii *sii = (ntfs_attr_sii *) ntfs->sii_data.buffer;
+    uint32_t size = 16;
+    size_t i;
+
+    if (ntfs->sii_data.used == 0)
+        return 0;
+
+    // keep the table at most half full
+    while (size < 2 * ntfs->sii_data.used)
+        size <<= 1;
+    if ((ntfs->sid_map =
+            (NTFS_SID_ENT *) tsk_malloc(size * sizeof(NTFS_SID_ENT))) ==
+        NULL)
+        return 1;
+    ntfs->sid_map_size = size;
+
+    for (i = 0; i < ntfs->sii_data.used; i++) {
+        uint32_t sec_id = tsk_getu32(fs->endian, sii[i].key_sec_id);
+        const ntfs_attr_sds *sds;
+        NTFS_SID_ENT *ent;
+
+        if (sec_id == 0)
+            continue;
+
+        // only the first $SII entry for an ID is used, as in ntfs_get_sds
+        ent = ntfs_sid_map_slot(ntfs, sec_id);
+        if (ent->sec_id == sec_id)
+            continue;
+        ent->sec_id = sec_id;
+
+        if (((sds = ntfs_get_sii_sds(fs, &sii[i])) == NULL)
+            || (ntfs_sds_to_str(fs, sds, &ent->sid_str))) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "ntfs_sid_map_build: error resolving security ID %"
+                    PRIu32 ": %s\n", sec_id, tsk_error_get_errstr());
+            tsk_error_reset();
+            ent->sid_str = NULL;
+        }
+    }
+    return 0;
+}
+
+
+/** \internal
+ * Free the table of resolved owner SIDs
+ */
+static void
+ntfs_sid_map_free(NTFS_INFO * ntfs)
+{
+    uint32_t i;
+
+    if (ntfs->sid_map == NULL)
+        return;
+    for (i = 0; i < ntfs->sid_map_size; i++)
+        free(ntfs->sid_map[i].sid_str);
+    free(ntfs->sid_map);
+    ntfs->sid_map = NULL;
+    ntfs->sid_map_size = 0;
+}
 #endif
 
 /** \internal
@@ -3472,6 +4538,7 @@ ntfs_file_get_sidstr(TSK_FS_FILE * a_fs_file, char **sid_str)
     const TSK_FS_ATTR *fs_data;
     ntfs_attr_si *si;
     const ntfs_attr_sds *sds;
+    uint32_t sec_id;
     NTFS_INFO *ntfs = (NTFS_INFO *) a_fs_file->fs_info;
 
     *sid_str = NULL;
@@ -3500,11 +4567,36 @@ ntfs_file_get_sidstr(TSK_FS_FILE * a_fs_file, char **sid_str)
         return 1;
     }
 
+    sec_id = tsk_getu32(a_fs_file->fs_info->endian, si->sec_id);
+
+    // sid_map does not change after the file system is opened, so it can
+    // be read without the lock.
+    if ((ntfs->sid_map != NULL) && (sec_id != 0)) {
+        const NTFS_SID_ENT *ent = ntfs_sid_map_slot(ntfs, sec_id);
+
+        if (ent->sid_str != NULL) {
+            size_t len = strlen(ent->sid_str) + 1;
+
+            if ((*sid_str = (char *) tsk_malloc(len)) == NULL)
+                return 1;
+            memcpy(*sid_str, ent->sid_str, len);
+            return 0;
+        }
+        else if (ent->sec_id == 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr("ntfs_get_sds: SII entry not found (%"
+                PRIu32 ")", sec_id);
+            tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
+            return 1;
+        }
+        // The ID could not be resolved when the map was built. Look it
+        // up again below so that the caller gets the reason.
+    }
+
     tsk_take_lock(&ntfs->sid_lock);
     // sds points inside ntfs->sds_data, which we've just locked
-    sds =
-        ntfs_get_sds(a_fs_file->fs_info,
-        tsk_getu32(a_fs_file->fs_info->endian, si->sec_id));
+    sds = ntfs_get_sds(a_fs_file->fs_info, sec_id);
     if (!sds) {
         tsk_release_lock(&ntfs->sid_lock);
         tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
@@ -3804,7 +4896,10 @@ ntfs_load_secure(NTFS_INFO * ntfs)
     }
 
     tsk_fs_file_close(secure);
-    return 0;
+
+    // Resolve the owner SIDs now so that ntfs_file_get_sidstr() only
+    // needs a lookup in ntfs->sid_map.
+    return ntfs_sid_map_build(ntfs);
 }
 
 #endif
@@ -3851,6 +4946,8 @@ ntfs_block_walk(TSK_FS_INFO * fs,
     NTFS_INFO *ntfs = (NTFS_INFO *) fs;
     TSK_DADDR_T addr;
     TSK_FS_BLOCK *fs_block;
+    char *data_buf = NULL;
+    size_t buf_blocks;
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -3891,55 +4988,121 @@ ntfs_block_walk(TSK_FS_INFO * fs,
         return 1;
     }
 
-    /* Cycle through the blocks */
-    for (addr = a_start_blk; addr <= a_end_blk; addr++) {
-        int retval;
-        int myflags;
-
-        /* identify if the cluster is allocated or not */
-        retval = is_clustalloc(ntfs, addr);
-        if (retval == -1) {
+    buf_blocks = NTFS_BLKWALK_READ_SIZE / fs->block_size;
+    if (buf_blocks == 0)
+        buf_blocks = 1;
+    if ((a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY) == 0) {
+        if ((data_buf = (char *) tsk_malloc(buf_blocks *
+                    fs->block_size)) == NULL) {
             tsk_fs_block_free(fs_block);
             return 1;
         }
+    }
+
+    /* Cycle through the runs of clusters with the same allocation status */
+    addr = a_start_blk;
+    while (addr <= a_end_blk) {
+        TSK_DADDR_T run_end;
+        int myflags;
 
-        else if (retval == 1) {
-            myflags = TSK_FS_BLOCK_FLAG_ALLOC;
+        if ((addr < ntfs->bmap_nclust) && (ntfs->bmap_words)) {
+            int alloc;
+
+            run_end = ntfs_bmap_run_end(ntfs, addr, a_end_blk, &alloc);
+            myflags = alloc ? TSK_FS_BLOCK_FLAG_ALLOC :
+                TSK_FS_BLOCK_FLAG_UNALLOC;
         }
         else {
-            myflags = TSK_FS_BLOCK_FLAG_UNALLOC;
+            /* the cluster is not in the bitmap that we loaded */
+            int retval = is_clustalloc(ntfs, addr);
+            if (retval == -1) {
+                free(data_buf);
+                tsk_fs_block_free(fs_block);
+                return 1;
+            }
+            run_end = addr + 1;
+            myflags = (retval == 1) ? TSK_FS_BLOCK_FLAG_ALLOC :
+                TSK_FS_BLOCK_FLAG_UNALLOC;
         }
 
-        // test if we should call the callback with this one
-        if ((myflags & TSK_FS_BLOCK_FLAG_ALLOC)
-            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC)))
-            continue;
-        else if ((myflags & TSK_FS_BLOCK_FLAG_UNALLOC)
-            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC)))
+        // test if we should call the callback with this run
+        if (((myflags & TSK_FS_BLOCK_FLAG_ALLOC)
+                && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC)))
+            || ((myflags & TSK_FS_BLOCK_FLAG_UNALLOC)
+                && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC)))) {
+            addr = run_end;
             continue;
+        }
 
         if (a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY)
             myflags |= TSK_FS_BLOCK_FLAG_AONLY;
 
-        if (tsk_fs_block_get_flag(fs, fs_block, addr,
-                (TSK_FS_BLOCK_FLAG_ENUM) myflags) == NULL) {
-            tsk_error_set_errstr2
-                ("ntfs_block_walk: Error reading block at %" PRIuDADDR,
-                addr);
-            tsk_fs_block_free(fs_block);
-            return 1;
-        }
+        while (addr < run_end) {
+            size_t read_blocks = buf_blocks;
+            size_t j;
+
+            if (run_end - addr < read_blocks)
+                read_blocks = (size_t) (run_end - addr);
+
+            /* clusters that are not in the image get the usual error */
+            if (addr > fs->last_block_act) {
+                if (tsk_fs_block_get_flag(fs, fs_block, addr,
+                        (TSK_FS_BLOCK_FLAG_ENUM) myflags) == NULL) {
+                    tsk_error_set_errstr2
+                        ("ntfs_block_walk: Error reading block at %"
+                        PRIuDADDR, addr);
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
+                }
+            }
+            else if (fs->last_block_act - addr + 1 < read_blocks)
+                read_blocks = (size_t) (fs->last_block_act - addr + 1);
 
-        retval = a_action(fs_block, a_ptr);
-        if (retval == TSK_WALK_STOP) {
-            break;
-        }
-        else if (retval == TSK_WALK_ERROR) {
-            tsk_fs_block_free(fs_block);
-            return 1;
+            if (data_buf != NULL) {
+                ssize_t cnt;
+
+                cnt = tsk_fs_read_block(fs, addr, data_buf,
+                    read_blocks * fs->block_size);
+                if (cnt != (ssize_t) (read_blocks * fs->block_size)) {
+                    if (cnt >= 0) {
+                        tsk_error_reset();
+                        tsk_error_set_errno(TSK_ERR_FS_READ);
+                    }
+                    tsk_error_set_errstr2
+                        ("ntfs_block_walk: Error reading block at %"
+                        PRIuDADDR, addr);
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
+                }
+            }
+
+            for (j = 0; j < read_blocks; j++) {
+                int retval;
+
+                tsk_fs_block_set(fs, fs_block, addr + j,
+                    (TSK_FS_BLOCK_FLAG_ENUM) (myflags |
+                        TSK_FS_BLOCK_FLAG_RAW),
+                    data_buf ? &data_buf[j * fs->block_size] : NULL);
+
+                retval = a_action(fs_block, a_ptr);
+                if (retval == TSK_WALK_STOP) {
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 0;
+                }
+                else if (retval == TSK_WALK_ERROR) {
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
+                }
+            }
+            addr += read_blocks;
         }
     }
 
+    free(data_buf);
     tsk_fs_block_free(fs_block);
     return 0;
 }
@@ -4891,39 +6054,6 @@ ntfs_istat(TSK_FS_INFO * fs, TSK_FS_ISTAT_FLAG_ENUM istat_flags, FILE * hFile,
 
 
 
-/* JOURNAL CODE - MOVE TO NEW FILE AT SOME POINT */
-
-static uint8_t
-ntfs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
-{
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
-    tsk_error_set_errstr("NTFS Journal is not yet supported\n");
-    return 1;
-}
-
-static uint8_t
-ntfs_jentry_walk(TSK_FS_INFO * fs, int flags,
-    TSK_FS_JENTRY_WALK_CB a_action, void *ptr)
-{
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
-    tsk_error_set_errstr("NTFS Journal is not yet supported\n");
-    return 1;
-}
-
-
-static uint8_t
-ntfs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start,
-    TSK_DADDR_T end, int flags, TSK_FS_JBLK_WALK_CB a_action, void *ptr)
-{
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
-    tsk_error_set_errstr("NTFS Journal is not yet supported\n");
-    return 1;
-}
-
-
 static TSK_FS_ATTR_TYPE_ENUM
 ntfs_get_default_attr_type(const TSK_FS_FILE * a_file)
 {
@@ -4954,19 +6084,26 @@ ntfs_close(TSK_FS_INFO * fs)
     free(ntfs->sds_data.buffer);
     ntfs->sds_data.buffer = NULL;
 
+    ntfs_sid_map_free(ntfs);
 #endif
 
     fs->tag = 0;
     free(ntfs->fs);
     tsk_fs_attr_run_free(ntfs->bmap);
-    free(ntfs->bmap_buf);
+    free(ntfs->bmap_words);
     tsk_fs_file_close(ntfs->mft_file);
 
     if (ntfs->orphan_map)
         ntfs_orphan_map_free(ntfs);
 
-    tsk_deinit_lock(&ntfs->lock);
+    ntfs_mft_cache_free(ntfs);
+    ntfs_compunit_cache_free(ntfs);
+    ntfs_wof_free(ntfs);
+    ntfs_loginfo_free(ntfs);
+
     tsk_deinit_lock(&ntfs->orphan_map_lock);
+    tsk_deinit_lock(&ntfs->mft_cache_lock);
+    tsk_deinit_lock(&ntfs->comp_cache_lock);
 #if TSK_USE_SID
     tsk_deinit_lock(&ntfs->sid_lock);
 #endif
@@ -5026,7 +6163,7 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
 
     ntfs->loading_the_MFT = 0;
     ntfs->bmap = NULL;
-    ntfs->bmap_buf = NULL;
+    ntfs->bmap_words = NULL;
 
     /* Read the boot sector */
     len = roundup(sizeof(ntfs_sb), img_info->sector_size);
@@ -5193,13 +6330,14 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     fs->jblk_walk = ntfs_jblk_walk;
     fs->jentry_walk = ntfs_jentry_walk;
     fs->jopen = ntfs_jopen;
-    fs->journ_inum = 0;
+    fs->journ_inum = NTFS_MFT_LOG;
 
 
 
     // set up locks
-    tsk_init_lock(&ntfs->lock);
     tsk_init_lock(&ntfs->orphan_map_lock);
+    tsk_init_lock(&ntfs->mft_cache_lock);
+    tsk_init_lock(&ntfs->comp_cache_lock);
 #if TSK_USE_SID
     tsk_init_lock(&ntfs->sid_lock);
 #endif
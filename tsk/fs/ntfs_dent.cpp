@@ -25,36 +25,65 @@
  * NTFS file name processing internal functions.
  */
 
-#include <map>
+#include <algorithm>
+#include <unordered_map>
 #include <vector>
 
+/* Size of the pieces in which $IDX_ALLOC is read into memory */
+#define NTFS_IDXALLOC_READ_SIZE (4 * 1024 * 1024)
+
+/* Directories with at least this many index records have them processed
+ * in parallel, by jobs of NTFS_IDXREC_JOB_SIZE records */
+#define NTFS_IDXREC_PAR_MIN     64
+#define NTFS_IDXREC_JOB_SIZE    32
+
 /** 
- * Class to hold the pair of MFT entry and sequence. 
+ * Class to hold a child of a directory: the MFT entry and sequence of the
+ * child and the parent directory (and its sequence) it is listed in.
  */
 class NTFS_META_ADDR {
 private:
+    uint64_t parKey; ///< Parent MFT entry and sequence (see makeKey())
     uint64_t addr; ///< MFT entry
-    uint32_t seq; ///< Sequence 
     uint32_t hash; ///< Hash of the path
+    uint16_t seq; ///< Sequence 
 
 public:
-    NTFS_META_ADDR(uint64_t a_addr, uint32_t a_seq, uint32_t a_hash) {
+    NTFS_META_ADDR(uint64_t a_parKey, uint64_t a_addr, uint16_t a_seq,
+        uint32_t a_hash) {
+        parKey = a_parKey;
         addr = a_addr;
         seq = a_seq;
         hash = a_hash;
     }
 
-    uint64_t getAddr() {
+    /**
+     * Combine a parent address and sequence in one sort key.  NTFS uses
+     * 48-bit MFT entry addresses and 16-bit sequences.
+     */
+    static uint64_t makeKey(TSK_INUM_T a_par, uint32_t a_parSeq) {
+        return ((uint64_t) a_par << 16) | (a_parSeq & 0xffff);
+    }
+
+    uint64_t getParKey() const {
+        return parKey;
+    }
+
+    uint64_t getAddr() const {
         return addr;
     }
 
-    uint32_t getSeq() {
+    uint32_t getSeq() const {
         return seq;
     }
 
-    uint32_t getHash(){
+    uint32_t getHash() const {
         return hash;
     }
+
+    bool operator<(const NTFS_META_ADDR & other) const {
+        return parKey < other.parKey;
+    }
 };
 
 
@@ -64,42 +93,80 @@ class NTFS_META_ADDR {
  * shown in Windows (when mounted).  They must have been found via the MFT entry, so 
  * we now load all parent to child relationships into the map. 
  * 
- * One of these classes is created per parent folder */
+ * The map is filled once by an inode walk.  The children are appended to
+ * a flat vector, which is then sorted by parent and parent sequence so
+ * that the children of a folder are a contiguous range found with a
+ * binary search. */
 class NTFS_PAR_MAP  {
 private:
-        // maps sequence number to list of inums for the folder at that seq.
-        std::map <uint32_t, std::vector <NTFS_META_ADDR> > seq2addrs;
+        std::vector <NTFS_META_ADDR> children;
+        bool sorted;
+
+        typedef std::vector <NTFS_META_ADDR>::const_iterator ITER;
+
+        std::pair<ITER, ITER> range (TSK_INUM_T par, uint32_t parSeq) const {
+            NTFS_META_ADDR key(NTFS_META_ADDR::makeKey(par, parSeq), 0, 0, 0);
+            return std::equal_range(children.begin(), children.end(), key);
+        }
+
 public:
+        NTFS_PAR_MAP() {
+            sorted = true;
+        }
+
         /**
-         * Add a child to this parent.
-         * @param seq Sequence of the parent that this child belonged to
+         * Add a child to a parent.  finish() must be called once all of
+         * the children have been added.
+         * @param par Address of the parent folder
+         * @param parSeq Sequence of the parent that this child belonged to
          * @param inum Address of child in the folder.
          * @param seq Sequence of child in the folder
+         * @param hash Hash of the name of the child
+         */
+        void add (TSK_INUM_T par, uint32_t parSeq, TSK_INUM_T inum,
+            uint32_t seq, uint32_t hash) {
+            NTFS_META_ADDR addr(NTFS_META_ADDR::makeKey(par, parSeq), inum,
+                (uint16_t) seq, hash);
+            children.push_back(addr);
+            sorted = false;
+        }
+
+        /**
+         * Sort the children after they have all been added.  The sort is
+         * stable so that the children of a folder stay in the order in
+         * which they were added.
          */
-        void add (uint32_t parSeq, TSK_INUM_T inum, uint32_t seq, uint32_t hash) {
-            NTFS_META_ADDR addr(inum, seq, hash);
-            seq2addrs[parSeq].push_back(addr);
+        void finish () {
+            if (sorted == false) {
+                std::stable_sort(children.begin(), children.end());
+                children.shrink_to_fit();
+                sorted = true;
+            }
         }
 
         /**
-         * Test if there are any children for this directory at a given sequence.
-         * @param seq Sequence to test.
+         * Test if there are any children for a folder at a given sequence.
+         * @param par Address of the folder
+         * @param parSeq Sequence to test.
          * @returns true if children exist
          */
-        bool exists (uint32_t seq) {
-            if (seq2addrs.count(seq) > 0) 
-                return true;
-            else
-                return false;
+        bool exists (TSK_INUM_T par, uint32_t parSeq) const {
+            std::pair<ITER, ITER> r = range(par, parSeq);
+            return r.first != r.second;
         }
 
         /** 
-         * Get the children for this folder at a given sequence.  Use exists first. 
-         * @param seq Sequence number to retrieve children for.
-         * @returns list of INUMS for children.
+         * Get the children of a folder at a given sequence.
+         * @param par Address of the folder
+         * @param parSeq Sequence number to retrieve children for.
+         * @param count Set to the number of children
+         * @returns pointer to the first child (NULL if there are none)
          */
-        std::vector <NTFS_META_ADDR> &get (uint32_t seq) {
-            return seq2addrs[seq];
+        const NTFS_META_ADDR *get (TSK_INUM_T par, uint32_t parSeq,
+            size_t &count) const {
+            std::pair<ITER, ITER> r = range(par, parSeq);
+            count = r.second - r.first;
+            return count ? &(*r.first) : NULL;
         }
  };
 
@@ -111,12 +178,12 @@ class NTFS_PAR_MAP  {
 *
 * Assumes that you already have the lock
 */
-static std::map<TSK_INUM_T, NTFS_PAR_MAP> * getParentMap(NTFS_INFO *ntfs) {
+static NTFS_PAR_MAP * getParentMap(NTFS_INFO *ntfs) {
     // allocate it if it hasn't already been 
     if (ntfs->orphan_map == NULL) {
-        ntfs->orphan_map = new std::map<TSK_INUM_T, NTFS_PAR_MAP>;
+        ntfs->orphan_map = new NTFS_PAR_MAP;
     }
-    return (std::map<TSK_INUM_T, NTFS_PAR_MAP> *)ntfs->orphan_map;
+    return (NTFS_PAR_MAP *)ntfs->orphan_map;
 }
 
 
@@ -134,9 +201,9 @@ static std::map<TSK_INUM_T, NTFS_PAR_MAP> * getParentMap(NTFS_INFO *ntfs) {
 static uint8_t
 ntfs_parent_map_add(NTFS_INFO * ntfs, TSK_FS_META_NAME_LIST *name_list, TSK_FS_META *child_meta) 
 {
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[name_list->par_inode];
-    tmpParMap.add(name_list->par_seq, child_meta->addr, child_meta->seq, tsk_fs_dir_hash(name_list->name));
+    NTFS_PAR_MAP *tmpParentMap = getParentMap(ntfs);
+    tmpParentMap->add(name_list->par_inode, name_list->par_seq,
+        child_meta->addr, child_meta->seq, tsk_fs_dir_hash(name_list->name));
     return 0;
 }
 
@@ -153,32 +220,25 @@ ntfs_parent_map_add(NTFS_INFO * ntfs, TSK_FS_META_NAME_LIST *name_list, TSK_FS_M
 static bool 
 ntfs_parent_map_exists(NTFS_INFO *ntfs, TSK_INUM_T par, uint32_t seq) 
 {
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    if (tmpParentMap->count(par) > 0) {
-        NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[par];
-        if (tmpParMap.exists(seq))
-            return true;
-    }
-    return false;
+    return getParentMap(ntfs)->exists(par, seq);
 }
 
 /** \internal
- * Look up a map entry by the parent address. You should call ntfs_parent_map_exists() before this, otherwise
- * an empty entry could be created. 
+ * Look up the children of a parent.
  *
  * Note: This routine assumes &ntfs->orphan_map_lock is locked by the caller.
  *
  * @param ntfs File system that has already been analyzed
  * @param par Parent inode to find child files for
  * @param seq Sequence of parent inode 
+ * @param count Set to the number of children
  * @returns address of children files in the parent directory
  */
-static std::vector <NTFS_META_ADDR> &
-ntfs_parent_map_get(NTFS_INFO * ntfs, TSK_INUM_T par, uint32_t seq)
+static const NTFS_META_ADDR *
+ntfs_parent_map_get(NTFS_INFO * ntfs, TSK_INUM_T par, uint32_t seq,
+    size_t &count)
 {
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[par];
-    return tmpParMap.get(seq);
+    return getParentMap(ntfs)->get(par, seq, count);
 }
 
 
@@ -200,7 +260,7 @@ ntfs_orphan_map_free(NTFS_INFO * a_ntfs)
         tsk_release_lock(&a_ntfs->orphan_map_lock);
         return;
     }
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(a_ntfs);
+    NTFS_PAR_MAP *tmpParentMap = getParentMap(a_ntfs);
 
     delete tmpParentMap;
     a_ntfs->orphan_map = NULL;
@@ -732,6 +792,288 @@ ntfs_fix_idxrec(NTFS_INFO * ntfs, ntfs_idxrec * idxrec, uint32_t len)
 
 
 
+/* Location of an index record in the $IDX_ALLOC buffer */
+typedef struct {
+    size_t off;                 ///< Offset of the record in the buffer
+    uint32_t len;               ///< Length up to the next record
+} NTFS_IDXREC_LOC;
+
+
+/*
+ * Fix up and process the index entries of one index record.
+ *
+ * @param ntfs File system
+ * @param fs_dir Directory to add the entries to
+ * @param is_del 1 if the directory is deleted
+ * @param idxrec Index record to process
+ * @param rec_len Length from the start of the record to the next record
+ * (or to the end of the buffer)
+ *
+ * @returns TSK_ERR on error, TSK_COR if the record is corrupt and TSK_OK
+ * on success
+ */
+static TSK_RETVAL_ENUM
+ntfs_proc_idxrec(NTFS_INFO * ntfs, TSK_FS_DIR * fs_dir, uint8_t is_del,
+    ntfs_idxrec * idxrec, uint32_t rec_len)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+    ntfs_idxelist *idxelist;
+    ntfs_idxentry *idxe;
+    uintptr_t rec_end = (uintptr_t) idxrec + rec_len;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ntfs_proc_idxrec: Processing index record (len: %" PRIu32
+            ")\n", rec_len);
+
+    /* remove the update sequence in the index record */
+    if (ntfs_fix_idxrec(ntfs, idxrec, rec_len))
+        return TSK_COR;
+
+    /* Locate the start of the index entry list */
+    idxelist = &idxrec->list;
+    idxe = (ntfs_idxentry *) ((uintptr_t) idxelist +
+        tsk_getu32(fs->endian, idxelist->begin_off));
+
+    /* Verify the offset pointers.  The length of the list is taken from
+     * the start of the next record rather than from bufend_off, which we
+     * don't trust. */
+    if (((uintptr_t) idxe > rec_end) ||
+        ((uintptr_t) idxelist +
+            tsk_getu32(fs->endian, idxelist->seqend_off) > rec_end)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("Error: Index list offsets are invalid on entry: %"
+            PRIuINUM, fs_dir->addr);
+        return TSK_COR;
+    }
+
+    /* process the list of index entries */
+    return ntfs_proc_idxentry(ntfs, fs_dir, is_del, idxe,
+        (uint32_t) (rec_end - (uintptr_t) idxe),
+        tsk_getu32(fs->endian, idxelist->seqend_off) -
+        tsk_getu32(fs->endian, idxelist->begin_off));
+}
+
+
+/* A group of consecutive index records processed by one parallel job */
+typedef struct {
+    TSK_FS_DIR *fs_dir;         ///< Names found in the records
+    TSK_RETVAL_ENUM retval;     ///< TSK_OK or why the job stopped
+    uint32_t t_errno;           ///< Error that stopped the job
+    char *errstr;
+    char *errstr2;
+} NTFS_IDXREC_JOB;
+
+typedef struct {
+    NTFS_INFO *ntfs;
+    TSK_INUM_T addr;
+    uint32_t seq;
+    uint8_t is_del;
+    char *idxalloc;
+    const std::vector < NTFS_IDXREC_LOC > *recs;
+    NTFS_IDXREC_JOB *jobs;
+} NTFS_IDXREC_PAR;
+
+/* tsk_parallel_for callback: process the index records of one job into
+ * the job's own TSK_FS_DIR.  The error state is per thread, so a failure
+ * is copied into the job for the caller to report. */
+static void
+ntfs_idxrec_job(size_t a_job, void *a_ptr)
+{
+    NTFS_IDXREC_PAR *par = (NTFS_IDXREC_PAR *) a_ptr;
+    NTFS_IDXREC_JOB *job = &par->jobs[a_job];
+    size_t i = a_job * NTFS_IDXREC_JOB_SIZE;
+    size_t end = i + NTFS_IDXREC_JOB_SIZE;
+
+    if (end > par->recs->size())
+        end = par->recs->size();
+
+    job->retval = TSK_OK;
+    if ((job->fs_dir = tsk_fs_dir_alloc(&par->ntfs->fs_info, par->addr,
+                64)) == NULL) {
+        job->retval = TSK_ERR;
+    }
+    else {
+        job->fs_dir->seq = par->seq;
+        for (; i < end; i++) {
+            const NTFS_IDXREC_LOC & loc = (*par->recs)[i];
+            job->retval = ntfs_proc_idxrec(par->ntfs, job->fs_dir,
+                par->is_del, (ntfs_idxrec *) & par->idxalloc[loc.off],
+                loc.len);
+            if (job->retval != TSK_OK)
+                break;
+        }
+    }
+
+    if (job->retval != TSK_OK) {
+        job->t_errno = tsk_error_get_errno();
+        job->errstr = strdup(tsk_error_get_errstr());
+        job->errstr2 = strdup(tsk_error_get_errstr2());
+    }
+}
+
+/*
+ * Move the names found by the parallel jobs into a_fs_dir.  This gives
+ * the same result as calling tsk_fs_dir_add() for each name in order,
+ * but finds duplicates with a hash table instead of scanning the
+ * directory for every name.  The moved names are left empty in the job
+ * directories.
+ *
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+ntfs_idxrec_merge(TSK_FS_DIR * a_fs_dir, NTFS_IDXREC_JOB * a_jobs,
+    size_t a_job_cnt)
+{
+    std::unordered_multimap < uint64_t, size_t > names;
+    size_t total = a_fs_dir->names_used;
+
+    for (size_t j = 0; j < a_job_cnt && a_jobs[j].fs_dir; j++)
+        total += a_jobs[j].fs_dir->names_used;
+    if (tsk_fs_dir_realloc(a_fs_dir, total))
+        return 1;
+
+    names.reserve(total);
+    for (size_t i = 0; i < a_fs_dir->names_used; i++) {
+        TSK_FS_NAME *fs_name = &a_fs_dir->names[i];
+        names.insert(std::make_pair(((uint64_t) fs_name->meta_addr << 32) ^
+                tsk_fs_dir_hash(fs_name->name), i));
+    }
+
+    for (size_t j = 0; j < a_job_cnt && a_jobs[j].fs_dir; j++) {
+        TSK_FS_DIR *src_dir = a_jobs[j].fs_dir;
+
+        for (size_t i = 0; i < src_dir->names_used; i++) {
+            TSK_FS_NAME *src = &src_dir->names[i];
+            TSK_FS_NAME *dest = NULL;
+            uint64_t key = ((uint64_t) src->meta_addr << 32) ^
+                tsk_fs_dir_hash(src->name);
+            bool dup = false;
+
+            auto range = names.equal_range(key);
+            for (auto it = range.first; it != range.second; ++it) {
+                TSK_FS_NAME *cur = &a_fs_dir->names[it->second];
+                if ((cur->meta_addr != src->meta_addr) ||
+                    (strcmp(cur->name, src->name) != 0))
+                    continue;
+
+                // if the one in the list is unalloc and we have an alloc, replace it
+                dup = true;
+                if ((cur->flags & TSK_FS_NAME_FLAG_UNALLOC)
+                    && (src->flags & TSK_FS_NAME_FLAG_ALLOC)) {
+                    free(cur->name);
+                    free(cur->shrt_name);
+                    dest = cur;
+                }
+                break;
+            }
+
+            if (dup == false) {
+                names.insert(std::make_pair(key, a_fs_dir->names_used));
+                dest = &a_fs_dir->names[a_fs_dir->names_used++];
+            }
+            else if (dest == NULL) {
+                continue;
+            }
+
+            *dest = *src;
+            dest->par_addr = a_fs_dir->addr;
+            dest->par_seq = a_fs_dir->seq;
+            src->name = NULL;
+            src->name_size = 0;
+            src->shrt_name = NULL;
+            src->shrt_name_size = 0;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Process the index records in the $IDX_ALLOC buffer.  Large directories
+ * have their records split into jobs that are fixed up and parsed in
+ * parallel, each into its own TSK_FS_DIR, which are then merged in
+ * order.  Processing stops at the first corrupt record, as it does when
+ * the records are processed one at a time.
+ *
+ * @returns error, corruption, ok etc.
+ */
+static TSK_RETVAL_ENUM
+ntfs_proc_idxrecs(NTFS_INFO * ntfs, TSK_FS_DIR * fs_dir, uint8_t is_del,
+    char *idxalloc, const std::vector < NTFS_IDXREC_LOC > &recs)
+{
+    NTFS_IDXREC_PAR par;
+    size_t job_cnt;
+    TSK_RETVAL_ENUM retval = TSK_OK;
+
+    if (recs.size() < NTFS_IDXREC_PAR_MIN) {
+        for (size_t i = 0; i < recs.size(); i++) {
+            retval = ntfs_proc_idxrec(ntfs, fs_dir, is_del,
+                (ntfs_idxrec *) & idxalloc[recs[i].off], recs[i].len);
+            if (retval != TSK_OK)
+                return retval;
+        }
+        return TSK_OK;
+    }
+
+    job_cnt = (recs.size() + NTFS_IDXREC_JOB_SIZE - 1) / NTFS_IDXREC_JOB_SIZE;
+
+    par.ntfs = ntfs;
+    par.addr = fs_dir->addr;
+    par.seq = fs_dir->seq;
+    par.is_del = is_del;
+    par.idxalloc = idxalloc;
+    par.recs = &recs;
+    if ((par.jobs = (NTFS_IDXREC_JOB *) tsk_malloc(job_cnt *
+                sizeof(NTFS_IDXREC_JOB))) == NULL)
+        return TSK_ERR;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ntfs_proc_idxrecs: Processing %" PRIuSIZE
+            " index records in %" PRIuSIZE " jobs\n", recs.size(), job_cnt);
+
+    tsk_parallel_for(job_cnt, ntfs_idxrec_job, &par);
+
+    /* The names of the jobs after the first one that stopped are not
+     * used, because they would not have been processed serially */
+    size_t used_cnt;
+    for (used_cnt = 0; used_cnt < job_cnt; used_cnt++) {
+        if (par.jobs[used_cnt].retval != TSK_OK) {
+            retval = par.jobs[used_cnt].retval;
+            used_cnt++;
+            break;
+        }
+    }
+
+    if (ntfs_idxrec_merge(fs_dir, par.jobs, used_cnt)) {
+        retval = TSK_ERR;
+    }
+    else if (retval != TSK_OK) {
+        NTFS_IDXREC_JOB *job = &par.jobs[used_cnt - 1];
+
+        tsk_error_reset();
+        tsk_error_set_errno(job->t_errno);
+        if (job->errstr)
+            tsk_error_set_errstr("%s", job->errstr);
+        if (job->errstr2)
+            tsk_error_set_errstr2("%s", job->errstr2);
+    }
+
+    for (size_t j = 0; j < job_cnt; j++) {
+        tsk_fs_dir_close(par.jobs[j].fs_dir);
+        free(par.jobs[j].errstr);
+        free(par.jobs[j].errstr2);
+    }
+    free(par.jobs);
+    return retval;
+}
+
+
+
+
 /** \internal
 * Process a directory and load up FS_DIR with the entries. If a pointer to
 * an already allocated FS_DIR structure is given, it will be cleared.  If no existing
@@ -757,9 +1099,8 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
     ntfs_idxentry *idxe;
     ntfs_idxroot *idxroot;
     ntfs_idxelist *idxelist;
-    ntfs_idxrec *idxrec_p, *idxrec;
+    ntfs_idxrec *idxrec;
     TSK_OFF_T idxalloc_len;
-    TSK_FS_LOAD_FILE load_file;
 
     /* In this function, we will return immediately if we get an error.
      * If we get corruption though, we will record that in 'retval_final'
@@ -1012,38 +1353,44 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
         }
 
         /*
-         * Copy the index allocation run into a big buffer
+         * Copy the index allocation run into a big buffer.  It is read
+         * in large pieces so that each run is read from the image with
+         * as few requests as possible.
          */
         idxalloc_len = fs_attr_idx->nrd.allocsize;
         if ((idxalloc = (char *)tsk_malloc((size_t) idxalloc_len)) == NULL) {
             return TSK_ERR;
         }
 
-        /* Fill in the loading data structure */
-        load_file.total = load_file.left = (size_t) idxalloc_len;
-        load_file.cur = load_file.base = idxalloc;
-
         if (tsk_verbose)
             tsk_fprintf(stderr,
                 "ntfs_dir_open_meta: Copying $IDX_ALLOC into buffer\n");
 
-        if (tsk_fs_attr_walk(fs_attr_idx,
-                TSK_FS_FILE_WALK_FLAG_SLACK, tsk_fs_load_file_action,
-                (void *) &load_file)) {
-            free(idxalloc);
-            tsk_error_errstr2_concat(" - ntfs_dir_open_meta");
-            return TSK_COR;     // this could be an error though
-        }
+        for (TSK_OFF_T read_off = 0; read_off < idxalloc_len;) {
+            size_t read_len = NTFS_IDXALLOC_READ_SIZE;
+            ssize_t cnt;
 
-        /* Not all of the directory was copied, so we exit */
-        if (load_file.left > 0) {
-            free(idxalloc);
+            if ((TSK_OFF_T) read_len > idxalloc_len - read_off)
+                read_len = (size_t) (idxalloc_len - read_off);
 
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-            tsk_error_set_errstr("Error reading directory contents: %"
-                PRIuINUM "\n", a_addr);
-            return TSK_COR;
+            cnt = tsk_fs_attr_read(fs_attr_idx, read_off,
+                &idxalloc[read_off], read_len, TSK_FS_FILE_READ_FLAG_SLACK);
+            if (cnt < 0) {
+                free(idxalloc);
+                tsk_error_errstr2_concat(" - ntfs_dir_open_meta");
+                return TSK_COR;     // this could be an error though
+            }
+            /* Not all of the directory was copied, so we exit */
+            else if (cnt != (ssize_t) read_len) {
+                free(idxalloc);
+
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                tsk_error_set_errstr("Error reading directory contents: %"
+                    PRIuINUM "\n", a_addr);
+                return TSK_COR;
+            }
+            read_off += read_len;
         }
 
         /*
@@ -1053,27 +1400,22 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
          * not find the deleted file names.
          *
          * Therefore, we scan the big buffer looking for the index record
-         * structures.  We save a pointer to the known beginning (idxrec_p).
-         * Then we scan for the beginning of the next one (idxrec) and process
-         * everything in the middle as an ntfs_idxrec.  We can't use the
-         * size given because then we wouldn't see the deleted names
+         * structures.  Everything from the beginning of one record to
+         * the beginning of the next one (or the end of the buffer) is
+         * processed as an ntfs_idxrec.  We can't use the size given
+         * because then we wouldn't see the deleted names.
          */
-
-        /* Set the previous pointer to NULL */
-        idxrec_p = idxrec = NULL;
+        std::vector < NTFS_IDXREC_LOC > recs;
+        uint8_t scan_err = 0;
 
         /* Loop by cluster size */
         for (off = 0; off < idxalloc_len; off += ntfs->csize_b) {
-            uint32_t list_len, rec_len;
+            NTFS_IDXREC_LOC loc;
 
             // Ensure that there is enough data for an idxrec
             if (sizeof(ntfs_idxrec) > idxalloc_len - off) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-                tsk_error_set_errstr
-                    ("ntfs_dir_open_meta: Not enough data in idxalloc buffer for an idxrec.");
-                free(idxalloc);
-                return TSK_COR;
+                scan_err = 1;
+                break;
             }
 
             idxrec = (ntfs_idxrec *) & idxalloc[off];
@@ -1089,153 +1431,34 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
                     idxrec->magic) != NTFS_IDXREC_MAGIC)
                 continue;
 
+            /* the previous record ends where this one starts */
+            if (recs.empty() == false)
+                recs.back().len = (uint32_t) (off - recs.back().off);
 
-            /* idxrec_p is only NULL for the first time
-             * Set it and start again to find the next one */
-            if (idxrec_p == NULL) {
-                idxrec_p = idxrec;
-                continue;
-            }
-
-            /* Process the previous structure */
-
-            /* idxrec points to the next idxrec structure, idxrec_p
-             * points to the one we are going to process
-             */
-            rec_len =
-                (uint32_t) ((uintptr_t) idxrec - (uintptr_t) idxrec_p);
-
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "ntfs_dir_open_meta: Processing previous index record (len: %"
-                    PRIu32 ")\n", rec_len);
-
-            /* remove the update sequence in the index record */
-            if (ntfs_fix_idxrec(ntfs, idxrec_p, rec_len)) {
-                free(idxalloc);
-                return TSK_COR;
-            }
-
-            /* Locate the start of the index entry list */
-            idxelist = &idxrec_p->list;
-            idxe = (ntfs_idxentry *) ((uintptr_t) idxelist +
-                tsk_getu32(a_fs->endian, idxelist->begin_off));
-
-            /* the length from the start of the next record to where our
-             * list starts.
-             * This should be the same as bufend_off in idxelist, but we don't
-             * trust it.
-             */
-            list_len = (uint32_t) ((uintptr_t) idxrec - (uintptr_t) idxe);
-
-            /* Verify the offset pointers */
-            if (((uintptr_t) idxe > (uintptr_t) idxrec) ||
-                ((uintptr_t) idxelist +
-                    tsk_getu32(a_fs->endian,
-                        idxelist->seqend_off) > (uintptr_t) idxrec)) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-                tsk_error_set_errstr
-                    ("Error: Index list offsets are invalid on entry: %"
-                    PRIuINUM, fs_dir->fs_file->meta->addr);
-                free(idxalloc);
-                return TSK_COR;
-            }
-
-
-            /* process the list of index entries */
-            retval_tmp = ntfs_proc_idxentry(ntfs, fs_dir,
-                (fs_dir->fs_file->meta->
-                    flags & TSK_FS_META_FLAG_UNALLOC) ? 1 : 0, idxe,
-                list_len, tsk_getu32(a_fs->endian,
-                    idxelist->seqend_off) - tsk_getu32(a_fs->endian,
-                    idxelist->begin_off));
-            // stop if we get an error, record if we get corruption
-            if (retval_tmp == TSK_ERR) {
-                free(idxalloc);
-                return TSK_ERR;
-            }
-            else if (retval_tmp == TSK_COR) {
-                retval_final = TSK_COR;
-            }
-
-            /* reset the pointer to the next record */
-            idxrec_p = idxrec;
-
-        }                       /* end of cluster loop */
-
-
-        /* Process the final record */
-        if (idxrec_p) {
-            uint32_t list_len, rec_len;
-
-            /* Length from end of attribute to start of this */
-            rec_len =
-                (uint32_t) (idxalloc_len - ((uintptr_t) idxrec_p -
-                (uintptr_t) idxalloc));
-
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "ntfs_dir_open_meta: Processing final index record (len: %"
-                    PRIu32 ")\n", rec_len);
-
-            /* remove the update sequence */
-            if (ntfs_fix_idxrec(ntfs, idxrec_p, rec_len)) {
-                free(idxalloc);
-                return TSK_COR;
-            }
-
-            idxelist = &idxrec_p->list;
-            if (tsk_getu32(a_fs->endian, idxelist->begin_off) > rec_len) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-                tsk_error_set_errstr
-                    ("Error: Index list offsets are invalid on entry: %"
-                    PRIuINUM, fs_dir->fs_file->meta->addr);
-                free(idxalloc);
-                return TSK_COR;
-            }
-
-            idxe = (ntfs_idxentry *) ((uintptr_t) idxelist +
-                tsk_getu32(a_fs->endian, idxelist->begin_off));
+            loc.off = off;
+            loc.len = (uint32_t) (idxalloc_len - off);
+            recs.push_back(loc);
+        }
 
-            /* This is the length of the idx entries */
-            list_len =
-                (uint32_t) (((uintptr_t) idxalloc + idxalloc_len) -
-                (uintptr_t) idxe);
+        /* The final record is only processed if the whole buffer could
+         * be scanned */
+        if (scan_err && (recs.empty() == false))
+            recs.pop_back();
 
-            /* Verify the offset pointers */
-            if ((list_len > rec_len) ||
-                ((uintptr_t) idxelist +
-                    tsk_getu32(a_fs->endian, idxelist->seqend_off) >
-                    (uintptr_t) idxalloc + idxalloc_len)) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-                tsk_error_set_errstr
-                    ("Error: Index list offsets are invalid on entry: %"
-                    PRIuINUM, fs_dir->fs_file->meta->addr);
-                free(idxalloc);
-                return TSK_COR;
-            }
+        retval_tmp = ntfs_proc_idxrecs(ntfs, fs_dir,
+            (fs_dir->fs_file->meta->flags & TSK_FS_META_FLAG_UNALLOC) ? 1 : 0,
+            idxalloc, recs);
+        free(idxalloc);
+        if (retval_tmp != TSK_OK)
+            return retval_tmp;
 
-            /* process the list of index entries */
-            retval_tmp = ntfs_proc_idxentry(ntfs, fs_dir,
-                (fs_dir->fs_file->meta->
-                    flags & TSK_FS_META_FLAG_UNALLOC) ? 1 : 0, idxe,
-                list_len, tsk_getu32(a_fs->endian,
-                    idxelist->seqend_off) - tsk_getu32(a_fs->endian,
-                    idxelist->begin_off));
-            // stop if we get an error, record if we get corruption
-            if (retval_tmp == TSK_ERR) {
-                free(idxalloc);
-                return TSK_ERR;
-            }
-            else if (retval_tmp == TSK_COR) {
-                retval_final = TSK_COR;
-            }
+        if (scan_err) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+                ("ntfs_dir_open_meta: Not enough data in idxalloc buffer for an idxrec.");
+            return TSK_COR;
         }
-
-        free(idxalloc);
     }
 
 
@@ -1250,9 +1473,11 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
 
         if (a_fs->inode_walk(a_fs, a_fs->first_inum, a_fs->last_inum,
                 (TSK_FS_META_FLAG_ENUM)(TSK_FS_META_FLAG_UNALLOC | TSK_FS_META_FLAG_ALLOC), ntfs_parent_act, NULL)) {
+            getParentMap(ntfs)->finish();
             tsk_release_lock(&ntfs->orphan_map_lock);
             return TSK_ERR;
         }
+        getParentMap(ntfs)->finish();
     }
 
     
@@ -1275,7 +1500,8 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
     if (ntfs_parent_map_exists(ntfs, a_addr, seqToSrch)) {
         TSK_FS_NAME *fs_name;
         
-        std::vector <NTFS_META_ADDR> &childFiles = ntfs_parent_map_get(ntfs, a_addr, seqToSrch);
+        size_t childCnt;
+        const NTFS_META_ADDR *childFiles = ntfs_parent_map_get(ntfs, a_addr, seqToSrch, childCnt);
 
         if ((fs_name = tsk_fs_name_alloc(256, 0)) == NULL)
             return TSK_ERR;
@@ -1284,7 +1510,7 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
         fs_name->par_addr = a_addr;
         fs_name->par_seq = fs_dir->fs_file->meta->seq;
 
-        for (size_t a = 0; a < childFiles.size(); a++) {
+        for (size_t a = 0; a < childCnt; a++) {
             TSK_FS_FILE *fs_file_orp = NULL;
 
             /* Check if fs_dir already has an allocated entry for this
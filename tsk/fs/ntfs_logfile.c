@@ -0,0 +1,840 @@
+/*
+** ntfs_logfile
+** The Sleuth Kit
+**
+** Journal support for the NTFS $LogFile
+**
+** This software is distributed under the Common Public License 1.0
+**
+*/
+#include "tsk_fs_i.h"
+#include "tsk_ntfs.h"
+
+/**
+ * \file ntfs_logfile.c
+ * Contains the internal functions that list the records of the NTFS
+ * $LogFile (jls) and that show one of its pages (jcat).
+ *
+ * The log starts with two restart pages.  The restart area of the newer
+ * one has the size of the record pages, where the records start in a
+ * page and how many bits of an LSN are a sequence number.  The other bits
+ * of an LSN are the offset of the record in the log divided by 8.
+ *
+ * The record pages are decoded by several threads in batches, so that
+ * only one batch is in memory at a time, and the records are reported in
+ * the order that they are stored in.  Each page is decoded on its own: a
+ * record is only reported if its LSN is the offset where it was found.
+ * This skips the data of records that continue from the previous page,
+ * the pages that were never used and the copies of the last pages that
+ * are kept after the restart pages.
+ */
+
+/* Number of record pages that a thread decodes at once */
+#define NTFS_LOG_JOB_PAGES  64
+
+/* Number of jobs per thread in a batch */
+#define NTFS_LOG_BATCH_JOBS 2
+
+/* Largest page size that is accepted */
+#define NTFS_LOG_MAX_PAGE   65536
+
+
+/* A record found while decoding a page */
+typedef struct {
+    TSK_DADDR_T page;           // record page that the record starts in
+    uint32_t rec_type;          // NTFS_LOG_RECTYPE_XXX
+    uint64_t lsn;
+    uint64_t prev_lsn;
+    uint32_t trans_id;
+    uint8_t has_op;             // 1 if the fields below are set
+    uint16_t redo_op;
+    uint16_t undo_op;
+    uint16_t target_attr;
+    uint16_t lcn_cnt;
+    uint64_t target_vcn;
+    uint64_t lcn;               // first LCN (if lcn_cnt is not 0)
+} NTFS_LOG_ENTRY;
+
+/* The records found by a job */
+typedef struct {
+    NTFS_LOG_ENTRY *entries;
+    size_t cnt;
+    size_t alloc;
+    uint8_t err;
+    uint32_t t_errno;
+    char *errstr;
+    char *errstr2;
+} NTFS_LOG_RESULT;
+
+/* A batch of jobs */
+typedef struct {
+    TSK_FS_INFO *fs;
+    const NTFS_LOGINFO *loginfo;
+    TSK_DADDR_T first_page;     // first page of the batch
+    TSK_DADDR_T end_page;       // page after the last page of the log
+    NTFS_LOG_RESULT *results;   // one per job
+} NTFS_LOG_BATCH;
+
+
+/* Names of the operations in the NTFS client data */
+static const char *ntfs_log_op_names[] = {
+    "Noop",
+    "CompensationLogRecord",
+    "InitializeFileRecordSegment",
+    "DeallocateFileRecordSegment",
+    "WriteEndOfFileRecordSegment",
+    "CreateAttribute",
+    "DeleteAttribute",
+    "UpdateResidentValue",
+    "UpdateNonresidentValue",
+    "UpdateMappingPairs",
+    "DeleteDirtyClusters",
+    "SetNewAttributeSizes",
+    "AddIndexEntryRoot",
+    "DeleteIndexEntryRoot",
+    "AddIndexEntryAllocation",
+    "DeleteIndexEntryAllocation",
+    "WriteEndOfIndexBuffer",
+    "SetIndexEntryVcnRoot",
+    "SetIndexEntryVcnAllocation",
+    "UpdateFileNameRoot",
+    "UpdateFileNameAllocation",
+    "SetBitsInNonresidentBitMap",
+    "ClearBitsInNonresidentBitMap",
+    "HotFix",
+    "EndTopLevelAction",
+    "PrepareTransaction",
+    "CommitTransaction",
+    "ForgetTransaction",
+    "OpenNonresidentAttribute",
+    "OpenAttributeTableDump",
+    "AttributeNamesDump",
+    "DirtyPageTableDump",
+    "TransactionTableDump",
+    "UpdateRecordDataRoot",
+    "UpdateRecordDataAllocation",
+    "UpdateRelativeDataInIndex",
+    "UpdateRelativeDataInIndex2",
+    "ZeroEndOfFileRecord"
+};
+
+#define NTFS_LOG_OP_CNT \
+    (sizeof(ntfs_log_op_names) / sizeof(ntfs_log_op_names[0]))
+
+
+/*
+ * Apply the fixups of a restart or record page.
+ *
+ * @returns 1 if the page is not valid (it was not fully written)
+ */
+static uint8_t
+ntfs_log_fixup(TSK_FS_INFO * fs, uint8_t * page, uint32_t size)
+{
+    uint16_t upd_off = tsk_getu16(fs->endian, &page[4]);
+    uint16_t upd_cnt = tsk_getu16(fs->endian, &page[6]);
+    uint8_t *upd;
+    uint16_t i;
+
+    if ((upd_cnt == 0)
+        || ((uint32_t) (upd_cnt - 1) * NTFS_UPDATE_SEQ_STRIDE > size)
+        || ((uint32_t) upd_off + 2 * upd_cnt > size))
+        return 1;
+
+    upd = &page[upd_off];
+    for (i = 1; i < upd_cnt; i++) {
+        uint8_t *tail = &page[i * NTFS_UPDATE_SEQ_STRIDE - 2];
+
+        if ((tail[0] != upd[0]) || (tail[1] != upd[1]))
+            return 1;
+        tail[0] = upd[2 * i];
+        tail[1] = upd[2 * i + 1];
+    }
+    return 0;
+}
+
+
+/*
+ * Return the offset in the log of the record with an LSN
+ */
+static TSK_OFF_T
+ntfs_log_lsn_to_off(const NTFS_LOGINFO * loginfo, uint64_t lsn)
+{
+    return (TSK_OFF_T) ((lsn << loginfo->seq_bits) >>
+        (loginfo->seq_bits - 3));
+}
+
+
+/*
+ * Read a restart page and fill in the log settings from its restart area.
+ *
+ * @returns 1 if the page is not valid
+ */
+static uint8_t
+ntfs_log_read_rstr(TSK_FS_INFO * fs, const TSK_FS_ATTR * fs_attr,
+    TSK_OFF_T a_off, uint32_t a_size, uint8_t * buf,
+    NTFS_LOGINFO * loginfo)
+{
+    ntfs_log_rstr *rstr = (ntfs_log_rstr *) buf;
+    ntfs_log_ra *ra;
+    uint16_t ra_off;
+
+    if (tsk_fs_attr_read(fs_attr, a_off, (char *) buf, a_size,
+            TSK_FS_FILE_READ_FLAG_NONE) != (ssize_t) a_size) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "ntfs_log_read_rstr: error reading restart page at %"
+                PRIdOFF ": %s\n", a_off, tsk_error_get_errstr());
+        tsk_error_reset();
+        return 1;
+    }
+
+    if ((tsk_getu32(fs->endian, rstr->magic) != NTFS_LOG_RSTR_MAGIC)
+        || (tsk_getu32(fs->endian, rstr->sys_page_size) != a_size)
+        || (ntfs_log_fixup(fs, buf, a_size))) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "ntfs_log_read_rstr: invalid restart page at %" PRIdOFF
+                "\n", a_off);
+        return 1;
+    }
+
+    ra_off = tsk_getu16(fs->endian, rstr->ra_off);
+    if ((ra_off % 8) || ((uint32_t) ra_off + sizeof(ntfs_log_ra) > a_size)) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "ntfs_log_read_rstr: invalid restart area offset at %"
+                PRIdOFF "\n", a_off);
+        return 1;
+    }
+    ra = (ntfs_log_ra *) & buf[ra_off];
+
+    loginfo->sys_page_size = a_size;
+    loginfo->page_size = tsk_getu32(fs->endian, rstr->log_page_size);
+    loginfo->major_ver = tsk_getu16(fs->endian, rstr->major_ver);
+    loginfo->minor_ver = tsk_getu16(fs->endian, rstr->minor_ver);
+    loginfo->current_lsn = tsk_getu64(fs->endian, ra->current_lsn);
+    loginfo->seq_bits = tsk_getu32(fs->endian, ra->seq_bits);
+    loginfo->file_size = (TSK_OFF_T) tsk_getu64(fs->endian, ra->file_size);
+    loginfo->rec_hdr_len = tsk_getu16(fs->endian, ra->rec_hdr_len);
+    loginfo->data_off = tsk_getu16(fs->endian, ra->data_off);
+
+    if ((loginfo->page_size < NTFS_UPDATE_SEQ_STRIDE)
+        || (loginfo->page_size > NTFS_LOG_MAX_PAGE)
+        || (loginfo->page_size & (loginfo->page_size - 1))
+        || (loginfo->seq_bits < 3) || (loginfo->seq_bits > 63)
+        || (loginfo->file_size <= 0)
+        || (loginfo->rec_hdr_len < sizeof(ntfs_log_rec))
+        || (loginfo->data_off < sizeof(ntfs_log_rcrd))
+        || (loginfo->data_off % 8)
+        || ((uint32_t) loginfo->data_off + loginfo->rec_hdr_len >
+            loginfo->page_size)) {
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "ntfs_log_read_rstr: invalid restart area at %" PRIdOFF
+                "\n", a_off);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * \internal
+ * Load the settings in the newer of the restart pages of the $LogFile
+ * data in loginfo->fs_attr.
+ *
+ * @param fs File system
+ * @param loginfo Log to fill in (fs_attr and log_inum must be set)
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_log_load(TSK_FS_INFO * fs, NTFS_LOGINFO * loginfo)
+{
+    NTFS_LOGINFO rstr_info[2];
+    uint8_t valid[2];
+    uint32_t sys_page_size;
+    uint8_t *buf;
+    int i, best = -1;
+
+    if ((buf = (uint8_t *) tsk_malloc(NTFS_LOG_MAX_PAGE)) == NULL)
+        return 1;
+
+    /* The second restart page follows the first one, so we need the size
+     * of the first one.  Guess the usual size if it is not valid. */
+    sys_page_size = 4096;
+    if (tsk_fs_attr_read(loginfo->fs_attr, 0, (char *) buf,
+            sizeof(ntfs_log_rstr),
+            TSK_FS_FILE_READ_FLAG_NONE) == sizeof(ntfs_log_rstr)) {
+        ntfs_log_rstr *rstr = (ntfs_log_rstr *) buf;
+        uint32_t size = tsk_getu32(fs->endian, rstr->sys_page_size);
+
+        if ((tsk_getu32(fs->endian, rstr->magic) == NTFS_LOG_RSTR_MAGIC)
+            && (size >= NTFS_UPDATE_SEQ_STRIDE)
+            && (size <= NTFS_LOG_MAX_PAGE) && ((size & (size - 1)) == 0))
+            sys_page_size = size;
+    }
+    tsk_error_reset();
+
+    for (i = 0; i < 2; i++) {
+        memset(&rstr_info[i], 0, sizeof(NTFS_LOGINFO));
+        valid[i] = (ntfs_log_read_rstr(fs, loginfo->fs_attr,
+                (TSK_OFF_T) i * sys_page_size, sys_page_size, buf,
+                &rstr_info[i]) == 0);
+        if ((valid[i]) && ((best == -1)
+                || (rstr_info[i].current_lsn >
+                    rstr_info[best].current_lsn)))
+            best = i;
+    }
+    free(buf);
+
+    if (best == -1) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_MAGIC);
+        tsk_error_set_errstr("ntfs_log_load: $LogFile (%" PRIuINUM
+            ") does not have a valid restart page", loginfo->log_inum);
+        return 1;
+    }
+
+    loginfo->sys_page_size = rstr_info[best].sys_page_size;
+    loginfo->page_size = rstr_info[best].page_size;
+    loginfo->seq_bits = rstr_info[best].seq_bits;
+    loginfo->rec_hdr_len = rstr_info[best].rec_hdr_len;
+    loginfo->data_off = rstr_info[best].data_off;
+    loginfo->major_ver = rstr_info[best].major_ver;
+    loginfo->minor_ver = rstr_info[best].minor_ver;
+    loginfo->current_lsn = rstr_info[best].current_lsn;
+    loginfo->rstr_page = (TSK_DADDR_T) best * loginfo->sys_page_size /
+        loginfo->page_size;
+
+    // do not go past the end of the stream
+    loginfo->file_size = rstr_info[best].file_size;
+    if (loginfo->file_size > loginfo->fs_attr->size)
+        loginfo->file_size = loginfo->fs_attr->size;
+
+    return 0;
+}
+
+
+/**
+ * \internal
+ * Open the $LogFile and load the settings in the newer of its restart
+ * pages.
+ *
+ * @param fs File system
+ * @param inum Address of $LogFile
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    NTFS_LOGINFO *loginfo;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if (fs == NULL) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_jopen: fs is null");
+        return 1;
+    }
+
+    ntfs_loginfo_free(ntfs);
+
+    if ((loginfo =
+            (NTFS_LOGINFO *) tsk_malloc(sizeof(NTFS_LOGINFO))) == NULL)
+        return 1;
+    loginfo->log_inum = inum;
+
+    if ((loginfo->fs_file = tsk_fs_file_open_meta(fs, NULL, inum)) == NULL) {
+        free(loginfo);
+        return 1;
+    }
+
+    if ((loginfo->fs_attr = tsk_fs_file_attr_get(loginfo->fs_file)) == NULL) {
+        tsk_error_set_errstr2("ntfs_jopen: $DATA attribute of %" PRIuINUM,
+            inum);
+        ntfs->loginfo = loginfo;
+        ntfs_loginfo_free(ntfs);
+        return 1;
+    }
+
+    ntfs->loginfo = loginfo;
+    if (ntfs_log_load(fs, loginfo)) {
+        ntfs_loginfo_free(ntfs);
+        return 1;
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ntfs_jopen: $LogFile opened at inode %" PRIuINUM
+            " version: %" PRIu16 ".%" PRIu16 " page size: %" PRIu32
+            " current LSN: %" PRIu64 "\n", inum, loginfo->major_ver,
+            loginfo->minor_ver, loginfo->page_size, loginfo->current_lsn);
+
+    return 0;
+}
+
+
+/**
+ * \internal
+ * Free the data of an open $LogFile
+ */
+void
+ntfs_loginfo_free(NTFS_INFO * a_ntfs)
+{
+    if (a_ntfs->loginfo == NULL)
+        return;
+    tsk_fs_file_close(a_ntfs->loginfo->fs_file);
+    free(a_ntfs->loginfo);
+    a_ntfs->loginfo = NULL;
+}
+
+
+/*
+ * Copy client data that may continue in the next record page.
+ *
+ * @param buf Record pages of the job
+ * @param valid Flags of the pages that are valid record pages
+ * @param npages Number of pages in buf
+ * @param a_page Page where the data starts
+ * @param a_off Offset in the page where the data starts
+ * @returns number of bytes copied
+ */
+static size_t
+ntfs_log_copy(const NTFS_LOGINFO * loginfo, const uint8_t * buf,
+    const uint8_t * valid, size_t npages, size_t a_page, size_t a_off,
+    uint8_t * dst, size_t len)
+{
+    size_t done = 0;
+
+    while ((done < len) && (a_page < npages) && (valid[a_page])) {
+        size_t n;
+
+        if (a_off >= loginfo->page_size) {
+            a_page++;
+            a_off = loginfo->data_off;
+            continue;
+        }
+        n = loginfo->page_size - a_off;
+        if (n > len - done)
+            n = len - done;
+        memcpy(&dst[done], &buf[a_page * loginfo->page_size + a_off], n);
+        done += n;
+        a_off += n;
+    }
+    return done;
+}
+
+
+/*
+ * Save the error of the current thread in a job result.
+ */
+static void
+ntfs_log_save_error(NTFS_LOG_RESULT * result)
+{
+    result->err = 1;
+    result->t_errno = tsk_error_get_errno();
+    result->errstr = strdup(tsk_error_get_errstr());
+    result->errstr2 = strdup(tsk_error_get_errstr2());
+}
+
+
+/*
+ * Add a record to a job result.
+ *
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_log_add(NTFS_LOG_RESULT * result, const NTFS_LOG_ENTRY * entry)
+{
+    if (result->cnt == result->alloc) {
+        size_t alloc = result->alloc ? 2 * result->alloc : 256;
+        NTFS_LOG_ENTRY *entries;
+
+        if ((entries = (NTFS_LOG_ENTRY *) tsk_realloc(result->entries,
+                    alloc * sizeof(NTFS_LOG_ENTRY))) == NULL)
+            return 1;
+        result->entries = entries;
+        result->alloc = alloc;
+    }
+    result->entries[result->cnt++] = *entry;
+    return 0;
+}
+
+
+/*
+ * tsk_parallel_for callback: read and decode the record pages of a job.
+ * One more page is read so that the client data of a record at the end
+ * of the last page can be decoded.
+ */
+static void
+ntfs_log_decode(size_t a_idx, void *a_ptr)
+{
+    NTFS_LOG_BATCH *batch = (NTFS_LOG_BATCH *) a_ptr;
+    TSK_FS_INFO *fs = batch->fs;
+    const NTFS_LOGINFO *loginfo = batch->loginfo;
+    NTFS_LOG_RESULT *result = &batch->results[a_idx];
+    TSK_DADDR_T first = batch->first_page + a_idx * NTFS_LOG_JOB_PAGES;
+    size_t npages, nread, i;
+    uint8_t *buf, *valid;
+    ssize_t cnt;
+
+    nread = NTFS_LOG_JOB_PAGES + 1;
+    if (first + nread > batch->end_page)
+        nread = (size_t) (batch->end_page - first);
+    npages = nread;
+    if (npages > NTFS_LOG_JOB_PAGES)
+        npages = NTFS_LOG_JOB_PAGES;
+
+    if ((buf = (uint8_t *) tsk_malloc(nread * loginfo->page_size)) == NULL) {
+        ntfs_log_save_error(result);
+        return;
+    }
+    if ((valid = (uint8_t *) tsk_malloc(nread)) == NULL) {
+        ntfs_log_save_error(result);
+        free(buf);
+        return;
+    }
+
+    cnt = tsk_fs_attr_read(loginfo->fs_attr,
+        (TSK_OFF_T) first * loginfo->page_size, (char *) buf,
+        nread * loginfo->page_size, TSK_FS_FILE_READ_FLAG_NONE);
+    if (cnt != (ssize_t) (nread * loginfo->page_size)) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2("ntfs_jentry_walk: $LogFile pages %"
+            PRIuDADDR "-%" PRIuDADDR, first, first + nread - 1);
+        ntfs_log_save_error(result);
+        free(valid);
+        free(buf);
+        return;
+    }
+
+    for (i = 0; i < nread; i++) {
+        uint8_t *page = &buf[i * loginfo->page_size];
+
+        valid[i] = ((tsk_getu32(fs->endian, page) == NTFS_LOG_RCRD_MAGIC)
+            && (ntfs_log_fixup(fs, page, loginfo->page_size) == 0));
+        if ((valid[i] == 0) && (i < npages) && (tsk_verbose)
+            && (tsk_getu32(fs->endian, page) != 0)
+            && (tsk_getu32(fs->endian, page) != 0xffffffff))
+            tsk_fprintf(stderr,
+                "ntfs_log_decode: $LogFile page %" PRIuDADDR
+                " is not a valid record page\n", first + i);
+    }
+
+    for (i = 0; i < npages; i++) {
+        TSK_OFF_T page_off = (TSK_OFF_T) (first + i) * loginfo->page_size;
+        size_t off = loginfo->data_off;
+
+        if (valid[i] == 0)
+            continue;
+
+        while (off + loginfo->rec_hdr_len <= loginfo->page_size) {
+            ntfs_log_rec *rec =
+                (ntfs_log_rec *) & buf[i * loginfo->page_size + off];
+            uint64_t lsn = tsk_getu64(fs->endian, rec->this_lsn);
+            uint32_t data_len = tsk_getu32(fs->endian, rec->data_len);
+            NTFS_LOG_ENTRY entry;
+            uint64_t len;
+
+            if ((lsn == 0)
+                || (ntfs_log_lsn_to_off(loginfo, lsn) !=
+                    page_off + (TSK_OFF_T) off)
+                || (data_len > (uint64_t) loginfo->file_size)) {
+                off += 8;
+                continue;
+            }
+
+            memset(&entry, 0, sizeof(entry));
+            entry.page = first + i;
+            entry.rec_type = tsk_getu32(fs->endian, rec->rec_type);
+            entry.lsn = lsn;
+            entry.prev_lsn = tsk_getu64(fs->endian, rec->prev_lsn);
+            entry.trans_id = tsk_getu32(fs->endian, rec->trans_id);
+
+            if ((entry.rec_type != NTFS_LOG_RECTYPE_CLIENT)
+                && (entry.rec_type != NTFS_LOG_RECTYPE_RESTART)) {
+                off += 8;
+                continue;
+            }
+
+            if ((entry.rec_type == NTFS_LOG_RECTYPE_CLIENT)
+                && (data_len >= sizeof(ntfs_log_op))) {
+                uint8_t op_buf[sizeof(ntfs_log_op) + 8];
+                ntfs_log_op *op = (ntfs_log_op *) op_buf;
+                size_t op_len = sizeof(ntfs_log_op);
+                size_t copied;
+
+                if (data_len >= sizeof(op_buf))
+                    op_len = sizeof(op_buf);
+                copied = ntfs_log_copy(loginfo, buf, valid, nread, i,
+                    off + loginfo->rec_hdr_len, op_buf, op_len);
+                if (copied >= sizeof(ntfs_log_op)) {
+                    entry.has_op = 1;
+                    entry.redo_op = tsk_getu16(fs->endian, op->redo_op);
+                    entry.undo_op = tsk_getu16(fs->endian, op->undo_op);
+                    entry.target_attr =
+                        tsk_getu16(fs->endian, op->target_attr);
+                    entry.lcn_cnt = tsk_getu16(fs->endian, op->lcn_cnt);
+                    entry.target_vcn =
+                        tsk_getu64(fs->endian, op->target_vcn);
+                    if (copied < sizeof(op_buf))
+                        entry.lcn_cnt = 0;
+                    else if (entry.lcn_cnt)
+                        entry.lcn = tsk_getu64(fs->endian,
+                            &op_buf[sizeof(ntfs_log_op)]);
+                }
+            }
+
+            if (ntfs_log_add(result, &entry)) {
+                ntfs_log_save_error(result);
+                break;
+            }
+
+            // the rest of the page belongs to the record if it continues
+            len = roundup((uint64_t) loginfo->rec_hdr_len + data_len, 8);
+            if (off + len > loginfo->page_size)
+                break;
+            off += (size_t) len;
+        }
+        if (result->err)
+            break;
+    }
+
+    free(valid);
+    free(buf);
+}
+
+
+/*
+ * Print the name of an operation
+ */
+static void
+ntfs_log_print_op(uint16_t a_op)
+{
+    if (a_op < NTFS_LOG_OP_CNT)
+        tsk_printf("%s", ntfs_log_op_names[a_op]);
+    else
+        tsk_printf("Unknown (0x%" PRIx16 ")", a_op);
+}
+
+
+/*
+ * Print a record in the jls format
+ */
+static void
+ntfs_log_print(const NTFS_LOG_ENTRY * entry)
+{
+    if (entry->rec_type == NTFS_LOG_RECTYPE_RESTART) {
+        tsk_printf("%" PRIuDADDR ":\tClient Restart (LSN: %" PRIu64
+            ")\n", entry->page, entry->lsn);
+        return;
+    }
+
+    tsk_printf("%" PRIuDADDR ":\tLSN: %" PRIu64 " (prev: %" PRIu64
+        ", trans: %" PRIu32 ")", entry->page, entry->lsn,
+        entry->prev_lsn, entry->trans_id);
+    if (entry->has_op) {
+        tsk_printf(" Redo: ");
+        ntfs_log_print_op(entry->redo_op);
+        tsk_printf(" Undo: ");
+        ntfs_log_print_op(entry->undo_op);
+        if (entry->lcn_cnt)
+            tsk_printf(" Attr: %" PRIu16 " VCN: %" PRIu64 " LCN: %"
+                PRIu64, entry->target_attr, entry->target_vcn,
+                entry->lcn);
+    }
+    tsk_printf("\n");
+}
+
+
+/**
+ * \internal
+ * List the records of the $LogFile.  If a_action is NULL, they are
+ * printed in the jls format.  Otherwise, a_action is called with the
+ * record page of each record and the first cluster that it is about (0
+ * if none).
+ *
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_jentry_walk(TSK_FS_INFO * fs, int flags,
+    TSK_FS_JENTRY_WALK_CB a_action, void *ptr)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    NTFS_LOGINFO *loginfo = ntfs->loginfo;
+    NTFS_LOG_BATCH batch;
+    TSK_DADDR_T page;
+    size_t max_jobs;
+    uint8_t ret = 0, stop = 0;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if ((loginfo == NULL) || (loginfo->fs_file == NULL)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_jentry_walk: journal is not open");
+        return 1;
+    }
+
+    if (a_action == NULL) {
+        tsk_printf("JBlk\tDescription\n");
+        tsk_printf("%" PRIuDADDR ":\tRestart Page (version: %" PRIu16 ".%"
+            PRIu16 ", current LSN: %" PRIu64 ")\n", loginfo->rstr_page,
+            loginfo->major_ver, loginfo->minor_ver, loginfo->current_lsn);
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    batch.fs = fs;
+    batch.loginfo = loginfo;
+    batch.end_page = (TSK_DADDR_T) (loginfo->file_size / loginfo->page_size);
+
+    max_jobs = NTFS_LOG_BATCH_JOBS * tsk_parallel_nthreads();
+    if ((batch.results = (NTFS_LOG_RESULT *) tsk_malloc(max_jobs *
+                sizeof(NTFS_LOG_RESULT))) == NULL)
+        return 1;
+
+    // the record pages follow the two restart pages
+    for (page = roundup(2 * (TSK_DADDR_T) loginfo->sys_page_size,
+            loginfo->page_size) / loginfo->page_size;
+        (page < batch.end_page) && (stop == 0) && (ret == 0);
+        page += max_jobs * NTFS_LOG_JOB_PAGES) {
+        size_t njobs, i, j;
+
+        njobs = (size_t) ((batch.end_page - page + NTFS_LOG_JOB_PAGES -
+                1) / NTFS_LOG_JOB_PAGES);
+        if (njobs > max_jobs)
+            njobs = max_jobs;
+        batch.first_page = page;
+        tsk_parallel_for(njobs, ntfs_log_decode, &batch);
+
+        for (i = 0; i < njobs; i++) {
+            NTFS_LOG_RESULT *result = &batch.results[i];
+
+            if ((ret == 0) && (stop == 0) && (result->err)) {
+                tsk_error_reset();
+                tsk_error_set_errno(result->t_errno);
+                if (result->errstr)
+                    tsk_error_set_errstr("%s", result->errstr);
+                if (result->errstr2)
+                    tsk_error_set_errstr2("%s", result->errstr2);
+                ret = 1;
+            }
+
+            for (j = 0; (j < result->cnt) && (ret == 0) && (stop == 0);
+                j++) {
+                const NTFS_LOG_ENTRY *entry = &result->entries[j];
+
+                if (a_action == NULL) {
+                    ntfs_log_print(entry);
+                }
+                else {
+                    TSK_FS_JENTRY jentry;
+                    TSK_WALK_RET_ENUM retval;
+
+                    jentry.jblk = entry->page;
+                    jentry.fsblk = entry->lcn_cnt ? entry->lcn : 0;
+                    retval = a_action(fs, &jentry, flags, ptr);
+                    if (retval == TSK_WALK_STOP)
+                        stop = 1;
+                    else if (retval == TSK_WALK_ERROR)
+                        ret = 1;
+                }
+            }
+
+            free(result->entries);
+            free(result->errstr);
+            free(result->errstr2);
+            memset(result, 0, sizeof(NTFS_LOG_RESULT));
+        }
+    }
+
+    free(batch.results);
+    return ret;
+}
+
+
+/**
+ * \internal
+ * Write a page of the $LogFile to stdout, after applying its fixups if it
+ * is a restart or record page.  Pages are counted in units of the record
+ * page size.
+ *
+ * Limitations: start must equal end and the action is ignored.
+ *
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end,
+    int flags, TSK_FS_JBLK_WALK_CB a_action, void *ptr)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    NTFS_LOGINFO *loginfo = ntfs->loginfo;
+    uint32_t magic;
+    uint8_t *buf;
+    ssize_t cnt;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+
+    if ((loginfo == NULL) || (loginfo->fs_file == NULL)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_jblk_walk: journal is not open");
+        return 1;
+    }
+
+    if (start != end) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("ntfs_jblk_walk: only start == end is currently supported");
+        return 1;
+    }
+
+    if ((end + 1) * loginfo->page_size >
+        (TSK_DADDR_T) loginfo->fs_attr->size) {
+        tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
+        tsk_error_set_errstr("ntfs_jblk_walk: end is too large ");
+        return 1;
+    }
+
+    if ((buf = (uint8_t *) tsk_malloc(loginfo->page_size)) == NULL)
+        return 1;
+
+    cnt = tsk_fs_attr_read(loginfo->fs_attr,
+        (TSK_OFF_T) end * loginfo->page_size, (char *) buf,
+        loginfo->page_size, TSK_FS_FILE_READ_FLAG_NONE);
+    if (cnt != (ssize_t) loginfo->page_size) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2("ntfs_jblk_walk: $LogFile page %" PRIuDADDR,
+            end);
+        free(buf);
+        return 1;
+    }
+
+    magic = tsk_getu32(fs->endian, buf);
+    if (((magic == NTFS_LOG_RSTR_MAGIC) || (magic == NTFS_LOG_RCRD_MAGIC))
+        && (ntfs_log_fixup(fs, buf, loginfo->page_size))
+        && (tsk_verbose))
+        tsk_fprintf(stderr,
+            "ntfs_jblk_walk: fixup values of page %" PRIuDADDR
+            " do not match\n", end);
+
+    if (fwrite(buf, loginfo->page_size, 1, stdout) != 1) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WRITE);
+        tsk_error_set_errstr("ntfs_jblk_walk: error writing buffer block");
+        free(buf);
+        return 1;
+    }
+
+    free(buf);
+    return 0;
+}
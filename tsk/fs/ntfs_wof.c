@@ -0,0 +1,1281 @@
+/*
+** ntfs_wof
+** The Sleuth Kit
+**
+** Content layer support for the NTFS files that are compressed by the
+** Windows Overlay Filter (WOF)
+**
+** This software is distributed under the Common Public License 1.0
+**
+*/
+#include "tsk_fs_i.h"
+#include "tsk_ntfs.h"
+
+/**
+ * \file ntfs_wof.c
+ * Contains the internal functions that decompress the NTFS files that
+ * were compressed by the Windows Overlay Filter (WOF).
+ *
+ * Windows 10 compresses system files (CompactOS, "compact /exe") by
+ * storing their data in the WofCompressedData $DATA stream and by adding
+ * a reparse point with the WOF tag.  The unnamed $DATA stream is sparse
+ * and has the size of the uncompressed data.  The data is split into
+ * chunks that are compressed independently with XPRESS Huffman (4, 8 or
+ * 16 KiB chunks) or LZX (32 KiB chunks), and a chunk is stored as is if
+ * it does not get smaller.  The stream starts with a table that has the
+ * offset of each chunk after the first one (relative to the end of the
+ * table), so any chunk can be read without decompressing the others.
+ *
+ * ntfs_wof_setup() sets the compressed flag and the read and walk
+ * functions of the unnamed $DATA stream of these files.
+ */
+
+/* Huffman decoding tables.  Codes of up to NTFS_WOF_HUFF_BITS bits are
+ * decoded with one lookup of the first NTFS_WOF_HUFF_BITS bits.  The
+ * entries of longer codes link to a subtable that is indexed by the next
+ * bits.  An entry has the symbol in its upper 16 bits and the number of
+ * bits of the code (after the first NTFS_WOF_HUFF_BITS for a subtable)
+ * in its lower 5 bits.  A link has the index of the subtable in its
+ * upper 16 bits and the number of bits that index it in its lower 5 bits.
+ * An entry of 0 is not a code. */
+#define NTFS_WOF_HUFF_BITS      11
+#define NTFS_WOF_HUFF_MAXLEN    16
+#define NTFS_WOF_HUFF_LINK      0x8000
+#define NTFS_WOF_HUFF_SIZE(nsyms) \
+    ((1 << NTFS_WOF_HUFF_BITS) + \
+     ((nsyms) << (NTFS_WOF_HUFF_MAXLEN - NTFS_WOF_HUFF_BITS)))
+
+/* XPRESS Huffman */
+#define NTFS_WOF_XPRESS_SYMS    512
+
+/* LZX, as used by WIM files (32 KiB window, no header and E8
+ * translation always on) */
+#define NTFS_WOF_LZX_VERBATIM   1
+#define NTFS_WOF_LZX_ALIGNED    2
+#define NTFS_WOF_LZX_UNCOMP     3
+#define NTFS_WOF_LZX_CHARS      256
+#define NTFS_WOF_LZX_MAIN_SYMS  (256 + 8 * 30)
+#define NTFS_WOF_LZX_LEN_SYMS   249
+#define NTFS_WOF_LZX_ALIGNED_SYMS 8
+#define NTFS_WOF_LZX_PRE_SYMS   20
+#define NTFS_WOF_LZX_OVERRUN    50      /* most lengths written past the end by a run */
+#define NTFS_WOF_LZX_E8_SIZE    12000000
+
+static const uint32_t ntfs_wof_lzx_base[30] = {
+    0, 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384,
+    512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576
+};
+
+static const uint8_t ntfs_wof_lzx_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10,
+    10, 11, 11, 12, 12, 13, 13
+};
+
+/* Location and format of the data of a WOF compressed file */
+typedef struct {
+    const TSK_FS_ATTR *stream;  /* WofCompressedData */
+    uint32_t algo;              /* NTFS_WOF_XXX compression format */
+    uint32_t chunk_size;
+} NTFS_WOF_FILE;
+
+/* Buffers and decoding tables to decompress a chunk.  They are 200 KiB,
+ * so the file system keeps a few of them for the next reads. */
+typedef struct NTFS_WOF_DEC {
+    uint32_t main_table[NTFS_WOF_HUFF_SIZE(NTFS_WOF_XPRESS_SYMS)];
+    uint32_t len_table[NTFS_WOF_HUFF_SIZE(NTFS_WOF_LZX_LEN_SYMS)];
+    uint32_t aligned_table[NTFS_WOF_HUFF_SIZE(NTFS_WOF_LZX_ALIGNED_SYMS)];
+    uint32_t pre_table[NTFS_WOF_HUFF_SIZE(NTFS_WOF_LZX_PRE_SYMS)];
+    uint8_t main_lens[NTFS_WOF_XPRESS_SYMS + NTFS_WOF_LZX_OVERRUN];
+    uint8_t len_lens[NTFS_WOF_LZX_LEN_SYMS + NTFS_WOF_LZX_OVERRUN];
+    uint8_t aligned_lens[NTFS_WOF_LZX_ALIGNED_SYMS];
+    uint8_t pre_lens[NTFS_WOF_LZX_PRE_SYMS];
+    unsigned char comp_buf[NTFS_WOF_CHUNK_MAX];
+    /* 16 extra bytes let ntfs_uncompress_copy() copy 16 bytes at a time */
+    unsigned char uncomp_buf[NTFS_WOF_CHUNK_MAX + 16];
+} NTFS_WOF_DEC;
+
+/* LZX bit stream: 16-bit little endian words that are read from the most
+ * significant bit.  bits has the next 'left' bits at its top.  The last
+ * 'pad' of them are 0s that were added past the end of the chunk, so the
+ * chunk is truncated once left is less than pad. */
+typedef struct {
+    const unsigned char *next;
+    const unsigned char *end;
+    uint32_t bits;
+    unsigned int left;
+    unsigned int pad;
+} NTFS_WOF_BITS;
+
+
+/*
+ * Build the decoding table of a canonical Huffman code.  Incomplete codes
+ * are allowed and the unused codes are reported when they are decoded.
+ *
+ * @param a_table Table to fill in (NTFS_WOF_HUFF_SIZE(a_nsyms) entries)
+ * @param a_lens Length of the code of each symbol (0 if not used)
+ * @param a_nsyms Number of symbols (at most NTFS_WOF_XPRESS_SYMS)
+ *
+ * @returns 1 if the lengths are not valid
+ */
+static uint8_t
+ntfs_wof_huff_build(uint32_t * a_table, const uint8_t * a_lens,
+    unsigned int a_nsyms)
+{
+    uint16_t count[NTFS_WOF_HUFF_MAXLEN + 1];
+    uint16_t offs[NTFS_WOF_HUFF_MAXLEN + 2];
+    uint16_t sorted[NTFS_WOF_XPRESS_SYMS];
+    unsigned int len, prev_len = 0, max_len = 0, sub_bits = 0;
+    unsigned int sym, i, nused;
+    int32_t left = 1;
+    uint32_t code = 0;
+    uint32_t next_sub = 1 << NTFS_WOF_HUFF_BITS;
+
+    memset(count, 0, sizeof(count));
+    for (sym = 0; sym < a_nsyms; sym++) {
+        if (a_lens[sym] > NTFS_WOF_HUFF_MAXLEN)
+            return 1;
+        count[a_lens[sym]]++;
+    }
+
+    /* reject over-subscribed codes */
+    for (len = 1; len <= NTFS_WOF_HUFF_MAXLEN; len++) {
+        left = (left << 1) - count[len];
+        if (left < 0)
+            return 1;
+        if (count[len])
+            max_len = len;
+    }
+    if (max_len > NTFS_WOF_HUFF_BITS)
+        sub_bits = max_len - NTFS_WOF_HUFF_BITS;
+
+    /* sort the symbols by code length and then by value */
+    offs[1] = 0;
+    for (len = 1; len <= NTFS_WOF_HUFF_MAXLEN; len++)
+        offs[len + 1] = offs[len] + count[len];
+    nused = offs[NTFS_WOF_HUFF_MAXLEN + 1];
+    for (sym = 0; sym < a_nsyms; sym++) {
+        if (a_lens[sym])
+            sorted[offs[a_lens[sym]]++] = (uint16_t) sym;
+    }
+
+    memset(a_table, 0, (1 << NTFS_WOF_HUFF_BITS) * sizeof(uint32_t));
+    for (i = 0; i < nused; i++) {
+        uint32_t *ent;
+        uint32_t val, cnt;
+
+        sym = sorted[i];
+        len = a_lens[sym];
+        code <<= (len - prev_len);
+        prev_len = len;
+
+        if (len <= NTFS_WOF_HUFF_BITS) {
+            ent = &a_table[code << (NTFS_WOF_HUFF_BITS - len)];
+            cnt = 1 << (NTFS_WOF_HUFF_BITS - len);
+            val = (sym << 16) | len;
+        }
+        else {
+            uint32_t prefix = code >> (len - NTFS_WOF_HUFF_BITS);
+            unsigned int extra = len - NTFS_WOF_HUFF_BITS;
+
+            if ((a_table[prefix] & NTFS_WOF_HUFF_LINK) == 0) {
+                a_table[prefix] =
+                    (next_sub << 16) | NTFS_WOF_HUFF_LINK | sub_bits;
+                memset(&a_table[next_sub], 0,
+                    (1 << sub_bits) * sizeof(uint32_t));
+                next_sub += 1 << sub_bits;
+            }
+            ent = &a_table[(a_table[prefix] >> 16) +
+                ((code & ((1 << extra) - 1)) << (sub_bits - extra))];
+            cnt = 1 << (sub_bits - extra);
+            val = (sym << 16) | extra;
+        }
+        while (cnt--)
+            *ent++ = val;
+        code++;
+    }
+    return 0;
+}
+
+/*
+ * Decode a symbol from the bits at the top of a_bits, which must have
+ * at least as many valid bits as the longest code.
+ *
+ * @param a_len [out] Number of bits in the code
+ * @returns the symbol or -1 if the bits are not a code
+ */
+static int
+ntfs_wof_huff_decode(const uint32_t * a_table, uint32_t a_bits,
+    unsigned int *a_len)
+{
+    uint32_t ent = a_table[a_bits >> (32 - NTFS_WOF_HUFF_BITS)];
+
+    if (ent & NTFS_WOF_HUFF_LINK) {
+        ent = a_table[(ent >> 16) +
+            ((a_bits << NTFS_WOF_HUFF_BITS) >> (32 - (ent & 0x1f)))];
+        if ((ent & 0x1f) == 0)
+            return -1;
+        *a_len = NTFS_WOF_HUFF_BITS + (ent & 0x1f);
+    }
+    else {
+        if ((ent & 0x1f) == 0)
+            return -1;
+        *a_len = ent & 0x1f;
+    }
+    return (int) (ent >> 16);
+}
+
+static void
+ntfs_wof_decomp_error(const char *a_func, const char *a_msg)
+{
+    tsk_error_reset();
+    tsk_error_set_errno(TSK_ERR_FS_FWALK);
+    tsk_error_set_errstr("%s: %s", a_func, a_msg);
+}
+
+
+/*
+ * Decompress an XPRESS Huffman chunk ([MS-XCA] 2.2).  Chunks are at most
+ * 64 KiB and so have a single Huffman table.
+ *
+ * @param a_dec Decoding tables to use
+ * @param a_in Compressed data
+ * @param a_in_len Number of bytes in a_in
+ * @param a_out Buffer for the decompressed data (with 16 extra bytes)
+ * @param a_out_len Number of bytes in the decompressed chunk
+ *
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_wof_xpress(NTFS_WOF_DEC * a_dec, const unsigned char *a_in,
+    size_t a_in_len, unsigned char *a_out, size_t a_out_len)
+{
+    size_t in_pos, out_pos = 0;
+    uint32_t bits;
+    int extra;
+    unsigned int i;
+
+    if (a_in_len < 260) {
+        ntfs_wof_decomp_error("ntfs_wof_xpress", "chunk is too small");
+        return 1;
+    }
+
+    /* The table has the 4-bit code lengths of the 512 symbols */
+    for (i = 0; i < 256; i++) {
+        a_dec->main_lens[2 * i] = a_in[i] & 0x0f;
+        a_dec->main_lens[2 * i + 1] = a_in[i] >> 4;
+    }
+    if (ntfs_wof_huff_build(a_dec->main_table, a_dec->main_lens,
+            NTFS_WOF_XPRESS_SYMS)) {
+        ntfs_wof_decomp_error("ntfs_wof_xpress", "invalid Huffman table");
+        return 1;
+    }
+
+    /* bits has 16 + extra valid bits and is refilled as soon as it has
+     * less than 16, as the bytes of long match lengths follow the words
+     * that were read at that point.  Words past the end of the chunk are
+     * 0s, which must not be used. */
+#define NTFS_WOF_XPRESS_U16(pos) \
+    (((pos) + 2 <= a_in_len) ? tsk_getu16(TSK_LIT_ENDIAN, &a_in[(pos)]) : 0)
+#define NTFS_WOF_XPRESS_PAST_END() \
+    ((in_pos > a_in_len) && ((in_pos - a_in_len) * 8 > (size_t) (16 + extra)))
+#define NTFS_WOF_XPRESS_USE(n) \
+    { \
+        bits <<= (n); \
+        extra -= (n); \
+        if (extra < 0) { \
+            bits |= (uint32_t) NTFS_WOF_XPRESS_U16(in_pos) << -extra; \
+            in_pos += 2; \
+            extra += 16; \
+        } \
+    }
+
+    bits = ((uint32_t) NTFS_WOF_XPRESS_U16(256) << 16) |
+        NTFS_WOF_XPRESS_U16(258);
+    in_pos = 260;
+    extra = 16;
+
+    while (out_pos < a_out_len) {
+        unsigned int len, off_bits;
+        uint32_t match_len;
+        size_t match_off;
+        int sym;
+
+        if (NTFS_WOF_XPRESS_PAST_END()) {
+            ntfs_wof_decomp_error("ntfs_wof_xpress", "chunk is truncated");
+            return 1;
+        }
+        if ((sym = ntfs_wof_huff_decode(a_dec->main_table, bits, &len)) < 0) {
+            ntfs_wof_decomp_error("ntfs_wof_xpress", "invalid code");
+            return 1;
+        }
+        NTFS_WOF_XPRESS_USE(len);
+
+        if (sym < 256) {
+            a_out[out_pos++] = (unsigned char) sym;
+            continue;
+        }
+
+        sym -= 256;
+        match_len = sym & 0x0f;
+        off_bits = sym >> 4;
+        if (match_len == 15) {
+            if (in_pos >= a_in_len) {
+                ntfs_wof_decomp_error("ntfs_wof_xpress",
+                    "match length past end of chunk");
+                return 1;
+            }
+            match_len = a_in[in_pos++];
+            if (match_len == 255) {
+                if (in_pos + 2 > a_in_len) {
+                    ntfs_wof_decomp_error("ntfs_wof_xpress",
+                        "match length past end of chunk");
+                    return 1;
+                }
+                match_len = tsk_getu16(TSK_LIT_ENDIAN, &a_in[in_pos]);
+                in_pos += 2;
+                if (match_len == 0) {
+                    if (in_pos + 4 > a_in_len) {
+                        ntfs_wof_decomp_error("ntfs_wof_xpress",
+                            "match length past end of chunk");
+                        return 1;
+                    }
+                    match_len = tsk_getu32(TSK_LIT_ENDIAN, &a_in[in_pos]);
+                    in_pos += 4;
+                }
+                if (match_len < 15) {
+                    ntfs_wof_decomp_error("ntfs_wof_xpress",
+                        "invalid match length");
+                    return 1;
+                }
+                match_len -= 15;
+            }
+            match_len += 15;
+        }
+        match_len += 3;
+
+        match_off = (size_t) 1 << off_bits;
+        if (off_bits) {
+            match_off |= bits >> (32 - off_bits);
+            NTFS_WOF_XPRESS_USE(off_bits);
+        }
+
+        if ((match_off > out_pos) || (match_len > a_out_len - out_pos)) {
+            ntfs_wof_decomp_error("ntfs_wof_xpress",
+                "match is outside of the chunk");
+            return 1;
+        }
+        ntfs_uncompress_copy(a_out, a_out_len + 16, out_pos, match_off,
+            match_len);
+        out_pos += match_len;
+    }
+    if (NTFS_WOF_XPRESS_PAST_END()) {
+        ntfs_wof_decomp_error("ntfs_wof_xpress", "chunk is truncated");
+        return 1;
+    }
+#undef NTFS_WOF_XPRESS_U16
+#undef NTFS_WOF_XPRESS_USE
+#undef NTFS_WOF_XPRESS_PAST_END
+
+    return 0;
+}
+
+
+/* Make sure that the LZX bit stream has at least a_n (at most 16) bits.
+ * Past the end of the chunk, 0s are returned. */
+static void
+ntfs_wof_bits_ensure(NTFS_WOF_BITS * a_bs, unsigned int a_n)
+{
+    if (a_bs->left >= a_n)
+        return;
+    if (a_bs->end - a_bs->next >= 2) {
+        a_bs->bits |=
+            (uint32_t) tsk_getu16(TSK_LIT_ENDIAN,
+            a_bs->next) << (16 - a_bs->left);
+        a_bs->next += 2;
+        a_bs->left += 16;
+    }
+    else {
+        a_bs->pad += 32 - a_bs->left;
+        a_bs->left = 32;
+    }
+}
+
+/* Read a_n (at most 16) bits from the LZX bit stream */
+static uint32_t
+ntfs_wof_bits_read(NTFS_WOF_BITS * a_bs, unsigned int a_n)
+{
+    uint32_t val;
+
+    if (a_n == 0)
+        return 0;
+    ntfs_wof_bits_ensure(a_bs, a_n);
+    val = a_bs->bits >> (32 - a_n);
+    a_bs->bits <<= a_n;
+    a_bs->left -= a_n;
+    return val;
+}
+
+/* Read a Huffman coded symbol whose codes are at most a_max_len bits
+ * from the LZX bit stream.
+ * @returns the symbol or -1 if the bits are not a code */
+static int
+ntfs_wof_bits_sym(NTFS_WOF_BITS * a_bs, const uint32_t * a_table,
+    unsigned int a_max_len)
+{
+    unsigned int len;
+    int sym;
+
+    ntfs_wof_bits_ensure(a_bs, a_max_len);
+    if ((sym = ntfs_wof_huff_decode(a_table, a_bs->bits, &len)) >= 0) {
+        a_bs->bits <<= len;
+        a_bs->left -= len;
+    }
+    return sym;
+}
+
+/*
+ * Read code lengths of an LZX block, which are coded as differences from
+ * the previous lengths with a pretree.  Up to NTFS_WOF_LZX_OVERRUN
+ * lengths can be written past the end of a_lens.
+ *
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_wof_lzx_lens(NTFS_WOF_DEC * a_dec, NTFS_WOF_BITS * a_bs,
+    uint8_t * a_lens, unsigned int a_num)
+{
+    uint8_t *len_ptr = a_lens;
+    uint8_t *len_end = a_lens + a_num;
+    int i;
+
+    for (i = 0; i < NTFS_WOF_LZX_PRE_SYMS; i++)
+        a_dec->pre_lens[i] = (uint8_t) ntfs_wof_bits_read(a_bs, 4);
+    if (ntfs_wof_huff_build(a_dec->pre_table, a_dec->pre_lens,
+            NTFS_WOF_LZX_PRE_SYMS))
+        return 1;
+
+    while (len_ptr < len_end) {
+        int sym = ntfs_wof_bits_sym(a_bs, a_dec->pre_table, 15);
+        unsigned int run;
+        int len;
+
+        if (sym < 0)
+            return 1;
+
+        if (sym < 17) {
+            len = *len_ptr - sym;
+            *len_ptr++ = (uint8_t) ((len < 0) ? len + 17 : len);
+            continue;
+        }
+
+        if (sym == 17) {
+            run = 4 + ntfs_wof_bits_read(a_bs, 4);
+            len = 0;
+        }
+        else if (sym == 18) {
+            run = 20 + ntfs_wof_bits_read(a_bs, 5);
+            len = 0;
+        }
+        else {
+            run = 4 + ntfs_wof_bits_read(a_bs, 1);
+            sym = ntfs_wof_bits_sym(a_bs, a_dec->pre_table, 15);
+            if ((sym < 0) || (sym > 17))
+                return 1;
+            len = *len_ptr - sym;
+            if (len < 0)
+                len += 17;
+        }
+        while (run--)
+            *len_ptr++ = (uint8_t) len;
+    }
+    return 0;
+}
+
+/*
+ * Undo the translation of the targets of x86 CALL instructions that the
+ * LZX compressor does.
+ */
+static void
+ntfs_wof_lzx_e8(unsigned char *a_buf, size_t a_len)
+{
+    unsigned char *ptr = a_buf;
+    unsigned char *tail;
+
+    if (a_len <= 10)
+        return;
+
+    tail = a_buf + a_len - 10;
+    while (ptr < tail) {
+        int32_t abs_off, pos;
+
+        if ((ptr = (unsigned char *) memchr(ptr, 0xE8, tail - ptr)) == NULL)
+            break;
+
+        pos = (int32_t) (ptr - a_buf);
+        abs_off = (int32_t) tsk_getu32(TSK_LIT_ENDIAN, ptr + 1);
+        if (abs_off >= 0) {
+            if (abs_off < NTFS_WOF_LZX_E8_SIZE) {
+                uint32_t rel = (uint32_t) (abs_off - pos);
+                ptr[1] = (unsigned char) rel;
+                ptr[2] = (unsigned char) (rel >> 8);
+                ptr[3] = (unsigned char) (rel >> 16);
+                ptr[4] = (unsigned char) (rel >> 24);
+            }
+        }
+        else if (abs_off >= -pos) {
+            uint32_t rel = (uint32_t) (abs_off + NTFS_WOF_LZX_E8_SIZE);
+            ptr[1] = (unsigned char) rel;
+            ptr[2] = (unsigned char) (rel >> 8);
+            ptr[3] = (unsigned char) (rel >> 16);
+            ptr[4] = (unsigned char) (rel >> 24);
+        }
+        ptr += 5;
+    }
+}
+
+/*
+ * Decompress an LZX chunk.  The format is the one of WIM files: a 32 KiB
+ * window that starts empty at each chunk and E8 translation.
+ *
+ * @param a_dec Decoding tables to use
+ * @param a_in Compressed data
+ * @param a_in_len Number of bytes in a_in
+ * @param a_out Buffer for the decompressed data (with 16 extra bytes)
+ * @param a_out_len Number of bytes in the decompressed chunk
+ *
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_wof_lzx(NTFS_WOF_DEC * a_dec, const unsigned char *a_in,
+    size_t a_in_len, unsigned char *a_out, size_t a_out_len)
+{
+    NTFS_WOF_BITS bs;
+    uint32_t recent[3] = { 1, 1, 1 };
+    size_t out_pos = 0;
+    size_t block_end = 0;
+
+    /* lengths are coded as differences from the previous block */
+    memset(a_dec->main_lens, 0, sizeof(a_dec->main_lens));
+    memset(a_dec->len_lens, 0, sizeof(a_dec->len_lens));
+
+    bs.next = a_in;
+    bs.end = a_in + a_in_len;
+    bs.bits = 0;
+    bs.left = 0;
+    bs.pad = 0;
+
+    while (out_pos < a_out_len) {
+        uint32_t block_type, block_size;
+
+        block_type = ntfs_wof_bits_read(&bs, 3);
+        if (ntfs_wof_bits_read(&bs, 1))
+            block_size = 32768;
+        else
+            block_size = ntfs_wof_bits_read(&bs, 16);
+
+        /* A match may have gone past the end of the previous block */
+        if ((block_size == 0) || (block_end + block_size <= out_pos)) {
+            ntfs_wof_decomp_error("ntfs_wof_lzx", "invalid block size");
+            return 1;
+        }
+        block_end += block_size;
+        if (block_end > a_out_len)
+            block_end = a_out_len;
+
+        if (block_type == NTFS_WOF_LZX_UNCOMP) {
+            int i;
+
+            /* The data starts at the next 16-bit word (the next one if
+             * the bits are already aligned) */
+            ntfs_wof_bits_ensure(&bs, 1);
+            bs.bits = 0;
+            bs.left = 0;
+            bs.pad = 0;
+
+            if (bs.end - bs.next < 12) {
+                ntfs_wof_decomp_error("ntfs_wof_lzx",
+                    "uncompressed block past end of chunk");
+                return 1;
+            }
+            for (i = 0; i < 3; i++) {
+                recent[i] = tsk_getu32(TSK_LIT_ENDIAN, bs.next);
+                bs.next += 4;
+            }
+
+            block_size = (uint32_t) (block_end - out_pos);
+            if ((size_t) (bs.end - bs.next) < block_size) {
+                ntfs_wof_decomp_error("ntfs_wof_lzx",
+                    "uncompressed block past end of chunk");
+                return 1;
+            }
+            memcpy(&a_out[out_pos], bs.next, block_size);
+            bs.next += block_size;
+            out_pos += block_size;
+            if ((block_size & 1) && (bs.next < bs.end))
+                bs.next++;
+            continue;
+        }
+        else if ((block_type != NTFS_WOF_LZX_VERBATIM)
+            && (block_type != NTFS_WOF_LZX_ALIGNED)) {
+            ntfs_wof_decomp_error("ntfs_wof_lzx", "invalid block type");
+            return 1;
+        }
+
+        if (block_type == NTFS_WOF_LZX_ALIGNED) {
+            int i;
+
+            for (i = 0; i < NTFS_WOF_LZX_ALIGNED_SYMS; i++)
+                a_dec->aligned_lens[i] =
+                    (uint8_t) ntfs_wof_bits_read(&bs, 3);
+            if (ntfs_wof_huff_build(a_dec->aligned_table,
+                    a_dec->aligned_lens, NTFS_WOF_LZX_ALIGNED_SYMS)) {
+                ntfs_wof_decomp_error("ntfs_wof_lzx",
+                    "invalid aligned offset tree");
+                return 1;
+            }
+        }
+
+        if (ntfs_wof_lzx_lens(a_dec, &bs, a_dec->main_lens,
+                NTFS_WOF_LZX_CHARS)
+            || ntfs_wof_lzx_lens(a_dec, &bs,
+                &a_dec->main_lens[NTFS_WOF_LZX_CHARS],
+                NTFS_WOF_LZX_MAIN_SYMS - NTFS_WOF_LZX_CHARS)
+            || ntfs_wof_lzx_lens(a_dec, &bs, a_dec->len_lens,
+                NTFS_WOF_LZX_LEN_SYMS)
+            || ntfs_wof_huff_build(a_dec->main_table, a_dec->main_lens,
+                NTFS_WOF_LZX_MAIN_SYMS)
+            || ntfs_wof_huff_build(a_dec->len_table, a_dec->len_lens,
+                NTFS_WOF_LZX_LEN_SYMS)) {
+            ntfs_wof_decomp_error("ntfs_wof_lzx", "invalid Huffman tree");
+            return 1;
+        }
+
+        while (out_pos < block_end) {
+            uint32_t match_len, match_off, slot;
+            int sym;
+
+            if (bs.left < bs.pad) {
+                ntfs_wof_decomp_error("ntfs_wof_lzx", "chunk is truncated");
+                return 1;
+            }
+            if ((sym = ntfs_wof_bits_sym(&bs, a_dec->main_table, 16)) < 0) {
+                ntfs_wof_decomp_error("ntfs_wof_lzx", "invalid code");
+                return 1;
+            }
+            if (sym < NTFS_WOF_LZX_CHARS) {
+                a_out[out_pos++] = (unsigned char) sym;
+                continue;
+            }
+
+            sym -= NTFS_WOF_LZX_CHARS;
+            match_len = sym & 7;
+            slot = sym >> 3;
+            if (match_len == 7) {
+                if ((sym = ntfs_wof_bits_sym(&bs, a_dec->len_table, 16)) < 0) {
+                    ntfs_wof_decomp_error("ntfs_wof_lzx",
+                        "invalid length code");
+                    return 1;
+                }
+                match_len += sym;
+            }
+            match_len += 2;
+
+            if (slot < 3) {
+                /* recent offset, which is swapped with the first one */
+                match_off = recent[slot];
+                recent[slot] = recent[0];
+            }
+            else {
+                unsigned int extra_bits = ntfs_wof_lzx_extra[slot];
+
+                match_off = ntfs_wof_lzx_base[slot];
+                if ((block_type == NTFS_WOF_LZX_ALIGNED)
+                    && (extra_bits >= 3)) {
+                    match_off +=
+                        ntfs_wof_bits_read(&bs, extra_bits - 3) << 3;
+                    if ((sym = ntfs_wof_bits_sym(&bs,
+                                a_dec->aligned_table, 7)) < 0) {
+                        ntfs_wof_decomp_error("ntfs_wof_lzx",
+                            "invalid aligned offset code");
+                        return 1;
+                    }
+                    match_off += sym;
+                }
+                else {
+                    match_off += ntfs_wof_bits_read(&bs, extra_bits);
+                }
+                match_off -= 2;
+                recent[2] = recent[1];
+                recent[1] = recent[0];
+            }
+            recent[0] = match_off;
+
+            if ((match_off == 0) || (match_off > out_pos)
+                || (match_len > a_out_len - out_pos)) {
+                ntfs_wof_decomp_error("ntfs_wof_lzx",
+                    "match is outside of the chunk");
+                return 1;
+            }
+            ntfs_uncompress_copy(a_out, a_out_len + 16, out_pos,
+                match_off, match_len);
+            out_pos += match_len;
+        }
+    }
+    if (bs.left < bs.pad) {
+        ntfs_wof_decomp_error("ntfs_wof_lzx", "chunk is truncated");
+        return 1;
+    }
+
+    ntfs_wof_lzx_e8(a_out, a_out_len);
+    return 0;
+}
+
+/**
+ * Decompress a WOF chunk that is already in memory.  This is the decoder
+ * that the read functions use, without the reading of the chunk.
+ *
+ * @param a_algo Compression format (NTFS_WOF_XPRESS4K etc. or NTFS_WOF_LZX)
+ * @param a_in Compressed data
+ * @param a_in_len Number of bytes in a_in
+ * @param a_out Buffer for the decompressed data
+ * @param a_out_len Number of bytes in the decompressed chunk (at most
+ * NTFS_WOF_CHUNK_MAX)
+ *
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_wof_decompress(uint32_t a_algo, const unsigned char *a_in,
+    size_t a_in_len, unsigned char *a_out, size_t a_out_len)
+{
+    NTFS_WOF_DEC *dec;
+    uint8_t retval;
+
+    if (a_out_len > NTFS_WOF_CHUNK_MAX) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_wof_decompress: chunk is too large: %"
+            PRIuSIZE, a_out_len);
+        return 1;
+    }
+    if ((dec = (NTFS_WOF_DEC *) tsk_malloc(sizeof(NTFS_WOF_DEC))) == NULL)
+        return 1;
+
+    if (a_algo == NTFS_WOF_LZX)
+        retval = ntfs_wof_lzx(dec, a_in, a_in_len, dec->uncomp_buf,
+            a_out_len);
+    else
+        retval = ntfs_wof_xpress(dec, a_in, a_in_len, dec->uncomp_buf,
+            a_out_len);
+    if (retval == 0)
+        memcpy(a_out, dec->uncomp_buf, a_out_len);
+    free(dec);
+    return retval;
+}
+
+
+/*
+ * Get the location and format of the data of a WOF compressed file.
+ *
+ * @returns 1 if the file is not compressed by WOF (or uses an unknown
+ * format)
+ */
+static uint8_t
+ntfs_wof_open(TSK_FS_FILE * a_fs_file, NTFS_WOF_FILE * a_wof)
+{
+    const TSK_FS_ATTR *fs_attr;
+    ntfs_wof_reparse reparse;
+
+    if ((a_fs_file->meta == NULL) || (a_fs_file->meta->attr == NULL))
+        return 1;
+
+    fs_attr = tsk_fs_attrlist_get(a_fs_file->meta->attr,
+        TSK_FS_ATTR_TYPE_NTFS_REPARSE);
+    if ((fs_attr == NULL)
+        || (fs_attr->size < (TSK_OFF_T) sizeof(ntfs_wof_reparse))) {
+        tsk_error_reset();
+        return 1;
+    }
+
+    if (fs_attr->flags & TSK_FS_ATTR_RES) {
+        memcpy(&reparse, fs_attr->rd.buf, sizeof(ntfs_wof_reparse));
+    }
+    else if (tsk_fs_attr_read(fs_attr, 0, (char *) &reparse,
+            sizeof(ntfs_wof_reparse), TSK_FS_FILE_READ_FLAG_NONE) !=
+        (ssize_t) sizeof(ntfs_wof_reparse)) {
+        tsk_error_reset();
+        return 1;
+    }
+
+    if ((tsk_getu32(TSK_LIT_ENDIAN, reparse.tag) != NTFS_WOF_REPARSE_TAG)
+        || (tsk_getu32(TSK_LIT_ENDIAN, reparse.wof_ver) != 1)
+        || (tsk_getu32(TSK_LIT_ENDIAN,
+                reparse.wof_prov) != NTFS_WOF_PROVIDER_FILE)
+        || (tsk_getu32(TSK_LIT_ENDIAN, reparse.file_ver) != 1))
+        return 1;
+
+    a_wof->algo = tsk_getu32(TSK_LIT_ENDIAN, reparse.file_algo);
+    switch (a_wof->algo) {
+    case NTFS_WOF_XPRESS4K:
+        a_wof->chunk_size = 4096;
+        break;
+    case NTFS_WOF_XPRESS8K:
+        a_wof->chunk_size = 8192;
+        break;
+    case NTFS_WOF_XPRESS16K:
+        a_wof->chunk_size = 16384;
+        break;
+    case NTFS_WOF_LZX:
+        a_wof->chunk_size = 32768;
+        break;
+    default:
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "ntfs_wof_open: Unknown compression format %" PRIu32
+                " (%" PRIuINUM ")\n", a_wof->algo, a_fs_file->meta->addr);
+        return 1;
+    }
+
+    a_wof->stream = tsk_fs_attrlist_get_name_type(a_fs_file->meta->attr,
+        TSK_FS_ATTR_TYPE_NTFS_DATA, NTFS_WOF_STREAM_NAME);
+    if (a_wof->stream == NULL) {
+        tsk_error_reset();
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Load the chunk table of a WOF compressed file.
+ *
+ * @param a_wof File to load the table of
+ * @param a_size Size of the uncompressed data
+ * @param a_num_chunks Number of chunks
+ *
+ * @returns the offset of each chunk in the stream, followed by the end of
+ * the last one, or NULL on error
+ */
+static TSK_OFF_T *
+ntfs_wof_table_load(const NTFS_WOF_FILE * a_wof, TSK_OFF_T a_size,
+    uint64_t a_num_chunks)
+{
+    const TSK_FS_ATTR *stream = a_wof->stream;
+    size_t ent_size = (a_size > 0xffffffff) ? 8 : 4;
+    TSK_OFF_T tbl_len;
+    TSK_OFF_T *offs;
+    char *tbl = NULL;
+    uint64_t i;
+
+    if (a_num_chunks - 1 > (uint64_t) stream->size / ent_size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ntfs_wof_table_load: chunk table is larger than the stream (%"
+            PRIuINUM ")", stream->fs_file->meta->addr);
+        return NULL;
+    }
+    tbl_len = (TSK_OFF_T) ((a_num_chunks - 1) * ent_size);
+
+    if ((offs = (TSK_OFF_T *) tsk_malloc((size_t) (a_num_chunks + 1) *
+                sizeof(TSK_OFF_T))) == NULL)
+        return NULL;
+
+    if (tbl_len > 0) {
+        ssize_t cnt;
+
+        if ((tbl = (char *) tsk_malloc((size_t) tbl_len)) == NULL) {
+            free(offs);
+            return NULL;
+        }
+        cnt = tsk_fs_attr_read(stream, 0, tbl, (size_t) tbl_len,
+            TSK_FS_FILE_READ_FLAG_NONE);
+        if (cnt != (ssize_t) tbl_len) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("ntfs_wof_table_load: chunk table (%"
+                PRIuINUM ")", stream->fs_file->meta->addr);
+            free(tbl);
+            free(offs);
+            return NULL;
+        }
+    }
+
+    offs[0] = tbl_len;
+    for (i = 1; i < a_num_chunks; i++) {
+        if (ent_size == 8)
+            offs[i] = tbl_len +
+                (TSK_OFF_T) tsk_getu64(TSK_LIT_ENDIAN, &tbl[(i - 1) * 8]);
+        else
+            offs[i] = tbl_len + tsk_getu32(TSK_LIT_ENDIAN, &tbl[(i - 1) * 4]);
+
+        if ((offs[i] < offs[i - 1]) || (offs[i] > stream->size)) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+                ("ntfs_wof_table_load: invalid offset of chunk %" PRIu64
+                " (%" PRIuINUM ")", i, stream->fs_file->meta->addr);
+            free(tbl);
+            free(offs);
+            return NULL;
+        }
+    }
+    offs[a_num_chunks] = stream->size;
+    free(tbl);
+    return offs;
+}
+
+/*
+ * Get the location of a chunk in the WofCompressedData stream.  The chunk
+ * table of the last file that was read is kept.
+ *
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_wof_chunk_loc(NTFS_INFO * ntfs, const TSK_FS_ATTR * a_fs_attr,
+    const NTFS_WOF_FILE * a_wof, uint64_t a_num_chunks, uint64_t a_idx,
+    TSK_OFF_T * a_start, TSK_OFF_T * a_end)
+{
+    NTFS_WOF_TABLE *tbl = &ntfs->wof_table;
+    TSK_FS_META *meta = a_fs_attr->fs_file->meta;
+
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    if ((tbl->offs == NULL) || (tbl->addr != meta->addr)
+        || (tbl->seq != meta->seq) || (tbl->num_chunks != a_num_chunks)) {
+        TSK_OFF_T *offs;
+
+        // do not hold the lock while reading the table
+        tsk_release_lock(&ntfs->comp_cache_lock);
+        if ((offs = ntfs_wof_table_load(a_wof, a_fs_attr->size,
+                    a_num_chunks)) == NULL)
+            return 1;
+
+        tsk_take_lock(&ntfs->comp_cache_lock);
+        free(tbl->offs);
+        tbl->offs = offs;
+        tbl->addr = meta->addr;
+        tbl->seq = meta->seq;
+        tbl->num_chunks = a_num_chunks;
+    }
+    *a_start = tbl->offs[a_idx];
+    *a_end = tbl->offs[a_idx + 1];
+    tsk_release_lock(&ntfs->comp_cache_lock);
+    return 0;
+}
+
+/*
+ * Get a decoder state, one that was used before if there is one.
+ *
+ * @returns NULL on error
+ */
+static NTFS_WOF_DEC *
+ntfs_wof_dec_get(NTFS_INFO * ntfs)
+{
+    NTFS_WOF_DEC *dec = NULL;
+
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    if (ntfs->wof_dec_cnt > 0)
+        dec = ntfs->wof_decs[--ntfs->wof_dec_cnt];
+    tsk_release_lock(&ntfs->comp_cache_lock);
+
+    if (dec == NULL)
+        dec = (NTFS_WOF_DEC *) tsk_malloc(sizeof(NTFS_WOF_DEC));
+    return dec;
+}
+
+/* Give back a decoder state, which is kept if there is room for it */
+static void
+ntfs_wof_dec_put(NTFS_INFO * ntfs, NTFS_WOF_DEC * a_dec)
+{
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    if (ntfs->wof_dec_cnt < NTFS_WOF_DEC_CNT) {
+        ntfs->wof_decs[ntfs->wof_dec_cnt++] = a_dec;
+        a_dec = NULL;
+    }
+    tsk_release_lock(&ntfs->comp_cache_lock);
+    free(a_dec);
+}
+
+/*
+ * Read and decompress a chunk into a_dec->uncomp_buf.
+ *
+ * @returns the number of bytes in the chunk or -1 on error
+ */
+static ssize_t
+ntfs_wof_chunk_read(NTFS_INFO * ntfs, const TSK_FS_ATTR * a_fs_attr,
+    const NTFS_WOF_FILE * a_wof, NTFS_WOF_DEC * a_dec, uint64_t a_idx)
+{
+    uint64_t num_chunks =
+        (a_fs_attr->size + a_wof->chunk_size - 1) / a_wof->chunk_size;
+    TSK_OFF_T start, end;
+    size_t comp_len, uncomp_len;
+    ssize_t cnt;
+    uint8_t retval;
+
+    if (ntfs_wof_chunk_loc(ntfs, a_fs_attr, a_wof, num_chunks, a_idx,
+            &start, &end))
+        return -1;
+
+    uncomp_len = a_wof->chunk_size;
+    if (a_idx == num_chunks - 1)
+        uncomp_len = (size_t) (a_fs_attr->size - a_idx * a_wof->chunk_size);
+    if (end - start > (TSK_OFF_T) uncomp_len) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ntfs_wof_chunk_read: chunk %" PRIu64 " is too large (%"
+            PRIuINUM ")", a_idx, a_fs_attr->fs_file->meta->addr);
+        return -1;
+    }
+    comp_len = (size_t) (end - start);
+
+    // chunks that did not get smaller are stored as is
+    cnt = tsk_fs_attr_read(a_wof->stream, start,
+        (char *) ((comp_len == uncomp_len) ? a_dec->uncomp_buf :
+            a_dec->comp_buf), comp_len, TSK_FS_FILE_READ_FLAG_NONE);
+    if (cnt != (ssize_t) comp_len) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2("ntfs_wof_chunk_read: chunk %" PRIu64
+            " (%" PRIuINUM ")", a_idx, a_fs_attr->fs_file->meta->addr);
+        return -1;
+    }
+    if (comp_len == uncomp_len)
+        return (ssize_t) uncomp_len;
+
+    if (a_wof->algo == NTFS_WOF_LZX)
+        retval = ntfs_wof_lzx(a_dec, a_dec->comp_buf, comp_len,
+            a_dec->uncomp_buf, uncomp_len);
+    else
+        retval = ntfs_wof_xpress(a_dec, a_dec->comp_buf, comp_len,
+            a_dec->uncomp_buf, uncomp_len);
+    if (retval) {
+        tsk_error_set_errstr2("ntfs_wof_chunk_read: chunk %" PRIu64
+            " (%" PRIuINUM ")", a_idx,
+            a_fs_attr->fs_file->meta->addr);
+        return -1;
+    }
+    return (ssize_t) uncomp_len;
+}
+
+
+/** \internal
+ * Read function of the unnamed $DATA stream of WOF compressed files.
+ *
+ * @returns number of bytes read or -1 on error (incl if offset is past EOF)
+ */
+static ssize_t
+ntfs_wof_read(const TSK_FS_ATTR * a_fs_attr, TSK_OFF_T a_offset,
+    char *a_buf, size_t a_len)
+{
+    NTFS_INFO *ntfs;
+    NTFS_WOF_FILE wof;
+    NTFS_WOF_DEC *dec = NULL;
+    size_t buf_idx = 0;
+
+    if ((a_fs_attr == NULL) || (a_fs_attr->fs_file == NULL)
+        || (a_fs_attr->fs_file->meta == NULL)
+        || (a_fs_attr->fs_file->fs_info == NULL)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_wof_read: NULL parameters passed");
+        return -1;
+    }
+    ntfs = (NTFS_INFO *) a_fs_attr->fs_file->fs_info;
+
+    if (a_offset >= a_fs_attr->size) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_READ_OFF);
+        tsk_error_set_errstr("ntfs_wof_read - %" PRIdOFF " Meta: %"
+            PRIuINUM, a_offset, a_fs_attr->fs_file->meta->addr);
+        return -1;
+    }
+
+    if (ntfs_wof_open(a_fs_attr->fs_file, &wof)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("ntfs_wof_read: file is not compressed by WOF (%" PRIuINUM
+            ")", a_fs_attr->fs_file->meta->addr);
+        return -1;
+    }
+
+    if ((TSK_OFF_T) a_len > a_fs_attr->size - a_offset)
+        a_len = (size_t) (a_fs_attr->size - a_offset);
+
+    while (buf_idx < a_len) {
+        TSK_OFF_T off = a_offset + buf_idx;
+        uint64_t idx = off / wof.chunk_size;
+        size_t chunk_off = (size_t) (off % wof.chunk_size);
+        size_t cpylen = a_len - buf_idx;
+        size_t chunk_len = 0;
+        ssize_t cnt;
+
+        cnt = ntfs_compunit_cache_read(ntfs, a_fs_attr, idx, chunk_off,
+            &a_buf[buf_idx], cpylen, &chunk_len);
+        if (cnt == -1) {
+            if ((dec == NULL) && ((dec = ntfs_wof_dec_get(ntfs)) == NULL))
+                return -1;
+
+            if ((cnt = ntfs_wof_chunk_read(ntfs, a_fs_attr, &wof, dec,
+                        idx)) == -1) {
+                ntfs_wof_dec_put(ntfs, dec);
+                return -1;
+            }
+            chunk_len = (size_t) cnt;
+            if (chunk_len > chunk_off) {
+                if (cpylen > chunk_len - chunk_off)
+                    cpylen = chunk_len - chunk_off;
+                memcpy(&a_buf[buf_idx], &dec->uncomp_buf[chunk_off],
+                    cpylen);
+                cnt = (ssize_t) cpylen;
+
+                // keep the chunk for the next reads if it was not all read
+                if ((chunk_off > 0) || (cpylen < chunk_len))
+                    ntfs_compunit_cache_add(ntfs, a_fs_attr, idx,
+                        (const char *) dec->uncomp_buf, chunk_len);
+            }
+            else {
+                cnt = 0;
+            }
+        }
+
+        if (cnt == 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+            tsk_error_set_errstr
+                ("ntfs_wof_read: chunk %" PRIu64 " is too small (%"
+                PRIuINUM ")", idx, a_fs_attr->fs_file->meta->addr);
+            if (dec)
+                ntfs_wof_dec_put(ntfs, dec);
+            return -1;
+        }
+        buf_idx += cnt;
+    }
+
+    if (dec)
+        ntfs_wof_dec_put(ntfs, dec);
+    return (ssize_t) buf_idx;
+}
+
+/** \internal
+ * Walk function of the unnamed $DATA stream of WOF compressed files.  The
+ * data has no address, so 0 is given for each block.
+ *
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_wof_walk(const TSK_FS_ATTR * fs_attr, int flags,
+    TSK_FS_FILE_WALK_CB a_action, void *ptr)
+{
+    TSK_FS_INFO *fs;
+    NTFS_WOF_FILE wof;
+    NTFS_WOF_DEC *dec;
+    uint64_t idx, num_chunks;
+    TSK_OFF_T off = 0;
+    int retval = TSK_WALK_CONT;
+
+    // clean up any error messages that are lying around
+    tsk_error_reset();
+    if ((fs_attr == NULL) || (fs_attr->fs_file == NULL)
+        || (fs_attr->fs_file->meta == NULL)
+        || (fs_attr->fs_file->fs_info == NULL)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_wof_walk: Null arguments given\n");
+        return 1;
+    }
+    fs = fs_attr->fs_file->fs_info;
+
+    if (ntfs_wof_open(fs_attr->fs_file, &wof)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("ntfs_wof_walk: file is not compressed by WOF (%" PRIuINUM ")",
+            fs_attr->fs_file->meta->addr);
+        return 1;
+    }
+
+    if ((dec = ntfs_wof_dec_get((NTFS_INFO *) fs)) == NULL)
+        return 1;
+
+    num_chunks = (fs_attr->size + wof.chunk_size - 1) / wof.chunk_size;
+    for (idx = 0; idx < num_chunks && retval == TSK_WALK_CONT; idx++) {
+        ssize_t chunk_len;
+        size_t i;
+
+        if ((chunk_len = ntfs_wof_chunk_read((NTFS_INFO *) fs, fs_attr,
+                    &wof, dec, idx)) == -1) {
+            ntfs_wof_dec_put((NTFS_INFO *) fs, dec);
+            return 1;
+        }
+
+        for (i = 0; i < (size_t) chunk_len && retval == TSK_WALK_CONT;
+            i += fs->block_size) {
+            size_t read_len = (size_t) chunk_len - i;
+
+            if (read_len > fs->block_size)
+                read_len = fs->block_size;
+
+            retval = a_action(fs_attr->fs_file, off, 0,
+                (char *) &dec->uncomp_buf[i], read_len,
+                TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_COMP, ptr);
+            off += read_len;
+        }
+    }
+
+    ntfs_wof_dec_put((NTFS_INFO *) fs, dec);
+    if (retval == TSK_WALK_ERROR)
+        return 1;
+    else
+        return 0;
+}
+
+
+/**
+ * \internal
+ * Give the unnamed $DATA stream of a file that is compressed by WOF the
+ * functions that decompress its data.  Called once the attributes of the
+ * file are loaded.
+ *
+ * @param a_fs_file File to check
+ */
+void
+ntfs_wof_setup(TSK_FS_FILE * a_fs_file)
+{
+    NTFS_WOF_FILE wof;
+    TSK_FS_ATTR *fs_attr;
+
+    if (ntfs_wof_open(a_fs_file, &wof))
+        return;
+
+    for (fs_attr = a_fs_file->meta->attr->head; fs_attr;
+        fs_attr = fs_attr->next) {
+        if ((fs_attr->flags & TSK_FS_ATTR_INUSE)
+            && (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_DATA)
+            && ((fs_attr->name == NULL) || (fs_attr->name[0] == '\0')))
+            break;
+    }
+    if ((fs_attr == NULL)
+        || (fs_attr->flags & (TSK_FS_ATTR_COMP | TSK_FS_ATTR_ENC)))
+        return;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ntfs_wof_setup: File %" PRIuINUM " is compressed by WOF"
+            " (format %" PRIu32 ")\n", a_fs_file->meta->addr, wof.algo);
+
+    fs_attr->flags |= TSK_FS_ATTR_COMP;
+    fs_attr->r = ntfs_wof_read;
+    fs_attr->w = ntfs_wof_walk;
+    a_fs_file->meta->flags |= TSK_FS_META_FLAG_COMP;
+}
+
+/* Free the cached chunk table and decoder states */
+void
+ntfs_wof_free(NTFS_INFO * a_ntfs)
+{
+    free(a_ntfs->wof_table.offs);
+    a_ntfs->wof_table.offs = NULL;
+    while (a_ntfs->wof_dec_cnt > 0)
+        free(a_ntfs->wof_decs[--a_ntfs->wof_dec_cnt]);
+}
@@ -323,6 +323,10 @@ extern "C" {
     extern int8_t 
     exfatfs_is_cluster_alloc(FATFS_INFO *a_fatfs, TSK_DADDR_T a_cluster_addr);
 
+    extern TSK_DADDR_T
+    exfatfs_cluster_run_end(FATFS_INFO *a_fatfs, TSK_DADDR_T a_cluster_addr,
+        TSK_DADDR_T a_last_cluster_addr, int8_t *a_is_alloc);
+
     extern uint8_t
     exfatfs_fsstat(TSK_FS_INFO *a_fs, FILE *a_hFile);
 
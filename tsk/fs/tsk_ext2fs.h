@@ -95,6 +95,12 @@ extern "C" {
 #define EXT2FS_MIN_BLOCK_SIZE	1024
 #define EXT2FS_MAX_BLOCK_SIZE	4096
 #define EXT2FS_FILE_CONTENT_LEN     ((EXT2FS_NDADDR + EXT2FS_NIADDR) * sizeof(TSK_DADDR_T))
+#define EXT2FS_MAP_CACHE_MAX	(64 * 1024 * 1024)      /* max bytes of each per-volume bitmap cache */
+#define EXT2FS_MAP_RUN_MAX	256     /* max bitmaps read in one I/O */
+#define EXT2FS_EXTENT_CACHE_NUM	64      /* extent tree blocks kept in the per-volume cache */
+#define EXT2FS_EXTENT_DEPTH_MAX	5       /* max depth of an ext4 extent tree */
+#define EXT2FS_INODE_WALK_READ_SIZE	(4 * 1024 * 1024)      /* inode table slice read by inode_walk */
+#define EXT2FS_JOURNAL_READ_SIZE	(4 * 1024 * 1024)      /* journal chunk read when building the block index */
 
 /*
 ** Super Block
@@ -455,6 +461,43 @@ extern "C" {
 #define EXT2_DE_V2	2
 
 
+/*
+ * Hash tree (htree) directory index.  Block 0 of an indexed directory
+ * holds '.' and '..' followed by ext2fs_dx_root_info and the root
+ * entries; interior blocks hold an empty dentry followed by entries.
+ * The first entry of each node is an ext2fs_dx_countlimit.
+ */
+#define EXT2_DX_HASH_LEGACY     0
+#define EXT2_DX_HASH_HALF_MD4   1
+#define EXT2_DX_HASH_TEA        2
+#define EXT2_DX_HASH_UNSIGNED   3       /* added to the above with EXT2_FLAGS_UNSIGNED_HASH */
+#define EXT2_DX_ROOT_INFO_OFF   0x18    /* offset of ext2fs_dx_root_info in block 0 */
+#define EXT2_DX_LEVELS_MAX      3       /* index levels with the largedir feature */
+
+#define EXT2_FLAGS_UNSIGNED_HASH        0x0002  /* s_flags: dir hash uses unsigned char */
+
+#define EXT4_IN_ENCRYPT         0x00000800      /* encrypted inode (ext4 reuse of ECOMPR) */
+#define EXT4_IN_CASEFOLD        0x40000000      /* casefolded directory */
+
+    typedef struct {
+        uint8_t reserved_zero[4];       /* u32 */
+        uint8_t hash_version;
+        uint8_t info_length;
+        uint8_t indirect_levels;
+        uint8_t unused_flags;
+    } ext2fs_dx_root_info;
+
+    typedef struct {
+        uint8_t limit[2];       /* u16 */
+        uint8_t count[2];       /* u16 */
+    } ext2fs_dx_countlimit;
+
+    typedef struct {
+        uint8_t hash[4];        /* u32 */
+        uint8_t block[4];       /* u32: logical block in the directory */
+    } ext2fs_dx_entry;
+
+
 
 
 /* Extended Attributes
@@ -540,6 +583,8 @@ extern "C" {
 #define JBD2_FEATURE_INCOMPAT_REVOKE        0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT         0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT  0x00000004
+#define JBD2_FEATURE_INCOMPAT_CSUM_V2       0x00000008
+#define JBD2_FEATURE_INCOMPAT_CSUM_V3       0x00000010
 
     typedef struct {
         uint8_t magic[4];
@@ -582,6 +627,13 @@ extern "C" {
         uint8_t entry_seq[4];
     } ext2fs_journ_head;
 
+/* Header for revoke blocks.  It is followed by the revoked file system
+ * blocks, 4 bytes each or 8 bytes with JBD2_FEATURE_INCOMPAT_64BIT. */
+    typedef struct {
+        ext2fs_journ_head r_header;
+        uint8_t count[4];       /* bytes used in the block, including the header */
+    } ext2fs_journ_revoke_head;
+
 /* JBD2 Checksum types */
 #define JBD2_CRC32_CHKSUM   1
 #define JBD2_MD5_CHKSUM     2
@@ -610,12 +662,29 @@ extern "C" {
 #define EXT2_J_DENTRY_DEL	4       /* not currently used in src */
 #define EXT2_J_DENTRY_LAST	8       /* Last tag */
 
-/* Entry in the descriptor table */
+/* Entry in the descriptor table.  With JBD2_FEATURE_INCOMPAT_64BIT the
+ * entry is followed by the upper 32 bits of the block.  With CSUM_V2 the
+ * flag is a 16-bit checksum followed by 16-bits of flags.  With CSUM_V3
+ * the entry is 16 bytes: fs_blk, flag, fs_blk_high and checksum.
+ * Descriptors with CSUM_V2 or CSUM_V3 end with a 4-byte checksum tail. */
     typedef struct {
         uint8_t fs_blk[4];
         uint8_t flag[4];
     } ext2fs_journ_dentry;
 
+/* A copy of a file system block in the journal */
+    typedef struct {
+        TSK_DADDR_T fs_blk;     /* file system block that was copied */
+        TSK_DADDR_T jblk;       /* journal block holding the copy */
+        uint32_t seq;           /* sequence (transaction ID) of the descriptor */
+        uint32_t flags;         /* EXT2FS_JBLK_COPY_* */
+    } EXT2FS_JBLK_COPY;
+
+#define EXT2FS_JBLK_COPY_ESC	0x01    /* copy started with the journal magic, which was escaped */
+#define EXT2FS_JBLK_COPY_ALLOC	0x02    /* transaction is in the active part of the journal */
+#define EXT2FS_JBLK_COPY_COMMIT	0x04    /* commit block of the transaction was found */
+#define EXT2FS_JBLK_COPY_REVOKED	0x08    /* block was revoked by a committed transaction with the same or a later sequence */
+
 
 /* Journal Info */
     typedef struct {
@@ -629,6 +698,11 @@ extern "C" {
 
         uint32_t start_seq;
         TSK_DADDR_T start_blk;
+        uint32_t feature_incompat;      /* JBD2_FEATURE_INCOMPAT_*, 0 for v1 sb */
+
+        EXT2FS_JBLK_COPY *copies;       /* block index sorted by fs_blk, seq (set by ext2fs_jindex_load) */
+        size_t copies_cnt;
+        uint8_t copies_loaded;
 
     } EXT2FS_JINFO;
 
@@ -641,7 +715,8 @@ extern "C" {
         TSK_FS_INFO fs_info;    /* super class */
         ext2fs_sb *fs;          /* super block */
 
-        /* lock protects grp_buf, grp_num, bmap_buf, bmap_grp_num, imap_buf, imap_grp_num */
+        /* lock protects grp_buf, grp_num, bmap_buf, bmap_grp_num, imap_buf, imap_grp_num
+         * and the bitmap and extent caches */
         tsk_lock_t lock;
 
         // one of the below will be allocated and populated by ext2fs_group_load depending on the FS type
@@ -656,6 +731,18 @@ extern "C" {
         uint8_t *imap_buf;      /* cached inode allocation bitmap r/w shared - lock */
         EXT2_GRPNUM_T imap_grp_num;     /* cached inode bitmap nr r/w shared - lock */
 
+        // bitmaps of all groups, allocated at open if they fit in EXT2FS_MAP_CACHE_MAX
+        uint8_t *bmap_cache;    /* block bitmaps, one block per group r/w shared - lock */
+        uint8_t *bmap_cache_loaded;     /* bit per group set once in bmap_cache r/w shared - lock */
+        uint8_t *imap_cache;    /* inode bitmaps, one block per group r/w shared - lock */
+        uint8_t *imap_cache_loaded;     /* bit per group set once in imap_cache r/w shared - lock */
+
+        // extent tree blocks shared by all files, allocated on first use
+        uint8_t *extent_cache;  /* EXT2FS_EXTENT_CACHE_NUM blocks r/w shared - lock */
+        TSK_DADDR_T extent_cache_addr[EXT2FS_EXTENT_CACHE_NUM]; /* block in each slot, 0 if unused r/w shared - lock */
+        uint64_t extent_cache_used[EXT2FS_EXTENT_CACHE_NUM];    /* extent_cache_tick at last use r/w shared - lock */
+        uint64_t extent_cache_tick;     /* r/w shared - lock */
+
         TSK_OFF_T groups_offset;        /* offset to first group desc */
         EXT2_GRPNUM_T groups_count;     /* nr of descriptor group blocks */
         uint8_t deentry_type;   /* v1 or v2 of dentry */
@@ -669,11 +756,23 @@ extern "C" {
     extern TSK_RETVAL_ENUM
         ext2fs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
         TSK_INUM_T a_addr);
+    extern TSK_FS_DIR *ext2fs_dir_open_name(TSK_FS_INFO * a_fs,
+        TSK_INUM_T a_addr, const char *a_name);
+    extern uint8_t ext2fs_dx_hash(EXT2FS_INFO * ext2fs, uint8_t a_version,
+        const char *a_name, uint32_t * a_hash);
+    extern uint8_t ext2fs_dinode_load(EXT2FS_INFO * ext2fs,
+        TSK_INUM_T dino_inum, ext2fs_inode * dino_buf);
     extern uint8_t ext2fs_jentry_walk(TSK_FS_INFO *, int,
         TSK_FS_JENTRY_WALK_CB, void *);
     extern uint8_t ext2fs_jblk_walk(TSK_FS_INFO *, TSK_DADDR_T,
         TSK_DADDR_T, int, TSK_FS_JBLK_WALK_CB, void *);
     extern uint8_t ext2fs_jopen(TSK_FS_INFO *, TSK_INUM_T);
+    extern void ext2fs_jinfo_free(EXT2FS_INFO *);
+    extern uint8_t ext2fs_jindex_load(TSK_FS_INFO *);
+    extern uint8_t ext2fs_jindex_find(TSK_FS_INFO *, TSK_DADDR_T,
+        const EXT2FS_JBLK_COPY **, size_t *);
+    extern ssize_t ext2fs_jblk_copy_read(TSK_FS_INFO *,
+        const EXT2FS_JBLK_COPY *, char *, size_t);
 
 #ifdef __cplusplus
 }
@@ -56,8 +56,19 @@
 #define FATFS_FAT_CACHE_N		4       // number of caches
 #define FATFS_FAT_CACHE_B		4096
 
+/* number of FAT entries decoded per read when loading the FAT table (even
+ * so that FAT12 reads start on a byte boundary) */
+#define FATFS_FAT_TABLE_CHUNK   (64 * 1024)
+
 #define FATFS_MASTER_BOOT_RECORD_SIZE 512
 
+/* number of bytes that block_walk reads at a time from a run of clusters */
+#define FATFS_BLKWALK_READ_SIZE  (256 * 1024)
+
+/* number of bytes of directory clusters that inode_walk reads and checks
+ * at a time */
+#define FATFS_INODE_WALK_READ_SIZE  (1024 * 1024)
+
 /** 
  * Directory entries for all FAT file systems are currently 32 bytes long.
  */
@@ -205,6 +216,13 @@ extern "C" {
         TSK_DADDR_T fatc_addr[FATFS_FAT_CACHE_N];     // r/w shared - lock
         uint8_t fatc_ttl[FATFS_FAT_CACHE_N];  //r/w shared - lock
 
+        /* Decoded copy of the first FAT, built by fatfs_open() and
+         * read-only afterwards, so it is read without a lock. Entries are
+         * masked and out of range values are already reset to 0. Clusters
+         * at or after fat_table_cnt go through the cache above. */
+        uint32_t *fat_table;
+        TSK_DADDR_T fat_table_cnt;
+
         /* First sector of FAT */
         TSK_DADDR_T firstfatsect;
 
@@ -241,8 +259,9 @@ extern "C" {
         TSK_INUM_T fat1_virt_inum;
         TSK_INUM_T fat2_virt_inum;
 
-        tsk_lock_t dir_lock;    //< Lock that protects inum2par.
+        tsk_lock_t dir_lock;    //< Lock that protects inum2par and dir_sectors_bitmap.
         void *inum2par;         //< Maps subfolder metadata address to parent folder metadata addresses.
+        uint8_t *dir_sectors_bitmap;    //< Sectors allocated to directories, built by the first inode walk. Read-only once set.
 
 		char boot_sector_buffer[FATFS_MASTER_BOOT_RECORD_SIZE];
         int using_backup_boot_sector;
@@ -251,6 +270,12 @@ extern "C" {
 
         int8_t (*is_cluster_alloc)(FATFS_INFO *fatfs, TSK_DADDR_T clust);
 
+        /* Optional.  Returns the cluster after the run of clusters that
+         * starts at clust and have the same allocation status (at most
+         * last_clust + 1), or 0 if the status of clust is not cached. */
+        TSK_DADDR_T (*cluster_run_end)(FATFS_INFO *fatfs, TSK_DADDR_T clust,
+            TSK_DADDR_T last_clust, int8_t *is_alloc);
+
         uint8_t (*is_dentry)(FATFS_INFO *a_fatfs, FATFS_DENTRY *a_dentry, 
             FATFS_DATA_UNIT_ALLOC_STATUS_ENUM a_cluster_is_alloc, 
             uint8_t a_do_basic_tests_only);
@@ -274,6 +299,8 @@ extern "C" {
         struct {
             uint64_t first_sector_of_alloc_bitmap;
             uint64_t length_of_alloc_bitmap_in_bytes;
+            uint64_t *alloc_bitmap_words;       ///< Copy of the allocation bitmap (bit 0 is cluster 2), read-only after open
+            TSK_DADDR_T alloc_bitmap_nclust;    ///< Number of clusters in alloc_bitmap_words
         } EXFATFS_INFO;
 	};
 
@@ -171,6 +171,9 @@ extern "C" {
 
     extern int8_t fatxxfs_is_cluster_alloc(FATFS_INFO *fatfs, TSK_DADDR_T clust);
 
+    extern TSK_DADDR_T fatxxfs_cluster_run_end(FATFS_INFO *fatfs,
+        TSK_DADDR_T clust, TSK_DADDR_T last_clust, int8_t *is_alloc);
+
     extern uint8_t 
     fatxxfs_is_dentry(FATFS_INFO *a_fatfs, FATFS_DENTRY *a_dentry, 
         FATFS_DATA_UNIT_ALLOC_STATUS_ENUM a_cluster_is_alloc, 
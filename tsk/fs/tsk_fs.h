@@ -764,6 +764,14 @@ extern "C" {
         TSK_DADDR_T fsblk;      /* fs block that journal entry is about */
     } TSK_FS_JENTRY;
 
+    /**
+    * Flags used by jentry_walk.
+    */
+    typedef enum {
+        TSK_FS_JENTRY_WALK_FLAG_NONE = 0x00,    ///< List the journal blocks in journal order
+        TSK_FS_JENTRY_WALK_FLAG_FSBLK = 0x01,   ///< List the copies of file system blocks in file system block order (ext3/ext4 only)
+    } TSK_FS_JENTRY_WALK_FLAG_ENUM;
+
     typedef TSK_WALK_RET_ENUM(*TSK_FS_JBLK_WALK_CB) (TSK_FS_INFO *, char *,
         int, void *);
     typedef TSK_WALK_RET_ENUM(*TSK_FS_JENTRY_WALK_CB) (TSK_FS_INFO *,
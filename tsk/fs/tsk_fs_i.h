@@ -275,9 +275,23 @@ extern "C" {
     typedef TSK_WALK_RET_ENUM(*TSK_FS_USNJENTRY_WALK_CB) (
         TSK_USN_RECORD_HEADER *a_header, void *a_record, void *a_ptr);
 
+    /**
+    * Limits on the records passed to the callback of
+    * tsk_ntfs_usnjentry_walk_filter().  A limit of 0 is not checked.
+    */
+    typedef struct {
+        uint64_t usn_min;       ///< Smallest USN to report
+        uint64_t usn_max;       ///< Largest USN to report
+        uint32_t time_min;      ///< Earliest time (seconds since 1970) to report
+        uint32_t time_max;      ///< Latest time (seconds since 1970) to report
+    } TSK_FS_USNJ_FILTER;
+
     extern uint8_t tsk_ntfs_usnjopen(TSK_FS_INFO * fs, TSK_INUM_T inum);
     extern uint8_t tsk_ntfs_usnjentry_walk(TSK_FS_INFO * fs,
         TSK_FS_USNJENTRY_WALK_CB action, void *ptr);
+    extern uint8_t tsk_ntfs_usnjentry_walk_filter(TSK_FS_INFO * fs,
+        const TSK_FS_USNJ_FILTER * filter, TSK_FS_USNJENTRY_WALK_CB action,
+        void *ptr);
 
     enum TSK_FS_USNJLS_FLAG_ENUM {
         TSK_FS_USNJLS_NONE = 0x00,
@@ -287,6 +301,56 @@ extern "C" {
     typedef enum TSK_FS_USNJLS_FLAG_ENUM TSK_FS_USNJLS_FLAG_ENUM;
     extern uint8_t tsk_fs_usnjls(TSK_FS_INFO * fs, TSK_INUM_T inode,
         TSK_FS_USNJLS_FLAG_ENUM flags);
+    extern uint8_t tsk_fs_usnjls_filter(TSK_FS_INFO * fs, TSK_INUM_T inode,
+        TSK_FS_USNJLS_FLAG_ENUM flags, const TSK_FS_USNJ_FILTER * filter);
+
+
+    /****************** WFS video export ******************/
+
+    /**
+    * Options to select the videos exported by tsk_fs_wfsexport().
+    */
+    typedef struct {
+        int camera;             ///< Camera number to export (-1 for all cameras)
+        time_t start_time;      ///< Skip videos that end before this time (0 for no limit)
+        time_t end_time;        ///< Skip videos that start after this time (0 for no limit)
+        unsigned int nthreads;  ///< Number of writer threads (0 for default)
+    } TSK_FS_WFSEXPORT_OPTS;
+
+    extern uint8_t tsk_fs_wfsexport(TSK_FS_INFO * fs,
+        const TSK_TCHAR * a_out_dir, const TSK_FS_WFSEXPORT_OPTS * a_opts,
+        unsigned int *a_count);
+
+
+    /****************** WFS keyframe index ******************/
+
+    /**
+    * Keyframe of a WFS video (an H.264 IDR picture).
+    */
+    typedef struct {
+        time_t time;            ///< Time the keyframe was recorded at (interpolated within its fragment)
+        TSK_OFF_T offset;       ///< Offset in the video of its first NAL unit (SPS/PPS or IDR)
+    } TSK_FS_WFSKEY;
+
+    /**
+    * Keyframe index of a WFS video, ordered by offset (and time).
+    */
+    typedef struct {
+        TSK_FS_WFSKEY *keys;
+        size_t count;
+        TSK_OFF_T size;         ///< Size of the indexed video
+    } TSK_FS_WFSKEYS;
+
+    extern TSK_FS_WFSKEYS *tsk_fs_wfskeys_build(TSK_FS_FILE * a_fs_file);
+    extern void tsk_fs_wfskeys_free(TSK_FS_WFSKEYS * a_keys);
+    extern uint8_t tsk_fs_wfskeys_save(const TSK_FS_WFSKEYS * a_keys,
+        const TSK_TCHAR * a_path);
+    extern TSK_FS_WFSKEYS *tsk_fs_wfskeys_load(const TSK_TCHAR * a_path);
+    extern const TSK_FS_WFSKEY *tsk_fs_wfskeys_find(const TSK_FS_WFSKEYS *
+        a_keys, time_t a_time);
+    extern ssize_t tsk_fs_wfskeys_read(TSK_FS_FILE * a_fs_file,
+        const TSK_FS_WFSKEYS * a_keys, time_t a_time, char *a_buf,
+        size_t a_len, TSK_OFF_T * a_offset);
 
 
 // Endian macros - actual functions in misc/
@@ -403,6 +403,9 @@ typedef struct {
 #define HFS_BT_NODE_TYPE_HEAD	 1
 #define HFS_BT_NODE_TYPE_MAP	 2
 
+#define HFS_BT_MAX_DEPTH 16      /* levels searched before a B-tree is considered corrupt */
+#define HFS_CAT_LEAF_READ_SIZE (1024 * 1024)     /* max bytes of catalog leaf nodes read at once */
+
 // header that starts every B-tree node
 typedef struct {
     uint8_t flink[4];           /* node num of next node of same type */
@@ -606,6 +609,26 @@ typedef union {
     hfs_file file;
 } hfs_file_folder;
 
+#define HFS_BT_CACHE_NUM 64      /* number of nodes cached per B-tree */
+
+/* Cache of recently read B-tree nodes, keyed by node number (r/w shared - bt_cache_lock) */
+typedef struct {
+    char *data;                 ///< HFS_BT_CACHE_NUM buffers of nodesize bytes
+    uint16_t nodesize;          ///< Size of each cached node
+    uint32_t node[HFS_BT_CACHE_NUM];    ///< Node number held in each slot
+    uint64_t used[HFS_BT_CACHE_NUM];    ///< Tick of last use of each slot (0 if empty)
+    uint64_t tick;              ///< Counter used for LRU replacement
+} HFS_BT_CACHE;
+
+typedef struct {
+    hfs_file cat;               /* on-disk catalog record (either hfs_file or hfs_folder) */
+    int flags;                  /* flags for on-disk record */
+    TSK_INUM_T inum;            /* cnid */
+    hfs_thread thread;          /* thread record */
+} HFS_ENTRY;
+
+#define HFS_ENTRY_CACHE_NUM 2048  /* number of catalog entries cached from folder listings */
+
 typedef struct {
     TSK_FS_INFO fs_info;        /* SUPER CLASS */
 
@@ -630,6 +653,13 @@ typedef struct {
     const TSK_FS_ATTR *extents_attr;
     hfs_btree_header_record extents_header;
 
+    /* bt_cache_lock protects cat_cache, ext_cache, attr_cache and entry_cache */
+    tsk_lock_t bt_cache_lock;
+    HFS_BT_CACHE cat_cache;     ///< Catalog B-tree nodes (r/w shared - bt_cache_lock)
+    HFS_BT_CACHE ext_cache;     ///< Extents B-tree nodes (r/w shared - bt_cache_lock)
+    HFS_BT_CACHE attr_cache;    ///< Attributes B-tree nodes (r/w shared - bt_cache_lock)
+    HFS_ENTRY *entry_cache;     ///< HFS_ENTRY_CACHE_NUM entries of listed folders, slot is cnid % HFS_ENTRY_CACHE_NUM, inum 0 if empty (r/w shared - bt_cache_lock)
+
     TSK_OFF_T hfs_wrapper_offset;       /* byte offset of this FS within an HFS wrapper */
 
     /* Creation times needed for hard link recognition */
@@ -658,13 +688,6 @@ typedef struct {
 
 } HFS_INFO;
 
-typedef struct {
-    hfs_file cat;               /* on-disk catalog record (either hfs_file or hfs_folder) */
-    int flags;                  /* flags for on-disk record */
-    TSK_INUM_T inum;            /* cnid */
-    hfs_thread thread;          /* thread record */
-} HFS_ENTRY;
-
 
 /******************  Resource File Structures *****************/
 
@@ -776,6 +799,10 @@ typedef uint8_t(*TSK_HFS_BTREE_CB) (HFS_INFO *, int8_t level_type,
 
 extern uint8_t hfs_cat_traverse(HFS_INFO * hfs,
     TSK_HFS_BTREE_CB a_cb, void *ptr);
+extern uint8_t hfs_cat_leaf_walk(HFS_INFO * hfs, uint32_t parent_cnid,
+    TSK_HFS_BTREE_CB a_cb, void *ptr);
+extern void hfs_entry_cache_add(HFS_INFO * hfs,
+    const hfs_btree_key_cat * cur_key, const hfs_file_folder * rec);
 
 typedef struct {
     TSK_OFF_T offset;
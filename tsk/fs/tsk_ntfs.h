@@ -49,6 +49,9 @@ extern "C" {
 
 #define NTFS_UPDATE_SEQ_STRIDE  512
 
+/* Bytes of clusters read at once by the block walk */
+#define NTFS_BLKWALK_READ_SIZE  (256 * 1024)
+
 
 
 /************************************************************************
@@ -536,6 +539,14 @@ extern "C" {
         size_t used;            ///< Number of records used in the buffer (size depends on type of data stored)
     } NTFS_SXX_BUFFER;
 
+/* Entry in the table that maps a security ID to its owner SID string.
+ * The table is filled in by ntfs_load_secure() and is read-only after
+ * that. */
+    typedef struct {
+        uint32_t sec_id;        ///< Security ID (0 if the slot is empty)
+        char *sid_str;          ///< Owner SID (NULL if it could not be resolved)
+    } NTFS_SID_ENT;
+
 
 
 /************************************************************************
@@ -698,6 +709,200 @@ extern "C" {
     } NTFS_USNJINFO;
 
 
+/************************************************************************
+ * $LogFile structures.  The file starts with two restart pages, which
+ * are followed by the pages that hold the log records.  Both kinds of
+ * pages are protected with an update sequence array (fixups).
+ */
+#define NTFS_LOG_RSTR_MAGIC     0x52545352      /* "RSTR" */
+#define NTFS_LOG_RCRD_MAGIC     0x44524352      /* "RCRD" */
+
+/* Restart page header */
+    typedef struct {
+        uint8_t magic[4];       /* NTFS_LOG_RSTR_MAGIC */
+        uint8_t upd_off[2];     /* offset of the update sequence array */
+        uint8_t upd_cnt[2];     /* number of entries in the array */
+        uint8_t chkdsk_lsn[8];
+        uint8_t sys_page_size[4];       /* size of a restart page */
+        uint8_t log_page_size[4];       /* size of a record page */
+        uint8_t ra_off[2];      /* offset of the restart area */
+        uint8_t minor_ver[2];
+        uint8_t major_ver[2];
+    } ntfs_log_rstr;
+
+/* Restart area */
+    typedef struct {
+        uint8_t current_lsn[8]; /* LSN of the last checkpoint */
+        uint8_t log_clients[2];
+        uint8_t client_free[2];
+        uint8_t client_used[2];
+        uint8_t flags[2];
+        uint8_t seq_bits[4];    /* bits of the LSN that are a sequence number */
+        uint8_t ra_len[2];
+        uint8_t client_off[2];
+        uint8_t file_size[8];   /* usable size of the log */
+        uint8_t last_lsn_len[4];
+        uint8_t rec_hdr_len[2]; /* size of a log record header */
+        uint8_t data_off[2];    /* offset of the records in a record page */
+        uint8_t open_cnt[4];
+    } ntfs_log_ra;
+
+/* Record page header */
+    typedef struct {
+        uint8_t magic[4];       /* NTFS_LOG_RCRD_MAGIC */
+        uint8_t upd_off[2];
+        uint8_t upd_cnt[2];
+        uint8_t last_lsn[8];    /* LSN of the last record that starts in the page */
+        uint8_t flags[4];
+        uint8_t page_cnt[2];
+        uint8_t page_pos[2];
+        uint8_t next_rec_off[2];
+        uint8_t res[6];
+        uint8_t last_end_lsn[8];        /* LSN of the last record that ends in the page */
+    } ntfs_log_rcrd;
+
+/* Log record header.  Headers do not cross pages, but the client data
+ * that follows them can. */
+#define NTFS_LOG_RECTYPE_CLIENT     1
+#define NTFS_LOG_RECTYPE_RESTART    2
+
+#define NTFS_LOG_RECFLAG_MULTIPAGE  0x0001
+
+    typedef struct {
+        uint8_t this_lsn[8];
+        uint8_t prev_lsn[8];    /* previous record of the same client */
+        uint8_t undo_lsn[8];    /* next record to undo */
+        uint8_t data_len[4];    /* length of the client data */
+        uint8_t client_seq[2];
+        uint8_t client_idx[2];
+        uint8_t rec_type[4];    /* NTFS_LOG_RECTYPE_XXX */
+        uint8_t trans_id[4];    /* transaction ID */
+        uint8_t flags[2];       /* NTFS_LOG_RECFLAG_XXX */
+        uint8_t res[6];
+    } ntfs_log_rec;
+
+/* Client data of the records written by NTFS */
+    typedef struct {
+        uint8_t redo_op[2];
+        uint8_t undo_op[2];
+        uint8_t redo_off[2];
+        uint8_t redo_len[2];
+        uint8_t undo_off[2];
+        uint8_t undo_len[2];
+        uint8_t target_attr[2];
+        uint8_t lcn_cnt[2];     /* number of LCNs after the header */
+        uint8_t rec_off[2];
+        uint8_t attr_off[2];
+        uint8_t clust_blk_off[2];
+        uint8_t res[2];
+        uint8_t target_vcn[8];
+    } ntfs_log_op;
+
+    typedef struct {
+        TSK_FS_FILE *fs_file;
+        const TSK_FS_ATTR *fs_attr;     /* $DATA of $LogFile */
+        TSK_INUM_T log_inum;
+        uint32_t sys_page_size; /* size of the restart pages */
+        uint32_t page_size;     /* size of the record pages */
+        uint32_t seq_bits;
+        uint16_t rec_hdr_len;
+        uint16_t data_off;
+        uint16_t major_ver;
+        uint16_t minor_ver;
+        uint64_t current_lsn;
+        TSK_OFF_T file_size;    /* usable size of the log */
+        TSK_DADDR_T rstr_page;  /* restart page that is used */
+    } NTFS_LOGINFO;
+
+
+/* Sizes of the MFT entry cache and of the windows read into it (bytes) */
+#define NTFS_MFT_CACHE_SIZE     (8 * 1024 * 1024)
+#define NTFS_MFT_WIN_MIN        (16 * 1024)
+#define NTFS_MFT_WIN_MAX        (1024 * 1024)
+
+    typedef struct {
+        TSK_INUM_T mftnum;      /* address of the cached entry */
+        int32_t hnext;          /* next entry in the same hash bucket */
+        int32_t prev;           /* LRU list (head is most recently used) */
+        int32_t next;
+    } NTFS_MFT_CACHE_ENT;
+
+    /* Cache of MFT entries with their update sequences applied */
+    typedef struct {
+        char *recs;             /* cap entries of mft_rsize_b bytes */
+        NTFS_MFT_CACHE_ENT *ents;
+        int32_t *buckets;       /* hash of mftnum to index in ents */
+        int32_t cap;
+        int32_t count;
+        int32_t lru_head;
+        int32_t lru_tail;
+        uint8_t disabled;       /* set if the buffers could not be allocated */
+        char *win_buf;          /* buffer for the windows read from $MFT */
+        TSK_INUM_T win_start;   /* entries in the last window */
+        TSK_INUM_T win_end;
+        uint32_t win_recs;      /* size of the last window (in entries) */
+    } NTFS_MFT_CACHE;
+
+
+/* Number of decompressed compression units kept by ntfs_file_read_special */
+#define NTFS_COMPUNIT_CACHE_CNT 8
+
+    typedef struct {
+        TSK_INUM_T addr;        /* MFT entry of the attribute */
+        uint32_t seq;           /* sequence of the MFT entry */
+        uint32_t type;          /* type and id of the attribute */
+        uint16_t id;
+        TSK_DADDR_T vcn;        /* first cluster of the unit in the attribute */
+        char *buf;              /* decompressed data (NULL if not used) */
+        size_t buf_size;
+        size_t len;             /* number of bytes of data in buf */
+        uint64_t used;          /* value of comp_cache_clock when last used */
+    } NTFS_COMPUNIT_CACHE_ENT;
+
+
+/************************************************************************
+ * Files compressed by the Windows Overlay Filter (WOF), such as the
+ * system files of a CompactOS install.  The file has a reparse point with
+ * the WOF tag and its data is in the WofCompressedData $DATA stream.
+ */
+#define NTFS_WOF_REPARSE_TAG    0x80000017
+#define NTFS_WOF_PROVIDER_FILE  2
+#define NTFS_WOF_STREAM_NAME    "WofCompressedData"
+
+/* Compression formats of the file provider */
+#define NTFS_WOF_XPRESS4K   0
+#define NTFS_WOF_LZX        1
+#define NTFS_WOF_XPRESS8K   2
+#define NTFS_WOF_XPRESS16K  3
+
+/* Largest chunk size (LZX) */
+#define NTFS_WOF_CHUNK_MAX  32768
+
+/* Number of decoder states that are kept for the next reads */
+#define NTFS_WOF_DEC_CNT    4
+
+    struct NTFS_WOF_DEC;
+
+    typedef struct {
+        uint8_t tag[4];         /* NTFS_WOF_REPARSE_TAG */
+        uint8_t len[2];
+        uint8_t res[2];
+        uint8_t wof_ver[4];     /* 1 */
+        uint8_t wof_prov[4];    /* NTFS_WOF_PROVIDER_FILE */
+        uint8_t file_ver[4];    /* 1 */
+        uint8_t file_algo[4];   /* NTFS_WOF_XXX compression format */
+    } ntfs_wof_reparse;
+
+/* Chunk table of the last WOF compressed file that was read */
+    typedef struct {
+        TSK_INUM_T addr;        /* MFT entry of the file */
+        uint32_t seq;           /* sequence of the MFT entry */
+        uint64_t num_chunks;
+        TSK_OFF_T *offs;        /* offset of each chunk in the stream and of
+                                 * the end of the last one (NULL if not used) */
+    } NTFS_WOF_TABLE;
+
+
 /************************************************************************
 */
     typedef struct {
@@ -714,12 +919,25 @@ extern "C" {
 
         uint8_t loading_the_MFT;        /* set to 1 when initializing the setup */
 
+        /* mft_cache_lock protects mft_cache */
+        tsk_lock_t mft_cache_lock;
+        NTFS_MFT_CACHE mft_cache;       // (r/w shared - lock)
+
+        /* comp_cache_lock protects comp_cache, comp_cache_clock, wof_table,
+         * wof_decs, wof_dec_cnt */
+        tsk_lock_t comp_cache_lock;
+        NTFS_COMPUNIT_CACHE_ENT comp_cache[NTFS_COMPUNIT_CACHE_CNT];   // (r/w shared - lock)
+        uint64_t comp_cache_clock;      // (r/w shared - lock)
+        NTFS_WOF_TABLE wof_table;       // (r/w shared - lock)
+        struct NTFS_WOF_DEC *wof_decs[NTFS_WOF_DEC_CNT];        // (r/w shared - lock)
+        int wof_dec_cnt;        // (r/w shared - lock)
+
         TSK_FS_ATTR_RUN *bmap;  /* Run of bitmap for clusters (linked list) */
 
-        /* lock protects bmap_buf, bmap_buf_off */
-        tsk_lock_t lock;
-        char *bmap_buf;         /* buffer to hold cached copy of bitmap (r/w shared - lock)  */
-        TSK_DADDR_T bmap_buf_off;       /* offset cluster in cached bitmap  (r/w shared - lock) */
+        /* Copy of $Bitmap (as little endian words), loaded at open time and
+         * not changed after that */
+        uint64_t *bmap_words;
+        TSK_DADDR_T bmap_nclust;        /* number of clusters in bmap_words */
 
         ntfs_attrdef *attrdef;  // buffer of attrdef file contents
         size_t attrdef_len;     // length of addrdef buffer
@@ -733,6 +951,10 @@ extern "C" {
         tsk_lock_t sid_lock;
         NTFS_SXX_BUFFER sii_data;       // (r/w shared - lock)
         NTFS_SXX_BUFFER sds_data;       // (r/w shared - lock)
+
+        /* Hash table of resolved owner SIDs, not changed after open */
+        NTFS_SID_ENT *sid_map;
+        uint32_t sid_map_size;  /* number of slots (a power of 2) */
 #endif
 
         /* Number of allocated regular files. 0 until a directory is
@@ -740,6 +962,7 @@ extern "C" {
         int alloc_file_count;      
                                     
         NTFS_USNJINFO *usnjinfo;        // update sequence number journal
+        NTFS_LOGINFO *loginfo;  // $LogFile (set by ntfs_jopen)
     } NTFS_INFO;
 
 
@@ -754,6 +977,37 @@ extern "C" {
 
     extern void ntfs_orphan_map_free(NTFS_INFO * a_ntfs);
 
+    extern void ntfs_uncompress_copy(unsigned char *a_buf,
+        size_t a_buf_size, size_t a_dst, size_t a_offset, size_t a_len);
+    extern uint8_t ntfs_uncompress_buf(const unsigned char *a_in,
+        size_t a_in_len, unsigned char *a_out, size_t a_out_size,
+        size_t * a_out_len);
+    extern ssize_t ntfs_compunit_cache_read(NTFS_INFO * ntfs,
+        const TSK_FS_ATTR * a_fs_attr, TSK_DADDR_T a_vcn, size_t a_off,
+        char *a_buf, size_t a_len, size_t * a_unit_len);
+    extern void ntfs_compunit_cache_add(NTFS_INFO * ntfs,
+        const TSK_FS_ATTR * a_fs_attr, TSK_DADDR_T a_vcn,
+        const char *a_data, size_t a_len);
+
+    extern void ntfs_wof_setup(TSK_FS_FILE * a_fs_file);
+    extern uint8_t ntfs_wof_decompress(uint32_t a_algo,
+        const unsigned char *a_in, size_t a_in_len, unsigned char *a_out,
+        size_t a_out_len);
+    extern void ntfs_wof_free(NTFS_INFO * a_ntfs);
+
+    extern uint8_t ntfs_jopen(TSK_FS_INFO * fs, TSK_INUM_T inum);
+    extern uint8_t ntfs_log_load(TSK_FS_INFO * fs,
+        NTFS_LOGINFO * loginfo);
+    extern uint8_t ntfs_jentry_walk(TSK_FS_INFO * fs, int flags,
+        TSK_FS_JENTRY_WALK_CB a_action, void *ptr);
+    extern uint8_t ntfs_jblk_walk(TSK_FS_INFO * fs, TSK_DADDR_T start,
+        TSK_DADDR_T end, int flags, TSK_FS_JBLK_WALK_CB a_action,
+        void *ptr);
+    extern void ntfs_loginfo_free(NTFS_INFO * a_ntfs);
+    extern uint8_t ntfs_usnj_walk_attr(const TSK_FS_ATTR * fs_attr,
+        TSK_ENDIAN_ENUM endian, const TSK_FS_USNJ_FILTER * filter,
+        TSK_FS_USNJENTRY_WALK_CB action, void *ptr);
+
     extern int ntfs_name_cmp(TSK_FS_INFO *, const char *, const char *);
 
     extern uint8_t ntfs_find_file(TSK_FS_INFO * fs, TSK_INUM_T inode_toid,
@@ -38,7 +38,10 @@ extern "C" {
 #define WFSFS_MAGIC_WFS05       "WFS0.5"
 #define WFSFS_HEADER_FOOT       "XM"
 
-#define WFSFS_MAXNAMLEN         35  /* strlen("Vid-YYYYMMDD-HHMMSS-HHMMSS.CCC.h264") */
+#define WFSFS_MAXNAMLEN         38  /* strlen("Orphan-YYYYMMDD-HHMMSS-HHMMSS.CCC.h264") */
+
+#define WFSFS_VIDEO_PREFIX      "Vid"
+#define WFSFS_ORPHAN_PREFIX     "Orphan"
 #define WFSFS_INODE_SIZE        32
 
 #define WFSFS_FILE_CONTENT_LEN sizeof(TSK_DADDR_T)      // we will store the starting cluster
@@ -53,8 +56,6 @@ extern "C" {
 
 #define WFSFS_CAM_NUM(cam_id) ((cam_id + 2) / 4)
 
-    time_t wfsfs_mktime(const uint8_t* wfs_time);
-
     typedef struct {
         char h_fs_magic[6];
         char h_filler[504];
@@ -138,9 +139,23 @@ extern "C" {
     } WFSFS_INODE;
 
 /*
- * directory entries
+ * Timestamp decoded from the packed YYYYYYMMMMDDDDDHHHHHmmmmmmSSSSSS
+ * format.  Fields are taken as stored, so they may be out of range on
+ * damaged entries.
  */
     typedef struct {
+        uint16_t year;               /* full year (2000-2063) */
+        uint8_t  mon;                /* 1-12 */
+        uint8_t  mday;               /* 1-31 */
+        uint8_t  hour;
+        uint8_t  min;
+        uint8_t  sec;
+    } WFSFS_TIME;
+
+/*
+ * directory entries
+ */
+    typedef struct WFSFS_DENTRY {
         uint8_t d_type[1];                   /* 1 - datedir;  2 - camdir; 3 - file */
         union {
             uint8_t             d_inode[4];
@@ -150,6 +165,45 @@ extern "C" {
         char    d_name[WFSFS_MAXNAMLEN];
     } WFSFS_DENTRY;
 
+    /*
+     * Chain of continuation fragments (0x01) whose head inode has been
+     * overwritten.  These are shown in $OrphanFiles, using the first
+     * fragment of the chain as their address.
+     */
+    typedef struct {
+        uint32_t  first_frag;       /* first fragment (and inode) of chain */
+        uint32_t  num_frags;        /* number of fragments in chain */
+        uint8_t   time_start[4];    /* oldest fragment timestamp */
+        uint8_t   time_end[4];      /* newest fragment timestamp */
+        uint8_t   camera;
+    } WFSFS_ORPHAN;
+
+    /*
+     * Contiguous run of blocks sharing the same allocation status.  The
+     * file system is described by a handful of these (meta, reserved
+     * fragments and the two sides of the ring buffer).
+     */
+    typedef struct {
+        TSK_DADDR_T   start;        /* first block of range */
+        TSK_DADDR_T   end;          /* last block of range */
+        TSK_FS_BLOCK_FLAG_ENUM flags;
+    } WFSFS_BLK_RANGE;
+
+#define WFSFS_MAX_BLK_RANGES    5
+
+    /*
+     * Offset from UTC of the recorder clock from one hour of that clock
+     * on.  The offset follows the daylight saving time rules of the local
+     * time zone, so it changes at each transition of those rules.
+     */
+    typedef struct {
+        int64_t       hour;         /* hours since the epoch, recorder clock */
+        int32_t       offset;       /* seconds east of UTC */
+    } WFSFS_TZ_ENTRY;
+
+/* Number of fragments handled by one task of the orphan search */
+#define WFSFS_ORPHAN_PART_SIZE  65536
+
     /*
      * Structure of an WFS file system handle.
      */
@@ -157,8 +211,52 @@ extern "C" {
         TSK_FS_INFO   fs_info;      /* super class */
         WFSFS_SB      sb;           /* super block */
         TSK_FS_META   *root_inode;  /* root inode (virtual) */
+
+        /* layout decoded from the super block at open time */
+        TSK_DADDR_T   first_data_block;
+        uint32_t      blocks_per_frag;
+        TSK_DADDR_T   reserved_end;     /* first block after reserved frags */
+        TSK_DADDR_T   newest_end;       /* first block after newest frag */
+        TSK_DADDR_T   oldest_start;     /* first block of oldest frag */
+        WFSFS_BLK_RANGE blk_ranges[WFSFS_MAX_BLK_RANGES];
+        int           blk_range_cnt;
+
+        WFSFS_TZ_ENTRY *tz_table;   /* UTC offsets used by wfsfs_mktime,
+                                       sorted by hour (r/o after open) */
+        size_t        tz_cnt;
+
+        tsk_lock_t    lock;         /* protects idx_table and orphans loading */
+        uint8_t       *idx_table;   /* whole index area, loaded on demand by
+                                       wfsfs_load_idx_table (r/o once set) */
+        WFSFS_ORPHAN  *orphans;     /* orphan chains sorted by first_frag,
+                                       loaded by wfsfs_load_orphans */
+        size_t        orphan_cnt;
+        uint8_t       orphans_loaded;
     } WFSFS_INFO;
 
+/* Size of the reads done by wfsfs_block_walk */
+#define WFSFS_BLKWALK_READ_SIZE (256 * 1024)
+
+/* Size of the reads used to load the index area in one pass */
+#define WFSFS_IDX_READ_SIZE     (1024 * 1024)
+
+
+    extern void
+        wfsfs_decode_time(const uint8_t * wfs_time, WFSFS_TIME * a_time);
+    extern time_t
+        wfsfs_mktime(WFSFS_INFO * wfsfs, const uint8_t * wfs_time);
+    extern uint8_t
+        wfsfs_load_idx_table(WFSFS_INFO * wfsfs);
+    extern uint64_t
+        wfsfs_get_file_size(WFSFS_INFO * wfsfs, const WFSFS_INODE * dino_buf);
+    extern void
+        wfsfs_gen_name(const char *a_prefix, const uint8_t * a_time_start,
+            const uint8_t * a_time_end, uint8_t a_camera, char *a_name,
+            size_t a_len);
+    extern uint8_t
+        wfsfs_load_orphans(WFSFS_INFO * wfsfs);
+    extern const WFSFS_ORPHAN *
+        wfsfs_find_orphan(WFSFS_INFO * wfsfs, TSK_INUM_T a_inum);
 
     TSK_RETVAL_ENUM
         wfsfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
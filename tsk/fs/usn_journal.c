@@ -12,25 +12,126 @@
 
 /** \file usn_journal.c
  * Contains the TSK Update Sequence Number journal walking code.
+ *
+ * The journal ($UsnJrnl:$J) is mostly sparse.  Only the runs that hold
+ * data are read.  They are split into segments that are parsed in
+ * parallel, in batches of at most USNJ_BATCH_SIZE bytes.  The segments
+ * keep a copy of the records that match the filter, which are built and
+ * passed to the callback in order once the batch is parsed.  The USN of
+ * a record is its offset in the journal, which is used to find the first
+ * record of a segment that does not start a run.
  */
 
 #include "tsk_fs_i.h"
 #include "tsk_ntfs.h"
 
+/* Size of the pieces of the journal that are parsed in parallel */
+#define USNJ_SEGMENT_SIZE   (4 * 1024 * 1024)
+
+/* Most bytes of the journal that are parsed before their records are
+ * passed to the callback.  This bounds the memory used by the copies of
+ * the records. */
+#define USNJ_BATCH_SIZE     (64 * 1024 * 1024)
+
+/* Size of the reads done while parsing a segment */
+#define USNJ_READ_SIZE      (1024 * 1024)
+
+/* Largest record that is accepted (must be smaller than USNJ_READ_SIZE) */
+#define USNJ_MAX_RECORD_LEN 65536
+
+/* Size of the V 2.0 record before the name */
+#define USNJ_V2_HEADER_LEN  60
+
+
+/* A segment of the journal */
+typedef struct {
+    TSK_OFF_T start;            // first byte of the segment
+    TSK_OFF_T end;              // byte after the segment
+    TSK_OFF_T region_end;       // end of the data run(s) holding the segment
+    uint8_t region_first;       // 1 if the segment starts the run(s)
+    TSK_OFF_T sync;             // offset of the first record, -1 if none
+    TSK_OFF_T stop;             // records from here on are in the next segment
+} USNJ_SEGMENT;
+
+/* A record found while parsing a segment */
+typedef struct {
+    TSK_OFF_T off;              // offset of the record in the journal
+    size_t pos;                 // offset of its copy in USNJ_RESULT.data
+} USNJ_ENTRY;
+
+/* The records found in a segment */
+typedef struct {
+    USNJ_ENTRY *entries;
+    size_t cnt;
+    size_t alloc;
+    unsigned char *data;        // copies of the records
+    size_t data_len;
+    size_t data_alloc;
+    TSK_OFF_T end;              // offset after the last record
+    uint8_t err;
+    uint32_t t_errno;
+    char *errstr;
+    char *errstr2;
+} USNJ_RESULT;
+
+/* Data shared by the parallel parsing callbacks */
+typedef struct {
+    const TSK_FS_ATTR *fs_attr;
+    TSK_ENDIAN_ENUM endian;
+    const TSK_FS_USNJ_FILTER *filter;
+    USNJ_SEGMENT *segs;
+    USNJ_RESULT *results;       // results of the current batch
+    size_t batch_start;         // first segment of the current batch
+} USNJ_PARSE;
+
+/* Buffered reader of a range of the journal */
+typedef struct {
+    const TSK_FS_ATTR *fs_attr;
+    unsigned char *buf;
+    TSK_OFF_T off;              // offset of buf in the journal
+    size_t len;                 // bytes in buf
+    TSK_OFF_T end;              // reads stop here
+    uint8_t err;
+} USNJ_READER;
+
 
 /*
- * Search the next record in the buffer skipping null bytes.
- * Records are alway aligned at 8 bytes.
- * Returns the offset of the next record.
+ * Return a pointer to a_len bytes at offset a_off of the journal.  The
+ * buffer is refilled from a_off if they are not already in it.
+ * Returns NULL if the bytes go past the end of the reader's range or if
+ * they could not be read (a_rd->err is set and the TSK error is set).
  */
-static TSK_OFF_T
-search_record(const unsigned char *buf, TSK_OFF_T offset, ssize_t bufsize)
+static const unsigned char *
+usnj_reader_get(USNJ_READER * a_rd, TSK_OFF_T a_off, size_t a_len)
 {
-    for ( ; offset < bufsize; offset++)
-        if (buf[offset] != '\0')
-            return offset - (offset % 8);
-
-    return offset;
+    size_t len;
+    ssize_t cnt;
+
+    if ((a_off >= a_rd->off) &&
+        (a_off + (TSK_OFF_T) a_len <= a_rd->off + (TSK_OFF_T) a_rd->len))
+        return &a_rd->buf[a_off - a_rd->off];
+
+    if (a_off + (TSK_OFF_T) a_len > a_rd->end)
+        return NULL;
+
+    len = USNJ_READ_SIZE;
+    if ((TSK_OFF_T) len > a_rd->end - a_off)
+        len = (size_t) (a_rd->end - a_off);
+
+    cnt = tsk_fs_attr_read(a_rd->fs_attr, a_off, (char *) a_rd->buf, len,
+        TSK_FS_FILE_READ_FLAG_NONE);
+    if (cnt != (ssize_t) len) {
+        if (cnt >= 0) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+        }
+        tsk_error_set_errstr2("usnj_reader_get: offset %" PRIdOFF, a_off);
+        a_rd->err = 1;
+        return NULL;
+    }
+    a_rd->off = a_off;
+    a_rd->len = len;
+    return a_rd->buf;
 }
 
 
@@ -117,120 +218,535 @@ parse_v2_record(const unsigned char *buf, TSK_USN_RECORD_HEADER *header,
 
 
 /*
- * Parse the UsnJrnl record.
- * Calls the action callback.
- * Returns TSK_WALK_CONT on success, TSK_WALK_ERROR on error.
+ * Check that a record header is plausible and that the record fits in
+ * buf.  The whole record must have been loaded in buf.
+ * Returns 1 if the record can be parsed, 0 otherwise
  */
-static TSK_WALK_RET_ENUM
-parse_record(const unsigned char *buf, TSK_USN_RECORD_HEADER *header,
-             TSK_ENDIAN_ENUM endian, TSK_FS_USNJENTRY_WALK_CB action, void *ptr)
+static uint8_t
+record_valid(const unsigned char *buf, const TSK_USN_RECORD_HEADER *header,
+             TSK_ENDIAN_ENUM endian)
 {
-    TSK_WALK_RET_ENUM ret;
-
     switch (header->major_version) {
-    case 2: {
-        TSK_USN_RECORD_V2 record;
+    case 2:
+        if (header->length < USNJ_V2_HEADER_LEN)
+            return 0;
+        return (uint32_t) tsk_getu16(endian, &buf[58]) +
+            tsk_getu16(endian, &buf[56]) <= header->length;
+    case 3:
+    case 4:
+        return header->length >= 48;
+    default:
+        return 0;
+    }
+}
+
 
-        ret = parse_v2_record(buf, header, &record, endian);
-        if (ret == 1)
-            return TSK_WALK_ERROR;
+/*
+ * Check the length and version of a record header before the record is
+ * loaded.
+ * Returns 1 if it could be the header of a record, 0 otherwise
+ */
+static uint8_t
+header_valid(const TSK_USN_RECORD_HEADER *header)
+{
+    return (header->length >= 8) && (header->length % 8 == 0) &&
+        (header->length <= USNJ_MAX_RECORD_LEN) &&
+        (header->major_version >= 2) && (header->major_version <= 4);
+}
 
-        ret = (*action)(header, &record, ptr);
 
-        free(record.fname);
+/*
+ * Returns the USN of a valid record.
+ */
+static uint64_t
+record_usn(const unsigned char *buf, const TSK_USN_RECORD_HEADER *header,
+           TSK_ENDIAN_ENUM endian)
+{
+    /* V 3.0 and 4.0 records have 128-bit file references */
+    if (header->major_version == 2)
+        return tsk_getu64(endian, &buf[24]);
+    else
+        return tsk_getu64(endian, &buf[40]);
+}
 
-        return ret;
+
+/*
+ * Check a V 2.0 record against the filter without parsing it.
+ * Returns 1 if the record should be reported, 0 otherwise
+ */
+static uint8_t
+record_match(const unsigned char *buf, const TSK_FS_USNJ_FILTER *filter,
+             TSK_ENDIAN_ENUM endian)
+{
+    uint64_t usn;
+    uint32_t time_sec;
+
+    if (filter == NULL)
+        return 1;
+
+    usn = tsk_getu64(endian, &buf[24]);
+    if ((filter->usn_min && usn < filter->usn_min) ||
+        (filter->usn_max && usn > filter->usn_max))
+        return 0;
+
+    if (filter->time_min || filter->time_max) {
+        time_sec = nt2unixtime(tsk_getu64(endian, &buf[32]));
+        if ((filter->time_min && time_sec < filter->time_min) ||
+            (filter->time_max && time_sec > filter->time_max))
+            return 0;
     }
-    case 3: {
-        if (tsk_verbose)
-            tsk_fprintf(stderr,
-                        "parse_record: USN records V 3 not supported yet.");
+    return 1;
+}
 
-        return TSK_WALK_CONT;
+
+/*
+ * Save the TSK error of a parsing callback in its result, as the error
+ * state is per thread.
+ */
+static void
+save_error(USNJ_RESULT *result)
+{
+    result->err = 1;
+    result->t_errno = tsk_error_get_errno();
+    result->errstr = strdup(tsk_error_get_errstr());
+    result->errstr2 = strdup(tsk_error_get_errstr2());
+}
+
+
+/*
+ * tsk_parallel_for callback: find the first record of a segment that
+ * does not start a data run.  Records are always aligned at 8 bytes and
+ * the USN of a record is its offset in the journal, which is unlikely to
+ * match in the middle of a record.
+ */
+static void
+find_sync(size_t a_idx, void *a_ptr)
+{
+    USNJ_PARSE *parse = (USNJ_PARSE *) a_ptr;
+    USNJ_SEGMENT *seg = &parse->segs[a_idx];
+    USNJ_READER rd;
+    TSK_USN_RECORD_HEADER header;
+    TSK_OFF_T off;
+
+    seg->sync = -1;
+    if (seg->region_first) {
+        seg->sync = seg->start;
+        return;
     }
-    case 4: {
-        if (tsk_verbose)
-            tsk_fprintf(stderr,
-                        "parse_record: USN records V 4 not supported yet.");
 
-        return TSK_WALK_CONT;
+    memset(&rd, 0, sizeof(rd));
+    rd.fs_attr = parse->fs_attr;
+    rd.end = seg->region_end;
+    if ((rd.buf = (unsigned char *) tsk_malloc(USNJ_READ_SIZE)) == NULL) {
+        save_error(&parse->results[a_idx]);
+        return;
     }
-    default: return TSK_WALK_ERROR;
+
+    for (off = seg->start; off < seg->end; off += 8) {
+        const unsigned char *buf = usnj_reader_get(&rd, off, 8);
+
+        if (buf == NULL)
+            break;
+        if (tsk_getu64(parse->endian, buf) == 0)
+            continue;
+
+        parse_record_header(buf, &header, parse->endian);
+        if (header_valid(&header) == 0)
+            continue;
+
+        if ((buf = usnj_reader_get(&rd, off, header.length)) == NULL) {
+            if (rd.err)
+                break;
+            continue;
+        }
+
+        if (record_valid(buf, &header, parse->endian) &&
+            (record_usn(buf, &header, parse->endian) == (uint64_t) off)) {
+            seg->sync = off;
+            break;
+        }
     }
+
+    if (rd.err)
+        save_error(&parse->results[a_idx]);
+    free(rd.buf);
 }
 
 
 /*
- * Parse the UsnJrnl block buffer.
- *
- * Recover the record size from the header.
- *
- * If the record does not fit in the entire buffer, returns to the callee
- * its offset for alignment.
- *
- * If the buffer is big enough, parses the USN record.
- *
- * Returns -1 on error, 0 in case the action callback decided to stop,
- * a number greater than 0 if the buffer is not big enough.
+ * tsk_parallel_for callback: parse the records of a segment, from its
+ * first record up to its stop offset.  A record that starts before the
+ * stop offset may end in the next segment.  Bytes that are not a valid
+ * record (including the 0s that pad the records) are skipped 8 at a time.
+ * Only V 2.0 records that match the filter are saved, as a copy of their
+ * bytes.
  */
-static int
-parse_buffer(const unsigned char *buf, ssize_t bufsize,
-             TSK_ENDIAN_ENUM endian, TSK_FS_USNJENTRY_WALK_CB action, void *ptr)
+static void
+parse_segment(size_t a_idx, void *a_ptr)
 {
-    TSK_OFF_T offset = 0;
-    TSK_WALK_RET_ENUM ret = 0;
+    USNJ_PARSE *parse = (USNJ_PARSE *) a_ptr;
+    USNJ_SEGMENT *seg = &parse->segs[parse->batch_start + a_idx];
+    USNJ_RESULT *result = &parse->results[a_idx];
+    USNJ_READER rd;
     TSK_USN_RECORD_HEADER header;
+    TSK_OFF_T off;
+
+    memset(&rd, 0, sizeof(rd));
+    rd.fs_attr = parse->fs_attr;
+    rd.end = seg->region_end;
+    if ((rd.buf = (unsigned char *) tsk_malloc(USNJ_READ_SIZE)) == NULL) {
+        save_error(result);
+        return;
+    }
+
+    off = seg->sync;
+    while (off < seg->stop) {
+        const unsigned char *buf = usnj_reader_get(&rd, off, 8);
+
+        if (buf == NULL)
+            break;
+        if (tsk_getu64(parse->endian, buf) == 0) {
+            off += 8;
+            continue;
+        }
+
+        parse_record_header(buf, &header, parse->endian);
+        if ((header_valid(&header) == 0) ||
+            ((buf = usnj_reader_get(&rd, off, header.length)) == NULL) ||
+            (record_valid(buf, &header, parse->endian) == 0)) {
+            if (rd.err)
+                break;
+            off += 8;
+            continue;
+        }
+
+        if (header.major_version != 2) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "parse_segment: USN records V %" PRIu16
+                    " not supported yet.\n", header.major_version);
+        }
+        else if (record_match(buf, parse->filter, parse->endian)) {
+            USNJ_ENTRY *entry;
+
+            if (result->cnt == result->alloc) {
+                size_t alloc = result->alloc ? result->alloc * 2 : 1024;
+                USNJ_ENTRY *tmp = (USNJ_ENTRY *) tsk_realloc(result->entries,
+                    alloc * sizeof(USNJ_ENTRY));
+                if (tmp == NULL) {
+                    rd.err = 1;
+                    break;
+                }
+                result->entries = tmp;
+                result->alloc = alloc;
+            }
+            if (result->data_len + header.length > result->data_alloc) {
+                size_t alloc = result->data_alloc ?
+                    result->data_alloc * 2 : USNJ_MAX_RECORD_LEN;
+                unsigned char *tmp;
+
+                while (result->data_len + header.length > alloc)
+                    alloc *= 2;
+                tmp = (unsigned char *) tsk_realloc(result->data, alloc);
+                if (tmp == NULL) {
+                    rd.err = 1;
+                    break;
+                }
+                result->data = tmp;
+                result->data_alloc = alloc;
+            }
+
+            entry = &result->entries[result->cnt++];
+            entry->off = off;
+            entry->pos = result->data_len;
+            memcpy(&result->data[result->data_len], buf, header.length);
+            result->data_len += header.length;
+        }
+
+        off += header.length;
+    }
+    result->end = off;
 
-    while ((offset = search_record(buf, offset, bufsize)) < bufsize) {
-        parse_record_header(&buf[offset], &header, endian);
+    if (rd.err)
+        save_error(result);
+    free(rd.buf);
+}
 
-        /* The buffer does not contain the entire record */
-        if (offset + header.length > bufsize)
-            return bufsize - offset;
 
-        ret = parse_record(&buf[offset], &header, endian, action, ptr);
-        if (ret == TSK_WALK_ERROR)
-            return -1;
-        else if (ret == TSK_WALK_STOP)
-            return 0;
+/*
+ * Split the parts of the journal that hold data into segments.  Sparse
+ * runs and the data after the initialized size hold no records and are
+ * skipped.
+ * Returns the segments (NULL on error) and sets a_cnt to their number.
+ */
+static USNJ_SEGMENT *
+make_segments(const TSK_FS_ATTR *fs_attr, size_t *a_cnt)
+{
+    USNJ_SEGMENT *segs = NULL;
+    size_t cnt = 0, alloc = 0;
+    TSK_OFF_T end = fs_attr->size;
+    TSK_FS_ATTR_RUN *run;
+
+    *a_cnt = 0;
+
+    /* Compressed and resident data is read as one region */
+    if ((fs_attr->flags & TSK_FS_ATTR_NONRES) &&
+        ((fs_attr->flags & TSK_FS_ATTR_COMP) == 0)) {
+        run = fs_attr->nrd.run;
+        if (fs_attr->nrd.initsize < end)
+            end = fs_attr->nrd.initsize;
+    }
+    else {
+        run = NULL;
+    }
 
-        offset += header.length;
+    for (;;) {
+        TSK_OFF_T rstart, rend, off;
+        TSK_OFF_T block_size = fs_attr->fs_file->fs_info->block_size;
+
+        if (run == NULL) {
+            if ((fs_attr->flags & TSK_FS_ATTR_NONRES) &&
+                ((fs_attr->flags & TSK_FS_ATTR_COMP) == 0))
+                break;
+            rstart = 0;
+            rend = end;
+        }
+        else {
+            if (run->flags & (TSK_FS_ATTR_RUN_FLAG_SPARSE |
+                    TSK_FS_ATTR_RUN_FLAG_FILLER)) {
+                run = run->next;
+                continue;
+            }
+
+            /* Runs that follow each other in the journal are one region */
+            rstart = (TSK_OFF_T) run->offset * block_size;
+            rend = (TSK_OFF_T) (run->offset + run->len) * block_size;
+            while ((run->next) &&
+                ((run->next->flags & (TSK_FS_ATTR_RUN_FLAG_SPARSE |
+                            TSK_FS_ATTR_RUN_FLAG_FILLER)) == 0) &&
+                ((TSK_OFF_T) run->next->offset * block_size == rend)) {
+                run = run->next;
+                rend += (TSK_OFF_T) run->len * block_size;
+            }
+            run = run->next;
+        }
+
+        if (rend > end)
+            rend = end;
+
+        for (off = rstart; off < rend; off += USNJ_SEGMENT_SIZE) {
+            USNJ_SEGMENT *seg;
+
+            if (cnt == alloc) {
+                USNJ_SEGMENT *tmp;
+                alloc = alloc ? alloc * 2 : 64;
+                if ((tmp = (USNJ_SEGMENT *) tsk_realloc(segs,
+                            alloc * sizeof(USNJ_SEGMENT))) == NULL) {
+                    free(segs);
+                    return NULL;
+                }
+                segs = tmp;
+            }
+            seg = &segs[cnt++];
+            seg->start = off;
+            seg->end = off + USNJ_SEGMENT_SIZE;
+            if (seg->end > rend)
+                seg->end = rend;
+            seg->region_end = rend;
+            seg->region_first = (off == rstart);
+        }
+
+        if (run == NULL)
+            break;
     }
 
-    return offset;
+    /* tsk_realloc() is not called for an empty journal */
+    if (segs == NULL)
+        segs = (USNJ_SEGMENT *) tsk_malloc(sizeof(USNJ_SEGMENT));
+
+    *a_cnt = cnt;
+    return segs;
 }
 
 
 /*
- * Parse the UsnJrnl file.
- * Iterates through the file in blocks.
- * Returns 0 on success, 1 otherwise
+ * Copy the error saved by a parsing callback to this thread.
+ */
+static void
+set_saved_error(const USNJ_RESULT *result)
+{
+    tsk_error_reset();
+    tsk_error_set_errno(result->t_errno);
+    if (result->errstr)
+        tsk_error_set_errstr("%s", result->errstr);
+    if (result->errstr2)
+        tsk_error_set_errstr2("%s", result->errstr2);
+}
+
+
+/*
+ * Free the records and errors of a batch of results and clear them.
+ */
+static void
+free_results(USNJ_RESULT *results, size_t cnt)
+{
+    size_t i;
+
+    for (i = 0; i < cnt; i++) {
+        free(results[i].entries);
+        free(results[i].data);
+        free(results[i].errstr);
+        free(results[i].errstr2);
+    }
+    memset(results, 0, cnt * sizeof(USNJ_RESULT));
+}
+
+
+/*
+ * Build the records that were saved by a segment and pass them to the
+ * action callback.  Records that start before a_prev_end were already
+ * reported by the previous segment.
+ * Returns 0 to continue, 1 on error and 2 if the callback stopped the walk
  */
 static uint8_t
-parse_file(NTFS_INFO * ntfs, unsigned char *buf,
-           TSK_FS_USNJENTRY_WALK_CB action, void *ptr)
+report_result(const USNJ_RESULT *result, TSK_OFF_T a_prev_end,
+              TSK_ENDIAN_ENUM endian, TSK_FS_USNJENTRY_WALK_CB action,
+              void *ptr)
 {
-    ssize_t size = 0;
-    TSK_OFF_T offset = 0, ret = 0;
+    size_t i;
+
+    for (i = 0; i < result->cnt; i++) {
+        const USNJ_ENTRY *entry = &result->entries[i];
+        const unsigned char *buf = &result->data[entry->pos];
+        TSK_USN_RECORD_HEADER header;
+        TSK_USN_RECORD_V2 record;
+        TSK_WALK_RET_ENUM wret;
 
-    while ((size = tsk_fs_file_read(ntfs->usnjinfo->fs_file, offset,
-                                    (char*)buf, ntfs->usnjinfo->bsize,
-                                    TSK_FS_FILE_READ_FLAG_NONE)) > 0)
-    {
-        ret = parse_buffer(buf, size, ntfs->fs_info.endian, action, ptr);
+        /* The previous segment ran past the first record that was found
+         * in this one */
+        if (entry->off < a_prev_end)
+            continue;
 
-        if (ret < 0)
+        parse_record_header(buf, &header, endian);
+        if (parse_v2_record(buf, &header, &record, endian))
             return 1;
-        else if (ret == 0)
-            return 0;
 
-        offset += ret;
+        wret = (*action)(&header, &record, ptr);
+        free(record.fname);
+        if (wret == TSK_WALK_ERROR)
+            return 1;
+        else if (wret == TSK_WALK_STOP)
+            return 2;
     }
-
     return 0;
 }
 
 
+/*
+ * Walk the records of a UsnJrnl $J attribute.
+ * The segments are parsed in parallel in batches, after which the
+ * records of the batch are passed to the action callback in order.
+ * Returns 0 on success, 1 otherwise
+ */
+uint8_t
+ntfs_usnj_walk_attr(const TSK_FS_ATTR *fs_attr, TSK_ENDIAN_ENUM endian,
+                    const TSK_FS_USNJ_FILTER *filter,
+                    TSK_FS_USNJENTRY_WALK_CB action, void *ptr)
+{
+    USNJ_PARSE parse;
+    size_t seg_cnt, batch_size, i;
+    TSK_OFF_T prev_end = 0;
+    uint8_t ret = 0;
+
+    memset(&parse, 0, sizeof(parse));
+    parse.fs_attr = fs_attr;
+    parse.endian = endian;
+    parse.filter = filter;
+
+    if ((parse.segs = make_segments(parse.fs_attr, &seg_cnt)) == NULL)
+        return 1;
+
+    /* The results are used by all of the segments when looking for their
+     * first record and by one batch of segments when parsing */
+    batch_size = 2 * tsk_parallel_nthreads();
+    if (batch_size > USNJ_BATCH_SIZE / USNJ_SEGMENT_SIZE)
+        batch_size = USNJ_BATCH_SIZE / USNJ_SEGMENT_SIZE;
+    i = (seg_cnt > batch_size) ? seg_cnt : batch_size;
+    parse.results = (USNJ_RESULT *) tsk_malloc(i * sizeof(USNJ_RESULT));
+    if (parse.results == NULL) {
+        free(parse.segs);
+        return 1;
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr, "parse_file: %" PRIuSIZE
+                    " segments with data\n", seg_cnt);
+
+    /* Find the first record of each segment */
+    tsk_parallel_for(seg_cnt, find_sync, &parse);
+    for (i = 0; i < seg_cnt; i++) {
+        if (parse.results[i].err) {
+            set_saved_error(&parse.results[i]);
+            ret = 1;
+            break;
+        }
+    }
+    free_results(parse.results, seg_cnt);
+
+    /* Each segment parses up to the first record of the next one.  A
+     * segment without a record start is covered by the one before it. */
+    for (i = seg_cnt; ret == 0 && i > 0; i--) {
+        USNJ_SEGMENT *seg = &parse.segs[i - 1];
+
+        if ((i < seg_cnt) && (parse.segs[i].region_first == 0))
+            seg->stop = parse.segs[i].sync;
+        else
+            seg->stop = seg->region_end;
+
+        if (seg->sync == -1)
+            seg->sync = seg->stop;
+    }
+
+    for (parse.batch_start = 0; ret == 0 && parse.batch_start < seg_cnt;
+        parse.batch_start += batch_size) {
+        size_t cnt = seg_cnt - parse.batch_start;
+        if (cnt > batch_size)
+            cnt = batch_size;
+
+        tsk_parallel_for(cnt, parse_segment, &parse);
+
+        for (i = 0; ret == 0 && i < cnt; i++) {
+            USNJ_SEGMENT *seg = &parse.segs[parse.batch_start + i];
+            USNJ_RESULT *result = &parse.results[i];
+
+            if (result->err) {
+                set_saved_error(result);
+                ret = 1;
+                break;
+            }
+
+            if (seg->region_first)
+                prev_end = 0;
+
+            if ((ret = report_result(result, prev_end, parse.endian,
+                        action, ptr)) == 2) {
+                free_results(parse.results, cnt);
+                free(parse.results);
+                free(parse.segs);
+                return 0;
+            }
+            if (result->end > prev_end)
+                prev_end = result->end;
+        }
+        free_results(parse.results, cnt);
+    }
+
+    free(parse.results);
+    free(parse.segs);
+    return ret;
+}
+
+
 /**
  * Open the Update Sequence Number Journal stored at the inode inum.
  *
@@ -291,10 +807,33 @@ tsk_ntfs_usnjopen(TSK_FS_INFO *fs, TSK_INUM_T inum)
 uint8_t
 tsk_ntfs_usnjentry_walk(TSK_FS_INFO *fs, TSK_FS_USNJENTRY_WALK_CB action,
                         void *ptr)
+{
+    return tsk_ntfs_usnjentry_walk_filter(fs, NULL, action, ptr);
+}
+
+
+/**
+ * Walk through the Update Sequence Number journal file
+ * opened with ntfs_usnjopen, only reporting the records that match a
+ * filter.  The filter is checked before the records are built.
+ *
+ * For each matching USN record, calls the callback action passing the
+ * USN record header, the USN record and the pointer ptr.
+ *
+ * @param ntfs File system where the journal is stored
+ * @param filter Limits on the records to report (NULL for all records)
+ * @param action action to be called per each USN entry
+ * @param ptr pointer to data passed to the action callback
+ * @returns 0 on success, 1 otherwise
+ */
+uint8_t
+tsk_ntfs_usnjentry_walk_filter(TSK_FS_INFO *fs,
+                               const TSK_FS_USNJ_FILTER *filter,
+                               TSK_FS_USNJENTRY_WALK_CB action, void *ptr)
 {
     uint8_t ret = 0;
-    unsigned char *buf = NULL;
     NTFS_INFO *ntfs = (NTFS_INFO*)fs;
+    const TSK_FS_ATTR *fs_attr;
 
     tsk_error_reset();
 
@@ -310,15 +849,16 @@ tsk_ntfs_usnjentry_walk(TSK_FS_INFO *fs, TSK_FS_USNJENTRY_WALK_CB action,
         return 1;
     }
 
-    buf = tsk_malloc(ntfs->usnjinfo->bsize);
-    if (buf == NULL)
-        return 1;
-
-    ret = parse_file(ntfs, buf, action, ptr);
+    fs_attr = tsk_fs_file_attr_get(ntfs->usnjinfo->fs_file);
+    if (fs_attr == NULL)
+        ret = 1;
+    else
+        ret = ntfs_usnj_walk_attr(fs_attr, ntfs->fs_info.endian, filter,
+            action, ptr);
 
     tsk_fs_file_close(ntfs->usnjinfo->fs_file);
     free(ntfs->usnjinfo);
-    free(buf);
+    ntfs->usnjinfo = NULL;
 
     return ret;
 }
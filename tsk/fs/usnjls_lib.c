@@ -311,6 +311,16 @@ print_usnjent_act(TSK_USN_RECORD_HEADER *a_header, void *a_record, void *a_ptr)
 /* Returns 0 on success and 1 on error */
 uint8_t
 tsk_fs_usnjls(TSK_FS_INFO * fs, TSK_INUM_T inode, TSK_FS_USNJLS_FLAG_ENUM flags)
+{
+    return tsk_fs_usnjls_filter(fs, inode, flags, NULL);
+}
+
+
+/* Only lists the records that match filter (all records if NULL).
+ * Returns 0 on success and 1 on error */
+uint8_t
+tsk_fs_usnjls_filter(TSK_FS_INFO * fs, TSK_INUM_T inode,
+    TSK_FS_USNJLS_FLAG_ENUM flags, const TSK_FS_USNJ_FILTER * filter)
 {
     uint8_t ret = 0;
 
@@ -326,5 +336,6 @@ tsk_fs_usnjls(TSK_FS_INFO * fs, TSK_INUM_T inode, TSK_FS_USNJLS_FLAG_ENUM flags)
     if (ret == 1)
         return 1;
 
-    return tsk_ntfs_usnjentry_walk(fs, print_usnjent_act, &flags);
+    return tsk_ntfs_usnjentry_walk_filter(fs, filter, print_usnjent_act,
+        &flags);
 }
@@ -0,0 +1,558 @@
+/*
+** wfsexport
+** The Sleuth Kit
+**
+** Bulk export of the videos stored in a WFS0.4/5 file system.
+**
+** This software is distributed under the Common Public License 1.0
+**
+*/
+
+/** \file wfsexport_lib.cpp
+ * Contains the library code associated with the TSK wfsexport tool
+ * to export all videos of a WFS0.4/5 file system.
+ *
+ * Instead of resolving and reading each file on its own (like icat or
+ * tsk_recover do), the whole index area is loaded once, the fragments of
+ * all selected videos are sorted by their physical address and the data
+ * area is read in large contiguous chunks.  The chunks are handed over to
+ * a set of writer threads, each one owning a subset of the output files.
+ * A writer keeps the few files it last wrote to open, so the number of
+ * open handles does not grow with the number of videos.
+ */
+
+#include "tsk_fs_i.h"
+#include "tsk_wfsfs.h"
+
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef TSK_MULTITHREAD_LIB
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+/* Maximum number of bytes read from the image at once */
+#define WFS_EXPORT_READ_SIZE    (16 * 1024 * 1024)
+
+/* Default number of writer threads */
+#define WFS_EXPORT_NTHREADS     4
+
+/* Read chunks that can be waiting for writers, per writer thread */
+#define WFS_EXPORT_INFLIGHT     4
+
+/* Output files that a writer thread keeps open */
+#define WFS_EXPORT_OPEN_FILES   4
+
+typedef struct {
+    TSK_INUM_T inum;            // head fragment of the video
+    std::string name;           // output file name, unique in the export
+    TSK_OFF_T remain;           // bytes still to be written (writer owned)
+    bool created;               // output file exists (writer owned)
+} WFS_EXPORT_VIDEO;
+
+typedef struct {
+    TSK_OFF_T addr;             // byte offset of the fragment in the fs
+    size_t len;                 // bytes of the video stored there
+    size_t video;               // index in the video list
+    TSK_OFF_T offset;           // byte offset of the fragment in the video
+} WFS_EXPORT_EXTENT;
+
+static bool
+extent_cmp(const WFS_EXPORT_EXTENT & a, const WFS_EXPORT_EXTENT & b)
+{
+    return a.addr < b.addr;
+}
+
+/* A chunk of data read from the image and shared by the writers */
+typedef struct {
+    std::vector<char> data;
+#ifdef TSK_MULTITHREAD_LIB
+    std::atomic<size_t> refs;
+#else
+    size_t refs;
+#endif
+} WFS_EXPORT_CHUNK;
+
+typedef struct {
+    WFS_EXPORT_CHUNK *chunk;
+    size_t chunk_off;
+    const WFS_EXPORT_EXTENT *ext;
+} WFS_EXPORT_JOB;
+
+/* An open output file of a writer */
+typedef struct {
+    FILE *file;                 // NULL if the slot is free
+    size_t video;               // video written to file
+    uint64_t used;              // writer tick of the last write
+} WFS_EXPORT_HANDLE;
+
+class WfsExporter {
+public:
+    WfsExporter(const TSK_TCHAR * a_out_dir, unsigned int a_nthreads);
+    ~WfsExporter();
+
+    uint8_t run(TSK_FS_INFO * a_fs, std::vector<WFS_EXPORT_VIDEO> &a_videos,
+        const std::vector<WFS_EXPORT_EXTENT> &a_extents);
+
+private:
+    uint8_t writeJob(unsigned int a_writer, const WFS_EXPORT_JOB & a_job);
+    FILE *getFile(unsigned int a_writer, size_t a_video);
+    void closeFile(WFS_EXPORT_HANDLE & a_handle);
+    void pushJob(unsigned int a_writer, const WFS_EXPORT_JOB & a_job);
+    void releaseChunk(WFS_EXPORT_CHUNK * a_chunk);
+    void setError(const char *a_msg);
+
+    std::basic_string<TSK_TCHAR> m_out_dir;
+    std::vector<WFS_EXPORT_VIDEO> *m_videos;
+    unsigned int m_nthreads;
+    // WFS_EXPORT_OPEN_FILES open output files of each writer
+    std::vector<WFS_EXPORT_HANDLE> m_files;
+    std::vector<uint64_t> m_ticks;      // writes done by each writer
+#ifdef TSK_MULTITHREAD_LIB
+    std::atomic<bool> m_failed;
+#else
+    bool m_failed;
+#endif
+    std::string m_errstr;
+
+#ifdef TSK_MULTITHREAD_LIB
+    void writerLoop(unsigned int a_writer);
+
+    std::mutex m_lock;
+    std::condition_variable m_work_cv;  // signaled when a job is queued
+    std::condition_variable m_free_cv;  // signaled when a chunk is freed
+    std::vector<std::deque<WFS_EXPORT_JOB> > m_queues;
+    size_t m_inflight;
+    bool m_done;
+#endif
+};
+
+WfsExporter::WfsExporter(const TSK_TCHAR * a_out_dir,
+    unsigned int a_nthreads)
+:  m_out_dir(a_out_dir), m_videos(NULL), m_nthreads(a_nthreads),
+m_failed(false)
+{
+#ifdef TSK_MULTITHREAD_LIB
+    m_queues.resize(m_nthreads);
+    m_inflight = 0;
+    m_done = false;
+#else
+    m_nthreads = 1;
+#endif
+    WFS_EXPORT_HANDLE handle = { NULL, 0, 0 };
+    m_files.resize(m_nthreads * WFS_EXPORT_OPEN_FILES, handle);
+    m_ticks.resize(m_nthreads, 0);
+}
+
+WfsExporter::~WfsExporter()
+{
+    for (size_t i = 0; i < m_files.size(); i++)
+        closeFile(m_files[i]);
+}
+
+void
+WfsExporter::closeFile(WFS_EXPORT_HANDLE & a_handle)
+{
+    if (a_handle.file != NULL) {
+        fclose(a_handle.file);
+        a_handle.file = NULL;
+    }
+}
+
+void
+WfsExporter::setError(const char *a_msg)
+{
+#ifdef TSK_MULTITHREAD_LIB
+    std::lock_guard<std::mutex> guard(m_lock);
+#endif
+    if (!m_failed) {
+        m_failed = true;
+        m_errstr = a_msg;
+    }
+}
+
+/*
+ * Get the output file of a video from the open files of a writer.  If it
+ * is not open, the least recently used file of the writer is closed to
+ * make room; a video whose fragments are interleaved with those of more
+ * videos than that is reopened for update.
+ *
+ * @returns NULL on error
+ */
+FILE *
+WfsExporter::getFile(unsigned int a_writer, size_t a_video)
+{
+    WFS_EXPORT_HANDLE *handles = &m_files[a_writer * WFS_EXPORT_OPEN_FILES];
+    WFS_EXPORT_HANDLE *slot = &handles[0];
+    uint64_t tick = ++m_ticks[a_writer];
+
+    for (int i = 0; i < WFS_EXPORT_OPEN_FILES; i++) {
+        if ((handles[i].file != NULL) && (handles[i].video == a_video)) {
+            handles[i].used = tick;
+            return handles[i].file;
+        }
+        if ((slot->file != NULL) && ((handles[i].file == NULL)
+                || (handles[i].used < slot->used)))
+            slot = &handles[i];
+    }
+
+    WFS_EXPORT_VIDEO & video = (*m_videos)[a_video];
+    std::basic_string<TSK_TCHAR> path(m_out_dir);
+    path += _TSK_T('/');
+    for (size_t i = 0; i < video.name.size(); i++)
+        path += (TSK_TCHAR) video.name[i];
+
+    closeFile(*slot);
+#ifdef TSK_WIN32
+    slot->file = _wfopen(path.c_str(), video.created ? L"r+b" : L"wb");
+#else
+    slot->file = fopen(path.c_str(), video.created ? "r+b" : "wb");
+#endif
+    if (slot->file == NULL) {
+        char errbuf[512];
+        snprintf(errbuf, sizeof(errbuf),
+            "tsk_fs_wfsexport: Error %s file %s for video %" PRIuINUM,
+            video.created ? "opening" : "creating", video.name.c_str(),
+            video.inum);
+        setError(errbuf);
+        return NULL;
+    }
+    slot->video = a_video;
+    slot->used = tick;
+    video.created = true;
+    return slot->file;
+}
+
+/*
+ * Write the data of one fragment to its video file.  Only the writer that
+ * owns the video calls this, so the file handles need no locking.  The
+ * file is closed once all of the video has been written.
+ */
+uint8_t
+WfsExporter::writeJob(unsigned int a_writer, const WFS_EXPORT_JOB & a_job)
+{
+    WFS_EXPORT_VIDEO & video = (*m_videos)[a_job.ext->video];
+    char errbuf[512];
+
+    FILE *hFile = getFile(a_writer, a_job.ext->video);
+    if (hFile == NULL)
+        return 1;
+
+    if ((fseeko(hFile, a_job.ext->offset, SEEK_SET) != 0) ||
+        (fwrite(&a_job.chunk->data[a_job.chunk_off], a_job.ext->len, 1,
+                hFile) != 1)) {
+        snprintf(errbuf, sizeof(errbuf),
+            "tsk_fs_wfsexport: Error writing file %s at offset %" PRIdOFF,
+            video.name.c_str(), a_job.ext->offset);
+        setError(errbuf);
+        return 1;
+    }
+
+    video.remain -= a_job.ext->len;
+    if (video.remain <= 0) {
+        WFS_EXPORT_HANDLE *handles =
+            &m_files[a_writer * WFS_EXPORT_OPEN_FILES];
+        for (int i = 0; i < WFS_EXPORT_OPEN_FILES; i++) {
+            if (handles[i].file == hFile) {
+                closeFile(handles[i]);
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+void
+WfsExporter::releaseChunk(WFS_EXPORT_CHUNK * a_chunk)
+{
+    if (--a_chunk->refs > 0)
+        return;
+
+    delete a_chunk;
+#ifdef TSK_MULTITHREAD_LIB
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_inflight--;
+    m_free_cv.notify_one();
+#endif
+}
+
+#ifdef TSK_MULTITHREAD_LIB
+void
+WfsExporter::writerLoop(unsigned int a_writer)
+{
+    std::deque<WFS_EXPORT_JOB> & queue = m_queues[a_writer];
+
+    while (true) {
+        WFS_EXPORT_JOB job;
+        {
+            std::unique_lock<std::mutex> guard(m_lock);
+            m_work_cv.wait(guard, [&] {
+                return !queue.empty() || m_done;
+            });
+            if (queue.empty())
+                return;
+            job = queue.front();
+            queue.pop_front();
+        }
+
+        // once an error occurred, just drain the queue
+        if (!m_failed)
+            writeJob(a_writer, job);
+        releaseChunk(job.chunk);
+    }
+}
+#endif
+
+void
+WfsExporter::pushJob(unsigned int a_writer, const WFS_EXPORT_JOB & a_job)
+{
+#ifdef TSK_MULTITHREAD_LIB
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_queues[a_writer].push_back(a_job);
+    m_work_cv.notify_all();
+#else
+    if (!m_failed)
+        writeJob(a_writer, a_job);
+    releaseChunk(a_job.chunk);
+#endif
+}
+
+/*
+ * Read the extents in physical order, merging adjacent ones into large
+ * reads, and dispatch the data to the writers.
+ *
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+WfsExporter::run(TSK_FS_INFO * a_fs, std::vector<WFS_EXPORT_VIDEO> &a_videos,
+    const std::vector<WFS_EXPORT_EXTENT> &a_extents)
+{
+    uint8_t retval = 0;
+    m_videos = &a_videos;
+
+#ifdef TSK_MULTITHREAD_LIB
+    std::vector<std::thread> writers;
+    for (unsigned int i = 0; i < m_nthreads; i++)
+        writers.push_back(std::thread(&WfsExporter::writerLoop, this, i));
+#endif
+
+    size_t i = 0;
+    while (i < a_extents.size() && !m_failed) {
+        // merge physically adjacent extents
+        size_t last = i;
+        size_t len = a_extents[i].len;
+        while (last + 1 < a_extents.size()
+            && a_extents[last + 1].addr == a_extents[last].addr +
+            (TSK_OFF_T) a_extents[last].len
+            && len + a_extents[last + 1].len <= WFS_EXPORT_READ_SIZE) {
+            last++;
+            len += a_extents[last].len;
+        }
+
+#ifdef TSK_MULTITHREAD_LIB
+        {
+            std::unique_lock<std::mutex> guard(m_lock);
+            m_free_cv.wait(guard, [&] {
+                return m_inflight < m_nthreads * WFS_EXPORT_INFLIGHT;
+            });
+            m_inflight++;
+        }
+#endif
+        WFS_EXPORT_CHUNK *chunk = new WFS_EXPORT_CHUNK;
+        chunk->data.resize(len);
+        chunk->refs = last - i + 2;     // one extra ref held while dispatching
+
+        ssize_t cnt = tsk_fs_read(a_fs, a_extents[i].addr, &chunk->data[0],
+            len);
+        if (cnt != (ssize_t) len) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("tsk_fs_wfsexport: data at %" PRIdOFF,
+                a_extents[i].addr);
+            retval = 1;
+            chunk->refs = 1;
+            releaseChunk(chunk);
+            break;
+        }
+
+        size_t chunk_off = 0;
+        for (size_t j = i; j <= last; j++) {
+            WFS_EXPORT_JOB job;
+            job.chunk = chunk;
+            job.chunk_off = chunk_off;
+            job.ext = &a_extents[j];
+            pushJob((unsigned int) (a_extents[j].video % m_nthreads), job);
+            chunk_off += a_extents[j].len;
+        }
+        releaseChunk(chunk);
+        i = last + 1;
+    }
+
+#ifdef TSK_MULTITHREAD_LIB
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_done = true;
+        m_work_cv.notify_all();
+    }
+    for (size_t t = 0; t < writers.size(); t++)
+        writers[t].join();
+#endif
+
+    if (m_failed && retval == 0) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WRITE);
+        tsk_error_set_errstr("%s", m_errstr.c_str());
+        retval = 1;
+    }
+    return retval;
+}
+
+
+/**
+ * Export the videos of a WFS0.4/5 file system to a directory.  The videos
+ * get the same names that are shown by fls.  Videos with the same name
+ * (same times and camera) get the inode of their head fragment added to
+ * it, except for the first one.
+ *
+ * @param fs File system to export the videos of
+ * @param a_out_dir Existing directory to write the videos in
+ * @param a_opts Selection and thread options (NULL for defaults)
+ * @param a_count Set to the number of exported videos (can be NULL)
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_wfsexport(TSK_FS_INFO * fs, const TSK_TCHAR * a_out_dir,
+    const TSK_FS_WFSEXPORT_OPTS * a_opts, unsigned int *a_count)
+{
+    WFSFS_INFO *wfsfs = (WFSFS_INFO *) fs;
+    int camera = -1;
+    time_t start_time = 0, end_time = 0;
+    unsigned int nthreads = WFS_EXPORT_NTHREADS;
+
+    tsk_error_reset();
+
+    if (!TSK_FS_TYPE_ISWFS(fs->ftype)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_wfsexport: Called with non-WFS0.4/5 file system: %x",
+            fs->ftype);
+        return 1;
+    }
+
+    if (a_opts != NULL) {
+        camera = a_opts->camera;
+        start_time = a_opts->start_time;
+        end_time = a_opts->end_time;
+        if (a_opts->nthreads > 0)
+            nthreads = a_opts->nthreads;
+    }
+
+    if (wfsfs_load_idx_table(wfsfs))
+        return 1;
+
+    const WFSFS_INODE *table = (const WFSFS_INODE *) wfsfs->idx_table;
+    TSK_OFF_T frag_len =
+        (TSK_OFF_T) tsk_getu32(fs->endian, wfsfs->sb.s_blocks_per_frag) *
+        fs->block_size;
+    TSK_OFF_T data_off =
+        (TSK_OFF_T) tsk_getu32(fs->endian, wfsfs->sb.s_first_data_block) *
+        fs->block_size;
+    TSK_OFF_T fs_end = (TSK_OFF_T) (fs->last_block + 1) * fs->block_size;
+
+    std::vector<WFS_EXPORT_VIDEO> videos;
+    std::vector<WFS_EXPORT_EXTENT> extents;
+    std::set<std::string> names;
+
+    for (TSK_INUM_T inum = fs->first_inum; inum < fs->root_inum; inum++) {
+        const WFSFS_INODE *head = &table[inum];
+
+        if ((head->i_type_desc[0] != 0x02) && (head->i_type_desc[0] != 0x03))
+            continue;
+        if ((camera >= 0) && (WFSFS_CAM_NUM(head->i_camera[0]) != camera))
+            continue;
+        if ((start_time != 0) &&
+            (wfsfs_mktime(wfsfs, head->i_time_end) < start_time))
+            continue;
+        if ((end_time != 0) &&
+            (wfsfs_mktime(wfsfs, head->i_time_start) > end_time))
+            continue;
+
+        TSK_OFF_T size = (TSK_OFF_T) wfsfs_get_file_size(wfsfs, head);
+        size_t first_ext = extents.size();
+        size_t vid_idx = videos.size();
+        TSK_OFF_T offset = 0;
+        TSK_INUM_T cur_frag = inum;
+
+        /* Follow the fragment chain like wfsfs_load_attrs does, but over
+         * the cached index table */
+        while (offset < size) {
+            TSK_OFF_T len = (size - offset) / fs->block_size * fs->block_size;
+            if (len > frag_len)
+                len = frag_len;
+            if ((len == 0) || (cur_frag >= fs->root_inum)
+                || (data_off + (TSK_OFF_T) cur_frag * frag_len + len >
+                    fs_end))
+                break;
+
+            WFS_EXPORT_EXTENT ext;
+            ext.addr = data_off + (TSK_OFF_T) cur_frag * frag_len;
+            ext.len = (size_t) len;
+            ext.video = vid_idx;
+            ext.offset = offset;
+            extents.push_back(ext);
+
+            offset += len;
+            cur_frag = tsk_getu32(fs->endian, table[cur_frag].i_next_frag);
+        }
+
+        if ((offset == 0) || (offset < size
+                && size - offset >= fs->block_size)) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "tsk_fs_wfsexport: Skipping video %" PRIuINUM
+                    " with invalid fragment chain\n", inum);
+            extents.resize(first_ext);
+            continue;
+        }
+
+        WFS_EXPORT_VIDEO video;
+        char name[WFSFS_MAXNAMLEN + 1];
+        video.inum = inum;
+        wfsfs_gen_name(WFSFS_VIDEO_PREFIX, head->i_time_start,
+            head->i_time_end, head->i_camera[0], name, sizeof(name));
+        video.name = name;
+        if (names.insert(video.name).second == false) {
+            // Vid-...-HHMMSS.CCC.h264 -> Vid-...-HHMMSS.CCC-inum.h264
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "-%" PRIuINUM, inum);
+            video.name.insert(video.name.size() - strlen(".h264"), suffix);
+        }
+        video.remain = offset;
+        video.created = false;
+        videos.push_back(video);
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "tsk_fs_wfsexport: Exporting %" PRIuSIZE " videos (%" PRIuSIZE
+            " fragments) with %u writers\n", videos.size(), extents.size(),
+            nthreads);
+
+    std::sort(extents.begin(), extents.end(), extent_cmp);
+
+    WfsExporter exporter(a_out_dir, nthreads);
+    if (exporter.run(fs, videos, extents))
+        return 1;
+
+    if (a_count)
+        *a_count = (unsigned int) videos.size();
+    return 0;
+}
@@ -54,29 +54,186 @@ wfs_debug_print_buf(const char *msg, const uint8_t *buf, int len)
 }
 #endif
 
-time_t
-wfsfs_mktime(const uint8_t *wfs_time) {
+/* Days before the start of each month in a non-leap year */
+static const uint16_t wfsfs_mon_days[12] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+/* wfsfs_decode_time - split a packed WFS timestamp into its fields.
+ * This only does bit manipulation, so it is reentrant and does not
+ * depend on the time zone.
+ */
+void
+wfsfs_decode_time(const uint8_t * wfs_time, WFSFS_TIME * a_time)
+{
+    uint32_t val = tsk_getu32(TSK_LIT_ENDIAN, wfs_time);
+
+    a_time->year = (uint16_t) (2000 + (val >> 26));
+    a_time->mon = (val >> 22) & 0x0F;
+    a_time->mday = (val >> 17) & 0x1F;
+    a_time->hour = (val >> 12) & 0x1F;
+    a_time->min = (val >> 6) & 0x3F;
+    a_time->sec = val & 0x3F;
+}
+
+/* Seconds since the epoch of a decoded time, taken as UTC.  Out of range
+ * fields are carried over as mktime() does. */
+static int64_t
+wfsfs_time_to_utc(const WFSFS_TIME * a_time)
+{
+    int64_t year = a_time->year;
+    int mon = a_time->mon + 11;     // 0-based month, plus one year
+    int64_t days;
+
+    year += mon / 12 - 1;
+    mon %= 12;
+
+    days = 365 * (year - 1970) +
+        ((year - 1) / 4 - (year - 1) / 100 + (year - 1) / 400) -
+        (1969 / 4 - 1969 / 100 + 1969 / 400);
+    days += wfsfs_mon_days[mon];
+    if ((mon > 1) &&
+        ((year % 4 == 0) && ((year % 100 != 0) || (year % 400 == 0))))
+        days++;
+    days += a_time->mday - 1;
+
+    return ((days * 24 + a_time->hour) * 60 + a_time->min) * 60 +
+        a_time->sec;
+}
+
+/* UTC offset of the local time zone at an hour of the recorder clock */
+static int32_t
+wfsfs_tz_probe(int64_t a_hour)
+{
     struct tm tm;
-    tm.tm_year = (wfs_time[3] >> 2) + 100;
-    tm.tm_mon  = ((wfs_time[3] & 0x03) << 2) + (wfs_time[2] >> 6) - 1;
-    tm.tm_mday = (wfs_time[2] >> 1) & 0x1F;
-    tm.tm_hour = ((wfs_time[2] << 4) + (wfs_time[1] >> 4)) & 0x1F;
-    tm.tm_min  = ((wfs_time[1] << 2) + (wfs_time[0] >> 6)) & 0x3F;
-    tm.tm_sec  = wfs_time[0] & 0x3F;
-    return mktime(&tm);
-
-    wfs_debug_print_buf("timestamp: \n", wfs_time, 4);
+    time_t local;
+
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 70;
+    tm.tm_mday = (int) (1 + a_hour / 24);
+    tm.tm_hour = (int) (a_hour % 24);
+    tm.tm_isdst = -1;
+    if ((local = mktime(&tm)) == (time_t) -1)
+        return 0;
+    return (int32_t) (a_hour * 3600 - local);
+}
+
+static uint8_t
+wfsfs_tz_add(WFSFS_INFO * wfsfs, size_t * a_alloc, int64_t a_hour,
+    int32_t a_offset)
+{
+    if (wfsfs->tz_cnt == *a_alloc) {
+        size_t alloc = *a_alloc ? *a_alloc * 2 : 128;
+        WFSFS_TZ_ENTRY *tmp = (WFSFS_TZ_ENTRY *) tsk_realloc(wfsfs->tz_table,
+            alloc * sizeof(WFSFS_TZ_ENTRY));
+        if (tmp == NULL)
+            return 1;
+        wfsfs->tz_table = tmp;
+        *a_alloc = alloc;
+    }
+    wfsfs->tz_table[wfsfs->tz_cnt].hour = a_hour;
+    wfsfs->tz_table[wfsfs->tz_cnt].offset = a_offset;
+    wfsfs->tz_cnt++;
+    return 0;
 }
 
-static uint64_t
+/*
+ * The recorder clock is assumed to be in the local time zone of the
+ * analysis system.  Build wfsfs->tz_table with the UTC offsets of that
+ * zone over all of the times that a WFS timestamp can hold, so that
+ * wfsfs_mktime() does not need mktime() or a lock.  The offset is
+ * checked once per day of the recorder clock and the hour of each change
+ * is then searched for (zones change their offset at most once a day).
+ *
+ * @returns 1 on error and 0 on success
+ */
+static uint8_t
+wfsfs_load_tz(WFSFS_INFO * wfsfs)
+{
+    /* years 2000-2063, plus room for out of range months and days */
+    const WFSFS_TIME first = { 1999, 12, 1, 0, 0, 0 };
+    const WFSFS_TIME last = { 2064, 7, 1, 0, 0, 0 };
+    int64_t day = wfsfs_time_to_utc(&first) / 86400;
+    int64_t last_day = wfsfs_time_to_utc(&last) / 86400;
+    int32_t offset = wfsfs_tz_probe(day * 24);
+    size_t alloc = 0;
+
+    wfsfs->tz_table = NULL;
+    wfsfs->tz_cnt = 0;
+    if (wfsfs_tz_add(wfsfs, &alloc, day * 24, offset))
+        return 1;
+
+    for (; day < last_day; day++) {
+        int32_t next = wfsfs_tz_probe((day + 1) * 24);
+        int lo = 1, hi = 24;
+
+        if (next == offset)
+            continue;
+
+        // first hour of the day that does not have the old offset
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (wfsfs_tz_probe(day * 24 + mid) == offset)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (wfsfs_tz_add(wfsfs, &alloc, day * 24 + lo, next))
+            return 1;
+        offset = next;
+    }
+    return 0;
+}
+
+/* Offset from UTC at a time of the recorder clock, from wfsfs->tz_table
+ * @param a_wall Time as seconds since the epoch, taken as UTC
+ */
+static int32_t
+wfsfs_tz_offset(const WFSFS_INFO * wfsfs, int64_t a_wall)
+{
+    int64_t hour = a_wall / 3600;
+    size_t lo = 0, hi = wfsfs->tz_cnt;
+
+    if (hi == 0)
+        return 0;
+
+    // last entry that starts at or before the hour
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (wfsfs->tz_table[mid].hour <= hour)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return wfsfs->tz_table[lo].offset;
+}
+
+/* wfsfs_mktime - convert a packed WFS timestamp to seconds since the epoch.
+ * The recorder stores its local wall clock time, which is converted with
+ * the rules (including daylight saving time) of the local time zone.
+ * @returns 0 for an empty timestamp
+ */
+time_t
+wfsfs_mktime(WFSFS_INFO * wfsfs, const uint8_t * wfs_time)
+{
+    WFSFS_TIME tm;
+    int64_t wall;
+
+    if (tsk_getu32(TSK_LIT_ENDIAN, wfs_time) == 0)
+        return 0;
+
+    wfsfs_decode_time(wfs_time, &tm);
+    wall = wfsfs_time_to_utc(&tm);
+    return (time_t) (wall - wfsfs_tz_offset(wfsfs, wall));
+}
+
+uint64_t
 wfsfs_get_file_size (WFSFS_INFO *wfsfs, const WFSFS_INODE * dino_buf)
 {
     uint64_t size = 0;
 
     int   nfrag = tsk_getu32(TSK_LIT_ENDIAN, dino_buf->i_numb_frag);
-    int   blk_per_frag = tsk_getu32(TSK_LIT_ENDIAN,
-                        wfsfs->sb.s_blocks_per_frag);
-    size = nfrag * blk_per_frag;
+    size = (uint64_t) nfrag * wfsfs->blocks_per_frag;
     size += tsk_getu16(TSK_LIT_ENDIAN, dino_buf->i_blks_in_last);
     size *= wfsfs->fs_info.block_size;
     return size;
@@ -117,10 +274,10 @@ wfs_dump_inode(WFSFS_INFO * wfsfs, TSK_INUM_T dino_inum,
         }
     }
 
-    time_t t_start = wfsfs_mktime(dino_buf->i_time_start);
+    time_t t_start = wfsfs_mktime(wfsfs, dino_buf->i_time_start);
     char   t_start_buf[128];
 
-    time_t t_end = wfsfs_mktime(dino_buf->i_time_end);
+    time_t t_end = wfsfs_mktime(wfsfs, dino_buf->i_time_end);
     char   t_end_buf[128];
     int    is_main = dino_buf->i_type_desc[0] == 0x02 ||
                      dino_buf->i_type_desc[1] == 0x03;
@@ -139,7 +296,7 @@ wfs_dump_inode(WFSFS_INFO * wfsfs, TSK_INUM_T dino_inum,
         tsk_getu32(TSK_LIT_ENDIAN, dino_buf->i_next_frag),
         t_start, tsk_fs_time_to_str(t_start, t_start_buf),
         t_end, tsk_fs_time_to_str(t_end, t_end_buf),
-        wfsfs_mktime (dino_buf->i_time_end));
+        wfsfs_mktime(wfsfs, dino_buf->i_time_end));
 
     if (is_main)
         tsk_fprintf(stderr,
@@ -158,6 +315,272 @@ wfs_dump_inode(WFSFS_INFO * wfsfs, TSK_INUM_T dino_inum,
     return 0;
 }
 
+/* wfsfs_load_idx_table - read the whole index area into wfsfs->idx_table
+ * using large sequential reads. The table is loaded only once and is
+ * read-only afterwards, so callers can use it without holding the lock.
+ * @param wfsfs A wfsfs file system information structure
+ *
+ * return 1 on error and 0 on success
+ * */
+uint8_t
+wfsfs_load_idx_table(WFSFS_INFO * wfsfs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) wfsfs;
+    uint8_t *table;
+    size_t table_len, done;
+    TSK_OFF_T addr;
+    ssize_t cnt;
+
+    tsk_take_lock(&wfsfs->lock);
+    if (wfsfs->idx_table != NULL) {
+        tsk_release_lock(&wfsfs->lock);
+        return 0;
+    }
+
+    table_len = (size_t) fs->inum_count * WFSFS_INODE_SIZE;
+    if ((table = (uint8_t *) tsk_malloc(table_len)) == NULL) {
+        tsk_release_lock(&wfsfs->lock);
+        return 1;
+    }
+
+    addr = (TSK_OFF_T) tsk_getu32(fs->endian, wfsfs->sb.s_first_index_block)
+        * fs->block_size;
+
+    for (done = 0; done < table_len; done += cnt) {
+        size_t len = table_len - done;
+        if (len > WFSFS_IDX_READ_SIZE)
+            len = WFSFS_IDX_READ_SIZE;
+
+        cnt = tsk_fs_read(fs, addr + done, (char *) &table[done], len);
+        if (cnt != (ssize_t) len) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("wfsfs_load_idx_table: index area at %"
+                PRIdOFF, addr + (TSK_OFF_T) done);
+            free(table);
+            tsk_release_lock(&wfsfs->lock);
+            return 1;
+        }
+    }
+
+    wfsfs->idx_table = table;
+    tsk_release_lock(&wfsfs->lock);
+    return 0;
+}
+
+/* Returns 1 if a_next is the fragment that follows a_cur in a chain,
+ * based on the cached index table.  The prev and next links of both
+ * fragments must point to each other. */
+static int
+wfsfs_frag_follows(WFSFS_INFO * wfsfs, TSK_INUM_T a_cur, TSK_INUM_T a_next)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) wfsfs;
+    const WFSFS_INODE *table = (const WFSFS_INODE *) wfsfs->idx_table;
+
+    if ((a_cur >= fs->root_inum) || (a_next >= fs->root_inum)
+        || (a_cur == a_next))
+        return 0;
+
+    if ((table[a_next].i_type_desc[0] != 0x01) ||
+        (table[a_cur].i_type_desc[0] == 0x00))
+        return 0;
+
+    return (tsk_getu32(fs->endian, table[a_cur].i_next_frag) == a_next) &&
+        (tsk_getu32(fs->endian, table[a_next].i_prev_frag) == a_cur);
+}
+
+typedef struct {
+    WFSFS_INFO *wfsfs;
+    WFSFS_ORPHAN **part_orphans;    /* orphans found by each partition */
+    size_t *part_cnt;
+    uint8_t *part_err;
+} WFSFS_ORPHAN_DATA;
+
+/* tsk_parallel_for callback: find the orphan chains that start in one
+ * partition of the index table.  Chains are followed across partitions,
+ * but each one is reported only by the partition of its first fragment. */
+static void
+wfsfs_find_orphans_part(size_t a_part, void *a_ptr)
+{
+    WFSFS_ORPHAN_DATA *data = (WFSFS_ORPHAN_DATA *) a_ptr;
+    WFSFS_INFO *wfsfs = data->wfsfs;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) wfsfs;
+    const WFSFS_INODE *table = (const WFSFS_INODE *) wfsfs->idx_table;
+    size_t alloc_cnt = 0;
+    TSK_INUM_T inum, start, end;
+
+    start = fs->first_inum + (TSK_INUM_T) a_part * WFSFS_ORPHAN_PART_SIZE;
+    end = start + WFSFS_ORPHAN_PART_SIZE;
+    if (end > fs->root_inum)
+        end = fs->root_inum;
+
+    for (inum = start; inum < end; inum++) {
+        WFSFS_ORPHAN *orphan;
+        TSK_INUM_T cur, next;
+        uint32_t tmin, tmax, t;
+
+        if ((table[inum].i_type_desc[0] != 0x01) ||
+            wfsfs_frag_follows(wfsfs,
+                tsk_getu32(fs->endian, table[inum].i_prev_frag), inum))
+            continue;
+
+        if (data->part_cnt[a_part] == alloc_cnt) {
+            WFSFS_ORPHAN *tmp;
+            alloc_cnt = alloc_cnt ? alloc_cnt * 2 : 64;
+            if ((tmp = (WFSFS_ORPHAN *) tsk_realloc(data->part_orphans[a_part],
+                        alloc_cnt * sizeof(WFSFS_ORPHAN))) == NULL) {
+                data->part_err[a_part] = 1;
+                return;
+            }
+            data->part_orphans[a_part] = tmp;
+        }
+        orphan = &data->part_orphans[a_part][data->part_cnt[a_part]++];
+        orphan->first_frag = (uint32_t) inum;
+        orphan->num_frags = 1;
+        orphan->camera = table[inum].i_camera[0];
+
+        tmin = tsk_getu32(fs->endian, table[inum].i_time_start);
+        tmax = tsk_getu32(fs->endian, table[inum].i_time_end);
+        memcpy(orphan->time_start, table[inum].i_time_start, 4);
+        memcpy(orphan->time_end, table[inum].i_time_end, 4);
+
+        /* The packed time format sorts like an integer, so the range can
+         * be found without decoding the timestamps. */
+        cur = inum;
+        while (orphan->num_frags < fs->inum_count) {
+            next = tsk_getu32(fs->endian, table[cur].i_next_frag);
+            if (!wfsfs_frag_follows(wfsfs, cur, next))
+                break;
+            cur = next;
+            orphan->num_frags++;
+
+            t = tsk_getu32(fs->endian, table[cur].i_time_start);
+            if ((t != 0) && ((tmin == 0) || (t < tmin))) {
+                tmin = t;
+                memcpy(orphan->time_start, table[cur].i_time_start, 4);
+            }
+            t = tsk_getu32(fs->endian, table[cur].i_time_end);
+            if (t > tmax) {
+                tmax = t;
+                memcpy(orphan->time_end, table[cur].i_time_end, 4);
+            }
+        }
+    }
+}
+
+/* wfsfs_load_orphans - find the chains of continuation fragments whose
+ * head inode has been overwritten.  The index table is split in
+ * partitions that are searched in parallel.  The result is cached.
+ * @param wfsfs A wfsfs file system information structure
+ *
+ * return 1 on error and 0 on success
+ * */
+uint8_t
+wfsfs_load_orphans(WFSFS_INFO * wfsfs)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) wfsfs;
+    WFSFS_ORPHAN_DATA data;
+    size_t part_cnt, i, total;
+    uint8_t retval = 0;
+
+    if (wfsfs_load_idx_table(wfsfs))
+        return 1;
+
+    tsk_take_lock(&wfsfs->lock);
+    if (wfsfs->orphans_loaded) {
+        tsk_release_lock(&wfsfs->lock);
+        return 0;
+    }
+
+    part_cnt = (size_t) ((fs->root_inum - fs->first_inum +
+            WFSFS_ORPHAN_PART_SIZE - 1) / WFSFS_ORPHAN_PART_SIZE);
+
+    data.wfsfs = wfsfs;
+    data.part_orphans =
+        (WFSFS_ORPHAN **) tsk_malloc((part_cnt + 1) * sizeof(WFSFS_ORPHAN *));
+    data.part_cnt = (size_t *) tsk_malloc((part_cnt + 1) * sizeof(size_t));
+    data.part_err = (uint8_t *) tsk_malloc(part_cnt + 1);
+    if ((data.part_orphans == NULL) || (data.part_cnt == NULL)
+        || (data.part_err == NULL)) {
+        free(data.part_orphans);
+        free(data.part_cnt);
+        free(data.part_err);
+        tsk_release_lock(&wfsfs->lock);
+        return 1;
+    }
+
+    tsk_parallel_for(part_cnt, wfsfs_find_orphans_part, &data);
+
+    total = 0;
+    for (i = 0; i < part_cnt; i++) {
+        if (data.part_err[i])
+            retval = 1;
+        total += data.part_cnt[i];
+    }
+
+    if (retval) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUX_MALLOC);
+        tsk_error_set_errstr("wfsfs_load_orphans: Error allocating memory");
+    }
+    else if ((total > 0) && ((wfsfs->orphans = (WFSFS_ORPHAN *)
+                tsk_malloc(total * sizeof(WFSFS_ORPHAN))) == NULL)) {
+        retval = 1;
+    }
+    else {
+        // the partitions are in order, so the result is sorted
+        wfsfs->orphan_cnt = 0;
+        for (i = 0; i < part_cnt; i++) {
+            if (data.part_cnt[i] == 0)
+                continue;
+            memcpy(&wfsfs->orphans[wfsfs->orphan_cnt], data.part_orphans[i],
+                data.part_cnt[i] * sizeof(WFSFS_ORPHAN));
+            wfsfs->orphan_cnt += data.part_cnt[i];
+        }
+        wfsfs->orphans_loaded = 1;
+
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "wfsfs_load_orphans: %" PRIuSIZE " orphan chains found\n",
+                wfsfs->orphan_cnt);
+    }
+
+    for (i = 0; i < part_cnt; i++)
+        free(data.part_orphans[i]);
+    free(data.part_orphans);
+    free(data.part_cnt);
+    free(data.part_err);
+
+    tsk_release_lock(&wfsfs->lock);
+    return retval;
+}
+
+/* wfsfs_find_orphan - return the orphan chain whose first fragment is
+ * a_inum, or NULL if there is none (or on error).
+ * */
+const WFSFS_ORPHAN *
+wfsfs_find_orphan(WFSFS_INFO * wfsfs, TSK_INUM_T a_inum)
+{
+    size_t lo = 0, hi;
+
+    if (wfsfs_load_orphans(wfsfs))
+        return NULL;
+
+    hi = wfsfs->orphan_cnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (wfsfs->orphans[mid].first_frag == a_inum)
+            return &wfsfs->orphans[mid];
+        else if (wfsfs->orphans[mid].first_frag < a_inum)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
 /* wfsfs_dinode_load - look up disk inode & load into wfsfs_inode structure
  * @param wfsfs A wfsfs file system information structure
  * @param dino_inum Metadata address
@@ -211,16 +634,6 @@ wfsfs_dinode_load(WFSFS_INFO * wfsfs, TSK_INUM_T dino_inum,
         return TSK_ERR;
     }
 
-    if (dino_buf->i_type_desc[0] != 0x02 &&
-        dino_buf->i_type_desc[0] != 0x03) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_INODE_NUM);
-        tsk_error_set_errstr2("wfsfs_dinode_load: Inode %" PRIuINUM
-            " from %" PRIdOFF " is not valid.", dino_inum, addr);
-
-        return TSK_ERR;
-    }
-
     if (tsk_verbose)
         wfs_dump_inode(wfsfs, dino_inum, dino_buf);
 
@@ -255,8 +668,8 @@ wfsfs_dinode_copy(WFSFS_INFO * wfsfs, TSK_FS_META * fs_meta,
     fs_meta->flags = TSK_FS_META_FLAG_ALLOC;
 
     fs_meta->atime = 0;
-    fs_meta->ctime = wfsfs_mktime(dino_buf->i_time_start);
-    fs_meta->mtime = wfsfs_mktime(dino_buf->i_time_end);
+    fs_meta->ctime = wfsfs_mktime(wfsfs, dino_buf->i_time_start);
+    fs_meta->mtime = wfsfs_mktime(wfsfs, dino_buf->i_time_end);
     fs_meta->size = wfsfs_get_file_size(wfsfs, dino_buf);
     fs_meta->seq = inum;
 
@@ -270,6 +683,43 @@ wfsfs_dinode_copy(WFSFS_INFO * wfsfs, TSK_FS_META * fs_meta,
     return 0;
 }
 
+/* wfsfs_orphan_copy - fill generic inode for an orphan chain
+ *
+ * returns 1 on error and 0 on success
+ * */
+static uint8_t
+wfsfs_orphan_copy(WFSFS_INFO * wfsfs, TSK_FS_META * fs_meta,
+    const WFSFS_ORPHAN * orphan)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) wfsfs;
+
+    fs_meta->attr_state = TSK_FS_META_ATTR_EMPTY;
+    if (fs_meta->attr) {
+        tsk_fs_attrlist_markunused(fs_meta->attr);
+    }
+
+    fs_meta->type = TSK_FS_META_TYPE_REG;
+    fs_meta->mode = 0;
+    fs_meta->nlink = 0;
+    fs_meta->addr = orphan->first_frag;
+    fs_meta->flags = TSK_FS_META_FLAG_UNALLOC | TSK_FS_META_FLAG_USED;
+
+    fs_meta->atime = 0;
+    fs_meta->ctime = wfsfs_mktime(wfsfs, orphan->time_start);
+    fs_meta->mtime = wfsfs_mktime(wfsfs, orphan->time_end);
+    // the number of blocks used in the last fragment is lost with the head
+    fs_meta->size = (TSK_OFF_T) orphan->num_frags *
+        wfsfs->blocks_per_frag * fs->block_size;
+    fs_meta->seq = orphan->first_frag;
+
+    if (fs_meta->link) {
+        free(fs_meta->link);
+        fs_meta->link = NULL;
+    }
+
+    return 0;
+}
+
 
 /* wfsfs_inode_lookup - lookup inode, external interface
  *
@@ -285,17 +735,17 @@ wfsfs_inode_lookup(TSK_FS_INFO * fs, TSK_FS_FILE * a_fs_file,
     WFSFS_INODE *dino_buf = NULL;
     unsigned int size = 0;
     
-    if (inum == fs->root_inum) {
-        a_fs_file->meta = wfsfs->root_inode;
-        return TSK_OK;
-    }
-
     if (a_fs_file == NULL) {
         tsk_error_set_errno(TSK_ERR_FS_ARG);
         tsk_error_set_errstr("wfsfs_inode_lookup: fs_file is NULL");
         return 1;
     }
 
+    if (inum == fs->root_inum) {
+        a_fs_file->meta = wfsfs->root_inode;
+        return TSK_OK;
+    }
+
     if (a_fs_file->meta == NULL) {
         if ((a_fs_file->meta =
                 tsk_fs_meta_alloc(WFSFS_FILE_CONTENT_LEN)) == NULL)
@@ -310,16 +760,46 @@ wfsfs_inode_lookup(TSK_FS_INFO * fs, TSK_FS_FILE * a_fs_file,
         return 1;
     }
 
-    if (wfsfs_dinode_load(wfsfs, inum, dino_buf)) {
+    // see if they are looking for the special "orphans" directory
+    if (inum == TSK_FS_ORPHANDIR_INUM(fs)) {
         free(dino_buf);
-        return TSK_ERR;
+        if (tsk_fs_dir_make_orphan_dir_meta(fs, a_fs_file->meta))
+            return TSK_ERR;
+        return TSK_OK;
     }
 
-    if (wfsfs_dinode_copy(wfsfs, a_fs_file->meta, inum, dino_buf)) {
+    if (wfsfs_dinode_load(wfsfs, inum, dino_buf)) {
         free(dino_buf);
         return TSK_ERR;
     }
 
+    if (dino_buf->i_type_desc[0] == 0x02 ||
+        dino_buf->i_type_desc[0] == 0x03) {
+        if (wfsfs_dinode_copy(wfsfs, a_fs_file->meta, inum, dino_buf)) {
+            free(dino_buf);
+            return TSK_ERR;
+        }
+    }
+    else {
+        const WFSFS_ORPHAN *orphan = NULL;
+
+        // continuation fragments are files only if they start an orphan chain
+        if ((dino_buf->i_type_desc[0] != 0x01) ||
+            ((orphan = wfsfs_find_orphan(wfsfs, inum)) == NULL)) {
+            free(dino_buf);
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_INODE_NUM);
+            tsk_error_set_errstr("wfsfs_inode_lookup: Inode %" PRIuINUM
+                " is not valid.", inum);
+            return TSK_ERR;
+        }
+
+        if (wfsfs_orphan_copy(wfsfs, a_fs_file->meta, orphan)) {
+            free(dino_buf);
+            return TSK_ERR;
+        }
+    }
+
     free(dino_buf);
     return TSK_OK;
 }
@@ -476,47 +956,122 @@ wfsfs_load_attrs(TSK_FS_FILE * fs_file)
     return TSK_OK;
 }
 
-TSK_FS_BLOCK_FLAG_ENUM
-wfsfs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
+/*
+ * Classify a block using the layout cached in WFSFS_INFO.  Blocks before
+ * the data area are meta data, the reserved fragments are never used and
+ * the live part of the ring buffer goes from the oldest fragment to the
+ * newest one (wrapping around the end of the data area).
+ */
+static TSK_FS_BLOCK_FLAG_ENUM
+wfsfs_classify_block(WFSFS_INFO * wfsfs, TSK_DADDR_T a_addr)
 {
-    WFSFS_INFO* wfsfs = (WFSFS_INFO*) a_fs;
-    uint32_t s_blocks_per_frag = tsk_getu32(a_fs->endian,
-        wfsfs->sb.s_blocks_per_frag);
-    TSK_DADDR_T s_first_data_block = 
-        tsk_getu32(a_fs->endian, wfsfs->sb.s_first_data_block);
-    TSK_DADDR_T s_newest_data_block =
-        s_first_data_block +
-        s_blocks_per_frag *
-        (tsk_getu32(a_fs->endian, wfsfs->sb.s_index_last_frag) + 1) - 1;
-    TSK_DADDR_T s_oldest_data_block =
-        s_first_data_block +
-        s_blocks_per_frag *
-        tsk_getu32(a_fs->endian, wfsfs->sb.s_index_first_frag);
-    TSK_DADDR_T s_last_reserved_data_block =
-        s_first_data_block +
-        s_blocks_per_frag *
-        (tsk_getu32(a_fs->endian, wfsfs->sb.s_num_reserv_frags) + 1) - 1;
-
-    if (a_addr < s_first_data_block)
+    if (a_addr < wfsfs->first_data_block)
         return TSK_FS_BLOCK_FLAG_META | TSK_FS_BLOCK_FLAG_ALLOC;
 
-    if (a_addr <= s_last_reserved_data_block)
+    if (a_addr < wfsfs->reserved_end)
         return TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_UNALLOC;
 
-    if (a_addr <= s_newest_data_block)
+    if (a_addr < wfsfs->newest_end)
         return TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_ALLOC;
 
-    if (a_addr >= s_oldest_data_block)
+    if (a_addr >= wfsfs->oldest_start)
         return TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_ALLOC;
 
     return TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_UNALLOC;
 }
 
+/*
+ * Decode the layout fields of the super block and split the file system
+ * into the ranges of blocks that share the same allocation status.  The
+ * status can only change at the boundaries computed here, so classifying
+ * the first block of each range is enough.
+ */
+static void
+wfsfs_init_layout(WFSFS_INFO * wfsfs)
+{
+    TSK_FS_INFO *fs = &wfsfs->fs_info;
+    WFSFS_SB *sb = &wfsfs->sb;
+    TSK_DADDR_T bounds[WFSFS_MAX_BLK_RANGES];
+    int i, j, cnt = 0;
+
+    wfsfs->first_data_block =
+        tsk_getu32(fs->endian, sb->s_first_data_block);
+    wfsfs->blocks_per_frag = tsk_getu32(fs->endian, sb->s_blocks_per_frag);
+    wfsfs->reserved_end = wfsfs->first_data_block +
+        (TSK_DADDR_T) wfsfs->blocks_per_frag *
+        ((TSK_DADDR_T) tsk_getu32(fs->endian, sb->s_num_reserv_frags) + 1);
+    wfsfs->newest_end = wfsfs->first_data_block +
+        (TSK_DADDR_T) wfsfs->blocks_per_frag *
+        ((TSK_DADDR_T) tsk_getu32(fs->endian, sb->s_index_last_frag) + 1);
+    wfsfs->oldest_start = wfsfs->first_data_block +
+        (TSK_DADDR_T) wfsfs->blocks_per_frag *
+        tsk_getu32(fs->endian, sb->s_index_first_frag);
+
+    // sorted, unique range starts inside the file system
+    bounds[cnt++] = 0;
+    {
+        TSK_DADDR_T cand[4] = { wfsfs->first_data_block,
+            wfsfs->reserved_end, wfsfs->newest_end, wfsfs->oldest_start
+        };
+
+        for (i = 0; i < 4; i++) {
+            if (cand[i] > fs->last_block)
+                continue;
+            for (j = 0; j < cnt; j++) {
+                if (bounds[j] == cand[i])
+                    break;
+            }
+            if (j < cnt)
+                continue;
+            for (j = cnt; (j > 0) && (bounds[j - 1] > cand[i]); j--)
+                bounds[j] = bounds[j - 1];
+            bounds[j] = cand[i];
+            cnt++;
+        }
+    }
+
+    // classify each range, merging neighbours with the same status
+    wfsfs->blk_range_cnt = 0;
+    for (i = 0; i < cnt; i++) {
+        TSK_FS_BLOCK_FLAG_ENUM flags =
+            wfsfs_classify_block(wfsfs, bounds[i]);
+        TSK_DADDR_T end = (i + 1 < cnt) ? bounds[i + 1] - 1 : fs->last_block;
+        WFSFS_BLK_RANGE *prev = (wfsfs->blk_range_cnt > 0) ?
+            &wfsfs->blk_ranges[wfsfs->blk_range_cnt - 1] : NULL;
+
+        if ((prev != NULL) && (prev->flags == flags)) {
+            prev->end = end;
+            continue;
+        }
+        wfsfs->blk_ranges[wfsfs->blk_range_cnt].start = bounds[i];
+        wfsfs->blk_ranges[wfsfs->blk_range_cnt].end = end;
+        wfsfs->blk_ranges[wfsfs->blk_range_cnt].flags = flags;
+        wfsfs->blk_range_cnt++;
+    }
+}
+
+TSK_FS_BLOCK_FLAG_ENUM
+wfsfs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
+{
+    WFSFS_INFO* wfsfs = (WFSFS_INFO*) a_fs;
+    int i;
+
+    for (i = 0; i < wfsfs->blk_range_cnt; i++) {
+        if (a_addr <= wfsfs->blk_ranges[i].end)
+            return wfsfs->blk_ranges[i].flags;
+    }
+    return wfsfs_classify_block(wfsfs, a_addr);
+}
+
 /* wfsfs_block_walk - block iterator
  *
  * flags: TSK_FS_BLOCK_FLAG_ALLOC, TSK_FS_BLOCK_FLAG_UNALLOC, TSK_FS_BLOCK_FLAG_CONT,
  *  TSK_FS_BLOCK_FLAG_META
  *
+ * The walk goes over the allocation ranges computed at open time, skipping
+ * whole ranges that do not match a_flags and reading the others in large
+ * chunks.
+ *
  *  Return 1 on error and 0 on success
 */
 
@@ -526,8 +1081,11 @@ wfsfs_block_walk(TSK_FS_INFO * a_fs, TSK_DADDR_T a_start_blk,
     TSK_FS_BLOCK_WALK_CB a_action, void *a_ptr)
 {
     char* myname = "wfsfs_block_walk";
+    WFSFS_INFO* wfsfs = (WFSFS_INFO*) a_fs;
     TSK_FS_BLOCK* fs_block;
-    TSK_DADDR_T addr;
+    char *data_buf = NULL;
+    size_t buf_blocks;
+    int i;
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -568,13 +1126,26 @@ wfsfs_block_walk(TSK_FS_INFO * a_fs, TSK_DADDR_T a_start_blk,
         return TSK_ERR;
     }
 
-    for (addr = a_start_blk; addr <= a_end_blk; addr++) {
-        int retval;
-        int myflags;
+    buf_blocks = WFSFS_BLKWALK_READ_SIZE / a_fs->block_size;
+    if (buf_blocks == 0)
+        buf_blocks = 1;
+    if ((a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY) == 0) {
+        if ((data_buf = (char *) tsk_malloc(buf_blocks *
+                    a_fs->block_size)) == NULL) {
+            tsk_fs_block_free(fs_block);
+            return TSK_ERR;
+        }
+    }
 
-        myflags = wfsfs_block_getflags(a_fs, addr);
+    for (i = 0; i < wfsfs->blk_range_cnt; i++) {
+        WFSFS_BLK_RANGE *range = &wfsfs->blk_ranges[i];
+        int myflags = range->flags;
+        TSK_DADDR_T addr, last;
 
-        // test if we should call the callback with this one
+        if ((range->end < a_start_blk) || (range->start > a_end_blk))
+            continue;
+
+        // test if we should call the callback with this range
         if ((myflags & TSK_FS_BLOCK_FLAG_META)
             && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_META)))
             continue;
@@ -591,23 +1162,72 @@ wfsfs_block_walk(TSK_FS_INFO * a_fs, TSK_DADDR_T a_start_blk,
         if (a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY)
             myflags |= TSK_FS_BLOCK_FLAG_AONLY;
 
-        if (tsk_fs_block_get_flag(a_fs, fs_block, addr, myflags) == NULL) {
-            tsk_error_set_errstr2("%s: block %" PRIuDADDR,
-                myname, addr);
-            tsk_fs_block_free(fs_block);
-            return 1;
-        }
+        addr = (range->start > a_start_blk) ? range->start : a_start_blk;
+        last = (range->end < a_end_blk) ? range->end : a_end_blk;
+
+        while (addr <= last) {
+            size_t read_blocks = buf_blocks;
+            size_t j;
+
+            if (last - addr + 1 < read_blocks)
+                read_blocks = (size_t) (last - addr + 1);
+
+            /* blocks that are not in the image get the usual error */
+            if (addr > a_fs->last_block_act) {
+                if (tsk_fs_block_get_flag(a_fs, fs_block, addr,
+                        (TSK_FS_BLOCK_FLAG_ENUM) myflags) == NULL) {
+                    tsk_error_set_errstr2("%s: block %" PRIuDADDR,
+                        myname, addr);
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
+                }
+            }
+            else if (a_fs->last_block_act - addr + 1 < read_blocks)
+                read_blocks = (size_t) (a_fs->last_block_act - addr + 1);
+
+            if (data_buf != NULL) {
+                ssize_t cnt;
+
+                cnt = tsk_fs_read_block(a_fs, addr, data_buf,
+                    read_blocks * a_fs->block_size);
+                if (cnt != (ssize_t) (read_blocks * a_fs->block_size)) {
+                    if (cnt >= 0) {
+                        tsk_error_reset();
+                        tsk_error_set_errno(TSK_ERR_FS_READ);
+                    }
+                    tsk_error_set_errstr2("%s: block %" PRIuDADDR,
+                        myname, addr);
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
+                }
+            }
 
-        retval = a_action(fs_block, a_ptr);
-        if (retval == TSK_WALK_STOP) {
-            break;
-        }
-        else if (retval == TSK_WALK_ERROR) {
-            tsk_fs_block_free(fs_block);
-            return 1;
+            for (j = 0; j < read_blocks; j++) {
+                int retval;
+
+                tsk_fs_block_set(a_fs, fs_block, addr + j,
+                    myflags | TSK_FS_BLOCK_FLAG_RAW,
+                    data_buf ? &data_buf[j * a_fs->block_size] : NULL);
+
+                retval = a_action(fs_block, a_ptr);
+                if (retval == TSK_WALK_STOP) {
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return TSK_OK;
+                }
+                else if (retval == TSK_WALK_ERROR) {
+                    free(data_buf);
+                    tsk_fs_block_free(fs_block);
+                    return 1;
+                }
+            }
+            addr += read_blocks;
         }
     }
 
+    free(data_buf);
     tsk_fs_block_free(fs_block);
     return TSK_OK;
 }
@@ -716,19 +1336,19 @@ wfsfs_fsstat(TSK_FS_INFO * fs, FILE * hFile)
 
     tsk_fprintf(hFile, "\nTIMESTAMPS:\n");
     tsk_fprintf(hFile, "--------------------------------------------\n");
-    tmptime = wfsfs_mktime(sb->s_time_first_creation);
+    tmptime = wfsfs_mktime(wfsfs, sb->s_time_first_creation);
     tsk_fprintf(hFile, "First fragment creation: %s\n",
         (tmptime > 0) ? tsk_fs_time_to_str(tmptime, timeBuf) : "empty");
 
-    tmptime = wfsfs_mktime(sb->s_time_last_modification);
+    tmptime = wfsfs_mktime(wfsfs, sb->s_time_last_modification);
     tsk_fprintf(hFile, "Last fragment modification: %s\n",
         (tmptime > 0) ? tsk_fs_time_to_str(tmptime, timeBuf) : "empty");
 
-    tmptime = wfsfs_mktime(sb->s_time_oldest_creation);
+    tmptime = wfsfs_mktime(wfsfs, sb->s_time_oldest_creation);
     tsk_fprintf(hFile, "Oldest fragment creation: %s\n",
         (tmptime > 0) ? tsk_fs_time_to_str(tmptime, timeBuf) : "empty");
 
-    tmptime = wfsfs_mktime(sb->s_time_newest_modification);
+    tmptime = wfsfs_mktime(wfsfs, sb->s_time_newest_modification);
     tsk_fprintf(hFile, "Newest Fragment modification: %s\n",
         (tmptime > 0) ? tsk_fs_time_to_str(tmptime, timeBuf) : "empty");
 
@@ -790,17 +1410,20 @@ static uint8_t
 wfsfs_istat(TSK_FS_INFO * fs, TSK_FS_ISTAT_FLAG_ENUM istat_flags, FILE * hFile, TSK_INUM_T inum,
     TSK_DADDR_T numblock, int32_t sec_skew)
 {
-    TSK_FS_META *fs_meta;
-    TSK_FS_FILE *fs_file;
+    TSK_FS_META *fs_meta = NULL;
+    TSK_FS_FILE *fs_file = NULL;
     WFSFS_INFO* wfsfs = (WFSFS_INFO *) fs;
 
-    WFSFS_INODE *dino_buf = NULL;
     char timeBuf[128];
 
     // clean up any error messages that are lying around
     tsk_error_reset();
 
-    if (inum == fs->root_inum)
+    if (inum == TSK_FS_ORPHANDIR_INUM(fs)) {
+        tsk_fprintf(hFile, "This is the virtual orphan directory.\n");
+        return TSK_OK;
+    }
+    else if (inum == fs->root_inum)
         fs_meta = wfsfs->root_inode;
     else if (inum < fs->root_inum) {
         // Call wfsfs_inode_lookup. All errors checked there.
@@ -809,9 +1432,19 @@ wfsfs_istat(TSK_FS_INFO * fs, TSK_FS_ISTAT_FLAG_ENUM istat_flags, FILE * hFile,
         }
         fs_meta = fs_file->meta;
     }
+    else {
+        tsk_error_set_errno(TSK_ERR_FS_INODE_NUM);
+        tsk_error_set_errstr("wfsfs_istat: Inode %" PRIuINUM
+            " is out of range", inum);
+        return TSK_ERR;
+    }
          
     if (inum != fs->root_inum) {
-        tsk_fprintf(hFile, "Video : %" PRIuINUM "\n", inum);
+        if (fs_meta->flags & TSK_FS_META_FLAG_UNALLOC)
+            tsk_fprintf(hFile, "Orphan video (head overwritten) : %"
+                PRIuINUM "\n", inum);
+        else
+            tsk_fprintf(hFile, "Video : %" PRIuINUM "\n", inum);
         tsk_fprintf(hFile, "size: %" PRIdOFF "\n", fs_meta->size);
         tsk_fprintf(hFile, "#frags: %" PRIdOFF "\n", (fs_meta->size - 1) /
             (tsk_getu32(fs->endian, wfsfs->sb.s_blocks_per_frag) *
@@ -849,8 +1482,14 @@ wfsfs_istat(TSK_FS_INFO * fs, TSK_FS_ISTAT_FLAG_ENUM istat_flags, FILE * hFile,
 static void
 wfsfs_close(TSK_FS_INFO * fs)
 {
+    WFSFS_INFO *wfsfs = (WFSFS_INFO *) fs;
+
     fs->tag = 0;
-    tsk_fs_meta_close(((WFSFS_INFO*)fs)->root_inode);
+    tsk_fs_meta_close(wfsfs->root_inode);
+    free(wfsfs->idx_table);
+    free(wfsfs->orphans);
+    free(wfsfs->tz_table);
+    tsk_deinit_lock(&wfsfs->lock);
     tsk_fs_free(fs);
 }
 
@@ -958,8 +1597,8 @@ wfsfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     fs->dev_bsize = img_info->sector_size;
     fs->first_block = 0;
     fs->inum_count = tsk_getu32(fs->endian, sb->s_total_indexes); 
-    fs->last_inum = fs->inum_count;
     fs->root_inum = fs->inum_count;
+    fs->last_inum = fs->root_inum + 1;     // $OrphanFiles (virtual)
     fs->first_inum = tsk_getu32(fs->endian, sb->s_num_reserv_frags);
     fs->block_count = tsk_getu32(fs->endian, sb->s_first_data_block) +
                       tsk_getu32(fs->endian, sb->s_total_indexes) *
@@ -984,6 +1623,8 @@ wfsfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
         fs->last_block_act =
             (img_info->size - offset) / fs->block_size - 1;
 
+    wfsfs_init_layout(wfsfs);
+
     /* Set the generic function pointers */
     fs->inode_walk = wfsfs_inode_walk;
     fs->block_walk = wfsfs_block_walk;
@@ -1006,9 +1647,25 @@ wfsfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     fs->jentry_walk = wfsfs_jentry_walk;
     fs->jopen = wfsfs_jopen;
 
+    wfsfs->idx_table = NULL;
+    wfsfs->orphans = NULL;
+    wfsfs->orphan_cnt = 0;
+    wfsfs->orphans_loaded = 0;
+    tsk_init_lock(&wfsfs->lock);
+
+    if (wfsfs_load_tz(wfsfs)) {
+        fs->tag = 0;
+        free(wfsfs->tz_table);
+        tsk_deinit_lock(&wfsfs->lock);
+        tsk_fs_free((TSK_FS_INFO*)wfsfs);
+        return NULL;
+    }
+
     wfsfs->root_inode = NULL;
     if (wfsfs_gen_root(wfsfs, fs->root_inum)) {
         fs->tag = 0;
+        free(wfsfs->tz_table);
+        tsk_deinit_lock(&wfsfs->lock);
         tsk_fs_free((TSK_FS_INFO*)wfsfs);
         tsk_error_reset();
         tsk_error_set_errstr("wfsfs_open: error in generation of root inode.");
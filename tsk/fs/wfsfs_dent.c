@@ -41,6 +41,77 @@
 #include "tsk_wfsfs.h"
 
 
+/* Write a_val as a_width decimal digits (zero padded) and return the
+ * position after them. */
+static char *
+wfsfs_put_digits(char *a_buf, unsigned int a_val, int a_width)
+{
+    int i;
+
+    for (i = a_width - 1; i >= 0; i--) {
+        a_buf[i] = (char) ('0' + a_val % 10);
+        a_val /= 10;
+    }
+    return a_buf + a_width;
+}
+
+/* wfsfs_gen_name - build the name of a video.
+ * The name carries the date, start/end times and camera of the video, as
+ * recorded by the device (no time zone conversion).  It is built from the
+ * packed fields directly, so it is reentrant.
+ * @param a_prefix Prefix of the name (WFSFS_VIDEO_PREFIX or WFSFS_ORPHAN_PREFIX)
+ * @param a_time_start Start time of the video (WFS format)
+ * @param a_time_end End time of the video (WFS format)
+ * @param a_camera Camera id of the video
+ * @param a_name Buffer to store the name in
+ * @param a_len Size of a_name (should be at least WFSFS_MAXNAMLEN + 1)
+ */
+void
+wfsfs_gen_name(const char *a_prefix, const uint8_t * a_time_start,
+    const uint8_t * a_time_end, uint8_t a_camera, char *a_name, size_t a_len)
+{
+    char buf[WFSFS_MAXNAMLEN + 1];
+    char *cp = buf;
+    WFSFS_TIME stime, etime;
+    size_t len;
+
+    if (a_len == 0)
+        return;
+
+    wfsfs_decode_time(a_time_start, &stime);
+    wfsfs_decode_time(a_time_end, &etime);
+
+    // prefix, as long as it leaves room for the rest of the name
+    len = strlen(a_prefix);
+    if (len > sizeof(buf) - 1 - strlen("-YYYYMMDD-HHMMSS-HHMMSS.CCC.h264"))
+        len = sizeof(buf) - 1 - strlen("-YYYYMMDD-HHMMSS-HHMMSS.CCC.h264");
+    memcpy(cp, a_prefix, len);
+    cp += len;
+
+    *cp++ = '-';
+    cp = wfsfs_put_digits(cp, stime.year, 4);
+    cp = wfsfs_put_digits(cp, stime.mon, 2);
+    cp = wfsfs_put_digits(cp, stime.mday, 2);
+    *cp++ = '-';
+    cp = wfsfs_put_digits(cp, stime.hour, 2);
+    cp = wfsfs_put_digits(cp, stime.min, 2);
+    cp = wfsfs_put_digits(cp, stime.sec, 2);
+    *cp++ = '-';
+    cp = wfsfs_put_digits(cp, etime.hour, 2);
+    cp = wfsfs_put_digits(cp, etime.min, 2);
+    cp = wfsfs_put_digits(cp, etime.sec, 2);
+    *cp++ = '.';
+    cp = wfsfs_put_digits(cp, WFSFS_CAM_NUM(a_camera), 3);
+    memcpy(cp, ".h264", 5);
+    cp += 5;
+
+    len = cp - buf;
+    if (len > a_len - 1)
+        len = a_len - 1;
+    memcpy(a_name, buf, len);
+    a_name[len] = '\0';
+}
+
 static void
 wfsfs_gen_dentry (TSK_INUM_T i_num,
     char *wfs_inode,  TSK_FS_NAME * fs_name)
@@ -52,26 +123,8 @@ wfsfs_gen_dentry (TSK_INUM_T i_num,
                 PRIu64 ": camera %d\n",i_num,
                 WFSFS_CAM_NUM(dir->i_camera[0]));
 
-    time_t stime = wfsfs_mktime(dir->i_time_start);
-    struct tm *stmTime = localtime(&stime);
-    /* localtime is not reentrant. So we need save values
-       before call again. */
-    int year   = stmTime->tm_year + 1900;
-    int month  = stmTime->tm_mon + 1;
-    int day    = stmTime->tm_mday;
-    int s_hour = stmTime->tm_hour;
-    int s_min  = stmTime->tm_min;
-    int s_sec  = stmTime->tm_sec;
-
-    time_t etime = wfsfs_mktime(dir->i_time_end);
-    struct tm *etmTime = localtime(&etime);
-
-    sprintf(fs_name->name,
-            "Vid-%04d%02d%02d-%02d%02d%02d-%02d%02d%02d.%03d.h264",
-            year, month, day, s_hour, s_min, s_sec,
-            etmTime->tm_hour, etmTime->tm_min, etmTime->tm_sec,
-            WFSFS_CAM_NUM(dir->i_camera[0]));
-
+    wfsfs_gen_name(WFSFS_VIDEO_PREFIX, dir->i_time_start, dir->i_time_end,
+        dir->i_camera[0], fs_name->name, WFSFS_MAXNAMLEN + 1);
 
     fs_name->meta_addr = i_num;
     fs_name->name_size = strlen(fs_name->name);
@@ -107,8 +160,8 @@ wfsfs_gen_root (WFSFS_INFO * wfsfs, TSK_INUM_T i_num)
     fs_meta->addr = i_num;
     fs_meta->flags = TSK_FS_META_FLAG_ALLOC;
     fs_meta->atime = 0;
-    fs_meta->ctime = wfsfs_mktime(wfsfs->sb.s_time_oldest_creation);
-    fs_meta->mtime = wfsfs_mktime(wfsfs->sb.s_time_newest_modification);
+    fs_meta->ctime = wfsfs_mktime(wfsfs, wfsfs->sb.s_time_oldest_creation);
+    fs_meta->mtime = wfsfs_mktime(wfsfs, wfsfs->sb.s_time_newest_modification);
     fs_meta->size = 0;
     fs_meta->seq = i_num;
     fs_meta->nlink = 1;
@@ -117,6 +170,37 @@ wfsfs_gen_root (WFSFS_INFO * wfsfs, TSK_INUM_T i_num)
     return TSK_OK;
 }
 
+/* wfsfs_dir_open_orphans - add the orphan chains to the virtual
+ * $OrphanFiles directory.
+ */
+static TSK_RETVAL_ENUM
+wfsfs_dir_open_orphans(WFSFS_INFO * wfsfs, TSK_FS_DIR * fs_dir,
+    TSK_FS_NAME * fs_name)
+{
+    TSK_FS_INFO *a_fs = (TSK_FS_INFO *) wfsfs;
+    size_t i;
+
+    if (wfsfs_load_orphans(wfsfs))
+        return TSK_ERR;
+
+    for (i = 0; i < wfsfs->orphan_cnt; i++) {
+        const WFSFS_ORPHAN *orphan = &wfsfs->orphans[i];
+
+        wfsfs_gen_name(WFSFS_ORPHAN_PREFIX, orphan->time_start,
+            orphan->time_end, orphan->camera, fs_name->name,
+            WFSFS_MAXNAMLEN + 1);
+        fs_name->meta_addr = orphan->first_frag;
+        fs_name->name_size = strlen(fs_name->name);
+        fs_name->par_addr = TSK_FS_ORPHANDIR_INUM(a_fs);
+        fs_name->type = TSK_FS_NAME_TYPE_REG;
+        fs_name->flags = TSK_FS_NAME_FLAG_UNALLOC;
+
+        if (tsk_fs_dir_add(fs_dir, fs_name))
+            return TSK_ERR;
+    }
+    return TSK_OK;
+}
+
 /** \internal
 * Process a directory and load up FS_DIR with the entries. If a pointer to
 * an already allocated FS_DIR structure is given, it will be cleared.  If no existing
@@ -142,7 +226,7 @@ wfsfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir, TSK_INUM_T i_num
     TSK_DADDR_T addr;
     TSK_INUM_T  max_inode;
 
-    if (i_num != a_fs->root_inum) {
+    if ((i_num != a_fs->root_inum) && (i_num != TSK_FS_ORPHANDIR_INUM(a_fs))) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
         tsk_error_set_errstr("wfsfs_dir_open_meta: inode value: %"
@@ -203,6 +287,19 @@ wfsfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir, TSK_INUM_T i_num
         return TSK_ERR;
     }
 
+    if (i_num == TSK_FS_ORPHANDIR_INUM(a_fs)) {
+        TSK_RETVAL_ENUM retval = wfsfs_dir_open_orphans(wfsfs, fs_dir, fs_name);
+        tsk_fs_name_free(fs_name);
+        return retval;
+    }
+
+    fs_name->name_size = WFSFS_MAXNAMLEN + 1;
+    if (tsk_fs_dir_make_orphan_dir_name(a_fs, fs_name) ||
+        tsk_fs_dir_add(fs_dir, fs_name)) {
+        tsk_fs_name_free(fs_name);
+        return TSK_ERR;
+    }
+
     if ((inode_blk = (uint8_t *) tsk_malloc(a_fs->block_size)) == NULL) {
         tsk_fs_name_free(fs_name);
         tsk_error_reset();
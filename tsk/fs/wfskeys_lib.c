@@ -0,0 +1,546 @@
+/*
+** wfskeys
+** The Sleuth Kit
+**
+** Keyframe index of the H.264 videos stored in a WFS0.4/5 file system.
+**
+** This software is distributed under the Common Public License 1.0
+**
+*/
+
+/** \file wfskeys_lib.c
+ * Contains the library code associated with the TSK wfskeys tool.
+ *
+ * A video is scanned once for H.264 NAL start codes (00 00 01) and the
+ * position of each IDR picture is recorded, together with the time it was
+ * recorded at.  When the IDR picture is preceded by its parameter sets
+ * (SPS/PPS), the key starts at the first of them so that a decoder can
+ * start there.  The index can be saved to a sidecar file and used to read
+ * a video starting at the keyframe nearest to a given time.
+ */
+
+#include "tsk_fs_i.h"
+#include "tsk_wfsfs.h"
+
+/* Bytes of a video read at once while scanning */
+#define WFSKEYS_READ_SIZE   (1024 * 1024)
+
+/* Bytes kept from the end of a read: a start code (3 bytes, plus the
+ * leading zero of a 4 byte one) whose 2 NAL bytes have not been read yet */
+#define WFSKEYS_KEEP        5
+
+/* H.264 NAL unit types */
+#define WFSKEYS_NAL_SLICE   1
+#define WFSKEYS_NAL_IDR     5
+#define WFSKEYS_NAL_SPS     7
+#define WFSKEYS_NAL_PPS     8
+#define WFSKEYS_NAL_AUD     9
+
+/* Sidecar file: magic, video size, key count and then the keys, all
+ * stored as 64-bit little endian values */
+#define WFSKEYS_MAGIC       "WFSKEYS1"
+#define WFSKEYS_HDR_SIZE    24
+#define WFSKEYS_ENTRY_SIZE  16
+
+
+/* Recording times of one fragment of a video */
+typedef struct {
+    time_t start;
+    time_t end;
+} WFSKEYS_FRAG_TIME;
+
+typedef struct {
+    TSK_FS_WFSKEYS *keys;
+    size_t keys_alloc;
+    const WFSKEYS_FRAG_TIME *frag_times;
+    size_t frag_cnt;
+    TSK_OFF_T frag_len;
+    time_t vid_start;           // times of the whole video, used when
+    time_t vid_end;             //   a fragment has no times of its own
+    TSK_OFF_T param_off;        // first SPS/PPS since the last slice (-1)
+} WFSKEYS_DATA;
+
+
+/* Interpolate the recording time of byte a_off of the video */
+static time_t
+wfskeys_time(const WFSKEYS_DATA * a_data, TSK_OFF_T a_off)
+{
+    size_t frag = (size_t) (a_off / a_data->frag_len);
+    time_t start = a_data->vid_start;
+    time_t end = a_data->vid_end;
+    TSK_OFF_T pos = a_off;
+    TSK_OFF_T len = a_data->keys->size;
+
+    if ((frag < a_data->frag_cnt) && (a_data->frag_times[frag].start != 0)
+        && (a_data->frag_times[frag].end >= a_data->frag_times[frag].start)) {
+        start = a_data->frag_times[frag].start;
+        end = a_data->frag_times[frag].end;
+        pos = a_off - (TSK_OFF_T) frag * a_data->frag_len;
+        len = a_data->frag_len;
+    }
+
+    if ((end <= start) || (len <= 0))
+        return start;
+    return start + (time_t) ((end - start) * pos / len);
+}
+
+static uint8_t
+wfskeys_add(WFSKEYS_DATA * a_data, TSK_OFF_T a_off)
+{
+    TSK_FS_WFSKEYS *keys = a_data->keys;
+    time_t t = wfskeys_time(a_data, a_off);
+
+    if (keys->count == a_data->keys_alloc) {
+        size_t new_alloc = a_data->keys_alloc ? a_data->keys_alloc * 2 : 64;
+        TSK_FS_WFSKEY *tmp;
+
+        if ((tmp = (TSK_FS_WFSKEY *) tsk_realloc(keys->keys,
+                    new_alloc * sizeof(TSK_FS_WFSKEY))) == NULL)
+            return 1;
+        keys->keys = tmp;
+        a_data->keys_alloc = new_alloc;
+    }
+
+    // keep the times ordered, so that keys can be searched by time
+    if ((keys->count > 0) && (t < keys->keys[keys->count - 1].time))
+        t = keys->keys[keys->count - 1].time;
+
+    keys->keys[keys->count].time = t;
+    keys->keys[keys->count].offset = a_off;
+    keys->count++;
+    return 0;
+}
+
+/*
+ * Process the NAL units found in a_buf[a_start .. a_len - 3].  a_base is
+ * the offset of a_buf in the video.  The candidates are found with
+ * memchr(), which is vectorized by the C library.
+ */
+static uint8_t
+wfskeys_scan(WFSKEYS_DATA * a_data, const uint8_t * a_buf, size_t a_len,
+    size_t a_start, TSK_OFF_T a_base)
+{
+    const uint8_t *p = a_buf + a_start;
+    const uint8_t *end;
+
+    if (a_len < 3)
+        return 0;
+    end = a_buf + a_len - 2;    // the 2 bytes after 0x01 must be present
+
+    for (; (p < end) && ((p = (const uint8_t *) memchr(p, 0x01,
+                    end - p)) != NULL); p++) {
+        size_t i = p - a_buf;
+        TSK_OFF_T sc_off;
+        uint8_t type;
+
+        if ((i < 2) || (p[-1] != 0) || (p[-2] != 0))
+            continue;
+        if (p[1] & 0x80)        // forbidden_zero_bit
+            continue;
+
+        sc_off = a_base + i - 2;
+        if ((i >= 3) && (p[-3] == 0))
+            sc_off--;
+        type = p[1] & 0x1F;
+
+        switch (type) {
+        case WFSKEYS_NAL_AUD:
+        case WFSKEYS_NAL_SPS:
+        case WFSKEYS_NAL_PPS:
+            if (a_data->param_off == -1)
+                a_data->param_off = sc_off;
+            break;
+
+        case WFSKEYS_NAL_IDR:
+            // first_mb_in_slice == 0 (ue(v) "1") starts a new picture
+            if (p[2] & 0x80) {
+                if (wfskeys_add(a_data, (a_data->param_off != -1) ?
+                        a_data->param_off : sc_off))
+                    return 1;
+            }
+            a_data->param_off = -1;
+            break;
+
+        case WFSKEYS_NAL_SLICE:
+            a_data->param_off = -1;
+            break;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Load the recording times of the fragments of a video, following its
+ * fragment chain in the index table.
+ */
+static WFSKEYS_FRAG_TIME *
+wfskeys_frag_times(WFSFS_INFO * a_wfsfs, TSK_INUM_T a_inum,
+    size_t a_frag_cnt)
+{
+    TSK_FS_INFO *fs = &a_wfsfs->fs_info;
+    const WFSFS_INODE *table;
+    WFSKEYS_FRAG_TIME *times;
+    TSK_INUM_T cur_frag = a_inum;
+    size_t i;
+
+    if (wfsfs_load_idx_table(a_wfsfs))
+        return NULL;
+    table = (const WFSFS_INODE *) a_wfsfs->idx_table;
+
+    if ((times = (WFSKEYS_FRAG_TIME *) tsk_malloc((a_frag_cnt + 1) *
+                sizeof(WFSKEYS_FRAG_TIME))) == NULL)
+        return NULL;
+
+    for (i = 0; (i < a_frag_cnt) && (cur_frag < fs->root_inum); i++) {
+        times[i].start = wfsfs_mktime(a_wfsfs, table[cur_frag].i_time_start);
+        times[i].end = wfsfs_mktime(a_wfsfs, table[cur_frag].i_time_end);
+        cur_frag = tsk_getu32(fs->endian, table[cur_frag].i_next_frag);
+    }
+    return times;
+}
+
+/**
+ * \internal
+ * Build the keyframe index of a WFS video.
+ *
+ * @param a_fs_file Video to index (a video or an orphan chain)
+ * @returns NULL on error
+ */
+TSK_FS_WFSKEYS *
+tsk_fs_wfskeys_build(TSK_FS_FILE * a_fs_file)
+{
+    TSK_FS_INFO *fs;
+    WFSFS_INFO *wfsfs;
+    WFSKEYS_DATA data;
+    WFSKEYS_FRAG_TIME *frag_times;
+    uint8_t *buf;
+    TSK_OFF_T off = 0;
+    size_t keep = 0;
+
+    tsk_error_reset();
+
+    if ((a_fs_file == NULL) || (a_fs_file->fs_info == NULL)
+        || (a_fs_file->meta == NULL)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_wfskeys_build: file is NULL");
+        return NULL;
+    }
+    fs = a_fs_file->fs_info;
+    wfsfs = (WFSFS_INFO *) fs;
+
+    if (!TSK_FS_TYPE_ISWFS(fs->ftype)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_wfskeys_build: only WFS file systems are supported");
+        return NULL;
+    }
+    if (a_fs_file->meta->type != TSK_FS_META_TYPE_REG) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_wfskeys_build: inode %" PRIuINUM
+            " is not a video", a_fs_file->meta->addr);
+        return NULL;
+    }
+
+    memset(&data, 0, sizeof(data));
+    data.param_off = -1;
+    data.frag_len = (TSK_OFF_T) wfsfs->blocks_per_frag * fs->block_size;
+    if (data.frag_len == 0)
+        data.frag_len = fs->block_size;
+    data.frag_cnt = (size_t) ((a_fs_file->meta->size + data.frag_len - 1)
+        / data.frag_len);
+    data.vid_start = a_fs_file->meta->ctime;
+    data.vid_end = a_fs_file->meta->mtime;
+
+    if ((frag_times = wfskeys_frag_times(wfsfs, a_fs_file->meta->addr,
+                data.frag_cnt)) == NULL)
+        return NULL;
+    data.frag_times = frag_times;
+
+    if ((data.keys = (TSK_FS_WFSKEYS *) tsk_malloc(sizeof(TSK_FS_WFSKEYS)))
+        == NULL) {
+        free(frag_times);
+        return NULL;
+    }
+    data.keys->size = a_fs_file->meta->size;
+
+    if ((buf = (uint8_t *) tsk_malloc(WFSKEYS_READ_SIZE + WFSKEYS_KEEP))
+        == NULL) {
+        free(frag_times);
+        tsk_fs_wfskeys_free(data.keys);
+        return NULL;
+    }
+
+    while (off < a_fs_file->meta->size) {
+        ssize_t cnt;
+        size_t len;
+
+        cnt = tsk_fs_file_read(a_fs_file, off, (char *) buf + keep,
+            WFSKEYS_READ_SIZE, TSK_FS_FILE_READ_FLAG_NONE);
+        if (cnt <= 0) {
+            if (cnt == 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("tsk_fs_wfskeys_build: offset %" PRIdOFF,
+                off);
+            free(buf);
+            free(frag_times);
+            tsk_fs_wfskeys_free(data.keys);
+            return NULL;
+        }
+        len = keep + (size_t) cnt;
+
+        /* candidates before index 3 of a carried buffer were processed
+         * by the previous scan */
+        if (wfskeys_scan(&data, buf, len, keep ? WFSKEYS_KEEP - 2 : 2,
+                off - (TSK_OFF_T) keep)) {
+            free(buf);
+            free(frag_times);
+            tsk_fs_wfskeys_free(data.keys);
+            return NULL;
+        }
+
+        off += cnt;
+        if (len >= WFSKEYS_KEEP) {
+            memmove(buf, buf + len - WFSKEYS_KEEP, WFSKEYS_KEEP);
+            keep = WFSKEYS_KEEP;
+        }
+        else {
+            keep = 0;           // too short to hold a start code anyway
+        }
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "tsk_fs_wfskeys_build: %" PRIuSIZE " keyframes in inode %"
+            PRIuINUM "\n", data.keys->count, a_fs_file->meta->addr);
+
+    free(buf);
+    free(frag_times);
+    return data.keys;
+}
+
+/**
+ * \internal
+ * Free a keyframe index.
+ */
+void
+tsk_fs_wfskeys_free(TSK_FS_WFSKEYS * a_keys)
+{
+    if (a_keys == NULL)
+        return;
+    free(a_keys->keys);
+    free(a_keys);
+}
+
+static void
+wfskeys_put64(uint8_t * a_buf, uint64_t a_val)
+{
+    int i;
+    for (i = 0; i < 8; i++)
+        a_buf[i] = (uint8_t) (a_val >> (8 * i));
+}
+
+static FILE *
+wfskeys_fopen(const TSK_TCHAR * a_path, int a_write)
+{
+#ifdef TSK_WIN32
+    return _wfopen(a_path, a_write ? L"wb" : L"rb");
+#else
+    return fopen(a_path, a_write ? "wb" : "rb");
+#endif
+}
+
+/**
+ * \internal
+ * Save a keyframe index to a sidecar file.
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_wfskeys_save(const TSK_FS_WFSKEYS * a_keys, const TSK_TCHAR * a_path)
+{
+    uint8_t buf[WFSKEYS_HDR_SIZE];
+    FILE *hFile;
+    size_t i;
+
+    tsk_error_reset();
+    if ((hFile = wfskeys_fopen(a_path, 1)) == NULL) {
+        tsk_error_set_errno(TSK_ERR_FS_WRITE);
+        tsk_error_set_errstr("tsk_fs_wfskeys_save: error creating %"
+            PRIttocTSK " (%s)", a_path, strerror(errno));
+        return 1;
+    }
+
+    memcpy(buf, WFSKEYS_MAGIC, 8);
+    wfskeys_put64(&buf[8], (uint64_t) a_keys->size);
+    wfskeys_put64(&buf[16], (uint64_t) a_keys->count);
+    if (fwrite(buf, WFSKEYS_HDR_SIZE, 1, hFile) != 1)
+        goto on_error;
+
+    for (i = 0; i < a_keys->count; i++) {
+        wfskeys_put64(&buf[0], (uint64_t) (int64_t) a_keys->keys[i].time);
+        wfskeys_put64(&buf[8], (uint64_t) a_keys->keys[i].offset);
+        if (fwrite(buf, WFSKEYS_ENTRY_SIZE, 1, hFile) != 1)
+            goto on_error;
+    }
+
+    if (fclose(hFile) != 0) {
+        hFile = NULL;
+        goto on_error;
+    }
+    return 0;
+
+  on_error:
+    tsk_error_set_errno(TSK_ERR_FS_WRITE);
+    tsk_error_set_errstr("tsk_fs_wfskeys_save: error writing %"
+        PRIttocTSK " (%s)", a_path, strerror(errno));
+    if (hFile)
+        fclose(hFile);
+    return 1;
+}
+
+/**
+ * \internal
+ * Load a keyframe index from a sidecar file written by tsk_fs_wfskeys_save.
+ * @returns NULL on error
+ */
+TSK_FS_WFSKEYS *
+tsk_fs_wfskeys_load(const TSK_TCHAR * a_path)
+{
+    uint8_t buf[WFSKEYS_HDR_SIZE];
+    TSK_FS_WFSKEYS *keys;
+    FILE *hFile;
+    uint64_t count;
+    size_t i;
+
+    tsk_error_reset();
+    if ((hFile = wfskeys_fopen(a_path, 0)) == NULL) {
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr("tsk_fs_wfskeys_load: error opening %"
+            PRIttocTSK " (%s)", a_path, strerror(errno));
+        return NULL;
+    }
+
+    if ((fread(buf, WFSKEYS_HDR_SIZE, 1, hFile) != 1)
+        || (memcmp(buf, WFSKEYS_MAGIC, 8) != 0)) {
+        fclose(hFile);
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr("tsk_fs_wfskeys_load: %" PRIttocTSK
+            " is not a keyframe index", a_path);
+        return NULL;
+    }
+    count = tsk_getu64(TSK_LIT_ENDIAN, &buf[16]);
+    if (count > SIZE_MAX / sizeof(TSK_FS_WFSKEY)) {
+        fclose(hFile);
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr("tsk_fs_wfskeys_load: invalid key count %"
+            PRIu64, count);
+        return NULL;
+    }
+
+    if ((keys = (TSK_FS_WFSKEYS *) tsk_malloc(sizeof(TSK_FS_WFSKEYS)))
+        == NULL) {
+        fclose(hFile);
+        return NULL;
+    }
+    keys->size = (TSK_OFF_T) tsk_getu64(TSK_LIT_ENDIAN, &buf[8]);
+    if ((count > 0) && ((keys->keys = (TSK_FS_WFSKEY *)
+                tsk_malloc((size_t) count * sizeof(TSK_FS_WFSKEY))) ==
+            NULL)) {
+        fclose(hFile);
+        free(keys);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (fread(buf, WFSKEYS_ENTRY_SIZE, 1, hFile) != 1)
+            break;
+        keys->keys[i].time = (time_t) (int64_t)
+            tsk_getu64(TSK_LIT_ENDIAN, &buf[0]);
+        keys->keys[i].offset = (TSK_OFF_T)
+            tsk_getu64(TSK_LIT_ENDIAN, &buf[8]);
+        if ((keys->keys[i].offset < 0) || (keys->keys[i].offset >= keys->size)
+            || ((i > 0) && ((keys->keys[i].offset <= keys->keys[i - 1].offset)
+                    || (keys->keys[i].time < keys->keys[i - 1].time))))
+            break;
+    }
+    fclose(hFile);
+    keys->count = i;
+
+    if (i != count) {
+        tsk_fs_wfskeys_free(keys);
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr("tsk_fs_wfskeys_load: invalid key %" PRIuSIZE
+            " in %" PRIttocTSK, i, a_path);
+        return NULL;
+    }
+    return keys;
+}
+
+/**
+ * \internal
+ * Find the key to start playing a video at a given time: the last
+ * keyframe recorded at or before a_time (or the first one).
+ * @returns NULL if the index has no keys
+ */
+const TSK_FS_WFSKEY *
+tsk_fs_wfskeys_find(const TSK_FS_WFSKEYS * a_keys, time_t a_time)
+{
+    size_t lo = 0, hi;
+
+    if ((a_keys == NULL) || (a_keys->count == 0))
+        return NULL;
+
+    // first key with time > a_time
+    hi = a_keys->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a_keys->keys[mid].time <= a_time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return &a_keys->keys[(lo > 0) ? lo - 1 : 0];
+}
+
+/**
+ * \internal
+ * Read a video starting at the keyframe nearest to (at or before) a_time,
+ * with a single call to tsk_fs_file_read.  Further data can be read from
+ * *a_offset plus the returned length.
+ *
+ * @param a_fs_file Video to read
+ * @param a_keys Keyframe index of the video
+ * @param a_time Time to start at
+ * @param a_buf Buffer to read into
+ * @param a_len Size of a_buf
+ * @param a_offset Set to the offset of the keyframe in the video
+ * @returns number of bytes read or -1 on error
+ */
+ssize_t
+tsk_fs_wfskeys_read(TSK_FS_FILE * a_fs_file, const TSK_FS_WFSKEYS * a_keys,
+    time_t a_time, char *a_buf, size_t a_len, TSK_OFF_T * a_offset)
+{
+    const TSK_FS_WFSKEY *key;
+
+    tsk_error_reset();
+    if ((a_fs_file == NULL) || (a_fs_file->meta == NULL) || (a_keys == NULL)) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_wfskeys_read: NULL argument");
+        return -1;
+    }
+    if (a_keys->size != a_fs_file->meta->size) {
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_wfskeys_read: index does not match"
+            " inode %" PRIuINUM " (size %" PRIdOFF " instead of %" PRIdOFF
+            ")", a_fs_file->meta->addr, a_keys->size,
+            a_fs_file->meta->size);
+        return -1;
+    }
+
+    key = tsk_fs_wfskeys_find(a_keys, a_time);
+    *a_offset = (key != NULL) ? key->offset : 0;
+
+    return tsk_fs_file_read(a_fs_file, *a_offset, a_buf, a_len,
+        TSK_FS_FILE_READ_FLAG_NONE);
+}